@@ -15,6 +15,30 @@
 #define INLINE inline
 
 
+/* Compile the inner loops of the builtin net functions for more than
+   one instruction set, with the best version for the running CPU
+   chosen at load time, and let them use GCC's vector extensions.
+   This needs GCC 6 or later on an x86-64 ELF system; elsewhere, or
+   if NL_NO_KERNEL_CLONES is defined, only a plain C version is
+   compiled. */
+
+#if defined(__GNUC__) && !defined(__clang__) && (__GNUC__ >= 6) && \
+    defined(__x86_64__) && defined(__ELF__) && !defined(NL_NO_KERNEL_CLONES)
+#define NL_KERNEL __attribute__((target_clones("avx512f", "avx2", "default")))
+#define NL_KERNEL_VECTORS
+#else
+#define NL_KERNEL
+#endif
+
+
+/* Let nn_map() load the weights of a NN by mapping its file into
+   memory with mmap().  Without this, nn_map() just reads the file. */
+
+#if defined(__unix__) || defined(__APPLE__)
+#define NL_MMAP
+#endif
+
+
 /* Use these defines to work around the namespace pollution in libmp
    and CMU Common Lisp. */
 
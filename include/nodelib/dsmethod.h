@@ -98,6 +98,8 @@ typedef struct DATASET_METHOD {
      Method for accessing an indexed portion of another DATASET.
   \item \bf{dsm_fifo_method:}
      Method for accessing incrementally made fifo sets.
+  \item \bf{dsm_prefetch_method:}
+     Method for reading another DATASET ahead of its use.
   \end{itemize}
  */
 
@@ -173,6 +175,14 @@ DATASET_METHOD dsm_union_method = {
   dsm_union_y
 };
 
+DATASET_METHOD dsm_prefetch_method = {
+  dsm_prefetch_size,
+  dsm_prefetch_x_size,
+  dsm_prefetch_y_size,
+  dsm_prefetch_x,
+  dsm_prefetch_y
+};
+
 #else /* OWNER */
 
 extern DATASET_METHOD dsm_series_method;
@@ -183,6 +193,7 @@ extern DATASET_METHOD dsm_subset_method;
 extern DATASET_METHOD dsm_isubset_method;
 extern DATASET_METHOD dsm_fifo_method;
 extern DATASET_METHOD dsm_union_method;
+extern DATASET_METHOD dsm_prefetch_method;
 
 #endif /* OWNER */
 
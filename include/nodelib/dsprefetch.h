@@ -0,0 +1,144 @@
+/* Copyright (c) 2000 by G. W. Flake.
+ *
+ * NAME
+ *   dsprefetch.h - DATASET_METHOD that reads ahead of its user
+ * SYNOPSIS
+ *   Given an existing DATASET, one can define a new DATASET with
+ *   the same patterns whose accesses are served from memory, while
+ *   a background thread reads the next blocks of patterns from the
+ *   original.  This lets training on a huge \bf{dsm_file}(3) overlap
+ *   the I/O with the arithmetic.
+ * DESCRIPTION
+ *   The patterns of the wrapped DATASET are fetched in blocks of
+ *   \em{block} patterns, and up to \em{depth} blocks are kept in a
+ *   ring of buffers.  Whenever pattern \em{i} is asked for, the
+ *   background thread is told to fill the block that holds \em{i}
+ *   and the \em{depth - 1} blocks after it (wrapping around to the
+ *   start for the next epoch), and the caller only waits if the
+ *   block that it needs is not ready yet.  The patterns are
+ *   converted to doubles by the background thread, so the
+ *   conversions of a \bf{dsm_file}(3) are off of the critical path
+ *   as well.
+ *
+ *   Patterns are read in order, or in the order given by a
+ *   permutation, so walking through the new DATASET from start to
+ *   end is what it is good at.  Random access works, but each jump
+ *   to a block that is not in the ring has to wait for a read.  For
+ *   shuffled training, hand a new permutation to
+ *   \bf{dsm_prefetch_order()} between epochs instead.
+ *
+ *   The wrapped DATASET is only ever touched by one thread at a
+ *   time, so it does not need to be thread safe.  Accesses to the
+ *   new DATASET may come from any thread; as with other DATASETs,
+ *   the returned memory is only good until the next access.  If
+ *   NODElib is compiled without \em{PTHREADS}, then the blocks are
+ *   read by the caller when they are first needed.
+ * AUTHOR
+ *   Gary William Flake (\url{\bf{gary.flake@usa.net}}{mailto:gary.flake@usa.net}).
+ * SEE ALSO
+ *   \bf{dsmethod}(3), \bf{dsfile}(3), \bf{thread}(3), and \bf{dataset}(3).
+ */
+
+#ifndef __DSPREFETCH_H__
+#define __DSPREFETCH_H__
+
+#define NOEXTERN
+#include "nodelib/dataset.h"
+#undef NOEXTERN
+
+#include "nodelib/thread.h"
+#include "nodelib/etc/version.h"
+#include "nodelib/etc/options.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* The default number of patterns in a block and the default number
+   of blocks in the ring. */
+
+#define DSM_PREFETCH_BLOCK 256
+#define DSM_PREFETCH_DEPTH 4
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* One buffer in the ring.  The \em{x} and \em{y} fields hold the
+   patterns of the block \em{block}, which are only there once
+   \em{ready} is set.  The \em{ok} field marks the patterns that the
+   wrapped DATASET could actually produce: bit 0 for x, and bit 1
+   for y. */
+
+typedef struct DSM_PREFETCH_SLOT {
+  double **x, **y;
+  unsigned char *ok;
+  unsigned block;
+  int ready;
+} DSM_PREFETCH_SLOT;
+
+/* A DSM_PREFETCH reads ahead of accesses to \em{dset}.  Asking for
+   the \em{i'th} pattern of the DATASET wrapped by this structure
+   gets the \em{index[i]} pattern of \em{dset}, or simply the
+   \em{i'th} if \em{index} is NULL.  Only \em{len} patterns can be
+   referenced.  You should never manipulate this structure
+   directly. */
+
+typedef struct DSM_PREFETCH {
+  DATASET *dset;
+  unsigned *index;
+  unsigned len, block, depth;
+  /*
+   * Private fields.
+   */
+  DSM_PREFETCH_SLOT *slots;
+  unsigned xsz, ysz, numblocks, want;
+  int busy, stop;
+  THREAD_LOCK *lock;
+  THREAD *thread;
+} DSM_PREFETCH;
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Allocates a new DSM_PREFETCH for \em{dset}, and starts reading the
+   first blocks.  If \em{index} is NULL, then the patterns are read
+   in order and \em{len} may be zero for all of them.  A \em{block}
+   or \em{depth} of zero picks \bf{DSM_PREFETCH_BLOCK} or
+   \bf{DSM_PREFETCH_DEPTH}.  The \em{index} vector is not copied, so
+   it must outlive the DSM_PREFETCH. */
+
+DSM_PREFETCH *dsm_prefetch(DATASET *dset, unsigned *index, unsigned len,
+/*\*/			   unsigned block, unsigned depth);
+
+
+/* Switch to a new permutation of the same length (or back to the
+   natural order if \em{index} is NULL), throwing away anything that
+   was read ahead.  Nobody may be using the DATASET during the call.
+   This is meant to be called between epochs. */
+
+void dsm_prefetch_order(DSM_PREFETCH *prefetch, unsigned *index);
+
+
+/* Stop the background thread and free up any memory that was
+   allocated with the allocation routine.  The original DATASET that
+   is passed to \bf{dsm_prefetch()} is left intact; hence, it is your
+   job to free it up. */
+
+void dsm_destroy_prefetch(DSM_PREFETCH *prefetch);
+
+
+/* Internal functions to retrieve x and y data.  Don't use these
+   functions.  They are only to be used by the DATASET method
+   handlers. */
+
+double *dsm_prefetch_x(void *instance, unsigned index);
+double *dsm_prefetch_y(void *instance, unsigned index);
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+
+#endif /* __DSPREFETCH_H__ */
@@ -15,6 +15,14 @@
  *   and two pointers to doubles where the first and second
  *   derivatives are computed and stored.  The error value is
  *   returned.
+ *
+ *   Each function also has a vector form, an OPT_ERRVEC, which
+ *   handles all of the outputs of a pattern in one call and only
+ *   computes the derivatives that are asked for.  The simple
+ *   functions are computed four outputs at a time when NODElib is
+ *   built with \em{NL_KERNEL_VECTORS}.  The vector form also allows
+ *   error functions that couple the outputs, such as
+ *   \em{opt_errvec_softmax_cross_entropy}, which has no scalar form.
  * AUTHOR
  *   Gary William Flake (\url{\bf{gary.flake@usa.net}}{mailto:gary.flake@usa.net}).
  */
@@ -73,6 +81,80 @@ double opt_err_symmetric_cross_entropy(double output, double target, /*\*/
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
+/* The vector form of an error function.  The \em{error} routine
+   returns the summed error of the \em{n} values in \em{output}
+   against \em{target}.  The first derivatives are stored in
+   \em{derivative} and the diagonal of the second derivatives in
+   \em{second_derivative}, but either one may be NULL if it is not
+   needed, which saves the work.  The \em{hv} routine puts the
+   product of the full matrix of second derivatives with \em{v} in
+   \em{hv}; it is NULL if that matrix is diagonal.  The \em{scalar}
+   field is the scalar form of the function, if it has one, and
+   \em{name} is for display.  If \em{nonneg} is nonzero, then the
+   error is never negative (for the targets that the function is
+   meant for), so a partial sum over some of the patterns is a lower
+   bound on the sum over all of them. */
+
+typedef struct OPT_ERRVEC {
+  char *name;
+  double (*error)(double *output, double *target, unsigned n,
+		  double *derivative, double *second_derivative);
+  void (*hv)(double *output, double *target, unsigned n, double *v,
+	     double *hv);
+  double (*scalar)(double output, double target, double *derivative,
+		   double *second_derivative);
+  int nonneg;
+} OPT_ERRVEC;
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Returns the builtin OPT_ERRVEC whose scalar form is \em{func}, or
+   NULL if there is none. */
+
+OPT_ERRVEC *opt_errvec_find(double (*func)(double output, double target,
+/*\*/					  double *derivative,
+/*\*/					  double *second_derivative));
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* h2man:include The builtin vector error functions are:
+  \begin{itemize}
+  \item \bf{opt_errvec_quadratic:}
+     The vector form of \bf{opt_err_quadratic()}.
+  \item \bf{opt_errvec_logistic:}
+     The vector form of \bf{opt_err_logistic()}.
+  \item \bf{opt_errvec_huber:}
+     The vector form of \bf{opt_err_huber()}.
+  \item \bf{opt_errvec_cross_entropy:}
+     The vector form of \bf{opt_err_cross_entropy()}.
+  \item \bf{opt_errvec_symmetric_cross_entropy:}
+     The vector form of \bf{opt_err_symmetric_cross_entropy()}.
+  \item \bf{opt_errvec_softmax_cross_entropy:}
+     Treats the outputs as unnormalized log probabilities, and
+     computes the cross entropy of their softmax against the
+     targets, \bf{-sum_i t_i log(p_i)} with \bf{p_i = exp(y_i) /
+     sum_j exp(y_j)}.  This is the same as an \bf{exp} layer
+     followed by a \bf{norm} link and a multiclass cross entropy,
+     but the derivative with respect to the outputs is just
+     \bf{p_i * sum_j t_j - t_i}, and it does not overflow for large
+     outputs.  The outputs are coupled, so it has an \em{hv}
+     routine.
+  \end{itemize}
+ */
+
+/* h2man:skipbeg */
+
+extern OPT_ERRVEC opt_errvec_quadratic;
+extern OPT_ERRVEC opt_errvec_logistic;
+extern OPT_ERRVEC opt_errvec_huber;
+extern OPT_ERRVEC opt_errvec_cross_entropy;
+extern OPT_ERRVEC opt_errvec_symmetric_cross_entropy;
+extern OPT_ERRVEC opt_errvec_softmax_cross_entropy;
+
+/* h2man:skipend */
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -41,6 +41,16 @@ extern "C" {
 
 void *allocate_array(size_t dim, size_t elemsz, ...);
 
+/* Like \bf{allocate_array()}, except that the elements are not
+   allocated.  Instead, the returned array indexes into the
+   contiguous block of elements at \em{data}, which must be large
+   enough to hold them all, and which must outlive the result.  Only
+   the table of pointers is freed by \bf{deallocate_array()}.  If
+   \em{dim} is one, then \em{data} itself is returned and must not be
+   passed to \bf{deallocate_array()}. */
+
+void *allocate_array_view(void *data, size_t dim, size_t elemsz, ...);
+
 /* Frees all memory allocated in an \bf{allocate_array()} call.  */
 
 void deallocate_array(void *ptr);
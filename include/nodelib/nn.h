@@ -27,12 +27,16 @@
  *        \item nn_create_rbf()
  *        \item nn_create_smlp()
  *        \item nn_link()
+ *        \item nn_set_sparse()
+ *        \item nn_set_sparse_mask()
  *        \item nn_set_actfunc()
  *        \item nn_init()
  *        \item nn_train()
+ *        \item nn_train_jobs()
  *        \item nn_write()
  *        \item nn_write_binary()
  *        \item nn_read()
+ *        \item nn_map()
  *        \item nn_destroy()
  *        \item nn_shutdown()
  *      \end{itemize}
@@ -42,16 +46,34 @@
  *        \item nn_Hv()
  *        \item nn_hessian()
  *        \item nn_offline_hessian()
+ *        \item nn_offline_gauss_newton()
+ *        \item nn_offline_Hv()
  *        \item nn_jacobian()
+ *        \item nn_offline_jacobian()
+ *        \item nn_free_R()
+ *        \item nn_replicate()
+ *        \item nn_clone()
+ *        \item nn_set_actfunc_fast()
+ *        \item nn_freeze()
  *      \end{itemize}
  *   \item \bf{Developer Functions:}
  *      \begin{itemize}
  *        \item nn_forward()
  *        \item nn_backward()
+ *        \item nn_forward_batch()
+ *        \item nn_backward_batch()
+ *        \item nn_compile()
+ *        \item nn_set_single()
  *        \item nn_offline_test()
+ *        \item nn_offline_test_bounded()
+ *        \item nn_offline_test_multi()
  *        \item nn_offline_grad()
+ *        \item nn_offline_grad_bounded()
+ *        \item nn_minibatch_grad()
  *        \item nn_register_actfunc()
+ *        \item nn_register_actfunc_vec()
  *        \item nn_register_netfunc()
+ *        \item nn_register_netfunc_batch()
  *      \end{itemize}
  *   \end{itemize}
  *
@@ -112,6 +134,7 @@
 #include "nodelib/array.h"
 #include "nodelib/dataset.h"
 #include "nodelib/optimize.h"
+#include "nodelib/errfunc.h"
 #include "nodelib/etc/version.h"
 #include "nodelib/etc/options.h"
 
@@ -124,6 +147,10 @@ extern "C" {
 #define NN_MAJOR_VER 0
 #define NN_MINOR_VER 0
 
+#define NN_IMAGE_VER 1
+
+#define NN_WSPARSE   (1 << 7)
+
 #define NN_WUSER     (1 << 6)
 
 #define NN_WMATRIX   (1 << 5)
@@ -170,6 +197,15 @@ struct NN;
    range of \em{u[numout][numin]} and  \em{v[numout][numin]}, while the
    scalars are only index by \em{numout}.
 
+   A sparse link (one whose net function asked for \em{NN_WSPARSE})
+   only keeps the \em{u} weights of its live connections, in
+   compressed sparse row form.  Output \em{i} is connected to the
+   inputs \em{index[start[i]]} through \em{index[start[i + 1] - 1]},
+   and \em{u[i][k]} is the weight of the \em{k}'th of these.  The
+   rows of \em{u} are consecutive, so \em{u[0]} holds all
+   \em{start[numout]} of the weights.  Both \em{start} and
+   \em{index} are NULL for all other links.
+
    The only field in this structure that you will ever usually modify
    is the \em{lock} field. */
 
@@ -196,6 +232,10 @@ typedef struct NN_LINK {
    */
   double ***RA,  **Ru,  **Rv,  **Rw,  *Ra,  *Rb;
   double ***RdA, **Rdu, **Rdv, **Rdw, *Rda, *Rdb;
+  /*
+   * The connectivity of a sparse link, or NULL.
+   */
+  unsigned *start, *index;
   /*
    * Linked lists for the source and the destination
    * layers.
@@ -218,6 +258,17 @@ typedef struct NN_LINK {
    * net functions always honor this flag.
    */
   unsigned need_grads : 1;
+  /*
+   * Set if the weights (but not the derivatives) belong
+   * to another NN, as in a replica made by nn_replicate().
+   */
+  unsigned shared : 1;
+  /*
+   * Set if the weights and derivatives are views into
+   * the contiguous buffers made by nn_pack(), or if the
+   * weights are views into the file mapped by nn_map().
+   */
+  unsigned packed : 1;
 } NN_LINK;
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
@@ -237,7 +288,16 @@ typedef struct NN_LINKLIST {
    should point to the functions that compute the activation function
    and the activation function's derivative.  The activation output
    is supplied to the derivative function so that mathematical shortcuts
-   can be exploited in computing the derivatives. */   
+   can be exploited in computing the derivatives.
+
+   The \em{func_vec} and \em{deriv_vec} function pointers are optional
+   versions of \em{func} and \em{deriv} that work on a whole slab of
+   \em{n} nodes in one call.  The first computes y[k] = func(x[k]),
+   and the second computes dx[k] = dy[k] * deriv(x[k], y[k]), and both
+   must give exactly the same answers as the scalar functions.  The
+   \em{fast_vec} function is like \em{func_vec}, but it may trade some
+   accuracy for speed; it is only used for slabs that ask for it with
+   \bf{nn_set_actfunc_fast()}.  See \bf{nn_register_actfunc_vec()}. */
 
 typedef struct NN_ACTFUNC {
   char *name;
@@ -245,6 +305,10 @@ typedef struct NN_ACTFUNC {
   double (*deriv)(double input, double output);
   double (*second_deriv)(double input, double output,
 			 double deriv);
+  void (*func_vec)(double *x, double *y, unsigned n);
+  void (*deriv_vec)(double *x, double *y, double *dy, double *dx,
+		    unsigned n);
+  void (*fast_vec)(double *x, double *y, unsigned n);
 } NN_ACTFUNC;
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
@@ -270,7 +334,14 @@ typedef struct NN_ACTFUNC {
    an error in the compatibility of the source and destination NN_LAYERS)
    or a positive integer which indicates the required weight terms to
    be allocated.  See the documentation for \bf{nn_register_netfunc()}
-   for more details and an example. */
+   for more details and an example.
+
+   The \em{forward_batch} and \em{backward_batch} function pointers
+   are like \em{forward} and \em{backward} but they operate on the
+   batch buffers of the NN_LAYER structures for all \em{nn->batchsz}
+   patterns of a batch.  The batch version of the backward pass must
+   set the weight derivatives to the sum over all patterns of the
+   batch.  See \bf{nn_register_netfunc_batch()} for more details. */
 
 typedef struct NN_NETFUNC {
   char *name;
@@ -287,6 +358,16 @@ typedef struct NN_NETFUNC {
                  struct NN_LAYERLIST *destination,
                  unsigned *numin, unsigned *numout,
                  unsigned *numaux);
+  /*
+   * Optional versions of the forward and backward passes
+   * that work on a whole batch of patterns at once.  These
+   * may be NULL, in which case the single pattern versions
+   * are used for each pattern in the batch.
+   */
+  void (*forward_batch)(struct NN *nn, struct NN_LINK *link,
+			struct NN_LAYER *dst);
+  void (*backward_batch)(struct NN *nn, struct NN_LINK *link,
+			 struct NN_LAYER *src);
 } NN_NETFUNC;
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
@@ -317,6 +398,13 @@ typedef struct NN_LAYER {
    * Rv{.} technique.
    */
   double *Rx, *Ry, *Rdx, *Rdy;
+  /*
+   * The same quantities as x, y, dx, and dy, but for all of
+   * the patterns in a batch.  These are stored node major,
+   * so the value for node i of pattern k in a batch of n
+   * patterns is located at Bx[i * n + k].
+   */
+  double *Bx, *By, *Bdx, *Bdy;
   /*
    * Lists of NN_LINKS.  The out field contains the links
    * leading away from this layer while the in field contains
@@ -337,6 +425,11 @@ typedef struct NN_LAYER {
    * gradient calculated?
    */
   unsigned need_grads : 1;
+  /*
+   * Should the fast version of the activation function be
+   * used?  See nn_set_actfunc_fast().
+   */
+  unsigned fastact : 1;
 } NN_LAYER;
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
@@ -351,6 +444,13 @@ typedef struct NN_LAYERLIST {
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
+/* A NN_PLAN is the flattened form of a NN that is built by
+   \bf{nn_compile()}.  Its contents are private. */
+
+typedef struct NN_PLAN NN_PLAN;
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
 /* The NN_TRAININFO structure is the only component of the NN
    structure that typical users will have to modify.  Most of the
    fields should be self explanatory.  The \em{error_function}
@@ -360,6 +460,17 @@ typedef struct NN_LAYERLIST {
    manual pages for more information on error functions and
    optimization algorithms.
 
+   If \em{error_vector} is not NULL, then it is used instead of
+   \em{error_function}, and all of the outputs of a pattern are
+   handed to it at once.  If it is NULL (the default), then the
+   builtin error functions are still computed in their vector forms,
+   and any other \em{error_function} is called once per output.
+   Error functions whose outputs are coupled, such as
+   \em{opt_errvec_softmax_cross_entropy}, are exact in
+   \bf{nn_Hv()} and \bf{nn_hessian()}, but only the diagonal of
+   their second derivatives is used by
+   \bf{nn_offline_gauss_newton()}.
+
    The \em{online_hook} is called at the end of each step of an
    online optimization procedure, so this is only currently useful in
    the backprop routine.
@@ -373,17 +484,24 @@ typedef struct NN_LAYERLIST {
    that will be used.  The \em{subsampseed} field is the random
    seed that is used for all calls to the two offline procedures.
    At the end of \bf{nn_offline_grad()} its value is incremented
-   by one. */
+   by one.
+
+   During \bf{nn_train()}, \em{test_error} holds the error on
+   \em{test_set} at the last cross validation check, and \em{job} is
+   for the internal use of \bf{nn_train_jobs()}. */
 
 typedef struct NN_TRAININFO {
   DATASET *train_set, *test_set;
   double (*error_function)(double output, double target,
                            double *derivative,
                            double *second_derivative);
+  OPT_ERRVEC *error_vector;
   double subsample;
   double error, rmse, ol_error, ol_mse;
   double stc_eta_0, stc_tau;
   OPTIMIZER opt;
+  double test_error;
+  void *job;
 } NN_TRAININFO;
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
@@ -435,9 +553,18 @@ typedef struct NN {
   /*
    * Auxillary variables for computing the Hessian times
    * an arbitrary vector, using Barak Pearlmutter's
-   * Rv{.} technique.
+   * Rv{.} technique.  These are NULL until the first
+   * call to one of the R routines (see nn_free_R()).
    */
   double *Rweights, *Rgrads, *Rx, *Ry, *Rdx, *Rdy;
+  /*
+   * The size of the current batch, the number of patterns
+   * that the batch buffers can hold, the batch versions of
+   * the x, y, dx, and dy fields, and some scratch space
+   * with room for one value per pattern of a batch.
+   */
+  unsigned batchsz, batchcap;
+  double *Bx, *By, *Bdx, *Bdy, *Btmp;
   /*
    * An array of NN_LAYERS.
    */
@@ -453,7 +580,44 @@ typedef struct NN {
   NN_TRAININFO info;
 
   double **grads, **weights;
+  /*
+   * If this NN has been packed with nn_pack(), then wvec
+   * and gvec are contiguous vectors such that wvec[i] is
+   * *weights[i] and gvec[i] is *grads[i].  Both live in
+   * the single buffer, wbuf.  Otherwise, all are NULL.
+   */
+  double *wvec, *gvec;
+  void *wbuf;
+  /*
+   * If this NN was loaded by nn_map(), then the file is
+   * mapped at map, which is mapsz bytes long, and the
+   * weights of the links are views into it.
+   */
+  void *map;
+  size_t mapsz;
+  /*
+   * Replicas of this NN that share its weights, which are
+   * used by the threaded offline routines.
+   */
+  struct NN **replicas;
+  unsigned numreplicas;
+  /*
+   * The plan used by nn_forward() and nn_backward() if this
+   * NN has been compiled with nn_compile().
+   */
+  NN_PLAN *plan;
   unsigned need_all_grads : 1;
+  unsigned compiled : 1;
+  unsigned packed : 1;
+  /*
+   * Set by nn_set_single() if the compiled plan should
+   * work in single precision.
+   */
+  unsigned single : 1;
+  /*
+   * Set by nn_freeze() once the derivatives are gone.
+   */
+  unsigned frozen : 1;
 } NN;
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
@@ -562,6 +726,13 @@ NN *nn_create(char *format, ...);
                \em{a,} forming pair-wise connections from the source and
                the sink nodes.  When used as a self-connection, this forms
                the basis of simple memory.
+
+   \item \bf{x} - A sparse linear net input function which expects a
+               single source and sink.  This computes the same thing
+               as \bf{l}, but only over the connections that are given
+               to nn_set_sparse() or nn_set_sparse_mask(), so time and
+               memory grow with the number of live connections.  A new
+               link starts out fully connected.
    \end{itemize}
 
    The \bf{nn_link()} function returns a pointer the the newly created
@@ -571,6 +742,25 @@ NN *nn_create(char *format, ...);
 
 NN_LINK *nn_link(NN *nn, char *format, ...);
 
+/* Sets the connectivity of the sparse link (numbered \em{linknum}) of
+   \em{nn}.  Output \em{i} of the link is connected to the inputs
+   \em{index[start[i]]} through \em{index[start[i + 1] - 1]}, which
+   must be in increasing order, with \em{start[0]} equal to zero.  The
+   weights of connections that were already there are kept, and new
+   connections get zero weights.  The net must not be frozen, and the
+   link must not have weights shared with another NN.  Zero is returned
+   on success.
+
+   \bf{nn_set_sparse_mask()} does the same thing, but takes the
+   connectivity as a \em{numout} by \em{numin} matrix, stored by rows,
+   where a non-zero entry means that the output is connected to the
+   input. */
+
+int nn_set_sparse(NN *nn, unsigned linknum, unsigned *start, /*\*/
+                  unsigned *index);
+
+int nn_set_sparse_mask(NN *nn, unsigned linknum, int *mask);
+
 /* This function is used to change the activation function of a
    sublayer.  The two unsigned arguments denote the layer number and
    sublayer number, where 0 is the first of for each.  The last argument
@@ -599,6 +789,28 @@ NN_ACTFUNC *nn_set_actfunc(NN *nn, unsigned layer, /*\*/
                            unsigned slab, char *name);
 
 
+/* Selects between the exact (\em{fast} is zero) and fast (\em{fast}
+   is non-zero) versions of the activation function of a sublayer.
+   Exact is the default.  The fast versions of the builtin functions
+   use vectorized polynomial and rational approximations in place of
+   calls to the math library, and have these maximum errors:
+   \begin{itemize}
+     \item \bf{tanh}: absolute error below 1e-15.
+     \item \bf{logistic}, \bf{sigmoid}: absolute error below 5e-16.
+     \item \bf{gauss}, \bf{gaussian}: absolute error below 5e-16.
+     \item \bf{exp}, \bf{exp(-x)}: relative error below 1e-15.
+       Arguments are clamped to [-708, 709], so the answer is always
+       finite and non-zero.
+   \end{itemize}
+   The derivatives are computed from the (approximate) outputs in
+   the usual way.  Activation functions that have no fast version
+   (or all of them, on platforms where the library was built without
+   vector support) always use the exact version.  Zero is returned on
+   success, non-zero if the sublayer does not exist. */
+
+int nn_set_actfunc_fast(NN *nn, unsigned layer, unsigned slab, int fast);
+
+
 /* This function will initialize the weights of the supplied NN to
    uniform random value between the -abs(\em{wmax}) and abs(\em{wmax}). */
 
@@ -624,6 +836,8 @@ void nn_init(NN *nn, double wmax);
    \begin{itemize}
      \item \it{nn->info.opt.rate }
      \item \it{nn->info.opt.momentum}
+     \item \it{nn->info.opt.batch}
+     \item \it{nn->info.opt.nesterov}
    \end{itemize}
 
    After calling \bf{nn_train()} you can examine the following
@@ -645,8 +859,20 @@ void nn_init(NN *nn, double wmax);
      \item \it{nn->info.opt.hook}
      \item \it{nn->info.opt.hook_freq}
      \item \it{nn->info.opt.stepf}
+     \item \it{nn->info.opt.cache}
    \end{itemize}   
 
+   The \em{gradf} that \bf{nn_train()} passes to the optimizer gets
+   the error and the gradient from a single pass of
+   \bf{nn_offline_grad()}, so with \em{nn->info.opt.cache} set (the
+   default), a line search that needs both at the same point only
+   reads the training set once.  Turn the cache off if a hook changes
+   the training set or the error function during training.  The
+   \em{boundf} and \em{gradbf} it passes are
+   \bf{nn_offline_test_bounded()} and \bf{nn_offline_grad_bounded()},
+   or NULL if the error function can go negative, since then no pass
+   could stop early.
+
    Keep in mind that the hook function is passed a (void *)
    data type, which means that you must include the appropriate
    casts in your hook functions.  Also note that it is useless
@@ -660,18 +886,72 @@ void nn_init(NN *nn, double wmax);
      \item \it{nn->info.opt.funcf}
      \item \it{nn->info.opt.gradf}
      \item \it{nn->info.opt.haltf}
+     \item \it{nn->info.opt.batchf}
+     \item \it{nn->info.opt.hessf}
+     \item \it{nn->info.opt.hvf}
+     \item \it{nn->info.opt.boundf}
+     \item \it{nn->info.opt.gradbf}
+     \item \it{nn->info.opt.multif}
+     \item \it{nn->info.opt.numpats}
      \item \it{nn->info.opt.obj}
    \end{itemize}        
 
    with \em{obj} being set to the value of \em{nn}, and
    \em{haltf} being set to a function that does cross
-   validation with \em{nn->info.test_pats}.
+   validation with \em{nn->info.test_set}, stopping as soon as
+   the error on it goes up.
 
    */
 
 int nn_train(NN *nn);
 
 
+/* One run for \bf{nn_train_jobs()}.  The caller fills in \em{nn},
+   which must be ready for \bf{nn_train()}, and if \em{wmax} is
+   greater than zero, then the weights are set with
+   \bf{nn_init(nn, wmax)} right after \bf{srandom(seed)}.  The rest
+   is filled in by the run: what \bf{nn_train()} returned, whether
+   the run was cancelled for falling behind, the number of epochs,
+   and the final values of \em{nn->info.opt.error} and
+   \em{nn->info.test_error} (zero if there is no test set). */
+
+typedef struct NN_JOB {
+  NN *nn;
+  unsigned seed;
+  double wmax;
+  int result, cancelled;
+  unsigned epochs;
+  double error, test_error;
+} NN_JOB;
+
+
+/* Trains the \em{n} NNs in \em{jobs} at the same time, one per
+   thread of the worker pool, which is the way to try many seeds,
+   weight decays, or sizes of hidden layer for model selection.  All
+   of the weights are initialized up front, in order, so a run's
+   starting point depends on its \em{seed} and not on how the runs
+   are scheduled.  Each NN may use its own architecture and
+   settings, and any number of them may share a training or test
+   DATASET without copying it, as long as the DATASET can be read
+   from several threads at once, which is true of the matrix
+   DATASETs in \bf{dsmatrix}(3).  While runs share the pool, the
+   offline routines within a run are not threaded.  The random number
+   generator is shared, so runs that draw random numbers while they
+   train (because of \em{subsample} or a stochastic engine) are not
+   reproducible from one call to the next.
+
+   If \em{cull} is greater than zero, then a run is stopped early (and
+   marked as cancelled) when its error at some epoch is more than
+   (1 + \em{cull}) times the best error that any run has had at the
+   same epoch, but never before \em{nn->info.opt.min_epochs}.  The
+   error compared is the test error if the NN has a test set, and
+   the training error otherwise.  See \em{nn_jobs_threads} and
+   \em{nn_jobs_pin} below.  Zero is returned if every run could be
+   trained, and nonzero otherwise. */
+
+int nn_train_jobs(NN_JOB *jobs, unsigned n, double cull);
+
+
 /* If the supplied NN has a linear output layer that also has a linear
    link (numbered \em{linknum}) coming into it from somewhere and if
    the supplied DATASET and NN have compatible I/O dimensions, then
@@ -680,8 +960,9 @@ int nn_train(NN *nn);
    decomposition to compute the pseudo-inverse for the least squares
    solution.  Note that if you are using any error function other than
    the quadratic, then the LMS solution will only be an approximation
-   to what you really want.  Zero is returned on success, non-zero
-   otherwise. */
+   to what you really want.  The link may also be sparse (\bf{x}), in
+   which case each output is solved over its live connections only.
+   Zero is returned on success, non-zero otherwise. */
 
 int nn_solve(NN *nn, DATASET *set, unsigned linknum);
 
@@ -729,6 +1010,27 @@ NN *nn_create_smlp(unsigned nbasis, double var, DATASET *set);
 void nn_destroy(NN *nn);
 
 
+/* Returns a new NN with the same architecture, activation functions
+   and locked links as \em{nn}, but which uses the very same weight
+   arrays as \em{nn}.  The replica has its own node values and its own
+   derivatives, so a forward and backward pass can be performed on the
+   replica while another is performed on \em{nn}.  Changing a weight
+   in one changes it in the other.  The replica must be destroyed
+   (with \bf{nn_destroy()}) before \em{nn} is. */
+
+NN *nn_replicate(NN *nn);
+
+
+/* Like \bf{nn_replicate()}, but the weights of the links that are not
+   locked belong to the copy, and start out equal to those of \em{nn}.
+   The weights of locked links are still shared, so the copy must
+   still be destroyed before \em{nn} is.  Since \em{nn->weights} and
+   the copy's \em{weights} list the same weights in the same order,
+   one NN can be evaluated at many points at once. */
+
+NN *nn_clone(NN *nn);
+
+
 /* Ths function will write a ASCII readable descriptor file of the
    supplied NN that can be read back in at a later time.  The
    file format is verbose with comments, but you probably don't
@@ -746,21 +1048,53 @@ int nn_write(NN *nn, const char *fname);
 int nn_write_verbose(NN *nn, const char *fname);
 
 
-/* This function is similar to \bf{nn_write()} with the difference
-   that no comments are written, anf that weight values will be
-   written in binary.  A nonzero value is returned if an error
-   occured, while zero is returned if there were no errrors. */
+/* This function writes a binary image of \em{nn} that holds the
+   same information as \bf{nn_write()}.  The image starts with a 64
+   byte header: a text line with the usual magic number (of type
+   \bf{i}) padded with NULs, followed by 32 bit words for a byte order
+   mark, the image version (\bf{NN_IMAGE_VER}), the offset and size of
+   the topology section, the offset and size of the weights (in 64
+   byte blocks), the number of links, and a Fletcher checksum of
+   everything after the header.  The topology section holds the
+   architecture descriptor, the activation functions, and, for each
+   link, its format, its sparse connections, whether it is trained,
+   and where its weights are.  The weights of each link follow in a
+   section of their own that starts on a 64 byte boundary, in the same
+   order as in \em{nn->weights}.  The image can only be read on a
+   machine with the same byte order and the same doubles.  A nonzero
+   value is returned if an error occured, while zero is returned if
+   there were no errrors. */
 
 int nn_write_binary(NN *nn, char *fname);
 
 
 /* This function will read the contents of any file that was create
    with either \bf{nn_write()} or \bf{nn_write_binary()}, and return
-   the NN described by the file.  NULL is returned on error. */
+   the NN described by the file.  Files written in the older binary
+   format, with the weights at the end, can still be read.  NULL is
+   returned on error. */
 
 NN *nn_read(const char *fname);
 
 
+/* Loads the image written by \bf{nn_write_binary()} to \em{fname}
+   for inference, without copying the weights.  The file is mapped
+   into memory, and the weights of the links become views into the
+   mapping, so several processes that load the same file share a
+   single copy of the weights in the page cache.  The mapping is
+   private, so changing a weight only changes the copy of the page in
+   this process.  The returned NN is frozen as if by
+   \bf{nn_freeze()}, and the file is unmapped by \bf{nn_destroy()}.
+   The file must not be truncated or rewritten in place while the NN
+   is alive, so write a new file and rename it over the old one
+   instead.  Files that are not images are simply read.  If NODElib
+   was compiled without \bf{NL_MMAP}, then this is the same as
+   \bf{nn_read()} followed by \bf{nn_freeze()}.  NULL is returned on
+   error. */
+
+NN *nn_map(const char *fname);
+
+
 /* This function will eliminate internal hash tables used by the
    package, and free up other miscellaneous items as well.  It is
    not strictly necessary to call this function perform terminating
@@ -787,6 +1121,120 @@ void nn_forward(NN *nn, double *input);
 void nn_backward(NN *nn, double *error_gradient);
 
 
+/* Computes the forward passes of the \em{n} patterns with inputs
+   \em{input[0]} through \em{input[n - 1]} as a single batch.  The
+   outputs of the network are placed in \em{nn->By}, such that
+   \em{nn->By[i * n + k]} is the \em{i}th output for the \em{k}th
+   pattern.  The results are identical to calling \bf{nn_forward()}
+   on each pattern in turn, but the net input functions can
+   stream through each weight once per batch instead of once per
+   pattern.  Networks with recurrent links are computed one pattern
+   at a time so that they retain their memory from pattern to
+   pattern. */
+
+void nn_forward_batch(NN *nn, double **input, unsigned n);
+
+
+/* Computes the backward passes for the batch of patterns that was
+   last passed to \bf{nn_forward_batch()}.  The \em{k}th row of
+   \em{error_gradient} has the gradient of the error with respect to
+   the network's outputs for the \em{k}th pattern.  Upon return, the
+   weight derivatives hold the sum of the derivatives over the whole
+   batch, and \em{nn->Bdx} holds the derivatives with respect to the
+   inputs for each pattern. */
+
+void nn_backward_batch(NN *nn, double **error_gradient);
+
+
+/* Flattens the layers and links of \em{nn} into a fixed sequence of
+   steps that \bf{nn_forward()} and \bf{nn_backward()} will follow
+   from now on, instead of walking the lists of links for every
+   pattern.  A linear link that is the only one feeding a slab is
+   fused with the slab's activation function into a single loop (and
+   likewise for the backward pass), and only those buffers that are
+   accumulated into are cleared.  The results are the same as those
+   of the uncompiled passes (unless \bf{nn_set_single()} is used).
+
+   The plan is rebuilt automatically whenever a link is added,
+   locked, or unlocked.  Zero is returned on success. */
+
+int nn_compile(NN *nn);
+
+
+/* Makes \bf{nn_forward()} and \bf{nn_backward()} go back to walking
+   the links of \em{nn} directly. */
+
+void nn_uncompile(NN *nn);
+
+
+/* Makes the compiled passes of \em{nn} use single precision (if
+   \em{single} is non-zero) or double precision (the default) for the
+   fused linear links, which are the bulk of the work in a typical
+   MLP, and compiles \em{nn} if it was not already.  In single
+   precision, the plan keeps float copies of the weights of those
+   links and of the outputs and derivatives of every layer, which
+   halves the memory traffic and doubles the width of the vector
+   kernels.  The products and partial sums are floats, but each dot
+   product is finished in double, and everything outside of the fused
+   links (including the net inputs, the activation functions, and the
+   weight derivatives) stays in double.  The results differ from
+   those in double precision by roughly the rounding error of a
+   float.
+
+   The float copies of the weights are made when the plan is built,
+   by \bf{nn_set_weights()} and \bf{nn_init()}, and at the start of
+   \bf{nn_offline_test()} and \bf{nn_offline_grad()}, so training with
+   \bf{nn_train()} and the usual offline optimizers needs no extra
+   care.  If the weights are changed in any other way, call
+   \bf{nn_compile()} again before the next pass.  The batch passes always use double precision.  Zero is
+   returned on success. */
+
+int nn_set_single(NN *nn, int single);
+
+
+/* Moves all of the weights of \em{nn} into one contiguous, aligned
+   buffer, and all of the weight derivatives into another, so that
+   \em{nn->wvec[i]} and \em{nn->gvec[i]} are the same doubles as
+   \em{*nn->weights[i]} and \em{*nn->grads[i]}.  The weights of
+   locked links follow those that are trained.  The matrices and
+   vectors of every link become views into these buffers, so
+   existing code that indexes them is unaffected.  When \em{nn} is
+   trained with \bf{nn_train()}, the optimizer works directly on
+   the contiguous vectors instead of through the pointers.
+
+   The buffers are rebuilt whenever a link is added, locked, or
+   unlocked.  Zero is returned on success. */
+
+int nn_pack(NN *nn);
+
+
+/* Turns \em{nn} into an inference-only network by releasing
+   everything that only the backward passes use: the weight
+   derivatives, the \em{R} variables used by \bf{nn_Hv()}, the
+   derivative fields of every layer (\em{dx}, \em{dy}, \em{Rx},
+   \em{Ry}, \em{Rdx}, and \em{Rdy}, which all become NULL), the
+   \em{grads} table, and the buffers of the last batch.  What is
+   left is the weights and the forward buffers, which is roughly a
+   quarter of the memory held by the links and by the layers.  A
+   packed NN gets a new buffer with room for the weights alone, so
+   \em{nn->gvec} becomes NULL.
+
+   A frozen NN still works with \bf{nn_forward()},
+   \bf{nn_forward_batch()}, \bf{nn_compile()},
+   \bf{nn_set_single()}, \bf{nn_offline_test()}, and
+   \bf{nn_write()}, and its weights may still be changed through
+   \em{nn->weights}.  Everything that needs derivatives
+   (\bf{nn_backward()}, \bf{nn_offline_grad()}, \bf{nn_train()},
+   \bf{nn_Hv()}, \bf{nn_hessian()}, \bf{nn_jacobian()}, and
+   friends) logs an error and does nothing, as does anything that
+   changes the links.  There is no way to thaw a NN; read it again
+   with \bf{nn_read()} instead.  To serve a saved model, call
+   \bf{nn_freeze()} right after \bf{nn_read()}.  Zero is
+   returned on success. */
+
+int nn_freeze(NN *nn);
+
+
 /* Performs a feedforward pass on every pattern in \em{set}.  The
    \em{hook} function is called for every individual feedforward pass,
    which allows you to perform a function on every single pattern
@@ -795,12 +1243,73 @@ void nn_backward(NN *nn, double *error_gradient);
 double nn_offline_test(NN *nn, DATASET *set, int (*hook)(NN *nn));
 
 
+/* Like \bf{nn_offline_test()} with no hook, but the pass may stop
+   as soon as the summed error shows that the result will be more
+   than \em{bound}.  In that case, the mean error of the patterns seen
+   so far is returned, which is also more than \em{bound}.  Otherwise,
+   the result is the same as \bf{nn_offline_test()}.  Stopping early is
+   only done when the error function of \em{nn} is a builtin one that
+   never goes negative (see \bf{opt_errvec_find()}); with any other
+   error function, every pattern is visited.  This is the \em{boundf}
+   that \bf{nn_train()} passes to the optimizer, so line searches can
+   drop trial points that are no better than what they already have.
+   See \em{nn_offline_bound_random} below. */
+
+double nn_offline_test_bounded(NN *nn, DATASET *set, double bound);
+
+
+/* Computes what \bf{nn_offline_test()} with no hook would return if
+   the weights of \em{nn} were \em{w[i]}, for each of the \em{n}
+   weight vectors, and puts the results in \em{err[i]}.  Each vector
+   is laid out like \em{nn->weights}.  The vectors are evaluated at
+   the same time on clones of \em{nn} (see \bf{nn_clone()}), one per
+   thread, and each clone makes its own pass over \em{set}, in
+   order, so the results do not depend on the number of threads.
+   If \em{nn->info.subsample} is set, every vector sees the same
+   sample.  The weights of \em{nn} are left alone.  This is the
+   \em{multif} that \bf{nn_train()} passes to the optimizer, for
+   \bf{opt_lnsrch_parallel()}.  See \em{nn_offline_multi_threads}
+   below.  Zero is returned on success. */
+
+int nn_offline_test_multi(NN *nn, DATASET *set, double **w, unsigned n, /*\*/
+			  double *err);
+
+
 /* Like \bf{nn_offline_test()}, but also does the backward passes
-   as well.  The accumulated gradient is saved. */
+   as well.  The accumulated gradient is saved.
+
+   If no \em{hook} is passed, then both offline routines can split
+   the patterns over several threads, each of which uses its own
+   replica of \em{nn} (see \bf{nn_replicate()}).  The partial sums
+   from the threads are combined at the end.  See the global variables
+   \em{nn_offline_threads}, \em{nn_offline_chunk}, and
+   \em{nn_offline_deterministic} below. */
 
 double nn_offline_grad(NN *nn, DATASET *set, int (*hook)(NN *nn));
 
 
+/* Like \bf{nn_offline_grad()} with no hook, but the pass may stop as
+   soon as the summed error shows that the result will be more than
+   \em{bound}, just as in \bf{nn_offline_test_bounded()}.  In that
+   case, the gradient is only over the patterns seen so far and should
+   not be used.  This is the \em{gradbf} that \bf{nn_train()} passes
+   to the optimizer, so a line search can get the error and gradient
+   at a good trial point in one pass, and still give up early on a
+   bad one. */
+
+double nn_offline_grad_bounded(NN *nn, DATASET *set, double bound);
+
+
+/* Like \bf{nn_offline_grad()} with no hook, but only for the \em{n}
+   patterns of \em{set} numbered \em{index[0]} through
+   \em{index[n - 1]}, which is what a mini-batch engine such as
+   \bf{opt_stochastic_descent()} needs.  Unless
+   \em{nn_offline_batch} says otherwise, the whole mini-batch goes
+   through the network in a single batched pass. */
+
+double nn_minibatch_grad(NN *nn, DATASET *set, unsigned *index, unsigned n);
+
+
 /* This function allows you to add a new activation function to the
    library without recompiling everything.  See the source code
    in the file \bf{nnafunc.c} to see how the functions should be
@@ -815,6 +1324,26 @@ void nn_register_actfunc(char *name, /*\*/
 						double deriv));
 
 
+/* Adds versions of the function and its derivative that work on
+   whole slabs to the already registered activation function,
+   \em{name}, along with an optional fast approximation.  Any of the
+   three may be NULL, in which case the scalar function is called for
+   each node (and the exact version is used in place of a missing fast
+   one).  Registering an activation function again with
+   \bf{nn_register_actfunc()} clears its vector functions.  Zero is
+   returned on success, non-zero if there is no activation function
+   with the given name. */
+
+int nn_register_actfunc_vec(char *name, /*\*/
+			    void (*func_vec)(double *x, double *y, /*\*/
+					     unsigned n), /*\*/
+			    void (*deriv_vec)(double *x, double *y, /*\*/
+					      double *dy, double *dx, /*\*/
+					      unsigned n), /*\*/
+			    void (*fast_vec)(double *x, double *y, /*\*/
+					     unsigned n));
+
+
 /* This function allows you to add a new net-input function to the
    library without recompiling everything.  See the source code
    in the file \bf{nnnfunc.c} to see how the functions should be
@@ -841,6 +1370,23 @@ void nn_register_netfunc(char *name, /*\*/
 				       unsigned int *numaux));
 
 
+/* Adds batch versions of the forward and backward passes to the
+   already registered net-input function, \em{name}.  Either
+   function may be NULL, in which case the single pattern function
+   is called once for each pattern of a batch.  Registering a net
+   function again with \bf{nn_register_netfunc()} clears its batch
+   functions.  Zero is returned on success, non-zero if there is no
+   net function with the given name. */
+
+int nn_register_netfunc_batch(char *name, /*\*/
+			      void (*forward_batch)(struct NN *nn, /*\*/
+						    struct NN_LINK *link, /*\*/
+						    struct NN_LAYER *dst), /*\*/
+			      void (*backward_batch)(struct NN *nn, /*\*/
+						     struct NN_LINK *link, /*\*/
+						     struct NN_LAYER *src));
+
+
 /* Computes the product of the Hessian matrix of second derivatives and
    an arbitrary vector.  The vector that is multiplied to the Hessian
    is located in \em{nn->Rweights} and the result of the product
@@ -850,30 +1396,102 @@ void nn_register_netfunc(char *name, /*\*/
 void nn_Hv(NN *nn, double *input, double *target, double *v);
 
 
-/* This routines uses \bf{nn_Hv()} to extract the columns of the
-   Hessian matrix of second derivates of the neural network's error
-   function with respect to the weights. */
+/* This routines uses the same R passes as \bf{nn_Hv()} to extract the
+   columns of the Hessian matrix of second derivates of the neural
+   network's error function with respect to the weights.  The
+   symmetry of the result is checked if \em{nn_hessian_check} is
+   set. */
 
 int nn_hessian(NN *nn, double *input, double *target, double **H);
 
 
-/* This routines uses \bf{nn_hessian()} to compute the
-   Hessian matrix of second derivates of the neural network's error
-   function with respect to the weights over an entire DATASET. */
+/* This routines computes the Hessian matrix of second derivates of
+   the neural network's error function with respect to the weights,
+   averaged over an entire DATASET.  Each pattern takes a single
+   forward and backward pass, plus one R pass for each weight, and only
+   the upper triangle is summed and then mirrored.  The patterns are
+   split over \em{nn_offline_threads} threads in equal slices, each
+   with its own replica of \em{nn} and its own partial sum, so the
+   result only depends on the number of threads.  If
+   \em{nn_hessian_check} is set, then the Hessian of the first pattern
+   is checked with \bf{nn_hessian()} first. */
 
 int nn_offline_hessian(NN *nn, DATASET *set, double **H);
 
 
+/* This routine computes the Gauss-Newton approximation to the Hessian
+   of the error, J'DJ, averaged over an entire DATASET, where J is the
+   Jacobian of the outputs with respect to the weights and D is a
+   diagonal matrix of the second derivatives of the error with respect
+   to the outputs.  It leaves out the terms of the Hessian that are weighted
+   by the residuals, so it is positive semi-definite for the usual
+   error functions.  Each pattern takes a single forward pass and one
+   backward pass for each output, rather than one R pass for each
+   weight, so this is much cheaper than \bf{nn_offline_hessian()} when
+   there are many more weights than outputs.  It is threaded in the
+   same way. */
+
+int nn_offline_gauss_newton(NN *nn, DATASET *set, double **G);
+
+
+/* Puts the product of \em{v} with the Gauss-Newton matrix (if
+   \em{nn_hv_gauss_newton} is set) or the Hessian of the error in
+   \em{Hv}, averaged over the \em{n} patterns of \em{set} listed in
+   \em{index}, or over all of \em{set} if \em{index} is NULL.  The
+   result is scaled like the gradient of \bf{nn_offline_grad()}, so
+   it is the derivative of that gradient in the direction of
+   \em{v}.  Each pattern takes one forward pass, one R forward pass,
+   and one or two backward passes, and no matrix is ever formed, so
+   the memory used only grows with the number of weights.  It is
+   threaded like \bf{nn_offline_hessian()}.  Zero is returned on
+   success. */
+
+int nn_offline_Hv(NN *nn, DATASET *set, unsigned *index, unsigned n, /*\*/
+		  double *v, double *Hv);
+
+
 /* Evaluates the Jacobian matrix of \em{nn} at \em{input} and places
    the result in \em{J} which is assumed to have as many elements as
    the product of the number of input and outputs of \em{nn}.  The
    value of the entry \em{J[i * NCOL + j]} is set equal to the partial
    derivative of the \em{i}th output with respect to the \em{j}th
-   input. */
+   input.  After a single forward pass, this takes a backward pass for
+   each output or, if there are fewer inputs than outputs, an R
+   forward pass for each input. */
 
 void nn_jacobian(NN *nn, double *input, double *J);
 
 
+/* Evaluates the Jacobian of \em{nn}, as in \bf{nn_jacobian()}, for
+   every pattern in \em{set}.  If \em{J} is not NULL, then the
+   Jacobian of the \em{k}th pattern goes in \em{J[k * NIN * NOUT]}
+   onward, so \em{J} needs room for all of them.  If \em{hook} is not
+   NULL, then it is called with the number of each pattern, its
+   Jacobian, and \em{obj}; the Jacobian may be in a scratch buffer
+   that is reused when \em{J} is NULL.  The patterns are split over
+   \em{nn_offline_threads} threads, and the hook is called by
+   one thread at a time, but not necessarily in the order of the
+   patterns.  When backward passes are used, the patterns are done in
+   batches of \em{nn_offline_batch}, with \bf{nn_forward_batch()} and
+   \bf{nn_backward_batch()}.  The targets of \em{set} are not used.
+   Zero is returned on success. */
+
+int nn_offline_jacobian(NN *nn, DATASET *set, double *J, /*\*/
+			void (*hook)(unsigned pattern, double *J, /*\*/
+				     void *obj), void *obj);
+
+
+/* The \em{R} variables of the links and layers of \em{nn}, which
+   the routines above need for the Hessian, take up as much memory as
+   the weights and the node values themselves.  They are allocated by
+   the first call to \bf{nn_Hv()} or any of the other R routines, and
+   are kept until \em{nn} is destroyed or this function is called.
+   Links that are added later get theirs the next time they are
+   needed. */
+
+void nn_free_R(NN *nn);
+
+
 void nn_Rforward(NN *nn, double *Rinput, double *Rweights);
 
 void nn_Rbackward(NN *nn, double *Rdoutput);
@@ -931,6 +1549,80 @@ double nn_lnsrch_search_then_converge(OPTIMIZER *opt, /*\*/
    error value returned is normalized by the number of valid outputs
    for all patterns.
 
+   \item \bf{unsigned} \em{nn_offline_batch} ;
+   If greater than one, then nn_offline_test() and nn_offline_grad()
+   will group the patterns into batches of this size and use
+   nn_forward_batch() and nn_backward_batch() for each batch.  This
+   is only done when no hook function is passed to the offline
+   routines, since a hook expects to see each individual pattern.
+   nn_offline_jacobian() batches its backward passes in the same way.
+   The computed values only differ from the unbatched values by
+   the order in which the gradients are summed.  Default is 0.
+
+   \item \bf{unsigned} \em{nn_offline_threads} ;
+   The number of threads used by nn_offline_test() and
+   nn_offline_grad() when no hook function is passed, and by
+   nn_offline_hessian(), nn_offline_gauss_newton(), nn_offline_Hv(),
+   and nn_offline_jacobian().  If zero, then one thread per online
+   processor is used.  Networks with recurrent links always get one
+   thread, since their patterns must be seen in order.  Threads are
+   only really used if NODElib was compiled with PTHREADS defined.
+   Default is 1, which disables threading.
+
+   \item \bf{unsigned} \em{nn_offline_chunk} ;
+   When threaded, the patterns are handed out to the threads in
+   chunks of this many patterns.  A chunk is never smaller than
+   \em{nn_offline_batch}.  Default is 64.
+
+   \item \bf{int} \em{nn_offline_deterministic} ;
+   If nonzero, then the partial sums of each chunk are combined in
+   the order of the chunks, so that the returned error and gradient
+   are identical no matter how many threads are used.  Otherwise,
+   each thread keeps its own sum, which is faster but makes the last
+   few bits of the result depend on how the chunks were scheduled.
+   Default is 0.
+
+   \item \bf{int} \em{nn_offline_bound_random} ;
+   If nonzero, then nn_offline_test_bounded() and
+   nn_offline_grad_bounded() visit the patterns in a fresh random
+   order (unless \em{nn->info.subsample} already picks them at
+   random), so that a pass that stops early is not biased by the order
+   of the DATASET.  This costs a call to random() for every
+   pattern and loses the locality of a sequential pass.  Default is 0.
+
+   \item \bf{unsigned} \em{nn_offline_multi_threads} ;
+   The number of threads used by nn_offline_test_multi(), which
+   evaluates one weight vector per thread.  If zero, then one thread
+   per online processor is used.  This is apart from
+   \em{nn_offline_threads}, so that a line search can try several
+   step sizes at once even when each pass is single threaded.
+   Default is 0.
+
+   \item \bf{unsigned} \em{nn_jobs_threads} ;
+   The number of runs that nn_train_jobs() trains at once.  If zero,
+   then one thread per online processor is used.  Default is 0.
+
+   \item \bf{int} \em{nn_jobs_pin} ;
+   If nonzero, then each thread of nn_train_jobs() other than the
+   calling thread is kept on a processor of its own while the jobs
+   run (see \bf{thread_pin()}), which saves the caches from being
+   moved between processors.  This is only done on Linux.  Default
+   is 0.
+
+   \item \bf{int} \em{nn_hessian_check} ;
+   If nonzero, then nn_hessian() checks that the Hessian that it
+   computes is symmetric (to six significant digits), and fails if it
+   is not.  The check costs a call to pow() and log10() for every
+   entry, which is a lot for a big net.  nn_offline_hessian() only
+   checks its first pattern.  Default is 1.
+
+   \item \bf{int} \em{nn_hv_gauss_newton} ;
+   If nonzero, then nn_offline_Hv() (and so the \em{hvf} that
+   nn_train() passes to the optimizer) multiplies by the Gauss-Newton
+   matrix, which is positive semi-definite for the usual error
+   functions and so safe for conjugate gradients.  Otherwise, it
+   multiplies by the true Hessian.  Default is 1.
+
    \item \bf{int}  \em{nn_rbf_centers_random} ;
    If nonzero, then \bf{nn_create_rbf()} will set the centers to a random
    subset of the passed DATASET.  Default is zero.
@@ -984,6 +1676,86 @@ void nn_linklist_free(NN_LINKLIST *list);
 
 int nn_check_valid_layer(NN *nn, unsigned l);
 int nn_check_valid_slab(NN *nn, unsigned l, unsigned s);
+int nn_check_not_frozen(NN *nn, char *who);
+int nn_feedforward(NN *nn);
+void nn_free_derivs(NN *nn);
+void nn_alloc_R(NN *nn);
+double **nn_sparse_array(unsigned numout, unsigned *start, double *data);
+void nn_view_weights(NN *nn, double **data);
+double nn_error(NN *nn, double *y, double *t, unsigned n, double *dedy,
+		double *d2edy2);
+void nn_error_hv(NN *nn, double *y, double *t, double *d2edy2, double *v,
+		 double *hv);
+
+unsigned nn_link_blocks(NN_LINK *link, double **w, double **g,
+			double **Rw, double **Rg, unsigned *sz);
+
+NN **nn_get_replicas(NN *nn, unsigned n);
+void nn_free_replicas(NN *nn);
+
+#define NN_NF_OTHER    0
+#define NN_NF_LINEAR   1
+
+void nn_actfunc_forward(NN_LAYER *slab, double *x, double *y, unsigned n);
+void nn_actfunc_backward(NN_LAYER *slab, double *x, double *y, double *dy,
+			 double *dx, unsigned n);
+int nn_netfunc_kind(NN_NETFUNC *nf);
+
+void nn_kern_matvec(double *x, double **u, double *y, double *a,
+		    unsigned m, unsigned n, int accum);
+void nn_kern_matvec_R(double *Rx, double **u, double **Ru, double *y,
+		      double *Ry, double *Ra, unsigned m, unsigned n);
+void nn_kern_diagvec(double *x, double **u, double **v, double *y,
+		     double *a, unsigned m, unsigned n);
+void nn_kern_quadvec(double *x, double ***A, double **u, double *y,
+		     double *a, unsigned m, unsigned n);
+void nn_kern_vecmat(double *dy, double *dx, double **u, unsigned off,
+		    unsigned m, unsigned n, int accum);
+void nn_kern_vecmat_R(double *Rdy, double *dx, double *Rdx, double **u,
+		      double **Ru, unsigned m, unsigned n);
+void nn_kern_diagvecmat(double *dy, double *dx, double **u, double **v,
+			double *y, unsigned m, unsigned n);
+void nn_kern_quadvecmat(double *dy, double *dx, double ***A, double **u,
+			double *y, unsigned m, unsigned n);
+void nn_kern_outer(double **du, double *dx, double *y, unsigned m,
+		   unsigned n);
+void nn_kern_outer_R(double **Rdu, double *dx, double *Rdx, double *y,
+		     double *Ry, unsigned m, unsigned n);
+void nn_kern_diagouter(double **du, double **dv, double *dx, double *y,
+		       unsigned m, unsigned n);
+void nn_kern_syrk(double **G, double **J, double *d, unsigned k,
+		  unsigned n);
+void nn_kern_matvec_f(double *x, float **u, float *y, double *a,
+		      unsigned m, unsigned n);
+void nn_kern_vecmat_f(double *dy, float *dx, float **u, unsigned off,
+		      unsigned m, unsigned n);
+void nn_kern_fast_tanh(double *x, double *y, unsigned n);
+void nn_kern_fast_logistic(double *x, double *y, unsigned n);
+void nn_kern_fast_gauss(double *x, double *y, unsigned n);
+void nn_kern_fast_exp(double *x, double *y, unsigned n);
+void nn_kern_fast_expnx(double *x, double *y, unsigned n);
+
+void nn_plan_free(NN *nn);
+void nn_plan_sync(NN *nn);
+void nn_plan_forward(NN *nn, double *input);
+void nn_plan_backward(NN *nn, double *de_dy);
+
+#ifndef NN_OFFLINE_OWNER
+extern double nn_offline_bignum_skip;
+extern unsigned nn_offline_batch;
+extern unsigned nn_offline_threads;
+extern unsigned nn_offline_chunk;
+extern int nn_offline_deterministic;
+extern int nn_offline_bound_random;
+extern unsigned nn_offline_multi_threads;
+extern unsigned nn_jobs_threads;
+extern int nn_jobs_pin;
+#endif
+
+#ifndef NN_HESS_OWNER
+extern int nn_hessian_check;
+extern int nn_hv_gauss_newton;
+#endif
 
 #ifndef NN_SOLVE_OWNER
 extern int nn_kmeans_online;
@@ -71,6 +71,11 @@
  *     set how verbose the messages are and where they should go
  *     (i.e., log files, error message window, etc.).
  *   
+ *     \item \url{THREAD}{thread.html} - a minimal worker pool.  This
+ *     module hides the details of POSIX threads from the rest of
+ *     NODElib, and falls back to sequential execution when NODElib
+ *     is compiled without thread support.
+ *   
  *     \item \url{XALLOC}{xalloc.html} - smarter memory allocation.
  *     This module provides memory allocation with automatic error
  *     checking.  It also keeps track of the memory used by each
@@ -183,6 +188,12 @@
  *     With this module, a DATASET can consist of a single matrix or
  *     two matrices.
  *   
+ *     \item \url{DSPREFETCH}{dsprefetch.html} - DATASET_METHOD that
+ *     reads ahead of its user.  Given an existing DATASET, a
+ *     background thread reads the next blocks of patterns into
+ *     memory while the current ones are used, so that training on a
+ *     huge binary file does not have to wait on the disk.
+ *   
  *     \item \url{DSSUBSET}{dssubset.html} - DATASET_METHOD subset
  *     type.  Given an existing DATASET, one can define a new subset
  *     of the first data set.  The actual subset is determined by a
@@ -405,6 +416,7 @@
 #include "nodelib/dsisubset.h"
 #include "nodelib/dsmatrix.h"
 #include "nodelib/dsmethod.h"
+#include "nodelib/dsprefetch.h"
 #include "nodelib/dssubset.h"
 #include "nodelib/dsunion.h"
 #include "nodelib/errfunc.h"
@@ -418,6 +430,7 @@
 #include "nodelib/series.h"
 #include "nodelib/svd.h"
 #include "nodelib/svm.h"
+#include "nodelib/thread.h"
 #include "nodelib/ulog.h"
 #include "nodelib/xalloc.h"
 
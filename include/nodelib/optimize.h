@@ -9,7 +9,8 @@
  *   problems.  This package currently includes multi-dimensional
  *   search algorithms (steepest descent, conjugate gradient,
  *   and quasi-Newton) and line search routines (cubic interpolation,
- *   golden section, and a hybrid of the first two).
+ *   golden section, a hybrid of the first two, and a parallel search
+ *   that tries several step sizes at once).
  * DESCRIPTION
  *   With the suplied optimization routines, you can perform numerical
  *   optimization that's stops under a wide variety of user specified
@@ -145,6 +146,99 @@ typedef struct OPTIMIZER {
    * routines use to hold the progress of the optimization.
    */
   void *internal;
+  /*
+   * Optional contiguous copies of the weights and gradients.
+   * If wvec is non-NULL, then wvec[i] must be the same
+   * double that weights[i] points to (and likewise for
+   * gvec and grads), and the optimization routines will
+   * use these vectors directly instead of going through
+   * the pointers.
+   */
+  double *wvec, *gvec;
+  /*
+   * For mini-batch engines: a function that computes the
+   * error and the gradient over only the n patterns listed
+   * in index, the total number of patterns, the number of
+   * patterns in a mini-batch, and a flag that asks for
+   * Nesterov momentum instead of the classical kind.
+   */
+  double (*batchf)(void *obj, unsigned *index, unsigned n);
+  unsigned numpats, batch;
+  int nesterov;
+  /*
+   * For the adaptive engines: the decay rate of the
+   * running average of the squared gradient, and a small
+   * number that keeps the step sizes finite.  The decay
+   * rate of the average gradient (used only by Adam) is
+   * the momentum field above.
+   */
+  double beta2, epsilon;
+  /*
+   * The number of past steps remembered by the limited
+   * memory quasi-Newton engine.
+   */
+  unsigned history;
+  /*
+   * An optional function that puts a positive
+   * semi-definite approximation to the Hessian of the
+   * function at the current weights, such as the
+   * Gauss-Newton matrix, in the size by size matrix H.
+   * It must be on the same scale as the values returned
+   * by gradf, and it returns nonzero on failure.
+   */
+  int (*hessf)(void *obj, double **H);
+  /*
+   * For the Hessian-free engine: an optional function that
+   * puts the product of a curvature matrix (such as the
+   * Gauss-Newton matrix) with v in hv, on the same scale as
+   * gradf, using only the n patterns listed in index (or all
+   * of them if index is NULL), and returns nonzero on
+   * failure; and the most conjugate gradient steps to spend
+   * on each step of the engine.
+   */
+  int (*hvf)(void *obj, unsigned *index, unsigned n, double *v, double *hv);
+  unsigned inner;
+  /*
+   * If cache is nonzero (and stochastic is not), then
+   * optimize() remembers the error and gradient at the
+   * last point where gradf was called and the error at
+   * the last point where only funcf was called, and
+   * evaluations at either point are answered without
+   * calling funcf or gradf again.  This assumes that both
+   * depend on nothing but the weights during a run.  The
+   * remembered values live in evalcache, which is for
+   * internal use only.
+   */
+  int cache;
+  void *evalcache;
+  /*
+   * An optional form of funcf that may give up early.  If
+   * the value of funcf is certain to be above bound, then
+   * boundf may stop and return any value above bound (an
+   * estimate from the part that it has seen, ideally).
+   * Otherwise, it must return exactly what funcf would.
+   * Searches that only need to know whether a point is
+   * better than some other point use it.
+   */
+  double (*boundf)(void *obj, double bound);
+  /*
+   * An optional form of gradf that may give up early in
+   * the same way.  If the value of gradf is certain to be
+   * above bound, then gradbf may stop, return any value
+   * above bound, and leave the gradient in any state.
+   * Otherwise, it must do exactly what gradf would.
+   */
+  double (*gradbf)(void *obj, double bound);
+  /*
+   * For the parallel line search: an optional function
+   * that puts the value of funcf at each of the n weight
+   * vectors in w into err, evaluating them at the same
+   * time, without changing the weights, and returns
+   * nonzero on failure; and the number of step sizes to
+   * try at once.
+   */
+  int (*multif)(void *obj, double **w, unsigned n, double *err);
+  unsigned points;
 } OPTIMIZER;
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
@@ -153,7 +247,10 @@ typedef struct OPTIMIZER {
    sets \em{opt->val}, \em{opt->goodfval},  and \em{opt->fcalls}
    appropriately.  The last evaluated value of the objective function
    is returned.  If \em{weights} is non-NULL, then its values are
-   copied on top of \em{opt->weights} prior to doing anything. */
+   copied on top of \em{opt->weights} prior to doing anything.  If the
+   weights are those of a remembered evaluation (see \em{opt->cache}),
+   then \em{opt->funcf} is not called and \em{opt->fcalls} is left
+   alone. */
 
 double opt_eval_func(OPTIMIZER *opt, double *weights);
 
@@ -162,11 +259,89 @@ double opt_eval_func(OPTIMIZER *opt, double *weights);
    \em{opt->gcalls} appropriately.  The last evaluated value of the
    objective function is returned.  If \em{weights} is non-NULL,
    then its values are copied on top of \em{opt->weights} prior
-   to doing anything.*/
+   to doing anything.  Since \em{opt->gradf} returns the error along
+   with the gradient, this is also the way to get both from a single
+   evaluation.  If the weights are those of the last call to
+   \em{opt->gradf} (see \em{opt->cache}), then the remembered error
+   and gradient are put back and \em{opt->gcalls} is left alone.*/
 
 double opt_eval_grad(OPTIMIZER *opt, double *weights);
 
 
+/* Like \bf{opt_eval_func()}, but the caller only needs the error
+   exactly if it is no bigger than \em{bound}.  If \em{opt->boundf}
+   is set, then it is used, and if the returned error is above
+   \em{bound}, then it may only be an estimate and is not remembered
+   by the cache.  Otherwise, this is the same as
+   \bf{opt_eval_func()}. */
+
+double opt_eval_bounded(OPTIMIZER *opt, double *weights, double bound);
+
+
+/* Like \bf{opt_eval_grad()}, but the caller only needs the error and
+   gradient if the error is no bigger than \em{bound}.  Above
+   \em{bound}, the error may only be an estimate, the gradient is
+   not valid, and neither is remembered by the cache.  If
+   \em{opt->gradbf} is set, then it is used.  Otherwise, the error
+   comes from \bf{opt_eval_bounded()}, and the gradient is only
+   computed if the error is low enough, unless \em{opt->cache} is
+   set and \em{opt->boundf} is not, in which case both come from
+   \bf{opt_eval_grad()}. */
+
+double opt_eval_grad_bounded(OPTIMIZER *opt, double *weights, double bound);
+
+
+/* Evaluates the objective function at each of the \em{n} weight
+   vectors in \em{weights}, and puts the values (with weight decay) in
+   \em{err}.  \em{opt->multif} is used if it is set, and otherwise
+   (or if it fails) \em{opt->funcf} is called once per vector.  The
+   current weights and \em{opt->error} are left alone, and nothing is
+   remembered by the cache.  \em{opt->fcalls} goes up by \em{n}. */
+
+void opt_eval_multi(OPTIMIZER *opt, double **weights, unsigned n,
+/*\*/		    double *err);
+
+
+/* Like \bf{opt_eval_grad()}, but for the mini-batch of \em{n}
+   patterns listed in \em{index}, via \em{opt->batchf}.  Weight
+   decay is applied in full to every mini-batch. */
+
+double opt_eval_batch(OPTIMIZER *opt, unsigned *index, unsigned n);
+
+
+/* Copy the current weights into \em{w}, or the current gradient into
+   \em{g}, which must have room for \em{opt->size} values. */
+
+void opt_get_weights(OPTIMIZER *opt, double *w);
+void opt_get_grads(OPTIMIZER *opt, double *g);
+
+
+/* Copy the values in \em{w} on top of \em{opt->weights}. */
+
+void opt_set_weights(OPTIMIZER *opt, double *w);
+
+
+/* Return the weights or the gradient as a contiguous vector.  If
+   \em{opt->wvec} (or \em{opt->gvec}) is set, then it is returned
+   without any copying; otherwise, the values are copied into
+   \em{buf} and \em{buf} is returned.  In either case, the result
+   should be treated as read only. */
+
+double *opt_weights_vector(OPTIMIZER *opt, double *buf);
+double *opt_grads_vector(OPTIMIZER *opt, double *buf);
+
+
+/* Set the weights to \em{x + a * d}.  If \em{x} is NULL, then the
+   weights are set to \em{weights + a * d}. */
+
+void opt_extend_weights(OPTIMIZER *opt, double *x, double *d, double a);
+
+
+/* Returns the dot product of the current gradient with \em{d}. */
+
+double opt_grad_dot(OPTIMIZER *opt, double *d);
+
+
 /* Optimizes \em{opt} by calling \em{opt->engine}.  All calculations
    for statistics and checking halting conditions is done here. */
 
@@ -182,7 +357,9 @@ int optimize(OPTIMIZER *opt);
    where \em{alpha} is the optimimal step size (which is also
    the value that is returned by the function).  This routine assumes
    that the current gradient values are valid for the current
-   weights. */
+   weights.  Trial points are evaluated with
+   \bf{opt_eval_grad_bounded()}, since only those that lower the error
+   enough need the gradient. */
 
 double opt_lnsrch_cubic(OPTIMIZER *opt, double *dir, double stepsz);
 
@@ -213,6 +390,23 @@ double opt_lnsrch_golden(OPTIMIZER *opt, double *dir, double stepsz);
 
 double opt_lnsrch_hybrid(OPTIMIZER *opt, double *dir, double stepsz);
 
+/* Line search that tries \em{opt->points} step sizes at once with
+   \bf{opt_eval_multi()}, so that the trials can be evaluated in
+   parallel through \em{opt->multif}.  The first batches are spaced
+   by factors of two, starting from \em{stepsz} (or a guess if it is
+   zero), and move up or down until the lowest error is bracketed.
+   Each later batch puts one trial at the bottom of the parabola
+   through the best point and its neighbours, and spreads the rest
+   evenly on either side of the best point, so the bracket shrinks by
+   a factor of about half of \em{opt->points} per batch.  The search
+   stops under the same conditions as \bf{opt_lnsrch_golden()}.  The
+   weights are changed to \em{opt->weights + alpha * dir} for the
+   best \em{alpha} found, which is returned.  This routine assumes
+   that the current gradient values are valid for the current
+   weights. */
+
+double opt_lnsrch_parallel(OPTIMIZER *opt, double *dir, double stepsz);
+
 
 #ifdef OPT_LINESRCH_OWNER
 
@@ -223,7 +417,15 @@ double opt_lnsrch_min_relative_change = 0.01;
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
-/* Levenberg-Marquardt.  This routine is currently broken. */
+/* Levenberg-Marquardt.  If \em{opt->hessf} is set, then each step
+   gets the gradient and the curvature matrix H at the current
+   weights, and eigendecomposes H once.  It then tries the damped
+   steps -(H + lambda I)^-1 g, with lambda scaled by the average
+   eigenvalue, and each try costs only O(n^2) and one call to
+   \em{opt->funcf}.  The first step that lowers the error is taken,
+   and lambda shrinks by ten; each failure grows it by ten.  Without
+   \em{opt->hessf}, the old version with a secant approximation to
+   the Hessian is used, which is currently broken. */
 
 void opt_levenberg_marquardt(OPTIMIZER *opt, int state);
 
@@ -248,11 +450,73 @@ void opt_quasinewton_dfp(OPTIMIZER *opt, int state);
 void opt_quasinewton_bfgs(OPTIMIZER *opt, int state);
 
 
+/* Limited memory BFGS.  Instead of an n by n matrix, only the last
+   \em{opt->history} steps and gradient changes are kept, and the
+   search direction is found from them with the two loop recursion,
+   so memory and time per step are O(\em{history} n) for n weights.
+   Steps that would spoil the positive definiteness of the
+   approximation are not remembered, and if the direction is ever
+   uphill, the history is thrown away.  The line search is
+   \em{opt->stepf} (or cubic if NULL), which is offered a step of one
+   as its first guess. */
+
+void opt_lbfgs(OPTIMIZER *opt, int state);
+
+
+/* Hessian-free, or truncated Newton, optimization.  Each step solves
+   (B + lambda I) d = -g for the step d with at most \em{opt->inner}
+   steps of conjugate gradients, where the only access to the
+   curvature B is through the products of \em{opt->hvf}, so memory is
+   O(n) for n weights.  If \em{opt->batch} is nonzero and less than
+   \em{opt->numpats}, then B is estimated from a new random subset of
+   that many patterns on each step, while the gradient always uses
+   all of them.  The step is halved until the error goes down, and
+   lambda is raised or lowered depending on how well the quadratic
+   model predicted the change in the error.  \em{opt->stepf} is not
+   used. */
+
+void opt_hessian_free(OPTIMIZER *opt, int state);
+
+
 /* Batched gradient descent with momentum. */
 
 void opt_gradient_descent(OPTIMIZER *opt, int state);
 
 
+/* Mini-batch stochastic gradient descent with momentum.  Each epoch
+   visits the \em{opt->numpats} patterns once, in a new random order,
+   in mini-batches of \em{opt->batch} patterns, and takes a step
+   after every mini-batch.  The patterns within a mini-batch are
+   sorted so that they are read in order.  If \em{opt->nesterov} is
+   set, then the gradient is taken at the point that the momentum is
+   about to carry the weights to.  The error of an epoch is the
+   average over its mini-batches, which is noisy, so the decayed
+   statistics are the ones to watch.  The line search in
+   \em{opt->stepf} is not used.  Without \em{opt->batchf}, or if
+   \em{opt->batch} is zero, every epoch is a single step on the full
+   (or subsampled) gradient. */
+
+void opt_stochastic_descent(OPTIMIZER *opt, int state);
+
+
+/* Adaptive engines that give each weight its own step size.  They
+   visit the patterns just as \bf{opt_stochastic_descent()} does.
+   \bf{opt_adam()} scales a running average of the gradient (with
+   decay \em{opt->momentum}) by the square root of a running average
+   of the squared gradient (with decay \em{opt->beta2}), with the
+   usual corrections for the bias of the early averages.
+   \bf{opt_rmsprop()} scales the gradient itself by the second
+   average, for which a \em{beta2} of about 0.9 is typical.
+   \bf{opt_adagrad()} scales the gradient by the square root of the
+   sum of all of the squared gradients so far.  In every case the
+   base step size is \em{opt->rate}, which for these engines should
+   usually be around 0.001 to 0.01. */
+
+void opt_adam(OPTIMIZER *opt, int state);
+void opt_rmsprop(OPTIMIZER *opt, int state);
+void opt_adagrad(OPTIMIZER *opt, int state);
+
+
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
 /* h2man:skipbeg */
@@ -295,7 +559,16 @@ const OPTIMIZER OPTIMIZER_DEFAULT = {
   0, 0, 0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0,
   0, 0,
   0.0, 0.0, 0.0, 0.0, 0.0,
-  NULL, NULL
+  NULL, NULL,
+  NULL, NULL,
+  NULL, 0, 32, 0,
+  0.999, 1e-8,
+  8,
+  NULL,
+  NULL, 50,
+  1, NULL,
+  NULL, NULL,
+  NULL, 4
 };
 
 const char *const opt_result_strings[] =
@@ -0,0 +1,144 @@
+
+/* Copyright (c) 2000 by G. W. Flake.
+ *
+ * NAME
+ *   thread.h - a minimal worker pool and lock type
+ * SYNOPSIS
+ *   These routines hide the details of POSIX threads from the rest of
+ *   NODElib.  A function can be run simultaneously by a fixed number
+ *   of workers, and workers can coordinate through a simple lock
+ *   type that doubles as a condition variable.
+ * DESCRIPTION
+ *   Threads are only used if NODElib is compiled with \em{PTHREADS}
+ *   defined.  Otherwise, \bf{thread_run()} calls the function once
+ *   for every worker id, one after another, and all of the lock
+ *   routines do nothing.  Code that uses this module should therefore
+ *   be correct when the workers run sequentially in the order of
+ *   their ids.
+ *
+ *   Worker threads are created on the first call to \bf{thread_run()}
+ *   and are reused by later calls, so the cost of starting a thread
+ *   is only paid once.  The calling thread always acts as worker zero.
+ * AUTHOR
+ *   Gary William Flake (\url{\bf{gary.flake@usa.net}}{mailto:gary.flake@usa.net}).
+ * SEE ALSO
+ *   \bf{nn}(3).
+ */
+
+#ifndef __THREAD_H__
+#define __THREAD_H__
+
+#include "nodelib/etc/version.h"
+#include "nodelib/etc/options.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* A THREAD_LOCK is an opaque type that contains a mutex and a
+   condition variable. */
+
+typedef struct THREAD_LOCK THREAD_LOCK;
+
+/* A THREAD is an opaque handle for a single thread that runs outside
+   of the worker pool. */
+
+typedef struct THREAD THREAD;
+
+/* A THREAD_PIN is an opaque record of where a thread was allowed to
+   run before \bf{thread_pin()} moved it. */
+
+typedef struct THREAD_PIN THREAD_PIN;
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Create and destroy a lock. */
+
+THREAD_LOCK *thread_lock_create(void);
+void thread_lock_destroy(THREAD_LOCK *lock);
+
+
+/* Acquire and release a lock. */
+
+void thread_lock(THREAD_LOCK *lock);
+void thread_unlock(THREAD_LOCK *lock);
+
+
+/* Atomically release \em{lock} (which must be held by the caller)
+   and sleep until another thread calls \bf{thread_broadcast()} on the
+   same lock.  The lock is held again upon return.  As with all
+   condition variables, the caller should test its condition in a
+   loop. */
+
+void thread_wait(THREAD_LOCK *lock);
+
+
+/* Wake up all threads that are sleeping in \bf{thread_wait()} on
+   \em{lock}. */
+
+void thread_broadcast(THREAD_LOCK *lock);
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Call \em{func(obj, id)} for every \em{id} from 0 to \em{n - 1}, with
+   each call in its own thread.  The function returns after every
+   call has returned.  If \bf{thread_run()} is called from within a
+   worker, then the calls are made sequentially by the caller.
+   Returns zero on success. */
+
+int thread_run(unsigned n, void (*func)(void *obj, unsigned id), void *obj);
+
+
+/* Returns the number of processors that are online, or one if
+   threads are not supported. */
+
+unsigned thread_count(void);
+
+
+/* Stop and join all pooled worker threads.  The pool is recreated
+   by the next call to \bf{thread_run()}. */
+
+void thread_shutdown(void);
+
+
+/* Start a thread that calls \em{func(obj)} once, alongside the
+   caller and apart from the worker pool, so it may block for as long
+   as it likes.  NULL is returned if threads are not supported or if
+   the thread could not be made, in which case the caller has to do
+   the work itself. */
+
+THREAD *thread_start(void (*func)(void *obj), void *obj);
+
+
+/* Wait for a thread made by \bf{thread_start()} to return, and free
+   its handle. */
+
+void thread_join(THREAD *thread);
+
+
+/* Keep the calling thread on processor \em{cpu} (modulo the number
+   that are online) until \bf{thread_unpin()} is called with the
+   handle that is returned.  A pooled worker would otherwise stay put
+   for all later jobs, so a worker should unpin itself before its
+   function returns.  NULL is returned if this is not supported, which
+   is the case without threads or off of Linux. */
+
+THREAD_PIN *thread_pin(unsigned cpu);
+
+
+/* Let a thread pinned by \bf{thread_pin()} run wherever it could
+   before, and free the handle.  A NULL handle is ignored. */
+
+void thread_unpin(THREAD_PIN *pin);
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+
+#endif /* __THREAD_H__ */
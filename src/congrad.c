@@ -11,7 +11,7 @@
 #include "nodelib/optimize.h"
 
 typedef struct CGDATA {
-  double *g, *d;
+  double *g, *d, *t;
 } CGDATA;
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
@@ -20,19 +20,21 @@ void generic_conjgrad(OPTIMIZER *opt, int state, int polak_ribiere)
 {
   CGDATA *cgd = opt->internal;
   unsigned i;
-  double gg, dgg, beta;
+  double gg, dgg, beta, *grad;
 
   /* Initialize internal state. */
   if(state == 0) {
     cgd = opt->internal = xmalloc(sizeof(CGDATA));
     cgd->g = allocate_array(1, sizeof(double), opt->size);
     cgd->d = allocate_array(1, sizeof(double), opt->size);
+    cgd->t = allocate_array(1, sizeof(double), opt->size);
     for(i = 0; i < opt->size; i++)
       cgd->g[i] = cgd->d[i] = 0.0;
   }
   /* Do one conjugate gradiant step... */
   else if(state == 1) {
     opt_eval_grad(opt, NULL);
+    grad = opt_grads_vector(opt, cgd->t);
 
     if(opt->epoch == 1)
       beta = 0.0;
@@ -41,9 +43,9 @@ void generic_conjgrad(OPTIMIZER *opt, int state, int polak_ribiere)
       for(i = 0; i < opt->size; i++) {
         gg += cgd->g[i] * cgd->g[i];
         if(polak_ribiere)
-          dgg += (*opt->grads[i] - cgd->g[i]) * *opt->grads[i];
+          dgg += (grad[i] - cgd->g[i]) * grad[i];
         else
-	  dgg += *opt->grads[i] * *opt->grads[i];
+	  dgg += grad[i] * grad[i];
       }
       if(gg == 0.0)
 	return;
@@ -51,16 +53,15 @@ void generic_conjgrad(OPTIMIZER *opt, int state, int polak_ribiere)
 	beta = dgg / gg;
     }
     for(i = 0; i < opt->size; i++) {
-      cgd->d[i] = - *opt->grads[i] + beta * cgd->d[i];
-      cgd->g[i] = *opt->grads[i];
+      cgd->d[i] = - grad[i] + beta * cgd->d[i];
+      cgd->g[i] = grad[i];
     }
     if(opt->stochastic || opt->epoch == 1)
       opt->stepsz = 0;
     if(opt->stepf)
       opt->stepsz = opt->stepf(opt, cgd->d, opt->stepsz);
     else {
-      for(i = 0; i < opt->size; i++)
-	*opt->weights[i] += opt->rate * cgd->d[i];
+      opt_extend_weights(opt, NULL, cgd->d, opt->rate);
       opt->stepsz = opt->rate;
     }
   }
@@ -68,6 +69,7 @@ void generic_conjgrad(OPTIMIZER *opt, int state, int polak_ribiere)
   else if(state == -1) {
     deallocate_array(cgd->g);
     deallocate_array(cgd->d);
+    deallocate_array(cgd->t);
     xfree(cgd);
     opt->internal = NULL;
   }
@@ -268,6 +268,23 @@ static double *dsm_union_y(void *instance, unsigned index) {
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
+#include "nodelib/dsprefetch.h"
+
+static INLINE unsigned dsm_prefetch_size(void *instance) {
+  DSM_PREFETCH *prefetch = instance; return(prefetch->len);
+}
+
+static INLINE unsigned dsm_prefetch_x_size(void *instance) {
+  DSM_PREFETCH *prefetch = instance; return(prefetch->xsz);
+}
+
+static INLINE unsigned dsm_prefetch_y_size(void *instance) {
+  DSM_PREFETCH *prefetch = instance; return(prefetch->ysz);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
 #define OWNER
 #include "nodelib/dsmethod.h"
 #undef OWNER
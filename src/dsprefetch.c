@@ -0,0 +1,271 @@
+
+/* Copyright (c) 2000 by G. W. Flake. */
+
+#include "nodelib/xalloc.h"
+#include "nodelib/ulog.h"
+#include "nodelib/misc.h"
+#include "nodelib/dsprefetch.h"
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Copy the patterns of block b of the wrapped DATASET into slot.  The
+   lock is not held, since this is the slow part. */
+
+static void prefetch_fill(DSM_PREFETCH *pf, DSM_PREFETCH_SLOT *slot,
+			  unsigned b)
+{
+  double *x, *y;
+  unsigned i, j, k, n, first;
+
+  first = b * pf->block;
+  n = (first + pf->block > pf->len) ? pf->len - first : pf->block;
+  for(k = 0; k < n; k++) {
+    i = pf->index ? pf->index[first + k] : first + k;
+    x = dataset_x(pf->dset, i);
+    y = dataset_y(pf->dset, i);
+    slot->ok[k] = (x != NULL) | ((y != NULL) << 1);
+    if(x)
+      for(j = 0; j < pf->xsz; j++)
+	slot->x[k][j] = x[j];
+    if(y)
+      for(j = 0; j < pf->ysz; j++)
+	slot->y[k][j] = y[j];
+  }
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Returns the slot that holds (or is being filled with) block b, or
+   depth if there is none.  The lock must be held. */
+
+static unsigned prefetch_find(DSM_PREFETCH *pf, unsigned b)
+{
+  unsigned i;
+
+  for(i = 0; i < pf->depth; i++)
+    if(pf->slots[i].block == b)
+      return(i);
+  return(pf->depth);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* The window is the wanted block and the ones after it, wrapping
+   around at the end, and never more blocks than fit in the ring.
+   Returns nonzero if block b is in it. */
+
+static int prefetch_in_window(DSM_PREFETCH *pf, unsigned b)
+{
+  unsigned n;
+
+  n = (pf->depth < pf->numblocks) ? pf->depth : pf->numblocks;
+  return(b < pf->numblocks &&
+	 (b + pf->numblocks - pf->want) % pf->numblocks < n);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Returns the first block of the window that is not in the ring, or
+   numblocks if they are all there, and puts a slot that is free to
+   be filled in *slot.  Since the window is no bigger than the ring,
+   such a slot always exists.  The lock must be held. */
+
+static unsigned prefetch_next(DSM_PREFETCH *pf, DSM_PREFETCH_SLOT **slot)
+{
+  unsigned b, i, k, n;
+
+  n = (pf->depth < pf->numblocks) ? pf->depth : pf->numblocks;
+  for(k = 0; k < n; k++) {
+    b = (pf->want + k) % pf->numblocks;
+    if(prefetch_find(pf, b) == pf->depth) {
+      for(i = 0; i < pf->depth; i++)
+	if(!prefetch_in_window(pf, pf->slots[i].block))
+	  break;
+      *slot = &pf->slots[i];
+      return(b);
+    }
+  }
+  return(pf->numblocks);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* The body of the background thread.  Keep the ring full of the
+   blocks that follow the one most recently asked for, and sleep
+   when there is nothing to do. */
+
+static void prefetch_main(void *obj)
+{
+  DSM_PREFETCH *pf = obj;
+  DSM_PREFETCH_SLOT *slot;
+  unsigned b;
+
+  thread_lock(pf->lock);
+  while(!pf->stop) {
+    if((b = prefetch_next(pf, &slot)) == pf->numblocks) {
+      thread_wait(pf->lock);
+      continue;
+    }
+    slot->block = b;
+    slot->ready = 0;
+    pf->busy = 1;
+    thread_unlock(pf->lock);
+    prefetch_fill(pf, slot, b);
+    thread_lock(pf->lock);
+    slot->ready = 1;
+    pf->busy = 0;
+    thread_broadcast(pf->lock);
+  }
+  thread_unlock(pf->lock);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+DSM_PREFETCH *dsm_prefetch(DATASET *dset, unsigned *index, unsigned len,
+			   unsigned block, unsigned depth)
+{
+  DSM_PREFETCH *pf;
+  unsigned i, sz;
+
+  sz = dataset_size(dset);
+  if(len == 0 && index == NULL)
+    len = sz;
+  if(len == 0 || (index == NULL && len > sz)) {
+    ulog(ULOG_ERROR, "dsm_prefetch: parameters failed sanity check."
+	 "%t(%d == 0 || %d > %d).", len, len, sz);
+    return(NULL);
+  }
+  pf = xmalloc(sizeof(DSM_PREFETCH));
+  pf->dset = dset;
+  pf->index = index;
+  pf->len = len;
+  pf->block = (block == 0) ? DSM_PREFETCH_BLOCK : block;
+  pf->depth = (depth == 0) ? DSM_PREFETCH_DEPTH : depth;
+  pf->xsz = dataset_x_size(dset);
+  pf->ysz = dataset_y_size(dset);
+  pf->numblocks = (len + pf->block - 1) / pf->block;
+  pf->want = 0;
+  pf->busy = pf->stop = 0;
+
+  /* Every slot starts out holding the impossible block numblocks.  The
+   * rows get one extra element so that an empty y is still allocated.
+   */
+  pf->slots = xmalloc(sizeof(DSM_PREFETCH_SLOT) * pf->depth);
+  for(i = 0; i < pf->depth; i++) {
+    pf->slots[i].x = allocate_array(2, sizeof(double), pf->block,
+				    pf->xsz + 1);
+    pf->slots[i].y = allocate_array(2, sizeof(double), pf->block,
+				    pf->ysz + 1);
+    pf->slots[i].ok = xmalloc(pf->block);
+    pf->slots[i].block = pf->numblocks;
+    pf->slots[i].ready = 0;
+  }
+  pf->lock = thread_lock_create();
+  pf->thread = thread_start(prefetch_main, pf);
+  return(pf);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+void dsm_prefetch_order(DSM_PREFETCH *pf, unsigned *index)
+{
+  unsigned i;
+
+  thread_lock(pf->lock);
+  while(pf->busy)
+    thread_wait(pf->lock);
+  pf->index = index;
+  for(i = 0; i < pf->depth; i++) {
+    pf->slots[i].block = pf->numblocks;
+    pf->slots[i].ready = 0;
+  }
+  pf->want = 0;
+  thread_broadcast(pf->lock);
+  thread_unlock(pf->lock);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+void dsm_destroy_prefetch(DSM_PREFETCH *pf)
+{
+  unsigned i;
+
+  if(pf->thread) {
+    thread_lock(pf->lock);
+    pf->stop = 1;
+    thread_broadcast(pf->lock);
+    thread_unlock(pf->lock);
+    thread_join(pf->thread);
+  }
+  thread_lock_destroy(pf->lock);
+  for(i = 0; i < pf->depth; i++) {
+    deallocate_array(pf->slots[i].x);
+    deallocate_array(pf->slots[i].y);
+    xfree(pf->slots[i].ok);
+  }
+  xfree(pf->slots);
+  xfree(pf);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Returns the slot that holds pattern index, after waiting for it to
+   be read if need be, or NULL if index is out of range. */
+
+static DSM_PREFETCH_SLOT *prefetch_slot(DSM_PREFETCH *pf, unsigned index)
+{
+  DSM_PREFETCH_SLOT *slot;
+  unsigned b, i;
+
+  if(index >= pf->len) return(NULL);
+  b = index / pf->block;
+
+  thread_lock(pf->lock);
+  if(pf->want != b) {
+    pf->want = b;
+    thread_broadcast(pf->lock);
+  }
+  if(pf->thread) {
+    while((i = prefetch_find(pf, b)) == pf->depth || !pf->slots[i].ready)
+      thread_wait(pf->lock);
+    slot = &pf->slots[i];
+  }
+  else if((i = prefetch_find(pf, b)) == pf->depth) {
+    prefetch_next(pf, &slot);
+    prefetch_fill(pf, slot, b);
+    slot->block = b;
+    slot->ready = 1;
+  }
+  else
+    slot = &pf->slots[i];
+  thread_unlock(pf->lock);
+  return(slot);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+double *dsm_prefetch_x(void *instance, unsigned index)
+{
+  DSM_PREFETCH *pf = instance;
+  DSM_PREFETCH_SLOT *slot;
+  unsigned k = index % pf->block;
+
+  if((slot = prefetch_slot(pf, index)) == NULL || !(slot->ok[k] & 1))
+    return(NULL);
+  return(slot->x[k]);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+double *dsm_prefetch_y(void *instance, unsigned index)
+{
+  DSM_PREFETCH *pf = instance;
+  DSM_PREFETCH_SLOT *slot;
+  unsigned k = index % pf->block;
+
+  if((slot = prefetch_slot(pf, index)) == NULL || !(slot->ok[k] & 2))
+    return(NULL);
+  return(slot->y[k]);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
@@ -2,7 +2,12 @@
 /* Copyright (c) 1995-97  by G. W. Flake. */
 
 
+#include <stdlib.h>
+#include <string.h>
 #include <math.h>
+#include "nodelib/errfunc.h"
+
+#define LN2 0.69314718055994530942
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
@@ -97,3 +102,283 @@ double opt_err_symmetric_cross_entropy(double output, double target,
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
+#ifdef NL_KERNEL_VECTORS
+
+/* The vector versions of the simple error functions keep four partial
+   sums of the error, so they may differ from the scalar forms in the
+   last bits. */
+
+typedef double evec __attribute__((vector_size(4 * sizeof(double))));
+typedef long long eint __attribute__((vector_size(4 * sizeof(long long))));
+
+#define ELOAD(v, p)    memcpy(&(v), (p), sizeof(evec))
+#define ESTORE(p, v)   memcpy((p), &(v), sizeof(evec))
+#define ESUM(v)        (((v)[0] + (v)[1]) + ((v)[2] + (v)[3]))
+#define ESEL(m, a, b)  ((evec) (((eint) (a) & (m)) | ((eint) (b) & ~(m))))
+
+#endif /* NL_KERNEL_VECTORS */
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+NL_KERNEL
+static double errvec_quadratic(double *y, double *t, unsigned n,
+			       double *d, double *d2)
+{
+  double diff, err = 0;
+  unsigned i = 0;
+#ifdef NL_KERNEL_VECTORS
+  evec vy, vt, vd, ve = { 0, 0, 0, 0 };
+
+  for(; i + 4 <= n; i += 4) {
+    ELOAD(vy, y + i);
+    ELOAD(vt, t + i);
+    vd = vy - vt;
+    ve += vd * vd;
+    if(d) ESTORE(d + i, vd);
+  }
+  err = ESUM(ve);
+#endif
+  for(; i < n; i++) {
+    diff = y[i] - t[i];
+    err += diff * diff;
+    if(d) d[i] = diff;
+  }
+  if(d2)
+    for(i = 0; i < n; i++)
+      d2[i] = 1.0;
+  return(0.5 * err);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* With a = |e| and b = exp(-2a), ln(cosh(e)) is a + ln(1 + b) - ln(2)
+   and tanh(e) is sign(e) (1 - b) / (1 + b), neither of which
+   overflows. */
+
+static double errvec_logistic(double *y, double *t, unsigned n,
+			      double *d, double *d2)
+{
+  double diff, a, b, th, err = 0;
+  unsigned i;
+
+  for(i = 0; i < n; i++) {
+    diff = y[i] - t[i];
+    a = fabs(diff);
+    b = exp(-2 * a);
+    err += a + log1p(b) - LN2;
+    if(d || d2) {
+      th = (1 - b) / (1 + b);
+      th = (diff < 0) ? -th : th;
+      if(d) d[i] = th;
+      if(d2) d2[i] = (1.0 - th) * (1.0 + th);
+    }
+  }
+  return(err);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+NL_KERNEL
+static double errvec_huber(double *y, double *t, unsigned n,
+			   double *d, double *d2)
+{
+  double diff, ferr, err = 0;
+  unsigned i = 0;
+#ifdef NL_KERNEL_VECTORS
+  evec vy, vt, vd, va, ve = { 0, 0, 0, 0 }, one = { 1, 1, 1, 1 };
+  evec half = { 0.5, 0.5, 0.5, 0.5 }, zero = { 0, 0, 0, 0 };
+  eint small;
+
+  for(; i + 4 <= n; i += 4) {
+    ELOAD(vy, y + i);
+    ELOAD(vt, t + i);
+    vd = vy - vt;
+    va = ESEL(vd < zero, -vd, vd);
+    small = (va < one);
+    ve += ESEL(small, half * vd * vd, va - half);
+    if(d) {
+      vd = ESEL(small, vd, ESEL(vd > zero, one, -one));
+      ESTORE(d + i, vd);
+    }
+    if(d2) {
+      va = ESEL(small, one, zero);
+      ESTORE(d2 + i, va);
+    }
+  }
+  err = ESUM(ve);
+#endif
+  for(; i < n; i++) {
+    diff = y[i] - t[i];
+    ferr = fabs(diff);
+    err += (ferr < 1.0) ? 0.5 * diff * diff : ferr - 0.5;
+    if(d) d[i] = (ferr < 1.0) ? diff : (diff > 0) ? 1.0 : -1.0;
+    if(d2) d2[i] = (ferr < 1.0) ? 1.0 : 0.0;
+  }
+  return(err);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* The cross entropy of every output, after mapping both the output and
+   the target through (x + shift) * scale.  The derivatives are with
+   respect to the mapped output, just as in the scalar forms. */
+
+static double cross_entropy(double *y, double *t, unsigned n, double *d,
+			    double *d2, double shift, double scale)
+{
+  double out, tgt, err = 0, epsilon = 1e-8;
+  unsigned i;
+
+  for(i = 0; i < n; i++) {
+    tgt = (t[i] + shift) * scale;
+    out = (y[i] + shift) * scale;
+    tgt = (tgt < 0) ? 0 : (tgt > 1) ? 1 : tgt;
+    out = (out < 0) ? epsilon : (out > 1) ? 1 - epsilon : out;
+    if(tgt == out) {
+      if(d) d[i] = -tgt / out;
+      if(d2) d2[i] = -tgt / (out * out);
+    }
+    else {
+      err += -tgt * log(out) - (1 - tgt) * log(1 - out);
+      if(d) d[i] = -tgt / out + (1 - tgt) / (1 - out);
+      if(d2) d2[i] = -tgt / (out * out) +
+	       (1 - tgt) / ((1 - out) * (1 - out));
+    }
+  }
+  return(err);
+}
+
+static double errvec_cross_entropy(double *y, double *t, unsigned n,
+				   double *d, double *d2)
+{
+  return(cross_entropy(y, t, n, d, d2, 0.0, 1.0));
+}
+
+static double errvec_symmetric_cross_entropy(double *y, double *t,
+					     unsigned n, double *d,
+					     double *d2)
+{
+  return(cross_entropy(y, t, n, d, d2, 1.0, 0.5));
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Put the softmax of the n values in y into p, and return the log of
+   the normalizer, less the biggest value, which goes in *max. */
+
+static double softmax(double *y, unsigned n, double *p, double *max)
+{
+  double m, sum = 0;
+  unsigned i;
+
+  for(m = y[0], i = 1; i < n; i++)
+    m = (y[i] > m) ? y[i] : m;
+  for(i = 0; i < n; i++)
+    sum += (p[i] = exp(y[i] - m));
+  for(i = 0; i < n; i++)
+    p[i] /= sum;
+  *max = m;
+  return(log(sum));
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* E = -sum_i t_i log(p_i) = sum_i t_i (log(sum_j exp(y_j)) - y_i)
+   dE/dy_i = p_i T - t_i, where T = sum_i t_i
+   d^2E/dy_i dy_j = T (p_i delta_ij - p_i p_j) */
+
+static double errvec_softmax_cross_entropy(double *y, double *t,
+					   unsigned n, double *d,
+					   double *d2)
+{
+  double *p, m, lse, tsum = 0, err = 0;
+  unsigned i;
+
+  if(n == 0) return(0);
+  p = d ? d : d2;
+  if(p)
+    lse = softmax(y, n, p, &m);
+  else {
+    for(m = y[0], i = 1; i < n; i++)
+      m = (y[i] > m) ? y[i] : m;
+    for(lse = 0, i = 0; i < n; i++)
+      lse += exp(y[i] - m);
+    lse = log(lse);
+  }
+  for(i = 0; i < n; i++) {
+    tsum += t[i];
+    if(t[i] != 0)
+      err += t[i] * (lse - (y[i] - m));
+  }
+  if(d2)
+    for(i = 0; i < n; i++)
+      d2[i] = tsum * p[i] * (1 - p[i]);
+  if(d)
+    for(i = 0; i < n; i++)
+      d[i] = p[i] * tsum - t[i];
+  return(err);
+}
+
+static void errvec_softmax_hv(double *y, double *t, unsigned n, double *v,
+			      double *hv)
+{
+  double m, pv = 0, tsum = 0;
+  unsigned i;
+
+  if(n == 0) return;
+  softmax(y, n, hv, &m);
+  for(i = 0; i < n; i++) {
+    pv += hv[i] * v[i];
+    tsum += t[i];
+  }
+  for(i = 0; i < n; i++)
+    hv[i] = tsum * hv[i] * (v[i] - pv);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+OPT_ERRVEC opt_errvec_quadratic = {
+  "quadratic", errvec_quadratic, NULL, opt_err_quadratic, 1
+};
+
+OPT_ERRVEC opt_errvec_logistic = {
+  "logistic", errvec_logistic, NULL, opt_err_logistic, 1
+};
+
+OPT_ERRVEC opt_errvec_huber = {
+  "huber", errvec_huber, NULL, opt_err_huber, 1
+};
+
+OPT_ERRVEC opt_errvec_cross_entropy = {
+  "cross_entropy", errvec_cross_entropy, NULL, opt_err_cross_entropy, 1
+};
+
+OPT_ERRVEC opt_errvec_symmetric_cross_entropy = {
+  "symmetric_cross_entropy", errvec_symmetric_cross_entropy, NULL,
+  opt_err_symmetric_cross_entropy, 1
+};
+
+OPT_ERRVEC opt_errvec_softmax_cross_entropy = {
+  "softmax_cross_entropy", errvec_softmax_cross_entropy,
+  errvec_softmax_hv, NULL, 1
+};
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+OPT_ERRVEC *opt_errvec_find(double (*func)(double output, double target,
+					  double *derivative,
+					  double *second_derivative))
+{
+  static OPT_ERRVEC *builtins[] = {
+    &opt_errvec_quadratic, &opt_errvec_logistic, &opt_errvec_huber,
+    &opt_errvec_cross_entropy, &opt_errvec_symmetric_cross_entropy, NULL
+  };
+  unsigned i;
+
+  for(i = 0; builtins[i]; i++)
+    if(builtins[i]->scalar == func)
+      return(builtins[i]);
+  return(NULL);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
@@ -13,7 +13,7 @@
 #include "nodelib/misc.h"
 
 typedef struct CGDATA {
-  double *d;
+  double *d, *t;
 } GDDATA;
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
@@ -22,31 +22,308 @@ void opt_gradient_descent(OPTIMIZER *opt, int state)
 {
   GDDATA *gdd = opt->internal;
   unsigned i;
+  double *grad;
 
   /* Initialize internal state. */
   if(state == 0) {
     gdd = opt->internal = xmalloc(sizeof(GDDATA));
     gdd->d = allocate_array(1, sizeof(double), opt->size);
+    gdd->t = allocate_array(1, sizeof(double), opt->size);
     for(i = 0; i < opt->size; i++)
       gdd->d[i] = 0.0;
   }
   /* Do one gradiant descent step... */
   else if(state == 1) {
     opt_eval_grad(opt, NULL);
+    grad = opt_grads_vector(opt, gdd->t);
     for(i = 0; i < opt->size; i++)
-      gdd->d[i] = opt->momentum * gdd->d[i] - opt->rate * *opt->grads[i];
+      gdd->d[i] = opt->momentum * gdd->d[i] - opt->rate * grad[i];
     if(opt->stepf)
       opt->stepsz = opt->stepf(opt, gdd->d, opt->stepsz);
     else
-      for(i = 0; i < opt->size; i++)
-	*opt->weights[i] += gdd->d[i];
+      opt_extend_weights(opt, NULL, gdd->d, 1.0);
   }
   /* Clean up. */
   else if(state == -1) {
     deallocate_array(gdd->d);
+    deallocate_array(gdd->t);
     xfree(gdd);
     opt->internal = NULL;
   }
 }
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* The state of the mini-batch engines: three vectors whose meaning
+   is up to the engine (the momentum term or the moment estimates),
+   buffers for the gradient and the weights, the order of the
+   patterns, and the number of steps taken so far. */
+
+typedef struct SGDDATA {
+  double *d, *m, *v, *g, *w;
+  unsigned *perm, steps;
+} SGDDATA;
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+static SGDDATA *sgd_create(OPTIMIZER *opt)
+{
+  SGDDATA *sgd;
+  unsigned i;
+
+  sgd = xmalloc(sizeof(SGDDATA));
+  sgd->d = allocate_array(1, sizeof(double), opt->size);
+  sgd->m = allocate_array(1, sizeof(double), opt->size);
+  sgd->v = allocate_array(1, sizeof(double), opt->size);
+  sgd->g = allocate_array(1, sizeof(double), opt->size);
+  sgd->w = allocate_array(1, sizeof(double), opt->size);
+  sgd->perm = xmalloc(sizeof(unsigned) * (opt->numpats + 1));
+  for(i = 0; i < opt->size; i++)
+    sgd->d[i] = sgd->m[i] = sgd->v[i] = 0.0;
+  for(i = 0; i < opt->numpats; i++)
+    sgd->perm[i] = i;
+  sgd->steps = 0;
+  return(sgd);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+static void sgd_destroy(OPTIMIZER *opt)
+{
+  SGDDATA *sgd = opt->internal;
+
+  deallocate_array(sgd->d);
+  deallocate_array(sgd->m);
+  deallocate_array(sgd->v);
+  deallocate_array(sgd->g);
+  deallocate_array(sgd->w);
+  xfree(sgd->perm);
+  xfree(sgd);
+  opt->internal = NULL;
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+static int sgd_compare(const void *a, const void *b)
+{
+  unsigned x = *(const unsigned *)a, y = *(const unsigned *)b;
+
+  return((x > y) - (x < y));
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Do one epoch of the engine whose update rule is step.  If there are
+   mini-batches, then the patterns are shuffled and step is called
+   for each mini-batch in turn, with the patterns of the mini-batch
+   sorted.  Otherwise, step is called once with a NULL index, which
+   means the full (or subsampled) gradient.  The error of the epoch is
+   the average of the errors that step returns. */
+
+static void sgd_epoch(OPTIMIZER *opt, double (*step)(OPTIMIZER *opt,
+			unsigned *index, unsigned n))
+{
+  SGDDATA *sgd = opt->internal;
+  unsigned i, j, k, n;
+  double errsum;
+
+  if(opt->batchf == NULL || opt->numpats == 0 || opt->batch == 0) {
+    step(opt, NULL, 0);
+    return;
+  }
+  if(opt->stochastic) srandom(opt->seed);
+  for(i = opt->numpats - 1; i > 0; i--) {
+    j = random() % (i + 1);
+    k = sgd->perm[i]; sgd->perm[i] = sgd->perm[j]; sgd->perm[j] = k;
+  }
+  for(errsum = 0, i = 0; i < opt->numpats; i += n) {
+    n = (opt->numpats - i < opt->batch) ? opt->numpats - i : opt->batch;
+    qsort(sgd->perm + i, n, sizeof(unsigned), sgd_compare);
+    errsum += n * step(opt, sgd->perm + i, n);
+  }
+  opt->error = errsum / opt->numpats;
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Compute the gradient for a step, over the mini-batch in index or
+   over everything if index is NULL.  The gradient vector is put in
+   *g, and the weights in *w, which is written back by sgd_done(). */
+
+static double sgd_eval(OPTIMIZER *opt, unsigned *index, unsigned n,
+		       double **g, double **w)
+{
+  SGDDATA *sgd = opt->internal;
+  double err;
+
+  err = index ? opt_eval_batch(opt, index, n) : opt_eval_grad(opt, NULL);
+  *g = opt_grads_vector(opt, sgd->g);
+  *w = opt_weights_vector(opt, sgd->w);
+  sgd->steps++;
+  return(err);
+}
+
+static void sgd_done(OPTIMIZER *opt, double *w)
+{
+  if(!opt->wvec)
+    opt_set_weights(opt, w);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* A momentum step.  With Nesterov momentum, look ahead first and take
+   the gradient there, then step from the look ahead point so that the
+   net move is the new momentum term. */
+
+static double sgd_step(OPTIMIZER *opt, unsigned *index, unsigned n)
+{
+  SGDDATA *sgd = opt->internal;
+  unsigned i;
+  double *grad, err, old;
+
+  if(opt->nesterov)
+    opt_extend_weights(opt, NULL, sgd->d, opt->momentum);
+  err = index ? opt_eval_batch(opt, index, n) : opt_eval_grad(opt, NULL);
+  grad = opt_grads_vector(opt, sgd->g);
+  for(i = 0; i < opt->size; i++) {
+    old = sgd->d[i];
+    sgd->d[i] = opt->momentum * old - opt->rate * grad[i];
+    sgd->m[i] = opt->nesterov ? sgd->d[i] - opt->momentum * old : sgd->d[i];
+  }
+  opt_extend_weights(opt, NULL, sgd->m, 1.0);
+  return(err);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+void opt_stochastic_descent(OPTIMIZER *opt, int state) 
+{
+  if(state == 0)
+    opt->internal = sgd_create(opt);
+  else if(state == 1)
+    sgd_epoch(opt, sgd_step);
+  else if(state == -1)
+    sgd_destroy(opt);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* The fused updates of the adaptive engines.  Each one makes a single
+   pass over the weights, updating the moment estimates and the weight
+   together. */
+
+NL_KERNEL
+static void adam_update(double *w, double *g, double *m, double *v,
+			unsigned n, double b1, double b2, double a, double eps)
+{
+  unsigned i;
+
+  for(i = 0; i < n; i++) {
+    m[i] = b1 * m[i] + (1 - b1) * g[i];
+    v[i] = b2 * v[i] + (1 - b2) * g[i] * g[i];
+    w[i] -= a * m[i] / (sqrt(v[i]) + eps);
+  }
+}
+
+NL_KERNEL
+static void rmsprop_update(double *w, double *g, double *v, unsigned n,
+			   double b2, double a, double eps)
+{
+  unsigned i;
+
+  for(i = 0; i < n; i++) {
+    v[i] = b2 * v[i] + (1 - b2) * g[i] * g[i];
+    w[i] -= a * g[i] / (sqrt(v[i]) + eps);
+  }
+}
+
+NL_KERNEL
+static void adagrad_update(double *w, double *g, double *v, unsigned n,
+			   double a, double eps)
+{
+  unsigned i;
+
+  for(i = 0; i < n; i++) {
+    v[i] += g[i] * g[i];
+    w[i] -= a * g[i] / (sqrt(v[i]) + eps);
+  }
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* The bias corrections of Adam are folded into the step size. */
+
+static double adam_step(OPTIMIZER *opt, unsigned *index, unsigned n)
+{
+  SGDDATA *sgd = opt->internal;
+  double *g, *w, err, a;
+
+  err = sgd_eval(opt, index, n, &g, &w);
+  a = opt->rate * sqrt(1 - pow(opt->beta2, sgd->steps)) /
+    (1 - pow(opt->momentum, sgd->steps));
+  adam_update(w, g, sgd->m, sgd->v, opt->size, opt->momentum, opt->beta2,
+	      a, opt->epsilon);
+  sgd_done(opt, w);
+  return(err);
+}
+
+static double rmsprop_step(OPTIMIZER *opt, unsigned *index, unsigned n)
+{
+  SGDDATA *sgd = opt->internal;
+  double *g, *w, err;
+
+  err = sgd_eval(opt, index, n, &g, &w);
+  rmsprop_update(w, g, sgd->v, opt->size, opt->beta2, opt->rate,
+		 opt->epsilon);
+  sgd_done(opt, w);
+  return(err);
+}
+
+static double adagrad_step(OPTIMIZER *opt, unsigned *index, unsigned n)
+{
+  SGDDATA *sgd = opt->internal;
+  double *g, *w, err;
+
+  err = sgd_eval(opt, index, n, &g, &w);
+  adagrad_update(w, g, sgd->v, opt->size, opt->rate, opt->epsilon);
+  sgd_done(opt, w);
+  return(err);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+void opt_adam(OPTIMIZER *opt, int state) 
+{
+  if(state == 0)
+    opt->internal = sgd_create(opt);
+  else if(state == 1)
+    sgd_epoch(opt, adam_step);
+  else if(state == -1)
+    sgd_destroy(opt);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+void opt_rmsprop(OPTIMIZER *opt, int state) 
+{
+  if(state == 0)
+    opt->internal = sgd_create(opt);
+  else if(state == 1)
+    sgd_epoch(opt, rmsprop_step);
+  else if(state == -1)
+    sgd_destroy(opt);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+void opt_adagrad(OPTIMIZER *opt, int state) 
+{
+  if(state == 0)
+    opt->internal = sgd_create(opt);
+  else if(state == 1)
+    sgd_epoch(opt, adagrad_step);
+  else if(state == -1)
+    sgd_destroy(opt);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
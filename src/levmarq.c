@@ -11,18 +11,32 @@
 #include "nodelib/svd.h"
 
 typedef struct LMDATA {
-  double *xo, *go, *hxd;
+  double *xo, *go, *hxd, *x, *wt, *gt;
   double **ho, **hn, **hh, **hi;
   double lambda, last_error;
 } LMDATA;
 
+/* The state of the Gauss-Newton version: the curvature matrix, which
+   is replaced by its eigenvectors, the eigenvalues, the gradient in
+   the basis of the eigenvectors, the starting weights and gradient of
+   the step, the trial weights, and the damping, which is relative to
+   the average eigenvalue. */
+
+typedef struct LMGNDATA {
+  double **H, *S, *c, *w0, *g, *x;
+  double lambda;
+} LMGNDATA;
+
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
-void opt_levenberg_marquardt(OPTIMIZER *opt, int state)
+/* The old version, with a secant approximation to the Hessian that is
+   inverted for every value of lambda. */
+
+static void lm_secant(OPTIMIZER *opt, int state)
 {
   LMDATA *lmd = opt->internal;
   unsigned i, j, n = opt->size;
-  double **t, xdd, sum;
+  double **t, xdd, sum, *w, *g;
 
   /* Initialize internal state. */
   if(state == 0) {
@@ -30,6 +44,9 @@ void opt_levenberg_marquardt(OPTIMIZER *opt, int state)
     lmd->hxd = allocate_array(1, sizeof(double), n);
     lmd->go = allocate_array(1, sizeof(double), n);
     lmd->xo = allocate_array(1, sizeof(double), n);
+    lmd->x = allocate_array(1, sizeof(double), n);
+    lmd->wt = allocate_array(1, sizeof(double), n);
+    lmd->gt = allocate_array(1, sizeof(double), n);
     lmd->ho = allocate_array(2, sizeof(double), n, n);
     lmd->hn = allocate_array(2, sizeof(double), n, n);
     lmd->hh = allocate_array(2, sizeof(double), n, n);
@@ -47,24 +64,25 @@ void opt_levenberg_marquardt(OPTIMIZER *opt, int state)
   }
   /* Do one Levenberg-Marquardt step... */
   else if(state == 1) {
+    w = opt_weights_vector(opt, lmd->wt);
+    g = opt_grads_vector(opt, lmd->gt);
     xdd = 0;
     for(i = 0; i < n; i++) {
       sum = 0;
       for(j = 0; j < n; j++)
-	sum += lmd->ho[i][j] * (*opt->weights[j] - lmd->xo[j]);
+	sum += lmd->ho[i][j] * (w[j] - lmd->xo[j]);
       lmd->hxd[i] = sum;
-      xdd += (*opt->weights[i] - lmd->xo[i]) *
-	(*opt->weights[i] - lmd->xo[i]);
+      xdd += (w[i] - lmd->xo[i]) * (w[i] - lmd->xo[i]);
     }    
     if(xdd == 0) xdd = 1;
     for(i = 0; i < n; i++)
       for(j = 0; j < n; j++)
 	lmd->hn[i][j] = lmd->ho[i][j] + 
-	  (*opt->grads[i] - lmd->go[i] - lmd->hxd[i]) * 
-	  (*opt->weights[j] - lmd->xo[j]) / xdd;
+	  (g[i] - lmd->go[i] - lmd->hxd[i]) * 
+	  (w[j] - lmd->xo[j]) / xdd;
     for(i = 0; i < n; i++) {
-      lmd->go[i] = *opt->grads[i];
-      lmd->xo[i] = *opt->weights[i];
+      lmd->go[i] = g[i];
+      lmd->xo[i] = w[i];
     }
     while(1) {
       for(i = 0; i < n; i++)
@@ -77,10 +95,11 @@ void opt_levenberg_marquardt(OPTIMIZER *opt, int state)
       for(i = 0; i < n; i++) {
 	sum = 0;
 	for(j = 0; j < n; j++)
-	  sum += lmd->hi[i][j] * *opt->grads[j];
-	*opt->weights[i] = lmd->xo[i] - sum;
+	  sum += lmd->hi[i][j] * lmd->go[j];
+	lmd->x[i] = lmd->xo[i] - sum;
       }
-      
+      opt_set_weights(opt, lmd->x);
+
       opt_eval_func(opt, NULL);
 
       if(opt->epoch > 1 && opt->error < lmd->last_error) {
@@ -107,6 +126,9 @@ void opt_levenberg_marquardt(OPTIMIZER *opt, int state)
     deallocate_array(lmd->hxd);
     deallocate_array(lmd->go);
     deallocate_array(lmd->xo);
+    deallocate_array(lmd->x);
+    deallocate_array(lmd->wt);
+    deallocate_array(lmd->gt);
     deallocate_array(lmd->ho);
     deallocate_array(lmd->hn);
     deallocate_array(lmd->hh);
@@ -118,3 +140,111 @@ void opt_levenberg_marquardt(OPTIMIZER *opt, int state)
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
+/* The Gauss-Newton version.  Since H = U S U', the damped step
+   -(H + lambda I)^-1 g is -U (S + lambda)^-1 U' g, so once U and
+   U' g are known, each value of lambda costs O(n^2) plus the
+   evaluation of the error at the new weights. */
+
+static void lm_gauss_newton(OPTIMIZER *opt, int state)
+{
+  LMGNDATA *lmd = opt->internal;
+  unsigned i, j, n = opt->size;
+  double sum, f0, scale, *w, *g;
+
+  /* Initialize internal state. */
+  if(state == 0) {
+    lmd = opt->internal = xmalloc(sizeof(LMGNDATA));
+    lmd->H = allocate_array(2, sizeof(double), n, n);
+    lmd->S = allocate_array(1, sizeof(double), n);
+    lmd->c = allocate_array(1, sizeof(double), n);
+    lmd->w0 = allocate_array(1, sizeof(double), n);
+    lmd->g = allocate_array(1, sizeof(double), n);
+    lmd->x = allocate_array(1, sizeof(double), n);
+    lmd->lambda = 0.01;
+  }
+  /* Do one Levenberg-Marquardt step... */
+  else if(state == 1) {
+    f0 = opt_eval_grad(opt, NULL);
+    w = opt_weights_vector(opt, lmd->w0);
+    g = opt_grads_vector(opt, lmd->g);
+    if(w != lmd->w0)
+      for(i = 0; i < n; i++)
+	lmd->w0[i] = w[i];
+    if(g != lmd->g)
+      for(i = 0; i < n; i++)
+	lmd->g[i] = g[i];
+    if(opt->hessf(opt->obj, lmd->H) != 0) {
+      opt->engine_result = OPT_BAD_DIRECTION;
+      return;
+    }
+    if(opt->wdecay)
+      for(i = 0; i < n; i++)
+	lmd->H[i][i] += 2 * opt->wdecay;
+
+    /* Factor once.  The columns of H become the eigenvectors. */
+    svd(&lmd->H[0][0], lmd->S, NULL, n, n);
+    for(scale = 0, i = 0; i < n; i++)
+      scale += lmd->S[i] / n;
+    if(scale <= 0)
+      scale = 1;
+    for(j = 0; j < n; j++) {
+      for(sum = 0, i = 0; i < n; i++)
+	sum += lmd->H[i][j] * lmd->g[i];
+      lmd->c[j] = sum;
+    }
+
+    /* The gradient is not needed any more, so it holds the step in
+     * the basis of the eigenvectors.
+     */
+    while(1) {
+      for(j = 0; j < n; j++)
+	lmd->g[j] = lmd->c[j] / (lmd->S[j] + lmd->lambda * scale);
+      for(i = 0; i < n; i++) {
+	for(sum = 0, j = 0; j < n; j++)
+	  sum += lmd->H[i][j] * lmd->g[j];
+	lmd->x[i] = sum;
+      }
+      opt_extend_weights(opt, lmd->w0, lmd->x, -1.0);
+      opt_eval_bounded(opt, NULL, f0);
+
+      if(opt->error < f0) {
+	if(lmd->lambda > 10e-10) lmd->lambda /= 10;
+	opt->engine_result = OPT_SUCCESS;
+	return;
+      }
+      if(lmd->lambda < 10e10)
+	lmd->lambda *= 10;
+      else {
+	/* No luck, so stay put. */
+	opt_set_weights(opt, lmd->w0);
+	opt->error = f0;
+	opt->engine_result = OPT_MIN_DELTA_ERROR;
+	return;
+      }
+    }
+  }
+  /* Clean up. */
+  else if(state == -1) {
+    deallocate_array(lmd->H);
+    deallocate_array(lmd->S);
+    deallocate_array(lmd->c);
+    deallocate_array(lmd->w0);
+    deallocate_array(lmd->g);
+    deallocate_array(lmd->x);
+    xfree(lmd);
+    opt->internal = NULL;
+  }
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+void opt_levenberg_marquardt(OPTIMIZER *opt, int state)
+{
+  if(opt->hessf)
+    lm_gauss_newton(opt, state);
+  else
+    lm_secant(opt, state);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
@@ -6,8 +6,9 @@ unsigned opt_lnsrch_max_bracket_step = 20;
 
 /* Copyright (c) 1995 by G. W. Flake. */
 
-/* This file contains three line searches: cubic interpolation, GMK's
-   hybrid, and golden section, in that order. */
+/* This file contains four line searches: cubic interpolation, GMK's
+   hybrid, golden section, and a parallel search that tries several
+   step sizes at once, in that order. */
 
 /* Cubic interpolation: Original version by RLW.  Modified for
    inclusion into NODElib by GWF.  RLW's original block comments
@@ -328,18 +329,6 @@ static int interpolate(double a1, double f1, double f1_prime, double a2,
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
-static double dot_product_p(double **x, double *y, unsigned sz)
-{
-  unsigned i;
-  double d = 0;
-
-  for(i = 0; i < sz; i++)
-    d += *x[i] * y[i];
-  return(d);
-}
-
-/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
-
 #if 0
 static double dot_product(double *x, double *y, unsigned sz)
 {
@@ -354,12 +343,17 @@ static double dot_product(double *x, double *y, unsigned sz)
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
-static void extend(double **z, double *x, double *y, double a, unsigned sz)
-{
-  unsigned i;
+/* Evaluate the error at a point where the gradient will probably be
+   wanted too.  If the evaluations are being cached, then the gradient
+   comes from the same pass, and a later opt_eval_grad() there is free.
+   Every engine asks for it at the point that a search returns. */
 
-  for(i = 0; i < sz; i++)
-    *z[i] = x[i] + a * y[i];
+static void eval_fused(OPTIMIZER *opt)
+{
+  if(opt->evalcache)
+    opt_eval_grad(opt, NULL);
+  else
+    opt_eval_func(opt, NULL);
 }
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
@@ -375,20 +369,18 @@ double opt_lnsrch_cubic(OPTIMIZER *opt, double *d, double sz)
   double f0, f1, f1_prime, comp, reference, ref_f;
   double *w0;
   int done, f2_ok, succeed, bracket;
-  unsigned i;
   OPT_RESULT result;
 
   f_prime = f1_prime = 0;
 
-  w0 = allocate_array(1, sizeof(double), opt->size);
-  for(i = 0; i < opt->size; i++)
-    w0[i] = *opt->weights[i];
-  f0 = opt->error;
-
-  if((f1_prime = dot_product_p(opt->grads, d, opt->size)) == 0) {
+  if((f1_prime = opt_grad_dot(opt, d)) == 0) {
     opt->stepf_result = OPT_GRAD_DIR_ORTHOGONAL;
     return (0);
   }
+
+  w0 = allocate_array(1, sizeof(double), opt->size);
+  opt_get_weights(opt, w0);
+  f0 = opt->error;
   reference = f1_prime;
 
   a1 = 0;
@@ -420,10 +412,13 @@ double opt_lnsrch_cubic(OPTIMIZER *opt, double *d, double sz)
   done = 0;
   result = OPT_SUCCESS;
   while(!done) {
-    /*  Step 1 : evaluate function at x + alpha * s
+    /*  Step 1 : evaluate function at x + alpha * s.  A trial that
+     *  fails the first test below can stop early, and only the ones
+     *  that pass get a gradient.
      */
-    extend(opt->weights, w0, d, alpha, opt->size);
-    opt_eval_func(opt, NULL);
+    comp = RHO * alpha * reference;
+    opt_extend_weights(opt, w0, d, alpha);
+    opt_eval_grad_bounded(opt, NULL, (ref_f + comp < f1) ? ref_f + comp : f1);
     new_f = opt->error;
     f2_ok = 0;
 
@@ -431,10 +426,8 @@ double opt_lnsrch_cubic(OPTIMIZER *opt, double *d, double sz)
      * (First Goldstein Criterion)
      */
     delta = new_f - ref_f;
-    comp = RHO * alpha * reference;
     if((delta <= comp) && (new_f < f1)) {
-      opt_eval_grad(opt, NULL);
-      f_prime = dot_product_p(opt->grads, d, opt->size);
+      f_prime = opt_grad_dot(opt, d);
       f2_ok = 1;
 
       /* Check termination conditions (Wolfe Test)
@@ -490,10 +483,10 @@ double opt_lnsrch_cubic(OPTIMIZER *opt, double *d, double sz)
   }
   opt->stepf_result = result;
   if(done != 1) {
-    extend(opt->weights, w0, d, alpha, opt->size);
+    opt_extend_weights(opt, w0, d, alpha);
     opt_eval_func(opt, NULL);
     if(f0 < opt->error)
-      extend(opt->weights, w0, d, 0, opt->size);
+      opt_extend_weights(opt, w0, d, 0);
     opt_eval_func(opt, NULL);
   }
   deallocate_array(w0);
@@ -513,19 +506,18 @@ double opt_lnsrch_hybrid(OPTIMIZER *opt, double *d, double sz)
   double poly[3][2], alpha, lasterr;
   double *w0;
   int pi, pc;
-  unsigned i;			      
 
   /* Save original weights. */
   w0 = allocate_array(1, sizeof(double), opt->size);
-  for(i = 0; i < opt->size; i++)
-    w0[i] = *opt->weights[i];
+  opt_get_weights(opt, w0);
 
   /* Use the previous step size, if supplied, else make an educated guess. */
   if(sz > 0)
     alpha = sz;
   else {
-    if((alpha = dot_product_p(opt->grads, d, opt->size)) == 0) {
+    if((alpha = opt_grad_dot(opt, d)) == 0) {
       opt->stepf_result = OPT_GRAD_DIR_ORTHOGONAL;
+      deallocate_array(w0);
       return (0);
     }
     alpha = -2 * opt->error / alpha;
@@ -540,7 +532,7 @@ double opt_lnsrch_hybrid(OPTIMIZER *opt, double *d, double sz)
   pc = 1; pi = 1;
   do {
     lasterr = opt->error;
-    extend(opt->weights, w0, d, alpha, opt->size);
+    opt_extend_weights(opt, w0, d, alpha);
     opt_eval_func(opt, NULL);
     poly[pi][0] = alpha; poly[pi][1] = opt->error;
     pc++; pi = (pi + 1) % 3;
@@ -555,7 +547,7 @@ double opt_lnsrch_hybrid(OPTIMIZER *opt, double *d, double sz)
     do {
       poly[2][0] = poly[1][0]; poly[2][1] = poly[1][1];
       poly[1][0] = alpha = poly[2][0] / 2;
-      extend(opt->weights, w0, d, alpha, opt->size);
+      opt_extend_weights(opt, w0, d, alpha);
       opt_eval_func(opt, NULL);
       poly[1][1] = opt->error;
     }
@@ -583,12 +575,12 @@ double opt_lnsrch_hybrid(OPTIMIZER *opt, double *d, double sz)
 	alpha = -b / (2 * a);
       else
 	alpha = poly[(pi + 1) % 3][0];
-      extend(opt->weights, w0, d, alpha, opt->size);
+      opt_extend_weights(opt, w0, d, alpha);
       opt_eval_func(opt, NULL);
       if(poly[(pi + 1) % 3][1] < opt->error) {
 	alpha = poly[(pi + 1) % 3][0];
-	extend(opt->weights, w0, d, alpha, opt->size);
-	opt_eval_func(opt, NULL);
+	opt_extend_weights(opt, w0, d, alpha);
+	eval_fused(opt);
       }
     }
   }
@@ -606,21 +598,19 @@ double opt_lnsrch_golden(OPTIMIZER *opt, double *d, double sz)
   double poly[3][2], alpha, lasterr;
   double *w0;
   int pi, pc;
-  unsigned i;
 
   /* Save original weights. */
   w0 = allocate_array(1, sizeof(double), opt->size);
-  for(i = 0; i < opt->size; i++)
-    w0[i] = *opt->weights[i];
+  opt_get_weights(opt, w0);
 
   /* Use the previous step size, if supplied, Else, make an educated guess. */
   if(sz > 0)
     alpha = sz;
   else
-    alpha = -2 * opt->error / dot_product_p(opt->grads, d, opt->size);
+    alpha = -2 * opt->error / opt_grad_dot(opt, d);
 
 #if 0
-  alpha = dot_product_p(opt->grads, d, opt->size) /
+  alpha = opt_grad_dot(opt, d) /
     dot_product(d, d, opt->size);
 #endif
 
@@ -633,8 +623,8 @@ double opt_lnsrch_golden(OPTIMIZER *opt, double *d, double sz)
   pc = 1; pi = 1;
   do {
     lasterr = opt->error;
-    extend(opt->weights, w0, d, alpha, opt->size);
-    opt_eval_func(opt, NULL);
+    opt_extend_weights(opt, w0, d, alpha);
+    opt_eval_bounded(opt, NULL, lasterr);
     poly[pi][0] = alpha; poly[pi][1] = opt->error;
     pc++; pi = (pi + 1) % 3;
     alpha = poly[(pi - 2 + 3) % 3][0] +
@@ -649,8 +639,8 @@ double opt_lnsrch_golden(OPTIMIZER *opt, double *d, double sz)
     do {
       poly[2][0] = poly[1][0]; poly[2][1] = poly[1][1];
       poly[1][0] = alpha = C * poly[2][0];
-      extend(opt->weights, w0, d, alpha, opt->size);
-      opt_eval_func(opt, NULL);
+      opt_extend_weights(opt, w0, d, alpha);
+      opt_eval_bounded(opt, NULL, poly[0][1]);
       poly[1][1] = opt->error;
     }
     while(poly[1][1] > poly[0][1]);
@@ -660,6 +650,8 @@ double opt_lnsrch_golden(OPTIMIZER *opt, double *d, double sz)
 
   /* We now have the minimum bracketed in such a way that the middle point
    * obeys the golden ratio for the endpoints.  Now, search in this area.
+   * Only the middle value has to be exact, so the others may be the
+   * estimates of evaluations that gave up early.
    */
   {
     double ax, bx, cx, af, bf, cf, x, f;
@@ -674,8 +666,8 @@ double opt_lnsrch_golden(OPTIMIZER *opt, double *d, double sz)
 	  && count < opt_lnsrch_max_step) {
       if(bx - ax < cx - bx) {
 	alpha = x = bx * R + cx * C;
-	extend(opt->weights, w0, d, x, opt->size);
-	opt_eval_func(opt, NULL);
+	opt_extend_weights(opt, w0, d, x);
+	opt_eval_bounded(opt, NULL, bf);
 	f = opt->error;
 	if(f < bf) {
 	  ax = bx; af = bf;
@@ -687,8 +679,8 @@ double opt_lnsrch_golden(OPTIMIZER *opt, double *d, double sz)
       }
       else {
 	alpha = x = ax * C + bx * R;
-	extend(opt->weights, w0, d, x, opt->size);
-	opt_eval_func(opt, NULL);
+	opt_extend_weights(opt, w0, d, x);
+	opt_eval_bounded(opt, NULL, bf);
 	f = opt->error;
 	if(f < bf) {
 	  cx = bx; cf = bf;
@@ -701,8 +693,8 @@ double opt_lnsrch_golden(OPTIMIZER *opt, double *d, double sz)
       count++;
     }
     if(alpha != bx) {
-      extend(opt->weights, w0, d, bx, opt->size);
-      opt_eval_func(opt, NULL);
+      opt_extend_weights(opt, w0, d, bx);
+      eval_fused(opt);
     }
   }
 
@@ -711,3 +703,149 @@ double opt_lnsrch_golden(OPTIMIZER *opt, double *d, double sz)
 }
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Evaluate the n step sizes in x along d from w0 all at once, using
+   the rows of w to hold the weights, and put the errors in f.  Then
+   merge them into the m points in px and pf, which are kept sorted by
+   step size, and return the new number of points. */
+
+static unsigned par_eval(OPTIMIZER *opt, double *w0, double *d, double **w,
+			 double *x, double *f, unsigned n,
+			 double *px, double *pf, unsigned m)
+{
+  unsigned i, j;
+
+  for(i = 0; i < n; i++)
+    for(j = 0; j < opt->size; j++)
+      w[i][j] = w0[j] + x[i] * d[j];
+  opt_eval_multi(opt, w, n, f);
+  for(i = 0; i < n; i++, m++) {
+    for(j = m; j > 0 && px[j - 1] > x[i]; j--) {
+      px[j] = px[j - 1]; pf[j] = pf[j - 1];
+    }
+    px[j] = x[i]; pf[j] = f[i];
+  }
+  return(m);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Returns the index of the lowest of the m values in pf. */
+
+static unsigned par_best(double *pf, unsigned m)
+{
+  unsigned i, best = 0;
+
+  for(i = 1; i < m; i++)
+    if(pf[i] < pf[best]) best = i;
+  return(best);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+double opt_lnsrch_parallel(OPTIMIZER *opt, double *d, double sz)
+{
+  double *w0, **w, *x, *f, *px, *pf, alpha, a, b, c, fa, fb, fc, num, den;
+  double last;
+  unsigned i, j, k, m, best, n, nl, count;
+
+  /* Use the previous step size, if supplied, else make an educated guess. */
+  if(sz > 0)
+    alpha = sz;
+  else {
+    if((alpha = opt_grad_dot(opt, d)) == 0) {
+      opt->stepf_result = OPT_GRAD_DIR_ORTHOGONAL;
+      return(0);
+    }
+    alpha = -2 * opt->error / alpha;
+  }
+
+  k = (opt->points > 1) ? opt->points : 2;
+  m = 1 + k * (opt_lnsrch_max_bracket_step + opt_lnsrch_max_steps);
+  w0 = allocate_array(1, sizeof(double), opt->size);
+  w = allocate_array(2, sizeof(double), k, opt->size);
+  x = allocate_array(1, sizeof(double), k);
+  f = allocate_array(1, sizeof(double), k);
+  px = allocate_array(1, sizeof(double), m);
+  pf = allocate_array(1, sizeof(double), m);
+  opt_get_weights(opt, w0);
+  opt->stepf_result = OPT_SUCCESS;
+
+  /* Every point tried so far is kept in px and pf, starting with a
+   * step of zero.  The first batch straddles alpha, and later ones
+   * keep doubling (or halving) past the largest (or smallest) step
+   * until the best point has a worse point on either side.
+   */
+  px[0] = 0.0; pf[0] = opt->error;
+  m = 1; best = 0;
+  for(count = 0; best == 0 || best == m - 1; count++) {
+    if(count >= opt_lnsrch_max_bracket_step)
+      break;
+    for(i = 0; i < k; i++)
+      if(m == 1)
+	x[i] = ldexp(alpha, (int) i - (int) (k - 1) / 2);
+      else if(best == 0)
+	x[i] = ldexp(px[1], -(int) (i + 1));
+      else
+	x[i] = ldexp(px[best], i + 1);
+    m = par_eval(opt, w0, d, w, x, f, k, px, pf, m);
+    best = par_best(pf, m);
+  }
+  if(best == 0)
+    opt->stepf_result = OPT_BRACKET_FAILED;
+  else if(best == m - 1)
+    opt->stepf_result = OPT_MAX_LINE_STEPS;
+
+  /* Shrink the bracket around the best point.  One trial goes to the
+   * bottom of the parabola through the best point and its neighbours
+   * (if that lies inside of the bracket), and the rest are spread
+   * over the two sides in proportion to their widths.  Stop once the
+   * bracket is narrow next to the step, or once a batch adds little
+   * to the drop in the error so far.
+   */
+  last = pf[0];
+  for(count = 0; best > 0 && best < m - 1; count++) {
+    a = px[best - 1]; fa = pf[best - 1];
+    b = px[best];     fb = pf[best];
+    c = px[best + 1]; fc = pf[best + 1];
+    if(c - a <= opt_lnsrch_min_relative_change * b ||
+       last - fb <= opt_lnsrch_min_relative_change * (pf[0] - fb) ||
+       count >= opt_lnsrch_max_steps)
+      break;
+    last = fb;
+    j = 0;
+    num = (b - a) * (b - a) * (fb - fc) - (b - c) * (b - c) * (fb - fa);
+    den = (b - a) * (fb - fc) - (b - c) * (fb - fa);
+    if(den != 0) {
+      x[0] = b - 0.5 * num / den;
+      if(x[0] > a && x[0] < c && fabs(x[0] - b) > EPSILON10 * (c - a))
+	j = 1;
+    }
+    n = k - j;
+    nl = (unsigned) (n * (b - a) / (c - a) + 0.5);
+    if(n > 1 && nl == 0) nl = 1;
+    if(n > 1 && nl == n) nl = n - 1;
+    for(i = 1; i <= nl; i++)
+      x[j++] = a + (b - a) * i / (nl + 1);
+    for(i = 1; i <= n - nl; i++)
+      x[j++] = b + (c - b) * i / (n - nl + 1);
+    m = par_eval(opt, w0, d, w, x, f, k, px, pf, m);
+    best = par_best(pf, m);
+  }
+
+  alpha = px[best];
+  opt_extend_weights(opt, w0, d, alpha);
+  eval_fused(opt);
+
+  deallocate_array(w0);
+  deallocate_array(w);
+  deallocate_array(x);
+  deallocate_array(f);
+  deallocate_array(px);
+  deallocate_array(pf);
+  return(alpha);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
@@ -108,6 +108,34 @@ void *allocate_array(size_t dim, size_t elemsz, ...)
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
+void *allocate_array_view(void *data, size_t dim, size_t elemsz, ...)
+{
+  va_list args;
+  size_t mtotal = 1, ptotal = 0;
+  unsigned i, *sizes;
+  char *pointers, *cdata;
+  void *result;
+
+  if(dim == 1)
+    return(data);
+  sizes = xmalloc(sizeof(unsigned) * dim);
+  va_start(args, elemsz);
+  for(i = 0; i < dim; i++) {
+    sizes[i] = va_arg(args, int);
+    mtotal *= sizes[i];
+    if(i < dim - 1)
+      ptotal += mtotal;
+  }
+  va_end(args);
+  pointers = xmalloc(ptotal * sizeof(void *));
+  cdata = data;
+  result = get_space(dim, elemsz, sizes, &pointers, &cdata);
+  xfree(sizes);
+  return(result);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
 void deallocate_array(void *ptr)
 {
   xfree(ptr);
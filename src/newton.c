@@ -11,7 +11,7 @@
 #include "nodelib/optimize.h"
 
 typedef struct QNDATA {
-  double *xd, *gd, *xo, *go, *hg, *u, *d;
+  double *xd, *gd, *xo, *go, *hg, *u, *d, *wt, *gt;
   double **xdc, **hgc, **uc, **ho, **hn;
 } QNDATA;
 
@@ -21,7 +21,7 @@ static void generic_quasinewton(OPTIMIZER *opt, int state, int BFGS)
 {
   QNDATA *qnd = opt->internal;
   unsigned i, j, n = opt->size;
-  double **t, sum, xdgd, gdhd;
+  double **t, sum, xdgd, gdhd, *w, *g;
 
   /* Initialize internal state. */
   if(state == 0) {
@@ -33,6 +33,8 @@ static void generic_quasinewton(OPTIMIZER *opt, int state, int BFGS)
     qnd->hg = allocate_array(1, sizeof(double), n);
     qnd->u = allocate_array(1, sizeof(double), n);
     qnd->d = allocate_array(1, sizeof(double), n);
+    qnd->wt = allocate_array(1, sizeof(double), n);
+    qnd->gt = allocate_array(1, sizeof(double), n);
     qnd->xdc = allocate_array(2, sizeof(double), n, n);
     qnd->hgc = allocate_array(2, sizeof(double), n, n);
     qnd->uc = allocate_array(2, sizeof(double), n, n);
@@ -49,10 +51,12 @@ static void generic_quasinewton(OPTIMIZER *opt, int state, int BFGS)
   /* Do one quasi-Newton step. */
   else if(state == 1) {
     opt_eval_grad(opt, NULL);
+    w = opt_weights_vector(opt, qnd->wt);
+    g = opt_grads_vector(opt, qnd->gt);
 
     for(i = 0; i < n; i++) {
-      qnd->xd[i] = *opt->weights[i] - qnd->xo[i];
-      qnd->gd[i] = *opt->grads[i] - qnd->go[i];
+      qnd->xd[i] = w[i] - qnd->xo[i];
+      qnd->gd[i] = g[i] - qnd->go[i];
     }
     for(i = 0; i < n; i++) {
       for(sum = 0, j = 0; j < n; j++)
@@ -92,13 +96,13 @@ static void generic_quasinewton(OPTIMIZER *opt, int state, int BFGS)
     for(i = 0; i < n; i++) {
       sum = 0;
       for(j = 0; j < n; j++)
-	sum += qnd->ho[i][j] * *opt->grads[j];
+	sum += qnd->ho[i][j] * g[j];
       qnd->d[i] = -sum;
     }
    
     for(i = 0; i < n; i++) {
-      qnd->go[i] = *opt->grads[i];
-      qnd->xo[i] = *opt->weights[i];
+      qnd->go[i] = g[i];
+      qnd->xo[i] = w[i];
     }
 
     t = qnd->ho; qnd->ho = qnd->hn; qnd->hn = t;
@@ -115,6 +119,8 @@ static void generic_quasinewton(OPTIMIZER *opt, int state, int BFGS)
     deallocate_array(qnd->xo);
     deallocate_array(qnd->u);
     deallocate_array(qnd->d);
+    deallocate_array(qnd->wt);
+    deallocate_array(qnd->gt);
     deallocate_array(qnd->xdc);
     deallocate_array(qnd->hgc);
     deallocate_array(qnd->uc);
@@ -141,3 +147,328 @@ void opt_quasinewton_bfgs(OPTIMIZER *opt, int state)
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
+
+/* The state of the limited memory BFGS engine.  The last m steps in
+   weight space and in the gradient are kept in the rows of s and y,
+   as a ring whose newest entry is row newest, along with 1 / (s . y)
+   in rho.  The others are the previous weights and gradient, the
+   search direction, the two loop coefficients, and buffers. */
+
+typedef struct LBFGSDATA {
+  double **s, **y, *rho, *alpha, *xo, *go, *d, *wt, *gt;
+  unsigned m, count, newest;
+} LBFGSDATA;
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+static double lbfgs_dot(double *a, double *b, unsigned n)
+{
+  unsigned i;
+  double sum = 0;
+
+  for(i = 0; i < n; i++)
+    sum += a[i] * b[i];
+  return(sum);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Put -H g in d, where H is the inverse Hessian approximation that is
+   implied by the stored pairs, via the two loop recursion.  The
+   scaling of the starting matrix comes from the newest pair. */
+
+static void lbfgs_direction(LBFGSDATA *lb, double *g, unsigned n)
+{
+  unsigned i, j, k;
+  double gamma, beta, *d = lb->d;
+
+  for(i = 0; i < n; i++)
+    d[i] = -g[i];
+  for(k = 0; k < lb->count; k++) {
+    j = (lb->newest + lb->m - k) % lb->m;
+    lb->alpha[j] = lb->rho[j] * lbfgs_dot(lb->s[j], d, n);
+    for(i = 0; i < n; i++)
+      d[i] -= lb->alpha[j] * lb->y[j][i];
+  }
+  if(lb->count > 0) {
+    j = lb->newest;
+    gamma = 1 / (lb->rho[j] * lbfgs_dot(lb->y[j], lb->y[j], n));
+    for(i = 0; i < n; i++)
+      d[i] *= gamma;
+  }
+  for(k = lb->count; k > 0; k--) {
+    j = (lb->newest + lb->m - k + 1) % lb->m;
+    beta = lb->rho[j] * lbfgs_dot(lb->y[j], d, n);
+    for(i = 0; i < n; i++)
+      d[i] += (lb->alpha[j] - beta) * lb->s[j][i];
+  }
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+void opt_lbfgs(OPTIMIZER *opt, int state)
+{
+  LBFGSDATA *lb = opt->internal;
+  unsigned i, j, n = opt->size;
+  double sy, *w, *g;
+
+  /* Initialize internal state. */
+  if(state == 0) {
+    lb = opt->internal = xmalloc(sizeof(LBFGSDATA));
+    lb->m = (opt->history == 0) ? 1 : opt->history;
+    lb->s = allocate_array(2, sizeof(double), lb->m, n);
+    lb->y = allocate_array(2, sizeof(double), lb->m, n);
+    lb->rho = allocate_array(1, sizeof(double), lb->m);
+    lb->alpha = allocate_array(1, sizeof(double), lb->m);
+    lb->xo = allocate_array(1, sizeof(double), n);
+    lb->go = allocate_array(1, sizeof(double), n);
+    lb->d = allocate_array(1, sizeof(double), n);
+    lb->wt = allocate_array(1, sizeof(double), n);
+    lb->gt = allocate_array(1, sizeof(double), n);
+    lb->count = lb->newest = 0;
+    opt->stepsz = 0.0;
+  }
+  /* Do one quasi-Newton step. */
+  else if(state == 1) {
+    opt_eval_grad(opt, NULL);
+    w = opt_weights_vector(opt, lb->wt);
+    g = opt_grads_vector(opt, lb->gt);
+
+    /* Remember the last step, but only if it has the positive
+     * curvature that keeps the approximation positive definite.  The
+     * step is made in xo and go, so that a rejected one never
+     * overwrites the oldest pair in the ring.
+     */
+    if(opt->epoch > 1) {
+      for(i = 0; i < n; i++) {
+	lb->xo[i] = w[i] - lb->xo[i];
+	lb->go[i] = g[i] - lb->go[i];
+      }
+      sy = lbfgs_dot(lb->xo, lb->go, n);
+      if(sy > 1e-10 * sqrt(lbfgs_dot(lb->go, lb->go, n) *
+			   lbfgs_dot(lb->xo, lb->xo, n))) {
+	j = (lb->newest + 1) % lb->m;
+	for(i = 0; i < n; i++) {
+	  lb->s[j][i] = lb->xo[i];
+	  lb->y[j][i] = lb->go[i];
+	}
+	lb->rho[j] = 1 / sy;
+	lb->newest = j;
+	if(lb->count < lb->m)
+	  lb->count++;
+      }
+    }
+    for(i = 0; i < n; i++) {
+      lb->xo[i] = w[i];
+      lb->go[i] = g[i];
+    }
+
+    /* Start over with steepest descent if the direction is bad. */
+    lbfgs_direction(lb, g, n);
+    if(lbfgs_dot(lb->d, g, n) >= 0) {
+      lb->count = 0;
+      lbfgs_direction(lb, g, n);
+    }
+
+    /* Once there is some curvature information, the natural step
+     * is one; before that, let the line search make a guess.
+     */
+    opt->stepsz = (lb->count > 0) ? 1.0 : 0.0;
+    opt->stepsz = (opt->stepf ? opt->stepf(opt, lb->d, opt->stepsz) :
+      opt_lnsrch_cubic(opt, lb->d, opt->stepsz));
+  }
+  /* Clean up. */
+  else if(state == -1) {
+    deallocate_array(lb->s);
+    deallocate_array(lb->y);
+    deallocate_array(lb->rho);
+    deallocate_array(lb->alpha);
+    deallocate_array(lb->xo);
+    deallocate_array(lb->go);
+    deallocate_array(lb->d);
+    deallocate_array(lb->wt);
+    deallocate_array(lb->gt);
+    xfree(lb);
+    opt->internal = NULL;
+  }
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* The state of the Hessian-free engine: the weights and gradient at
+   the start of the step, the step itself, the residual, direction,
+   and curvature times direction of the inner conjugate gradient
+   solve, the patterns of the curvature batch, and the damping. */
+
+typedef struct HFDATA {
+  double *w0, *g, *d, *r, *p, *Ap, lambda;
+  unsigned *perm, *index;
+} HFDATA;
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+static int hf_compare(const void *a, const void *b)
+{
+  unsigned x = *(const unsigned *)a, y = *(const unsigned *)b;
+
+  return((x < y) ? -1 : (x > y));
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Put an approximate solution of (B + lambda I) d = -g in hf->d with
+   at most opt->inner steps of conjugate gradients, where B v is
+   opt->hvf() plus weight decay over the m patterns in index.  The
+   residual only has to shrink by a factor of min(1/2, |g|), so steps
+   far from a minimum are cheap and those near one are nearly exact.
+   The solve stops early at a direction of nonpositive curvature.  The
+   number of steps taken is returned. */
+
+static unsigned hf_solve(OPTIMIZER *opt, HFDATA *hf, unsigned *index,
+			 unsigned m)
+{
+  unsigned i, k, n = opt->size;
+  double rr, rrnew, pAp, alpha, tol, damp;
+
+  damp = hf->lambda + 2 * opt->wdecay;
+  for(i = 0; i < n; i++) {
+    hf->d[i] = 0.0;
+    hf->r[i] = hf->p[i] = -hf->g[i];
+  }
+  rr = lbfgs_dot(hf->r, hf->r, n);
+  tol = sqrt(rr) * ((sqrt(rr) < 0.5) ? sqrt(rr) : 0.5);
+  for(k = 0; k < opt->inner && sqrt(rr) > tol; k++) {
+    if(opt->hvf(opt->obj, index, m, hf->p, hf->Ap) != 0)
+      break;
+    for(i = 0; i < n; i++)
+      hf->Ap[i] += damp * hf->p[i];
+    pAp = lbfgs_dot(hf->p, hf->Ap, n);
+    if(pAp <= 0)
+      break;
+    alpha = rr / pAp;
+    for(i = 0; i < n; i++) {
+      hf->d[i] += alpha * hf->p[i];
+      hf->r[i] -= alpha * hf->Ap[i];
+    }
+    rrnew = lbfgs_dot(hf->r, hf->r, n);
+    for(i = 0; i < n; i++)
+      hf->p[i] = hf->r[i] + (rrnew / rr) * hf->p[i];
+    rr = rrnew;
+  }
+  return(k);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+void opt_hessian_free(OPTIMIZER *opt, int state)
+{
+  HFDATA *hf = opt->internal;
+  unsigned i, j, k, m, *index, n = opt->size;
+  double f0, q, rho, t, *w, *g;
+
+  /* Initialize internal state. */
+  if(state == 0) {
+    hf = opt->internal = xmalloc(sizeof(HFDATA));
+    hf->w0 = allocate_array(1, sizeof(double), n);
+    hf->g = allocate_array(1, sizeof(double), n);
+    hf->d = allocate_array(1, sizeof(double), n);
+    hf->r = allocate_array(1, sizeof(double), n);
+    hf->p = allocate_array(1, sizeof(double), n);
+    hf->Ap = allocate_array(1, sizeof(double), n);
+    hf->perm = hf->index = NULL;
+    if(opt->batch > 0 && opt->batch < opt->numpats) {
+      hf->perm = allocate_array(1, sizeof(unsigned), opt->numpats);
+      hf->index = allocate_array(1, sizeof(unsigned), opt->batch);
+      for(i = 0; i < opt->numpats; i++)
+	hf->perm[i] = i;
+    }
+    hf->lambda = 1.0;
+  }
+  /* Do one truncated Newton step... */
+  else if(state == 1) {
+    if(!opt->hvf) {
+      opt->engine_result = OPT_BAD_DIRECTION;
+      return;
+    }
+    f0 = opt_eval_grad(opt, NULL);
+    w = opt_weights_vector(opt, hf->w0);
+    g = opt_grads_vector(opt, hf->g);
+    if(w != hf->w0)
+      for(i = 0; i < n; i++)
+	hf->w0[i] = w[i];
+    if(g != hf->g)
+      for(i = 0; i < n; i++)
+	hf->g[i] = g[i];
+
+    /* A fresh random subset of the patterns for the curvature. */
+    index = NULL;
+    m = 0;
+    if(hf->perm) {
+      m = opt->batch;
+      for(i = 0; i < m; i++) {
+	j = i + random() % (opt->numpats - i);
+	k = hf->perm[i]; hf->perm[i] = hf->perm[j]; hf->perm[j] = k;
+	hf->index[i] = hf->perm[i];
+      }
+      qsort(hf->index, m, sizeof(unsigned), hf_compare);
+      index = hf->index;
+    }
+
+    /* The decrease predicted by the quadratic model is g'd + d'Bd / 2,
+     * and since r = -g - Bd, that is (g'd - r'd) / 2.  With no
+     * usable curvature at all, fall back to steepest descent.
+     */
+    if(hf_solve(opt, hf, index, m) > 0)
+      q = 0.5 * (lbfgs_dot(hf->g, hf->d, n) - lbfgs_dot(hf->r, hf->d, n));
+    else {
+      for(i = 0; i < n; i++)
+	hf->d[i] = -hf->g[i] / hf->lambda;
+      q = -lbfgs_dot(hf->g, hf->g, n) / hf->lambda;
+    }
+    if(q >= 0) {
+      opt->engine_result = OPT_BAD_DIRECTION;
+      return;
+    }
+
+    /* Back off until the error goes down, and adjust the damping by
+     * how well the model predicted the full step.
+     */
+    for(t = 1.0, k = 0; k < 10; k++, t *= 0.5) {
+      opt_extend_weights(opt, hf->w0, hf->d, t);
+      opt_eval_bounded(opt, NULL, f0);
+      if(opt->error < f0) {
+	rho = (k == 0) ? (opt->error - f0) / q : 0.0;
+	if(rho < 0.25 && hf->lambda < 1e10)
+	  hf->lambda *= 1.5;
+	else if(rho > 0.75 && hf->lambda > 1e-10)
+	  hf->lambda *= 2.0 / 3.0;
+	opt->stepsz = t;
+	opt->engine_result = OPT_SUCCESS;
+	return;
+      }
+    }
+    /* No luck, so stay put. */
+    if(hf->lambda < 1e10)
+      hf->lambda *= 1.5;
+    opt_set_weights(opt, hf->w0);
+    opt->error = f0;
+    opt->engine_result = OPT_MIN_DELTA_ERROR;
+  }
+  /* Clean up. */
+  else if(state == -1) {
+    deallocate_array(hf->w0);
+    deallocate_array(hf->g);
+    deallocate_array(hf->d);
+    deallocate_array(hf->r);
+    deallocate_array(hf->p);
+    deallocate_array(hf->Ap);
+    if(hf->perm) {
+      deallocate_array(hf->perm);
+      deallocate_array(hf->index);
+    }
+    xfree(hf);
+    opt->internal = NULL;
+  }
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
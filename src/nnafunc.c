@@ -15,6 +15,15 @@ static void afinit(void);
 
 #define SGN(x) ((x < 0) ? -1 : 1)
 
+/* The fast versions of the builtin activation functions live with the
+   other vectorized kernels in nnkern.c, if there are any. */
+
+#ifdef NL_KERNEL_VECTORS
+#define FAST(name) nn_kern_fast_ ## name
+#else
+#define FAST(name) NULL
+#endif
+
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
 NN_ACTFUNC *nn_set_actfunc(NN *nn, unsigned layer, unsigned slab, char *name)
@@ -33,6 +42,16 @@ NN_ACTFUNC *nn_set_actfunc(NN *nn, unsigned layer, unsigned slab, char *name)
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
+int nn_set_actfunc_fast(NN *nn, unsigned layer, unsigned slab, int fast)
+{
+  if(nn_check_valid_slab(nn, layer, slab))
+    return(1);
+  nn->layers[layer].slabs[slab].fastact = (fast != 0);
+  return(0);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
 void nn_register_actfunc(char *name,
 			 double (*func)(double input),
 			 double (*deriv)(double input, double output),
@@ -58,6 +77,33 @@ void nn_register_actfunc(char *name,
     afx->second_deriv = second_deriv;
     hash_insert(afhash, afx);
   }
+  afx->func_vec = NULL;
+  afx->deriv_vec = NULL;
+  afx->fast_vec = NULL;
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+int nn_register_actfunc_vec(char *name,
+			    void (*func_vec)(double *x, double *y,
+					     unsigned n),
+			    void (*deriv_vec)(double *x, double *y,
+					      double *dy, double *dx,
+					      unsigned n),
+			    void (*fast_vec)(double *x, double *y,
+					     unsigned n))
+{
+  NN_ACTFUNC *afx;
+
+  if((afx = nn_find_actfunc(name)) == NULL) {
+    ulog(ULOG_ERROR, "nn_register_actfunc_vec: unknown activation function"
+	 " '%s'.", name);
+    return(1);
+  }
+  afx->func_vec = func_vec;
+  afx->deriv_vec = deriv_vec;
+  afx->fast_vec = fast_vec;
+  return(0);
 }
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
@@ -73,6 +119,42 @@ NN_ACTFUNC *nn_find_actfunc(char *name)
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
+/* Map n net inputs of a slab through its activation function, using
+   the fastest version that the slab allows. */
+
+void nn_actfunc_forward(NN_LAYER *slab, double *x, double *y, unsigned n)
+{
+  NN_ACTFUNC *af = slab->afunc;
+  unsigned k;
+
+  if(slab->fastact && af->fast_vec)
+    af->fast_vec(x, y, n);
+  else if(af->func_vec)
+    af->func_vec(x, y, n);
+  else
+    for(k = 0; k < n; k++)
+      y[k] = af->func(x[k]);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Likewise, but for dx = dy * f'(x). */
+
+void nn_actfunc_backward(NN_LAYER *slab, double *x, double *y, double *dy,
+			 double *dx, unsigned n)
+{
+  NN_ACTFUNC *af = slab->afunc;
+  unsigned k;
+
+  if(af->deriv_vec)
+    af->deriv_vec(x, y, dy, dx, n);
+  else
+    for(k = 0; k < n; k++)
+      dx[k] = dy[k] * af->deriv(x[k], y[k]);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
 static void free_actfunc(void *af)
 { 
   xfree(af);
@@ -111,6 +193,27 @@ static double aftanhdd(double in, double out, double deriv)
   return(-2 * deriv * out);
 }
 
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+static void aftanhfv(double *x, double *y, unsigned n)
+{
+  unsigned k;
+
+  for(k = 0; k < n; k++)
+    y[k] = tanh(x[k]);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+static void aftanhdv(double *x, double *y, double *dy, double *dx,
+		     unsigned n)
+{
+  unsigned k;
+
+  for(k = 0; k < n; k++)
+    dx[k] = dy[k] * ((1 + y[k]) * (1 - y[k]));
+}
+
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 /* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
@@ -134,6 +237,27 @@ static double afsindd(double in, double out, double deriv)
   return(-out);
 }
 
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+static void afsinfv(double *x, double *y, unsigned n)
+{
+  unsigned k;
+
+  for(k = 0; k < n; k++)
+    y[k] = sin(x[k]);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+static void afsindv(double *x, double *y, double *dy, double *dx,
+		    unsigned n)
+{
+  unsigned k;
+
+  for(k = 0; k < n; k++)
+    dx[k] = dy[k] * cos(x[k]);
+}
+
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 /* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
@@ -157,6 +281,27 @@ static double afcosdd(double in, double out, double deriv)
   return(-out);
 }
 
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+static void afcosfv(double *x, double *y, unsigned n)
+{
+  unsigned k;
+
+  for(k = 0; k < n; k++)
+    y[k] = cos(x[k]);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+static void afcosdv(double *x, double *y, double *dy, double *dx,
+		    unsigned n)
+{
+  unsigned k;
+
+  for(k = 0; k < n; k++)
+    dx[k] = dy[k] * -sin(x[k]);
+}
+
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 /* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
@@ -184,6 +329,27 @@ static double aflogisticdd(double in, double out, double deriv)
   return(deriv * (1 - 2 * out));
 }
 
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+static void aflogisticfv(double *x, double *y, unsigned n)
+{
+  unsigned k;
+
+  for(k = 0; k < n; k++)
+    y[k] = aflogisticf(x[k]);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+static void aflogisticdv(double *x, double *y, double *dy, double *dx,
+			 unsigned n)
+{
+  unsigned k;
+
+  for(k = 0; k < n; k++)
+    dx[k] = dy[k] * (y[k] * (1 - y[k]));
+}
+
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 /* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
@@ -207,6 +373,27 @@ static double afgaussdd(double in, double out, double deriv)
   return(-2.0 * (out + deriv * in));
 }
 
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+static void afgaussfv(double *x, double *y, unsigned n)
+{
+  unsigned k;
+
+  for(k = 0; k < n; k++)
+    y[k] = exp(-x[k]*x[k]);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+static void afgaussdv(double *x, double *y, double *dy, double *dx,
+		      unsigned n)
+{
+  unsigned k;
+
+  for(k = 0; k < n; k++)
+    dx[k] = dy[k] * (-2.0 * y[k] * x[k]);
+}
+
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 /* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
@@ -230,6 +417,27 @@ static double afexpdd(double in, double out, double deriv)
   return(deriv);
 }
 
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+static void afexpfv(double *x, double *y, unsigned n)
+{
+  unsigned k;
+
+  for(k = 0; k < n; k++)
+    y[k] = exp(x[k]);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+static void afexpdv(double *x, double *y, double *dy, double *dx,
+		    unsigned n)
+{
+  unsigned k;
+
+  for(k = 0; k < n; k++)
+    dx[k] = dy[k] * y[k];
+}
+
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 /* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
@@ -253,6 +461,27 @@ static double afexpnxdd(double in, double out, double deriv)
   return(out);
 }
 
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+static void afexpnxfv(double *x, double *y, unsigned n)
+{
+  unsigned k;
+
+  for(k = 0; k < n; k++)
+    y[k] = exp(-x[k]);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+static void afexpnxdv(double *x, double *y, double *dy, double *dx,
+		      unsigned n)
+{
+  unsigned k;
+
+  for(k = 0; k < n; k++)
+    dx[k] = dy[k] * -y[k];
+}
+
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 /* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
@@ -276,6 +505,27 @@ static double aflineardd(double in, double out, double deriv)
   return(0);
 }
 
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+static void aflinearfv(double *x, double *y, unsigned n)
+{
+  unsigned k;
+
+  for(k = 0; k < n; k++)
+    y[k] = x[k];
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+static void aflineardv(double *x, double *y, double *dy, double *dx,
+		       unsigned n)
+{
+  unsigned k;
+
+  for(k = 0; k < n; k++)
+    dx[k] = dy[k] * 1;
+}
+
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 /* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
@@ -316,6 +566,23 @@ static void afinit(void)
     nn_register_actfunc("sine", afsinf, afsind, afsindd);
     nn_register_actfunc("cos", afcosf, afcosd, afcosdd);
     nn_register_actfunc("cosine", afcosf, afcosd, afcosdd);
+
+    nn_register_actfunc_vec("logistic", aflogisticfv, aflogisticdv,
+			    FAST(logistic));
+    nn_register_actfunc_vec("sigmoid", aflogisticfv, aflogisticdv,
+			    FAST(logistic));
+    nn_register_actfunc_vec("tanh", aftanhfv, aftanhdv, FAST(tanh));
+    nn_register_actfunc_vec("gauss", afgaussfv, afgaussdv, FAST(gauss));
+    nn_register_actfunc_vec("gaussian", afgaussfv, afgaussdv, FAST(gauss));
+    nn_register_actfunc_vec("exp", afexpfv, afexpdv, FAST(exp));
+    nn_register_actfunc_vec("exp(-x)", afexpnxfv, afexpnxdv, FAST(expnx));
+    nn_register_actfunc_vec("lin", aflinearfv, aflineardv, NULL);
+    nn_register_actfunc_vec("none", aflinearfv, aflineardv, NULL);
+    nn_register_actfunc_vec("linear", aflinearfv, aflineardv, NULL);
+    nn_register_actfunc_vec("sin", afsinfv, afsindv, NULL);
+    nn_register_actfunc_vec("sine", afsinfv, afsindv, NULL);
+    nn_register_actfunc_vec("cos", afcosfv, afcosdv, NULL);
+    nn_register_actfunc_vec("cosine", afcosfv, afcosdv, NULL);
   }
 }
 
@@ -1,6 +1,7 @@
 
 /* Copyright (c) 1995 by G. W. Flake. */
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <ctype.h>
 #include <stdarg.h>
@@ -18,6 +19,10 @@ char *vsprintf(char *, char *, va_list);
 #include "nodelib/optimize.h"
 #include "nodelib/errfunc.h"
 
+#ifdef NL_MMAP
+#include <sys/mman.h>
+#endif
+
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
 /* This function will take a format string that look like:
@@ -148,6 +153,7 @@ NN *nn_create(char *format, ...)
 
   nn->info.train_set = nn->info.test_set = NULL;
   nn->info.error_function = opt_err_quadratic;
+  nn->info.error_vector = NULL;
   nn->info.opt = OPTIMIZER_DEFAULT;
   nn->info.opt.owner = nn;
   nn->info.subsample = 0;
@@ -194,20 +200,12 @@ NN *nn_create(char *format, ...)
     nn->layers[i].y   = xcalloc(numnodes, sizeof(double));
     nn->layers[i].dx  = xcalloc(numnodes, sizeof(double));
     nn->layers[i].dy  = xcalloc(numnodes, sizeof(double));
-    nn->layers[i].Rx  = xcalloc(numnodes, sizeof(double));
-    nn->layers[i].Ry  = xcalloc(numnodes, sizeof(double));
-    nn->layers[i].Rdx = xcalloc(numnodes, sizeof(double));
-    nn->layers[i].Rdy = xcalloc(numnodes, sizeof(double));
     numnodes = 0;
     for(j = 0; j < numslabs; j++) {
       nn->layers[i].slabs[j].x   = nn->layers[i].x  + numnodes;
       nn->layers[i].slabs[j].y   = nn->layers[i].y  + numnodes;
       nn->layers[i].slabs[j].dx  = nn->layers[i].dx + numnodes;
       nn->layers[i].slabs[j].dy  = nn->layers[i].dy + numnodes;
-      nn->layers[i].slabs[j].Rx  = nn->layers[i].Rx  + numnodes;
-      nn->layers[i].slabs[j].Ry  = nn->layers[i].Ry  + numnodes;
-      nn->layers[i].slabs[j].Rdx = nn->layers[i].Rdx + numnodes;
-      nn->layers[i].slabs[j].Rdy = nn->layers[i].Rdy + numnodes;
       numnodes += nn->layers[i].slabs[j].sz;
     }
   }
@@ -221,12 +219,21 @@ NN *nn_create(char *format, ...)
   nn->dx = nn->layers[0].dx;
   nn->dy = nn->layers[numlayers - 1].dy;
 
-  nn->Rx = nn->layers[0].Rx;
-  nn->Ry = nn->layers[numlayers - 1].Ry;
-  nn->Rdx = nn->layers[0].Rdx;
-  nn->Rdy = nn->layers[numlayers - 1].Rdy;
+  /* The R variables are made by nn_alloc_R() when first needed. */
+  nn->Rx = nn->Ry = nn->Rdx = nn->Rdy = NULL;
   
   nn->weights = nn->grads = NULL;
+  nn->wvec = nn->gvec = NULL;
+  nn->wbuf = NULL;
+  nn->map = NULL;
+  nn->mapsz = 0;
+  nn->packed = 0;
+  nn->replicas = NULL;
+  nn->numreplicas = 0;
+  nn->plan = NULL;
+  nn->compiled = 0;
+  nn->single = 0;
+  nn->frozen = 0;
 
   xfree(nninfo);
   xfree(buffer);
@@ -235,54 +242,216 @@ NN *nn_create(char *format, ...)
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
+/* Free *array (if there is one) and clear it. */
+
+static void free_deriv(void *array)
+{
+  void **hold = array;
+
+  if(*hold) {
+    xfree(*hold);
+    *hold = NULL;
+  }
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Free everything that only the backward and R passes use, and leave
+   NULL in its place.  The derivatives of a packed link are views, so
+   only the views are freed; the space itself lives in nn->wbuf. */
+
+void nn_free_derivs(NN *nn)
+{
+  NN_LINK *link;
+  NN_LAYER *layer;
+  unsigned i, j;
+
+  nn_free_R(nn);
+  for(i = 0; i < nn->numlinks; i++) {
+    link = nn->links[i];
+    free_deriv(&link->dA);
+    free_deriv(&link->du);
+    free_deriv(&link->dv);
+    free_deriv(&link->dw);
+    if(link->packed)
+      link->da = link->db = NULL;
+    else {
+      free_deriv(&link->da);
+      free_deriv(&link->db);
+    }
+  }
+
+  for(i = 0; i < nn->numlayers; i++) {
+    layer = &nn->layers[i];
+    free_deriv(&layer->dx);
+    free_deriv(&layer->dy);
+    free_deriv(&layer->Bdx);
+    free_deriv(&layer->Bdy);
+    for(j = 0; j < layer->numslabs; j++) {
+      layer->slabs[j].dx = layer->slabs[j].dy = NULL;
+      layer->slabs[j].Bdx = layer->slabs[j].Bdy = NULL;
+    }
+  }
+  nn->dx = nn->dy = NULL;
+  nn->Bdx = nn->Bdy = NULL;
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+void nn_free_R(NN *nn)
+{
+  NN_LINK *link;
+  NN_LAYER *layer;
+  unsigned i, j;
+
+  for(i = 0; i < nn->numlinks; i++) {
+    link = nn->links[i];
+    free_deriv(&link->RA);
+    free_deriv(&link->RdA);
+    free_deriv(&link->Ru);
+    free_deriv(&link->Rdu);
+    free_deriv(&link->Rv);
+    free_deriv(&link->Rdv);
+    free_deriv(&link->Rw);
+    free_deriv(&link->Rdw);
+    free_deriv(&link->Ra);
+    free_deriv(&link->Rda);
+    free_deriv(&link->Rb);
+    free_deriv(&link->Rdb);
+  }
+
+  for(i = 0; i < nn->numlayers; i++) {
+    layer = &nn->layers[i];
+    free_deriv(&layer->Rx);
+    free_deriv(&layer->Ry);
+    free_deriv(&layer->Rdx);
+    free_deriv(&layer->Rdy);
+    for(j = 0; j < layer->numslabs; j++) {
+      layer->slabs[j].Rx = layer->slabs[j].Ry = NULL;
+      layer->slabs[j].Rdx = layer->slabs[j].Rdy = NULL;
+    }
+  }
+  nn->Rx = nn->Ry = nn->Rdx = nn->Rdy = NULL;
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Make whatever R variables nn does not have yet.  Everything starts
+   out at zero.  The R weights and derivatives of the trained links are
+   set before they are used, but those of locked links are only ever
+   read, so they must stay zero. */
+
+void nn_alloc_R(NN *nn)
+{
+  NN_LINK *link;
+  NN_LAYER *layer;
+  double *Rw[6], *Rg[6];
+  unsigned i, j, k, n, sz, off, numin, numout, numaux, bsz[6];
+
+  for(i = 0; i < nn->numlinks; i++) {
+    link = nn->links[i];
+    numin = link->numin;
+    numout = link->numout;
+    numaux = link->numaux;
+    if(!(link->A && !link->RA) && !(link->u && !link->Ru) &&
+       !(link->v && !link->Rv) && !(link->w && !link->Rw) &&
+       !(link->a && !link->Ra) && !(link->b && !link->Rb))
+      continue;
+    if(link->A && !link->RA) {
+      link->RA = allocate_array(3, sizeof(double), numout, numin, numin);
+      link->RdA = allocate_array(3, sizeof(double), numout, numin, numin);
+    }
+    if(link->u && link->index && !link->Ru) {
+      link->Ru = nn_sparse_array(numout, link->start, NULL);
+      link->Rdu = nn_sparse_array(numout, link->start, NULL);
+    }
+    else if(link->u && !link->Ru) {
+      link->Ru = allocate_array(2, sizeof(double), numout, numin);
+      link->Rdu = allocate_array(2, sizeof(double), numout, numin);
+    }
+    if(link->v && !link->Rv) {
+      link->Rv = allocate_array(2, sizeof(double), numout, numin);
+      link->Rdv = allocate_array(2, sizeof(double), numout, numin);
+    }
+    if(link->w && !link->Rw) {
+      link->Rw = allocate_array(2, sizeof(double), numout, numaux);
+      link->Rdw = allocate_array(2, sizeof(double), numout, numaux);
+    }
+    if(link->a && !link->Ra) {
+      link->Ra = allocate_array(1, sizeof(double), numout);
+      link->Rda = allocate_array(1, sizeof(double), numout);
+    }
+    if(link->b && !link->Rb) {
+      link->Rb = allocate_array(1, sizeof(double), numout);
+      link->Rdb = allocate_array(1, sizeof(double), numout);
+    }
+    n = nn_link_blocks(link, NULL, NULL, Rw, Rg, bsz);
+    for(k = 0; k < n; k++)
+      for(j = 0; j < bsz[k]; j++)
+	Rw[k][j] = Rg[k][j] = 0.0;
+  }
+
+  if(nn->Rx) return;
+  for(i = 0; i < nn->numlayers; i++) {
+    layer = &nn->layers[i];
+    sz = layer->sz;
+    layer->Rx  = xcalloc(sz, sizeof(double));
+    layer->Ry  = xcalloc(sz, sizeof(double));
+    layer->Rdx = xcalloc(sz, sizeof(double));
+    layer->Rdy = xcalloc(sz, sizeof(double));
+    for(off = 0, j = 0; j < layer->numslabs; j++) {
+      layer->slabs[j].Rx  = layer->Rx  + off;
+      layer->slabs[j].Ry  = layer->Ry  + off;
+      layer->slabs[j].Rdx = layer->Rdx + off;
+      layer->slabs[j].Rdy = layer->Rdy + off;
+      off += layer->slabs[j].sz;
+    }
+  }
+  nn->Rx = nn->layers[0].Rx;
+  nn->Ry = nn->layers[nn->numlayers - 1].Ry;
+  nn->Rdx = nn->layers[0].Rdx;
+  nn->Rdy = nn->layers[nn->numlayers - 1].Rdy;
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
 void nn_destroy(NN *nn)
 {
   unsigned i, j;
 
+  /* The replicas use our weights, so they must go first. */
+  if(nn->replicas)
+    nn_free_replicas(nn);
+  nn_plan_free(nn);
+  nn_free_derivs(nn);
+
   /* Free up the memory from the links.  We aren't freeing the
-   * weight-space at this point yet, nor the linked lists.
+   * weight-space at this point yet, nor the linked lists.  Shared
+   * weights belong to some other NN, and packed vectors live in
+   * nn->wbuf.
    */
   for(i = 0; i < nn->numlinks; i++) {
-    if(nn->links[i]->A) {
+    if(nn->links[i]->A && !nn->links[i]->shared)
       deallocate_array(nn->links[i]->A);
-      deallocate_array(nn->links[i]->dA);
-      deallocate_array(nn->links[i]->RA);
-      deallocate_array(nn->links[i]->RdA);
-    }
-    if(nn->links[i]->u) {
+    if(nn->links[i]->u && !nn->links[i]->shared)
       deallocate_array(nn->links[i]->u);
-      deallocate_array(nn->links[i]->du);
-      deallocate_array(nn->links[i]->Ru);
-      deallocate_array(nn->links[i]->Rdu);
-    }
-    if(nn->links[i]->v) {
+    if(nn->links[i]->v && !nn->links[i]->shared)
       deallocate_array(nn->links[i]->v);
-      deallocate_array(nn->links[i]->dv);
-      deallocate_array(nn->links[i]->Rv);
-      deallocate_array(nn->links[i]->Rdv);
-    }
-    if(nn->links[i]->w) {
+    if(nn->links[i]->w && !nn->links[i]->shared)
       deallocate_array(nn->links[i]->w);
-      deallocate_array(nn->links[i]->dw);
-      deallocate_array(nn->links[i]->Rw);
-      deallocate_array(nn->links[i]->Rdw);
-    }
-    if(nn->links[i]->a) {
+    if(nn->links[i]->a && !nn->links[i]->shared && !nn->links[i]->packed)
       deallocate_array(nn->links[i]->a);
-      deallocate_array(nn->links[i]->da);
-      deallocate_array(nn->links[i]->Ra);
-      deallocate_array(nn->links[i]->Rda);
-    }
-    if(nn->links[i]->b) {
+    if(nn->links[i]->b && !nn->links[i]->shared && !nn->links[i]->packed)
       deallocate_array(nn->links[i]->b);
-      deallocate_array(nn->links[i]->db);
-      deallocate_array(nn->links[i]->Rb);
-      deallocate_array(nn->links[i]->Rdb);
-    }
+
     /* Now do the linked lists for the sources and dests. */
     nn_layerlist_free(nn->links[i]->source);
     nn_layerlist_free(nn->links[i]->dest);
     
+    if(nn->links[i]->index) {
+      xfree(nn->links[i]->start);
+      xfree(nn->links[i]->index);
+    }
     xfree(nn->links[i]->format);
     xfree(nn->links[i]);
   }
@@ -299,21 +468,187 @@ void nn_destroy(NN *nn)
       xfree(nn->layers[i].slabs);
     xfree(nn->layers[i].x);
     xfree(nn->layers[i].y);
-    xfree(nn->layers[i].dx);
-    xfree(nn->layers[i].dy);
-    xfree(nn->layers[i].Rx);
-    xfree(nn->layers[i].Ry);
-    xfree(nn->layers[i].Rdx);
-    xfree(nn->layers[i].Rdy);
+    if(nn->layers[i].Bx) {
+      xfree(nn->layers[i].Bx);
+      xfree(nn->layers[i].By);
+    }
   }
 
   /* Do the weights and all of the rest. */
   if(nn->weights) xfree(nn->weights);
   if(nn->grads) xfree(nn->grads);
+  if(nn->wbuf) xfree(nn->wbuf);
+#ifdef NL_MMAP
+  if(nn->map) munmap(nn->map, nn->mapsz);
+#endif
   if(nn->layers) xfree(nn->layers);
   if(nn->links) xfree(nn->links);
+  if(nn->Btmp) xfree(nn->Btmp);
   xfree(nn->t);
   xfree(nn);
 }
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* The body of nn_replicate() and nn_clone().  If own is nonzero,
+   then the links that are not locked keep the arrays that nn_link()
+   made for them, and the weights are copied over at the end. */
+
+static NN *replicate(NN *nn, int own)
+{
+  NN *rep;
+  NN_LINK *src, *dst;
+  char *format, num[32];
+  unsigned i, j, len;
+
+  /* Rebuild a format string that describes the layers and slabs. */
+  len = 1;
+  for(i = 0; i < nn->numlayers; i++)
+    len += 3 + nn->layers[i].numslabs * sizeof(num);
+  format = xmalloc(len * sizeof(char));
+  format[0] = 0;
+  for(i = 0; i < nn->numlayers; i++) {
+    strcat(format, "(");
+    for(j = 0; j < nn->layers[i].numslabs; j++) {
+      sprintf(num, (j == 0) ? "%u" : " %u", nn->layers[i].slabs[j].sz);
+      strcat(format, num);
+    }
+    strcat(format, ") ");
+  }
+  rep = nn_create(format);
+  xfree(format);
+
+  for(i = 0; i < nn->numlayers; i++)
+    for(j = 0; j < nn->layers[i].numslabs; j++) {
+      rep->layers[i].slabs[j].afunc = nn->layers[i].slabs[j].afunc;
+      rep->layers[i].slabs[j].fastact = nn->layers[i].slabs[j].fastact;
+    }
+
+  /* Make the same links, but swap our weights for those of nn. */
+  for(i = 0; i < nn->numlinks; i++) {
+    src = nn->links[i];
+    if((dst = nn_link(rep, src->format)) == NULL) {
+      ulog(ULOG_ERROR, "%s: unable to replicate link %d.",
+	   own ? "nn_clone" : "nn_replicate", i);
+      nn_destroy(rep);
+      return(NULL);
+    }
+    if(src->index)
+      nn_set_sparse(rep, i, src->start, src->index);
+    if(own && src->need_grads)
+      continue;
+    if(dst->A) { deallocate_array(dst->A); dst->A = src->A; }
+    if(dst->u) { deallocate_array(dst->u); dst->u = src->u; }
+    if(dst->v) { deallocate_array(dst->v); dst->v = src->v; }
+    if(dst->w) { deallocate_array(dst->w); dst->w = src->w; }
+    if(dst->a) { deallocate_array(dst->a); dst->a = src->a; }
+    if(dst->b) { deallocate_array(dst->b); dst->b = src->b; }
+    dst->shared = 1;
+  }
+
+  /* Locking or unlocking every link also rebuilds the pointers in
+   * rep->weights, which still point to the arrays freed above.
+   */
+  for(i = 0; i < nn->numlinks; i++)
+    if(nn->links[i]->need_grads)
+      nn_unlock_link(rep, i);
+    else
+      nn_lock_link(rep, i);
+  rep->need_all_grads = nn->need_all_grads;
+  rep->single = nn->single;
+  if(nn->compiled)
+    nn_compile(rep);
+  if(own)
+    for(i = 0; i < nn->numweights; i++)
+      *rep->weights[i] = *nn->weights[i];
+
+  rep->info = nn->info;
+  rep->info.opt.owner = rep;
+  return(rep);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+NN *nn_replicate(NN *nn)
+{
+  return(replicate(nn, 0));
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+NN *nn_clone(NN *nn)
+{
+  return(replicate(nn, 1));
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Returns n replicas of nn, which are kept around between calls.  The
+   replicas are brought up to date with nn's activation functions and
+   locked links, and are rebuilt from scratch if nn has gained any
+   links since they were made. */
+
+NN **nn_get_replicas(NN *nn, unsigned n)
+{
+  NN *rep;
+  unsigned i, j, k;
+
+  if(nn->numreplicas > 0 && nn->replicas[0]->numlinks != nn->numlinks)
+    nn_free_replicas(nn);
+
+  if(nn->numreplicas < n) {
+    nn->replicas = xrealloc(nn->replicas, n * sizeof(NN *));
+    for(i = nn->numreplicas; i < n; i++) {
+      if((nn->replicas[i] = nn_replicate(nn)) == NULL) {
+	nn->numreplicas = i;
+	return(NULL);
+      }
+      if(nn->frozen)
+	nn_freeze(nn->replicas[i]);
+    }
+    nn->numreplicas = n;
+  }
+
+  for(k = 0; k < n; k++) {
+    rep = nn->replicas[k];
+    for(i = 0; i < nn->numlayers; i++)
+      for(j = 0; j < nn->layers[i].numslabs; j++) {
+	rep->layers[i].slabs[j].afunc = nn->layers[i].slabs[j].afunc;
+	rep->layers[i].slabs[j].fastact = nn->layers[i].slabs[j].fastact;
+      }
+    for(i = 0; i < nn->numlinks; i++)
+      if(rep->links[i]->need_grads != nn->links[i]->need_grads) {
+	if(nn->links[i]->need_grads)
+	  nn_unlock_link(rep, i);
+	else
+	  nn_lock_link(rep, i);
+      }
+    rep->need_all_grads = nn->need_all_grads;
+    if(rep->single != nn->single) {
+      rep->single = nn->single;
+      nn_plan_free(rep);
+    }
+    if(nn->compiled && !rep->compiled)
+      nn_compile(rep);
+    else if(!nn->compiled && rep->compiled)
+      nn_uncompile(rep);
+    nn_plan_sync(rep);
+  }
+  return(nn->replicas);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+void nn_free_replicas(NN *nn)
+{
+  unsigned i;
+
+  for(i = 0; i < nn->numreplicas; i++)
+    nn_destroy(nn->replicas[i]);
+  if(nn->replicas)
+    xfree(nn->replicas);
+  nn->replicas = NULL;
+  nn->numreplicas = 0;
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
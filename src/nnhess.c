@@ -5,37 +5,66 @@
 #include <stdlib.h>
 #include <math.h>
 
+#define NN_HESS_OWNER
 #include "nodelib/nn.h"
 #include "nodelib/misc.h"
+#include "nodelib/thread.h"
+
+int nn_hessian_check = 1;
+int nn_hv_gauss_newton = 1;
+
+/* Everything shared by the threads of the offline routines below.
+   Thread id uses nets[id], and adds its patterns into acc[id] (for a
+   Hessian), puts them in J and passes them to hook (for Jacobians),
+   or adds its products with v into sum[id] (for nn_offline_Hv(), which
+   visits index[0] through index[count - 1]).  The lock protects the
+   DATASET and the hook. */
+
+typedef struct HESS_WORK {
+  NN **nets;
+  DATASET *set;
+  double ***acc;
+  double *J;
+  void (*hook)(unsigned pattern, double *J, void *obj);
+  void *obj;
+  unsigned numthreads, batch;
+  int forward;
+  double *v, **sum;
+  unsigned *index, count;
+  THREAD_LOCK *lock;
+} HESS_WORK;
+
+/* The number of Jacobian rows that nn_offline_gauss_newton() collects
+   before adding them to its sum. */
+
+#define NN_GN_ROWS 32
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
-void nn_jacobian(NN *nn, double *input, double *J)
-{
-  unsigned i, j, save;
-  double *de_dy;
+/* Set the R weights (or the R derivatives, if grads is nonzero) of
+   the trained links to zero. */
 
-  save = nn->need_all_grads;
-  nn->need_all_grads = 1;
-  de_dy = allocate_array(1, sizeof(double), nn->numout);
-  for(j = 0; j < nn->numout; j++)
-    de_dy[j] = 0.0;
-
-  for(i = 0; i < nn->numout; i++) {
-    de_dy[i] = 1.0;
-    nn_forward(nn, input);
-    nn_backward(nn, de_dy);
-    for(j = 0; j < nn->numin; j++)
-      J[i * nn->numin + j] = nn->dx[j];
-    de_dy[i] = 0.0;
-  }
-  deallocate_array(de_dy);
-  nn->need_all_grads = save;
+static void clear_R(NN *nn, int grads)
+{
+  double *Rw[6], *Rg[6], *p;
+  unsigned i, j, k, n, sz[6];
+
+  for(i = 0; i < nn->numlinks; i++)
+    if(nn->links[i]->need_grads) {
+      n = nn_link_blocks(nn->links[i], NULL, NULL, Rw, Rg, sz);
+      for(k = 0; k < n; k++) {
+	p = grads ? Rg[k] : Rw[k];
+	for(j = 0; j < sz[k]; j++)
+	  p[j] = 0.0;
+      }
+    }
 }
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
-void nn_Rforward(NN *nn, double *Rinput, double *Rweights)
+/* The R forward pass, after the R weights have been set. */
+
+static void rforward(NN *nn, double *Rinput)
 {
   unsigned i, j, k;
   NN_LAYER *slab;
@@ -54,16 +83,6 @@ void nn_Rforward(NN *nn, double *Rinput, double *Rweights)
     for(i = 0; i < nn->numin; i++)
       nn->Rx[i] = 0.0;
 
-  if(Rweights)
-    nn_set_Rweights(nn, Rweights);
-  else {
-    double *Rw = allocate_array(1, sizeof(double), nn->numweights);
-    for(i = 0; i < nn->numweights; i++)
-      Rw[i] = 0;
-    nn_set_Rweights(nn, Rw);
-    deallocate_array(Rw);
-  }
-  
   /* For each layer... */
   for(i = 0; i < nn->numlayers; i++) {
 
@@ -90,19 +109,28 @@ void nn_Rforward(NN *nn, double *Rinput, double *Rweights)
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
-void nn_Rbackward(NN *nn, double *Rdoutput)
+void nn_Rforward(NN *nn, double *Rinput, double *Rweights)
+{
+  if(nn_check_not_frozen(nn, "nn_Rforward")) return;
+  nn_alloc_R(nn);
+  if(Rweights)
+    nn_set_Rweights(nn, Rweights);
+  else
+    clear_R(nn, 0);
+  rforward(nn, Rinput);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+static void rbackward(NN *nn, double *Rdoutput)
 {
   unsigned i, j, k;
-  double deriv, *Rg;
+  double deriv;
   NN_LAYER *slab;
   NN_LINKLIST *l;
 
   /* Clean up the Rderivatives. */
-  Rg = allocate_array(1, sizeof(double), nn->numweights);
-  for(i = 0; i < nn->numweights; i++)
-    Rg[i] = 0.0;
-  nn_set_Rgrads(nn, Rg);
-  deallocate_array(Rg);
+  clear_R(nn, 1);
 
   for(i = 0; i < nn->numlayers; i++)
     for(j = 0; j < nn->layers[i].sz; j++)
@@ -135,61 +163,119 @@ void nn_Rbackward(NN *nn, double *Rdoutput)
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
+void nn_Rbackward(NN *nn, double *Rdoutput)
+{
+  if(nn_check_not_frozen(nn, "nn_Rbackward")) return;
+  nn_alloc_R(nn);
+  rbackward(nn, Rdoutput);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
 void nn_Hv(NN *nn, double *input, double *target, double *v)
 {
-  double errsum, *dedy, *d2edy2, *Rg;
+  double *dedy, *d2edy2, *Rdy;
   unsigned i;
   
-  errsum = 0.0;
+  if(nn_check_not_frozen(nn, "nn_Hv")) return;
   dedy = xmalloc(sizeof(double) * nn->numout);
   d2edy2 = xmalloc(sizeof(double) * nn->numout);
+  Rdy = xmalloc(sizeof(double) * nn->numout);
   nn_forward(nn, input);
-  for(i = 0; i < nn->numout; i++) {
-    errsum += nn->info.error_function(nn->y[i], target[i],
-				      &dedy[i], &d2edy2[i]);
+  nn_error(nn, nn->y, target, nn->numout, dedy, d2edy2);
+  for(i = 0; i < nn->numout; i++)
     nn->t[i] = target[i];
-  }
   nn_backward(nn, dedy);
   nn_Rforward(nn, NULL, v);
 
-  Rg = allocate_array(1, sizeof(double), nn->numweights);
-  for(i = 0; i < nn->numweights; i++)
-    Rg[i] = 0.0;
-  nn_set_Rgrads(nn, Rg);
-  deallocate_array(Rg);
-
-  for(i = 0; i < nn->numout; i++)
-     d2edy2[i] *= nn->Ry[i];
-  nn_Rbackward(nn, d2edy2);
+  nn_error_hv(nn, nn->y, target, d2edy2, nn->Ry, Rdy);
+  nn_Rbackward(nn, Rdy);
   
   xfree(dedy);
   xfree(d2edy2);
+  xfree(Rdy);
 }
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
-int nn_hessian(NN *nn, double *input, double *target, double **H)
+/* Add the Hessian of the error of nn at (input, target) to H, using
+   one forward and one backward pass for all of the columns.  Column i
+   is the product of the Hessian and the i'th unit vector, so the R
+   weights are set and the R derivatives are read in place, through
+   tables of pointers, rather than by copying whole vectors.  If full
+   is zero, then only the part of column i at or below the diagonal is
+   added, and it goes into row i, which is all that is needed for the
+   upper triangle of a symmetric matrix. */
+
+static void hessian_pattern(NN *nn, double *input, double *target,
+			    double **H, int full)
 {
-  double h1, h2, *Rw, *Rg;
-  unsigned i, j;
+  double **Rw, **Rg, *dedy, *d2edy2, *Rdy, *bw[6], *bg[6];
+  unsigned i, j, k, n, nb, sz[6];
+
+  nn_alloc_R(nn);
+  Rw = xmalloc(sizeof(double *) * (nn->numweights + 1));
+  Rg = xmalloc(sizeof(double *) * (nn->numweights + 1));
+  dedy = allocate_array(1, sizeof(double), nn->numout);
+  d2edy2 = allocate_array(1, sizeof(double), nn->numout);
+  Rdy = allocate_array(1, sizeof(double), nn->numout);
+  for(n = 0, i = 0; i < nn->numlinks; i++)
+    if(nn->links[i]->need_grads) {
+      nb = nn_link_blocks(nn->links[i], NULL, NULL, bw, bg, sz);
+      for(k = 0; k < nb; k++)
+	for(j = 0; j < sz[k]; j++, n++) {
+	  Rw[n] = bw[k] + j;
+	  Rg[n] = bg[k] + j;
+	}
+    }
 
-  Rw = allocate_array(1, sizeof(double), nn->numweights);
-  Rg = allocate_array(1, sizeof(double), nn->numweights);
+  nn_forward(nn, input);
+  nn_error(nn, nn->y, target, nn->numout, dedy, d2edy2);
+  for(i = 0; i < nn->numout; i++)
+    nn->t[i] = target[i];
+  nn_backward(nn, dedy);
 
+  clear_R(nn, 0);
   for(i = 0; i < nn->numweights; i++) {
-    Rw[i] = 1.0;
-    nn_Hv(nn, input, target, Rw);
-    nn_get_Rgrads(nn, Rg);
-    for(j = 0; j < nn->numweights; j++)
-      H[j][i] = Rg[j];
-    Rw[i] = 0.0;
+    *Rw[i] = 1.0;
+    rforward(nn, NULL);
+    nn_error_hv(nn, nn->y, target, d2edy2, nn->Ry, Rdy);
+    rbackward(nn, Rdy);
+    *Rw[i] = 0.0;
+
+    if(full)
+      for(j = 0; j < nn->numweights; j++)
+	H[j][i] += *Rg[j];
+    else
+      for(j = i; j < nn->numweights; j++)
+	H[i][j] += *Rg[j];
   }
+  xfree(Rw);
+  xfree(Rg);
+  deallocate_array(dedy);
+  deallocate_array(d2edy2);
+  deallocate_array(Rdy);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+int nn_hessian(NN *nn, double *input, double *target, double **H)
+{
+  double h1, h2;
+  unsigned i, j;
+
+  if(nn_check_not_frozen(nn, "nn_hessian")) return(1);
+  for(i = 0; i < nn->numweights; i++)
+    for(j = 0; j < nn->numweights; j++)
+      H[i][j] = 0.0;
+  hessian_pattern(nn, input, target, H, 1);
+  if(!nn_hessian_check)
+    return(0);
 
   /* The sanity check below compares the first 6 significant digits. */
   for(i = 0; i < nn->numweights; i++)
-    for(j = 0; j < nn->numweights; j++) {
-      if(i == j) continue;
-      else if(H[i][j] == 0.0 && H[j][i] == 0.0) continue;
+    for(j = i + 1; j < nn->numweights; j++) {
+      if(H[i][j] == 0.0 && H[j][i] == 0.0) continue;
       else if(H[i][j] == 0.0 && fabs(H[j][i]) > 10e-100)
 	goto BADHESSIAN;
       else if(fabs(H[i][j]) > 10e-100 && H[j][i] == 0.0)
@@ -203,13 +289,9 @@ int nn_hessian(NN *nn, double *input, double *target, double **H)
 	  goto BADHESSIAN;
       }
     }
-  deallocate_array(Rw);
-  deallocate_array(Rg);
   return(0);
   
  BADHESSIAN:
-  deallocate_array(Rw);
-  deallocate_array(Rg);
   ulog(ULOG_ERROR, "nn_hessian: Hessian failed sanity check."
        "%t(H[%d][%d] = %g) != (H[%d][%d] = %g).", i, j, H[i][j],
        j, i, H[j][i]);
@@ -218,12 +300,149 @@ int nn_hessian(NN *nn, double *input, double *target, double **H)
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
-int nn_offline_hessian(NN *nn, DATASET *set, double **H)
+/* The body of each thread of nn_offline_hessian().  Thread id gets the
+   id'th of numthreads equal slices of the patterns, so the sums do not
+   depend on how the threads are scheduled. */
+
+static void hessian_worker(void *obj, unsigned id)
+{
+  HESS_WORK *work = obj;
+  NN *nn = work->nets[id];
+  double *x, *t, *in, *tgt;
+  unsigned i, k, end, pats;
+
+  in = allocate_array(1, sizeof(double), nn->numin);
+  tgt = allocate_array(1, sizeof(double), nn->numout);
+  pats = dataset_size(work->set);
+  k = (unsigned)((double)pats * id / work->numthreads);
+  end = (unsigned)((double)pats * (id + 1) / work->numthreads);
+  for(; k < end; k++) {
+    /* The DATASET may reuse its buffers, so copy the pattern. */
+    thread_lock(work->lock);
+    x = dataset_x(work->set, k);
+    t = dataset_y(work->set, k);
+    for(i = 0; i < nn->numin; i++)
+      in[i] = x[i];
+    for(i = 0; i < nn->numout; i++)
+      tgt[i] = t[i];
+    thread_unlock(work->lock);
+    hessian_pattern(nn, in, tgt, work->acc[id], 0);
+  }
+  deallocate_array(in);
+  deallocate_array(tgt);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Make an upper triangular n by n accumulator, where only acc[i][j]
+   with j >= i may be used.  The rows are packed, so this takes about
+   half the space of a full matrix. */
+
+static double **hessian_acc(unsigned n)
+{
+  double **acc, *data;
+  unsigned i, j;
+
+  acc = xmalloc(n * sizeof(double *));
+  data = xmalloc(((size_t)n * (n + 1) / 2 + 1) * sizeof(double));
+  for(i = 0; i < n; i++) {
+    acc[i] = data - i;
+    for(j = i; j < n; j++)
+      acc[i][j] = 0.0;
+    data += n - i;
+  }
+  return(acc);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Pick the number of threads for the patterns of set, and fill in
+   the nets and the lock of work, with nn as the net of the first
+   thread.  A net with recurrent links gets one thread, since its
+   patterns must be seen in order.  Everything else is cleared. */
+
+static void offline_start(NN *nn, DATASET *set, HESS_WORK *work)
 {
-  double *x, *t, **HH;
-  unsigned i, j, k, pats;
+  NN **reps = NULL;
+  unsigned i, pats = dataset_size(set);
+
+  work->numthreads = (nn_offline_threads == 0) ? thread_count() :
+    nn_offline_threads;
+  if(work->numthreads > pats)
+    work->numthreads = pats;
+  if(work->numthreads == 0 || !nn_feedforward(nn))
+    work->numthreads = 1;
+  if(work->numthreads > 1 &&
+     (reps = nn_get_replicas(nn, work->numthreads - 1)) == NULL)
+    work->numthreads = 1;
+
+  work->set = set;
+  work->nets = xmalloc(work->numthreads * sizeof(NN *));
+  for(i = 0; i < work->numthreads; i++)
+    work->nets[i] = (i == 0) ? nn : reps[i - 1];
+  work->acc = NULL;
+  work->J = NULL;
+  work->hook = NULL;
+  work->obj = NULL;
+  work->batch = 1;
+  work->forward = 0;
+  work->v = NULL;
+  work->sum = NULL;
+  work->index = NULL;
+  work->count = pats;
+  work->lock = thread_lock_create();
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Run worker over the patterns of set with the usual number of
+   threads, each with its own replica of nn and its own triangle, and
+   put the average of the triangles in H and its mirror image. */
+
+static void offline_triangle(NN *nn, DATASET *set, double **H,
+			     void (*worker)(void *, unsigned))
+{
+  HESS_WORK work;
+  double sum;
+  unsigned i, j, k, pats, n;
 
   pats = dataset_size(set);
+  n = nn->numweights;
+  offline_start(nn, set, &work);
+  work.acc = xmalloc(work.numthreads * sizeof(double **));
+  for(i = 0; i < work.numthreads; i++)
+    work.acc[i] = hessian_acc(n);
+
+  thread_run(work.numthreads, worker, &work);
+
+  /* Add up the triangles in thread order, and mirror the sum.  The
+   * result is not normalized by anything other than the number of
+   * patterns, per Dragan Obradovic's assertion that the novelty
+   * detection scheme does not want it to be.
+   */
+  for(i = 0; i < n; i++)
+    for(j = i; j < n; j++) {
+      for(sum = 0.0, k = 0; k < work.numthreads; k++)
+	sum += work.acc[k][i][j];
+      H[i][j] = H[j][i] = sum / pats;
+    }
+
+  thread_lock_destroy(work.lock);
+  for(i = 0; i < work.numthreads; i++) {
+    xfree(work.acc[i][0]);
+    xfree(work.acc[i]);
+  }
+  xfree(work.acc);
+  xfree(work.nets);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+int nn_offline_hessian(NN *nn, DATASET *set, double **H)
+{
+  double *x, *t;
+
+  if(nn_check_not_frozen(nn, "nn_offline_hessian")) return(-1);
   if(dataset_x_size(set) != nn->numin || dataset_y_size(set) != nn->numout) {
     ulog(ULOG_ERROR, "nn_offline_hessian: I/O dimensions are incompatible.%t"
 	 "NN dimension = (%d x %d)%tDATASET dimension = (%d x %d).",
@@ -231,34 +450,385 @@ int nn_offline_hessian(NN *nn, DATASET *set, double **H)
     return(-1);
   }
 
-  for(i = 0; i < nn->numweights; i++)
-    for(j = 0; j < nn->numweights; j++)
-      H[i][j] = 0.0;
-  HH = allocate_array(2, sizeof(double), nn->numweights, nn->numweights);
-  for(k = 0; k < pats; k++) {
-    x = dataset_x(set, k);
-    t = dataset_y(set, k);
-    if(nn_hessian(nn, x, t, HH)) {
-      deallocate_array(HH);
+  /* The weights may have changed since the last pass. */
+  nn_plan_sync(nn);
+
+  /* Checking the symmetry of every pattern's Hessian costs as much
+   * as computing it, so only the first one is checked.
+   */
+  if(nn_hessian_check && dataset_size(set) > 0) {
+    x = dataset_x(set, 0);
+    t = dataset_y(set, 0);
+    if(nn_hessian(nn, x, t, H))
       return(1);
+  }
+
+  offline_triangle(nn, set, H, hessian_worker);
+  return(0);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* The body of each thread of nn_offline_gauss_newton().  Row o of the
+   Jacobian of a pattern is the gradient of output o, which takes one
+   backward pass.  The rows of several patterns are collected, along
+   with the second derivatives of the error, and then added to the
+   triangle in one rank-k update. */
+
+static void gauss_newton_worker(void *obj, unsigned id)
+{
+  HESS_WORK *work = obj;
+  NN *nn = work->nets[id];
+  double **J, *d, *dedy, *x, *t, *in, *tgt;
+  unsigned i, k, end, pats, r, rows;
+
+  rows = NN_GN_ROWS - NN_GN_ROWS % nn->numout;
+  if(rows == 0)
+    rows = nn->numout;
+  J = allocate_array(2, sizeof(double), rows, nn->numweights);
+  d = allocate_array(1, sizeof(double), rows);
+  dedy = allocate_array(1, sizeof(double), nn->numout);
+  in = allocate_array(1, sizeof(double), nn->numin);
+  tgt = allocate_array(1, sizeof(double), nn->numout);
+  pats = dataset_size(work->set);
+  k = (unsigned)((double)pats * id / work->numthreads);
+  end = (unsigned)((double)pats * (id + 1) / work->numthreads);
+  for(r = 0; k < end; k++) {
+    thread_lock(work->lock);
+    x = dataset_x(work->set, k);
+    t = dataset_y(work->set, k);
+    for(i = 0; i < nn->numin; i++)
+      in[i] = x[i];
+    for(i = 0; i < nn->numout; i++)
+      tgt[i] = t[i];
+    thread_unlock(work->lock);
+
+    nn_forward(nn, in);
+    nn_error(nn, nn->y, tgt, nn->numout, NULL, &d[r]);
+    for(i = 0; i < nn->numout; i++)
+      dedy[i] = 0.0;
+    for(i = 0; i < nn->numout; i++) {
+      dedy[i] = 1.0;
+      nn_backward(nn, dedy);
+      nn_get_grads(nn, J[r + i]);
+      dedy[i] = 0.0;
+    }
+    r += nn->numout;
+    if(r == rows || k + 1 == end) {
+      nn_kern_syrk(work->acc[id], J, d, r, nn->numweights);
+      r = 0;
     }
-    for(i = 0; i < nn->numweights; i++)
-      for(j = 0; j < nn->numweights; j++)
-	H[i][j] += HH[i][j];
   }
+  deallocate_array(J);
+  deallocate_array(d);
+  deallocate_array(dedy);
+  deallocate_array(in);
+  deallocate_array(tgt);
+}
 
-  /* Removed chunk below per Dragan Obradovic's assertion that the
-   * novelty detection scheme does not want the Hessian to be
-   * normalized by the number of patterns.
-   */
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+int nn_offline_gauss_newton(NN *nn, DATASET *set, double **G)
+{
+  if(nn_check_not_frozen(nn, "nn_offline_gauss_newton")) return(-1);
+  if(dataset_x_size(set) != nn->numin || dataset_y_size(set) != nn->numout) {
+    ulog(ULOG_ERROR, "nn_offline_gauss_newton: I/O dimensions are "
+	 "incompatible.%tNN dimension = (%d x %d)%t"
+	 "DATASET dimension = (%d x %d).",
+	 nn->numin, nn->numout, dataset_x_size(set), dataset_y_size(set));
+    return(-1);
+  }
+  nn_plan_sync(nn);
+  offline_triangle(nn, set, G, gauss_newton_worker);
+  return(0);
+}
 
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* The body of each thread of nn_offline_Hv().  For the Gauss-Newton
+   matrix, the R forward pass gives J v, which is scaled by the second
+   derivatives of the error and sent back with an ordinary backward
+   pass to make J' D J v.  For the Hessian, it is the same as
+   nn_Hv(). */
+
+static void hv_worker(void *obj, unsigned id)
+{
+  HESS_WORK *work = obj;
+  NN *nn = work->nets[id];
+  double *x, *t, *in, *tgt, *dedy, *d2edy2, *Rdy, *g, *sum = work->sum[id];
+  unsigned i, k, end, index;
+
+  in = allocate_array(1, sizeof(double), nn->numin);
+  tgt = allocate_array(1, sizeof(double), nn->numout);
+  dedy = allocate_array(1, sizeof(double), nn->numout);
+  d2edy2 = allocate_array(1, sizeof(double), nn->numout);
+  Rdy = allocate_array(1, sizeof(double), nn->numout);
+  g = allocate_array(1, sizeof(double), nn->numweights);
   for(i = 0; i < nn->numweights; i++)
-    for(j = 0; j < nn->numweights; j++)
-      H[i][j] /= pats;
+    sum[i] = 0.0;
+  k = (unsigned)((double)work->count * id / work->numthreads);
+  end = (unsigned)((double)work->count * (id + 1) / work->numthreads);
+  for(; k < end; k++) {
+    index = work->index ? work->index[k] : k;
+    thread_lock(work->lock);
+    x = dataset_x(work->set, index);
+    t = dataset_y(work->set, index);
+    for(i = 0; i < nn->numin; i++)
+      in[i] = x[i];
+    for(i = 0; i < nn->numout; i++)
+      tgt[i] = t[i];
+    thread_unlock(work->lock);
+
+    nn_forward(nn, in);
+    nn_error(nn, nn->y, tgt, nn->numout, dedy, d2edy2);
+    if(!nn_hv_gauss_newton)
+      nn_backward(nn, dedy);
+    nn_Rforward(nn, NULL, work->v);
+    nn_error_hv(nn, nn->y, tgt, d2edy2, nn->Ry, Rdy);
+    if(nn_hv_gauss_newton) {
+      nn_backward(nn, Rdy);
+      nn_get_grads(nn, g);
+    }
+    else {
+      nn_Rbackward(nn, Rdy);
+      nn_get_Rgrads(nn, g);
+    }
+    for(i = 0; i < nn->numweights; i++)
+      sum[i] += g[i];
+  }
+  deallocate_array(in);
+  deallocate_array(tgt);
+  deallocate_array(dedy);
+  deallocate_array(d2edy2);
+  deallocate_array(Rdy);
+  deallocate_array(g);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+int nn_offline_Hv(NN *nn, DATASET *set, unsigned *index, unsigned n,
+		  double *v, double *Hv)
+{
+  HESS_WORK work;
+  unsigned i, k;
+
+  if(nn_check_not_frozen(nn, "nn_offline_Hv")) return(-1);
+  if(dataset_x_size(set) != nn->numin || dataset_y_size(set) != nn->numout) {
+    ulog(ULOG_ERROR, "nn_offline_Hv: I/O dimensions are incompatible.%t"
+	 "NN dimension = (%d x %d)%tDATASET dimension = (%d x %d).",
+	 nn->numin, nn->numout, dataset_x_size(set), dataset_y_size(set));
+    return(-1);
+  }
+  nn_plan_sync(nn);
+  offline_start(nn, set, &work);
+  if(index) {
+    work.index = index;
+    work.count = n;
+  }
+  if(work.count == 0) {
+    for(i = 0; i < nn->numweights; i++)
+      Hv[i] = 0.0;
+    thread_lock_destroy(work.lock);
+    xfree(work.nets);
+    return(0);
+  }
+  if(work.numthreads > work.count)
+    work.numthreads = work.count;
+  work.v = v;
+  work.sum = allocate_array(2, sizeof(double), work.numthreads,
+			    nn->numweights + 1);
+
+  thread_run(work.numthreads, hv_worker, &work);
 
-  deallocate_array(HH);
+  /* Add up the sums in thread order, scaled like the gradient. */
+  for(i = 0; i < nn->numweights; i++) {
+    Hv[i] = 0.0;
+    for(k = 0; k < work.numthreads; k++)
+      Hv[i] += work.sum[k][i];
+    Hv[i] /= (double)work.count * nn->numout;
+  }
+
+  deallocate_array(work.sum);
+  thread_lock_destroy(work.lock);
+  xfree(work.nets);
   return(0);
 }
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
+/* Put the Jacobian of nn at input in J, with one forward pass
+   followed by either an R forward pass for each input (if forward is
+   nonzero) or a backward pass for each output.  Rin and de are
+   scratch space for numin and numout values, which must be zero, and
+   nn must need all of its derivatives for the backward passes. */
+
+static void jacobian_pattern(NN *nn, double *input, double *J, int forward,
+			     double *Rin, double *de)
+{
+  unsigned i, j, ni = nn->numin, no = nn->numout;
+
+  nn_forward(nn, input);
+  if(forward) {
+    nn_alloc_R(nn);
+    clear_R(nn, 0);
+    for(j = 0; j < ni; j++) {
+      Rin[j] = 1.0;
+      rforward(nn, Rin);
+      Rin[j] = 0.0;
+      for(i = 0; i < no; i++)
+	J[i * ni + j] = nn->Ry[i];
+    }
+  }
+  else
+    for(i = 0; i < no; i++) {
+      de[i] = 1.0;
+      nn_backward(nn, de);
+      de[i] = 0.0;
+      for(j = 0; j < ni; j++)
+	J[i * ni + j] = nn->dx[j];
+    }
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* The same as jacobian_pattern() in reverse mode, but for the n
+   inputs in input at once, with each backward pass done for the whole
+   batch.  The Jacobians go one after another in J, and de must be n
+   rows of numout zeros. */
+
+static void jacobian_batch(NN *nn, double **input, unsigned n, double *J,
+			   double **de)
+{
+  unsigned i, j, k, ni = nn->numin, no = nn->numout;
+
+  nn_forward_batch(nn, input, n);
+  for(i = 0; i < no; i++) {
+    for(k = 0; k < n; k++)
+      de[k][i] = 1.0;
+    nn_backward_batch(nn, de);
+    for(k = 0; k < n; k++) {
+      de[k][i] = 0.0;
+      for(j = 0; j < ni; j++)
+	J[(k * no + i) * ni + j] = nn->Bdx[j * n + k];
+    }
+  }
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+void nn_jacobian(NN *nn, double *input, double *J)
+{
+  unsigned i, save;
+  double *Rin, *de;
+
+  if(nn_check_not_frozen(nn, "nn_jacobian")) return;
+  save = nn->need_all_grads;
+  nn->need_all_grads = 1;
+  Rin = allocate_array(1, sizeof(double), nn->numin);
+  de = allocate_array(1, sizeof(double), nn->numout);
+  for(i = 0; i < nn->numin; i++)
+    Rin[i] = 0.0;
+  for(i = 0; i < nn->numout; i++)
+    de[i] = 0.0;
+  jacobian_pattern(nn, input, J, nn->numin < nn->numout, Rin, de);
+  deallocate_array(Rin);
+  deallocate_array(de);
+  nn->need_all_grads = save;
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* The body of each thread of nn_offline_jacobian().  Like the other
+   workers, thread id gets the id'th equal slice of the patterns, which
+   it takes work->batch at a time. */
+
+static void jacobian_worker(void *obj, unsigned id)
+{
+  HESS_WORK *work = obj;
+  NN *nn = work->nets[id];
+  double **in, **de, *Rin, *buf, *J, *x;
+  unsigned i, j, k, n, end, pats, save, sz;
+
+  sz = nn->numin * nn->numout;
+  in = allocate_array(2, sizeof(double), work->batch, nn->numin);
+  de = allocate_array(2, sizeof(double), work->batch, nn->numout);
+  Rin = allocate_array(1, sizeof(double), nn->numin);
+  buf = work->J ? NULL : allocate_array(1, sizeof(double), work->batch * sz);
+  for(i = 0; i < nn->numin; i++)
+    Rin[i] = 0.0;
+  for(k = 0; k < work->batch; k++)
+    for(i = 0; i < nn->numout; i++)
+      de[k][i] = 0.0;
+  save = nn->need_all_grads;
+  nn->need_all_grads = 1;
+
+  pats = dataset_size(work->set);
+  k = (unsigned)((double)pats * id / work->numthreads);
+  end = (unsigned)((double)pats * (id + 1) / work->numthreads);
+  for(; k < end; k += n) {
+    n = (end - k < work->batch) ? end - k : work->batch;
+    thread_lock(work->lock);
+    for(j = 0; j < n; j++) {
+      x = dataset_x(work->set, k + j);
+      for(i = 0; i < nn->numin; i++)
+	in[j][i] = x[i];
+    }
+    thread_unlock(work->lock);
+
+    J = work->J ? work->J + (size_t)k * sz : buf;
+    if(n > 1)
+      jacobian_batch(nn, in, n, J, de);
+    else
+      jacobian_pattern(nn, in[0], J, work->forward, Rin, de[0]);
+
+    if(work->hook) {
+      thread_lock(work->lock);
+      for(j = 0; j < n; j++)
+	work->hook(k + j, J + j * sz, work->obj);
+      thread_unlock(work->lock);
+    }
+  }
+  nn->need_all_grads = save;
+  deallocate_array(in);
+  deallocate_array(de);
+  deallocate_array(Rin);
+  if(buf) deallocate_array(buf);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+int nn_offline_jacobian(NN *nn, DATASET *set, double *J,
+			void (*hook)(unsigned pattern, double *J, void *obj),
+			void *obj)
+{
+  HESS_WORK work;
+
+  if(nn_check_not_frozen(nn, "nn_offline_jacobian")) return(-1);
+  if(dataset_x_size(set) != nn->numin) {
+    ulog(ULOG_ERROR, "nn_offline_jacobian: input dimensions are "
+	 "incompatible.%tNN inputs = %d%tDATASET inputs = %d.",
+	 nn->numin, dataset_x_size(set));
+    return(-1);
+  }
+  nn_plan_sync(nn);
+  offline_start(nn, set, &work);
+  work.J = J;
+  work.hook = hook;
+  work.obj = obj;
+
+  /* Forward mode needs a pass for each input, and reverse mode one
+   * for each output, so use whichever needs fewer.  Only the reverse
+   * mode has a batch version.
+   */
+  work.forward = nn->numin < nn->numout;
+  if(!work.forward && nn_offline_batch > 1)
+    work.batch = nn_offline_batch;
+
+  thread_run(work.numthreads, jacobian_worker, &work);
+
+  thread_lock_destroy(work.lock);
+  xfree(work.nets);
+  return(0);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
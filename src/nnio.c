@@ -9,12 +9,262 @@
 #include "nodelib/nn.h"
 #include "nodelib/scan.h"
 
+#ifdef NL_MMAP
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#endif
+
 char *nn_weight_fmt = "% .12e";
 
 #ifndef SEEK_END
 #define SEEK_END 2
 #endif
 
+/* The layout of a binary image; see nn_write_binary() in nn.h.  The
+   header is a 16 byte magic line followed by these 32 bit words.
+   Everything after the header is padded to a multiple of four bytes,
+   and each link's weights start on a multiple of IMAGE_ALIGN. */
+
+#define IMAGE_ALIGN   64
+#define IMAGE_MAGIC   16
+#define IMAGE_ORDER   0x01020304
+
+#define IMG_ORDER     0
+#define IMG_VERSION   1
+#define IMG_HEADER    2
+#define IMG_TOPO      3
+#define IMG_TOPOSZ    4
+#define IMG_WEIGHTS   5
+#define IMG_WEIGHTSZ  6
+#define IMG_LINKS     7
+#define IMG_SUMA      8
+#define IMG_SUMB      9
+#define IMG_WORDS     12
+
+/* A buffer that an image is written to or read from, with a cursor. */
+
+typedef struct IMAGE {
+  unsigned char *buf;
+  size_t sz, pos;
+} IMAGE;
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Read the connectivity of the sparse link linknum, which is written
+   as the number of inputs of each output followed by the inputs. */
+
+static int read_sparse(SCAN *s, NN *nn, unsigned linknum)
+{
+  NN_LINK *link = nn->links[linknum];
+  unsigned i, j, n, *start, *index;
+  char *line;
+  int result = 1;
+
+  start = xmalloc((link->numout + 1) * sizeof(unsigned));
+  index = xmalloc((link->numout * link->numin + 1) * sizeof(unsigned));
+  for(n = 0, i = 0; i < link->numout; i++) {
+    start[i] = n;
+    if((line = scan_get(s)) == NULL) goto done;
+    j = atoi(line);
+    if(j > link->numin) goto done;
+    while(j-- > 0) {
+      if((line = scan_get(s)) == NULL) goto done;
+      index[n++] = atoi(line);
+    }
+  }
+  start[link->numout] = n;
+  result = nn_set_sparse(nn, linknum, start, index);
+
+ done:
+  xfree(start);
+  xfree(index);
+  return(result);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* A Fletcher style checksum of the n bytes at p, taken over 32 bit
+   words, with both sums modulo 2^32.  n must be a multiple of four. */
+
+static void image_sum(unsigned char *p, size_t n, unsigned *a, unsigned *b)
+{
+  unsigned *q = (unsigned *)p, sa = 0, sb = 0;
+  size_t i;
+
+  for(i = 0; i < n / sizeof(unsigned); i++) {
+    sa += q[i];
+    sb += sa;
+  }
+  *a = sa;
+  *b = sb;
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Return a pointer to the next n words of img, or NULL if there are
+   not that many left. */
+
+static unsigned *image_words(IMAGE *img, unsigned n)
+{
+  unsigned *p;
+
+  if(n > (img->sz - img->pos) / sizeof(unsigned))
+    return(NULL);
+  p = (unsigned *)(img->buf + img->pos);
+  img->pos += n * sizeof(unsigned);
+  return(p);
+}
+
+/* Return the next string of img, which is its length, then the
+   characters and at least one NUL to pad it to a whole word. */
+
+static char *image_string(IMAGE *img)
+{
+  unsigned *len, n;
+  char *p;
+
+  if((len = image_words(img, 1)) == NULL)
+    return(NULL);
+  n = *len / sizeof(unsigned) + 1;
+  if((p = (char *)image_words(img, n)) == NULL || p[*len] != 0)
+    return(NULL);
+  return(p);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Build the NN in the image of size bytes at data.  If map is
+   nonzero, then data is a mapping of the file that the NN may keep,
+   so the NN is frozen and its weights become views into data;
+   otherwise the weights are copied. */
+
+static NN *read_image(const char *fname, unsigned char *data, size_t size,
+		      int map)
+{
+  IMAGE img;
+  NN *nn = NULL;
+  NN_LINK *link;
+  double **where = NULL, *w[6], *p;
+  unsigned hdr[IMG_WORDS], *need = NULL, *start, *index, *v;
+  unsigned i, j, k, n, a, b, sz[6];
+  char *str;
+
+  if(size < IMAGE_ALIGN) goto bad_file;
+  memcpy(hdr, data + IMAGE_MAGIC, sizeof(hdr));
+  if(hdr[IMG_ORDER] != IMAGE_ORDER) {
+    ulog(ULOG_WARN, "nn_read: '%s' was written with another byte order.",
+	 fname);
+    return(NULL);
+  }
+  if(hdr[IMG_VERSION] != NN_IMAGE_VER) {
+    ulog(ULOG_WARN, "nn_read: '%s' is image version %d, but the library "
+	 "reads version %d.", fname, hdr[IMG_VERSION], NN_IMAGE_VER);
+    return(NULL);
+  }
+  if(hdr[IMG_HEADER] != IMAGE_ALIGN || hdr[IMG_TOPO] != IMAGE_ALIGN ||
+     (size_t)hdr[IMG_TOPO] + hdr[IMG_TOPOSZ] >
+     (size_t)hdr[IMG_WEIGHTS] * IMAGE_ALIGN ||
+     ((size_t)hdr[IMG_WEIGHTS] + hdr[IMG_WEIGHTSZ]) * IMAGE_ALIGN > size)
+    goto bad_file;
+
+  /* The whole image is checked before any of it is trusted. */
+  image_sum(data + IMAGE_ALIGN, ((size_t)hdr[IMG_WEIGHTS] +
+				 hdr[IMG_WEIGHTSZ] - 1) * IMAGE_ALIGN,
+	    &a, &b);
+  if(a != hdr[IMG_SUMA] || b != hdr[IMG_SUMB]) {
+    ulog(ULOG_WARN, "nn_read: '%s' has a bad checksum.", fname);
+    return(NULL);
+  }
+
+  img.buf = data;
+  img.pos = hdr[IMG_TOPO];
+  img.sz = img.pos + hdr[IMG_TOPOSZ];
+  if((str = image_string(&img)) == NULL) goto bad_file;
+  if((nn = nn_create(str)) == NULL) goto bad_file;
+  for(i = 0; i < nn->numlayers; i++)
+    for(j = 0; j < nn->layers[i].numslabs; j++)
+      if((str = image_string(&img)) == NULL ||
+	 nn_set_actfunc(nn, i, j, str) == NULL)
+	goto bad_file;
+
+  where = xmalloc((hdr[IMG_LINKS] + 1) * sizeof(double *));
+  need = xmalloc((hdr[IMG_LINKS] + 1) * sizeof(unsigned));
+  for(i = 0; i < hdr[IMG_LINKS]; i++) {
+    if((str = image_string(&img)) == NULL || nn_link(nn, str) == NULL)
+      goto bad_file;
+    link = nn->links[i];
+    if((v = image_words(&img, 4)) == NULL) goto bad_file;
+    need[i] = v[0];
+    if(v[3]) {
+      if(!link->index ||
+	 (start = image_words(&img, link->numout + 1)) == NULL ||
+	 (index = image_words(&img, start[link->numout])) == NULL ||
+	 nn_set_sparse(nn, i, start, index))
+	goto bad_file;
+    }
+    if(link->numweights != v[1] || v[2] < hdr[IMG_WEIGHTS] ||
+       (size_t)v[2] * IMAGE_ALIGN + (size_t)v[1] * sizeof(double) > size)
+      goto bad_file;
+    where[i] = (double *)(data + (size_t)v[2] * IMAGE_ALIGN);
+  }
+
+  if(map) {
+    for(i = 0; i < nn->numlinks; i++)
+      if(!need[i]) nn_lock_link(nn, i);
+    nn_freeze(nn);
+    nn_view_weights(nn, where);
+  }
+  else {
+    for(i = 0; i < nn->numlinks; i++) {
+      n = nn_link_blocks(nn->links[i], w, NULL, NULL, NULL, sz);
+      for(p = where[i], k = 0; k < n; p += sz[k], k++)
+	memcpy(w[k], p, sz[k] * sizeof(double));
+    }
+    for(i = 0; i < nn->numlinks; i++)
+      if(!need[i]) nn_lock_link(nn, i);
+  }
+  xfree(where);
+  xfree(need);
+  return(nn);
+
+ bad_file:
+  if(nn) nn_destroy(nn);
+  if(where) xfree(where);
+  if(need) xfree(need);
+  ulog(ULOG_WARN, "nn_read: error in image file '%s'.", fname);
+  return(NULL);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Read all of the already opened file fp into memory, and build the
+   image in it. */
+
+static NN *read_image_file(const char *fname, FILE *fp)
+{
+  unsigned char *data;
+  long size;
+  NN *nn = NULL;
+
+  if(fseek(fp, 0, SEEK_END) == -1 || (size = ftell(fp)) < IMAGE_ALIGN) {
+    ulog(ULOG_WARN, "nn_read: '%s' is too short.", fname);
+    fclose(fp);
+    return(NULL);
+  }
+  rewind(fp);
+  data = xmalloc(size);
+  if(fread(data, 1, size, fp) != (size_t)size)
+    ulog(ULOG_WARN, "nn_read: could not read '%s': %m.", fname);
+  else
+    nn = read_image(fname, data, size, 0);
+  xfree(data);
+  fclose(fp);
+  return(nn);
+}
+
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
 NN *nn_read(const char *fname)
@@ -38,7 +288,7 @@ NN *nn_read(const char *fname)
     ulog(ULOG_WARN, "nn_read: bad magic number in '%s': %m.", fname);
     return(NULL);
   }
-  if(type != 'a' && type != 'b') {
+  if(type != 'a' && type != 'b' && type != 'i') {
     ulog(ULOG_WARN, "nn_read: '%s' has a bad header: '%s'.", fname, magic);
     return(NULL);
   }
@@ -46,6 +296,8 @@ NN *nn_read(const char *fname)
     ulog(ULOG_WARN, "nn_read: version numbers of '%s' and library differ.%t"
 	 "library version = %d.%d, data file version = %d.%d.%t"
 	 "cross your fingers.", fname, NN_MAJOR_VER, NN_MINOR_VER, major, minor);
+  if(type == 'i')
+    return(read_image_file(fname, fp));
 
   s = scan_create(1, fp);
   s->delims = "";
@@ -68,8 +320,12 @@ NN *nn_read(const char *fname)
     if(nn_link(nn, line) == NULL) goto bad_file;
   }
 
-  need_grads = allocate_array(1, sizeof(unsigned), nn->numlinks);
   s->whites = " \n";
+  for(i = 0; i < k; i++)
+    if(nn->links[i]->index && read_sparse(s, nn, i))
+      goto bad_file;
+
+  need_grads = allocate_array(1, sizeof(unsigned), nn->numlinks);
   for(i = 0; i < k; i++) {
     if((line = scan_get(s)) == NULL) goto bad_file;
     need_grads[i] = atoi(line);
@@ -192,6 +448,22 @@ static void write_internal(NN *nn, FILE *fp, int bin, int verbose)
   for(i = 0; i < nn->numlinks; i++)
     fprintf(fp, "%s\n", nn->links[i]->format);
 
+  for(l = 0, sz = 0; l < nn->numlinks; l++)
+    if(nn->links[l]->index) sz++;
+  if(!bin && sz)
+    fputs("#\n# The next section gives for each output of each sparse "
+	  "link the number of\n# inputs that it is connected to, "
+	  "followed by the inputs:\n", fp);
+  for(l = 0; l < nn->numlinks; l++)
+    if(nn->links[l]->index)
+      for(i = 0; i < nn->links[l]->numout; i++) {
+	fprintf(fp, "%u", nn->links[l]->start[i + 1] - nn->links[l]->start[i]);
+	for(j = 1, k = nn->links[l]->start[i];
+	    k < nn->links[l]->start[i + 1]; j++, k++)
+	  fprintf(fp, (j % 16) ? " %u" : "\n%u", nn->links[l]->index[k]);
+	fputc('\n', fp);
+      }
+
   /* Need to temporarily set need_grads field so that all weights
    * are retreived.
    */
@@ -224,7 +496,19 @@ static void write_internal(NN *nn, FILE *fp, int bin, int verbose)
 	      fprintf(fp, "A[%d][%d][%d]\n", i, j, k);
 	    }
       
-      if(nn->links[l]->u)
+      if(nn->links[l]->u && nn->links[l]->index)
+	for(i = 0; i < nn->links[l]->numout; i++)
+	  for(k = nn->links[l]->start[i]; k < nn->links[l]->start[i + 1];
+	      k++) {
+	    fprintf(fp, nn_weight_fmt, nn->links[l]->u[0][k]);
+	    fprintf(fp, "\t# ");
+	    fprintf(fp, "( % d, % d ) ", nn->links[l]->source->layer->idl,
+		    nn->links[l]->source->layer->ids);
+	    fprintf(fp, "( % d, % d ) ", nn->links[l]->dest->layer->idl,
+		    nn->links[l]->dest->layer->ids);
+	    fprintf(fp, "u[%d][%d]\n", i, nn->links[l]->index[k]);
+	  }
+      else if(nn->links[l]->u)
 	for(i = 0; i < nn->links[l]->numout; i++)
 	  for(j = 0; j < nn->links[l]->numin; j++) {
 	    fprintf(fp, nn_weight_fmt, nn->links[l]->u[i][j]);
@@ -320,6 +604,146 @@ static void write_internal(NN *nn, FILE *fp, int bin, int verbose)
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
+/* The number of bytes that image_put_string() uses for str. */
+
+static size_t image_string_size(char *str)
+{
+  return((strlen(str) / sizeof(unsigned) + 2) * sizeof(unsigned));
+}
+
+/* Put the n words at w into img. */
+
+static void image_put_words(IMAGE *img, unsigned *w, unsigned n)
+{
+  memcpy(img->buf + img->pos, w, n * sizeof(unsigned));
+  img->pos += n * sizeof(unsigned);
+}
+
+/* Put str into img, in the format read by image_string().  The
+   buffer must already be zeroed. */
+
+static void image_put_string(IMAGE *img, char *str)
+{
+  unsigned len = strlen(str);
+
+  image_put_words(img, &len, 1);
+  memcpy(img->buf + img->pos, str, len);
+  img->pos += image_string_size(str) - sizeof(unsigned);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Write the binary image of nn to fp, and close it.  The whole image
+   is built in memory first, so that the checksum can go in the
+   header. */
+
+static int write_image(NN *nn, FILE *fp)
+{
+  IMAGE img;
+  NN_LINK *link;
+  unsigned hdr[IMG_WORDS], v[4], *offs, i, j, k, n, sz[6];
+  size_t toposz, wpos, tot;
+  double *w[6];
+  unsigned char *p;
+  char *arch;
+  int result = 0;
+
+  /* The architecture descriptor, as written by nn_write(). */
+  for(i = 0, n = 1; i < nn->numlayers; i++)
+    n += 2 + 11 * nn->layers[i].numslabs;
+  arch = xmalloc(n);
+  for(i = 0, k = 0; i < nn->numlayers; i++) {
+    arch[k++] = '(';
+    for(j = 0; j < nn->layers[i].numslabs; j++)
+      k += sprintf(arch + k, (j == 0) ? "%u" : " %u",
+		   nn->layers[i].slabs[j].sz);
+    arch[k++] = ')';
+  }
+  arch[k] = 0;
+
+  /* Find out how big the topology is, and where each link's weights
+   * will go after it.
+   */
+  toposz = image_string_size(arch);
+  for(i = 0; i < nn->numlayers; i++)
+    for(j = 0; j < nn->layers[i].numslabs; j++)
+      toposz += image_string_size(nn->layers[i].slabs[j].afunc->name);
+  for(i = 0; i < nn->numlinks; i++) {
+    link = nn->links[i];
+    toposz += image_string_size(link->format) + sizeof(v);
+    if(link->index)
+      toposz += (link->numout + 1 + link->start[link->numout]) *
+	sizeof(unsigned);
+  }
+  wpos = (IMAGE_ALIGN + toposz + IMAGE_ALIGN - 1) / IMAGE_ALIGN *
+    IMAGE_ALIGN;
+  offs = xmalloc((nn->numlinks + 1) * sizeof(unsigned));
+  for(tot = wpos, i = 0; i < nn->numlinks; i++) {
+    offs[i] = tot / IMAGE_ALIGN;
+    tot += (nn->links[i]->numweights * sizeof(double) + IMAGE_ALIGN - 1) /
+      IMAGE_ALIGN * IMAGE_ALIGN;
+  }
+  if(tot == wpos)
+    tot += IMAGE_ALIGN;
+
+  img.buf = xmalloc(tot);
+  img.sz = tot;
+  memset(img.buf, 0, tot);
+  sprintf((char *)img.buf, "#sn%d.%d:i\n", NN_MAJOR_VER, NN_MINOR_VER);
+
+  img.pos = IMAGE_ALIGN;
+  image_put_string(&img, arch);
+  for(i = 0; i < nn->numlayers; i++)
+    for(j = 0; j < nn->layers[i].numslabs; j++)
+      image_put_string(&img, nn->layers[i].slabs[j].afunc->name);
+  for(i = 0; i < nn->numlinks; i++) {
+    link = nn->links[i];
+    image_put_string(&img, link->format);
+    v[0] = link->need_grads;
+    v[1] = link->numweights;
+    v[2] = offs[i];
+    v[3] = (link->index != NULL);
+    image_put_words(&img, v, 4);
+    if(link->index) {
+      image_put_words(&img, link->start, link->numout + 1);
+      image_put_words(&img, link->index, link->start[link->numout]);
+    }
+
+    /* The weights of locked links are written too. */
+    p = img.buf + (size_t)offs[i] * IMAGE_ALIGN;
+    n = nn_link_blocks(link, w, NULL, NULL, NULL, sz);
+    for(k = 0; k < n; k++) {
+      memcpy(p, w[k], sz[k] * sizeof(double));
+      p += sz[k] * sizeof(double);
+    }
+  }
+
+  for(i = 0; i < IMG_WORDS; i++)
+    hdr[i] = 0;
+  hdr[IMG_ORDER] = IMAGE_ORDER;
+  hdr[IMG_VERSION] = NN_IMAGE_VER;
+  hdr[IMG_HEADER] = IMAGE_ALIGN;
+  hdr[IMG_TOPO] = IMAGE_ALIGN;
+  hdr[IMG_TOPOSZ] = toposz;
+  hdr[IMG_WEIGHTS] = wpos / IMAGE_ALIGN;
+  hdr[IMG_WEIGHTSZ] = (tot - wpos) / IMAGE_ALIGN;
+  hdr[IMG_LINKS] = nn->numlinks;
+  image_sum(img.buf + IMAGE_ALIGN, tot - IMAGE_ALIGN, &hdr[IMG_SUMA],
+	    &hdr[IMG_SUMB]);
+  memcpy(img.buf + IMAGE_MAGIC, hdr, sizeof(hdr));
+
+  if(fwrite(img.buf, 1, tot, fp) != tot)
+    result = 1;
+  if(fclose(fp) != 0)
+    result = 1;
+  xfree(img.buf);
+  xfree(offs);
+  xfree(arch);
+  return(result);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
 int nn_write(NN *nn, const char *fname)
 {
   FILE *fp;
@@ -352,12 +776,73 @@ int nn_write_binary(NN *nn, char *fname)
 {
   FILE *fp;
 
-  if((fp = fopen(fname, "w")) == NULL) {
+  if((fp = fopen(fname, "wb")) == NULL) {
     ulog(ULOG_WARN, "nn_write_binary: unable to open '%s': %m.", fname);
     return(1);
   }
-  write_internal(nn, fp, 1, 0);
+  if(write_image(nn, fp)) {
+    ulog(ULOG_WARN, "nn_write_binary: unable to write '%s': %m.", fname);
+    return(1);
+  }
   return(0);
 }
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+NN *nn_map(const char *fname)
+{
+  NN *nn;
+#ifdef NL_MMAP
+  struct stat st;
+  void *map;
+  char *colon, *nl;
+  size_t n;
+  int fd;
+
+  if((fd = open(fname, O_RDONLY)) < 0) {
+    ulog(ULOG_WARN, "nn_map: unable to open '%s': %m.", fname);
+    return(NULL);
+  }
+  if(fstat(fd, &st) != 0) {
+    ulog(ULOG_WARN, "nn_map: unable to stat '%s': %m.", fname);
+    close(fd);
+    return(NULL);
+  }
+
+  /* Anything but an image is just read. */
+  if(st.st_size < IMAGE_ALIGN ||
+     (map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+		 fd, 0)) == MAP_FAILED) {
+    close(fd);
+    if((nn = nn_read(fname)) != NULL)
+      nn_freeze(nn);
+    return(nn);
+  }
+  close(fd);
+
+  /* The mapping is not a string, so only look inside the magic line. */
+  n = (st.st_size < IMAGE_MAGIC) ? st.st_size : IMAGE_MAGIC;
+  colon = memchr(map, ':', n);
+  nl = memchr(map, '\n', n);
+  if(strncmp(map, "#sn", 3) != 0 || colon == NULL ||
+     (nl != NULL && nl < colon) || colon + 1 >= (char *)map + n ||
+     colon[1] != 'i') {
+    munmap(map, st.st_size);
+    if((nn = nn_read(fname)) != NULL)
+      nn_freeze(nn);
+    return(nn);
+  }
+  if((nn = read_image(fname, map, st.st_size, 1)) == NULL) {
+    munmap(map, st.st_size);
+    return(NULL);
+  }
+  nn->map = map;
+  nn->mapsz = st.st_size;
+#else
+  if((nn = nn_read(fname)) != NULL)
+    nn_freeze(nn);
+#endif
+  return(nn);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
@@ -0,0 +1,748 @@
+
+/* Copyright (c) 2000 by G. W. Flake. */
+
+/* Inner loops for the builtin net functions.  Each kernel is marked
+   with NL_KERNEL, so it may be compiled for several instruction sets,
+   with the best version for the running CPU chosen at load time.
+
+   If NL_KERNEL_VECTORS is defined, the bulk of the work is done on
+   vectors of four doubles.  A forward pass computes four rows at a
+   time, reading a 4 by 4 block from each of four rows and transposing
+   it in registers, while a backward pass computes four or eight
+   columns at a time as it walks down the rows.  Either way, every
+   lane of a vector is a sum that is accumulated in exactly the same
+   order as in a plain scalar loop, which is used for the leftover
+   rows and columns (and for everything if there are no vectors).
+   Thus, every version of a kernel gives the same answer as the
+   others, and as the batch versions of the net functions.  This
+   assumes that the compiler does not fuse multiplies and adds; see
+   etc/Configure. */
+
+#include <stdlib.h>
+#include <string.h>
+#include "nodelib/nn.h"
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+#ifdef NL_KERNEL_VECTORS
+
+typedef double kvec __attribute__((vector_size(4 * sizeof(double))));
+typedef long long kint __attribute__((vector_size(4 * sizeof(long long))));
+
+#define KZERO         ((kvec) { 0, 0, 0, 0 })
+#define KLOAD(v, p)   memcpy(&(v), (p), sizeof(kvec))
+#define KSTORE(p, v)  memcpy((p), &(v), sizeof(kvec))
+#define KCOL(u, i, j) ((kvec) { (u)[i][j], (u)[(i) + 1][j], \
+                                (u)[(i) + 2][j], (u)[(i) + 3][j] })
+
+/* Set c[k] to (p0[k], p1[k], p2[k], p3[k]) for k from 0 to 3. */
+
+static INLINE void kern_trans(kvec *c, double *p0, double *p1,
+			      double *p2, double *p3)
+{
+  kvec r0, r1, r2, r3, t0, t1, t2, t3;
+
+  KLOAD(r0, p0);
+  KLOAD(r1, p1);
+  KLOAD(r2, p2);
+  KLOAD(r3, p3);
+  t0 = __builtin_shuffle(r0, r1, (kint) { 0, 4, 2, 6 });
+  t1 = __builtin_shuffle(r0, r1, (kint) { 1, 5, 3, 7 });
+  t2 = __builtin_shuffle(r2, r3, (kint) { 0, 4, 2, 6 });
+  t3 = __builtin_shuffle(r2, r3, (kint) { 1, 5, 3, 7 });
+  c[0] = __builtin_shuffle(t0, t2, (kint) { 0, 1, 4, 5 });
+  c[1] = __builtin_shuffle(t1, t3, (kint) { 0, 1, 4, 5 });
+  c[2] = __builtin_shuffle(t0, t2, (kint) { 2, 3, 6, 7 });
+  c[3] = __builtin_shuffle(t1, t3, (kint) { 2, 3, 6, 7 });
+}
+
+/* Transpose the 4 by 4 block at row i and column j of u. */
+
+#define KTRANS(c, u, i, j) \
+  kern_trans((c), (u)[i] + (j), (u)[(i) + 1] + (j), \
+	     (u)[(i) + 2] + (j), (u)[(i) + 3] + (j))
+
+#endif /* NL_KERNEL_VECTORS */
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* x[i] (+)= sum_j u[i][j] * y[j] + a[i], where the sum is added to the
+   old value of x[i] if accum is nonzero. */
+
+NL_KERNEL
+void nn_kern_matvec(double *x, double **u, double *y, double *a,
+		    unsigned m, unsigned n, int accum)
+{
+  unsigned i = 0, j;
+  double sum;
+#ifdef NL_KERNEL_VECTORS
+  kvec s0, s1, c0[4], c1[4];
+  unsigned k, r;
+
+  /* Two groups of four rows keep two chains of sums going at once. */
+  for(; i + 8 <= m; i += 8) {
+    s0 = s1 = KZERO;
+    for(j = 0; j + 4 <= n; j += 4) {
+      KTRANS(c0, u, i, j);
+      KTRANS(c1, u, i + 4, j);
+      for(k = 0; k < 4; k++) {
+	s0 += c0[k] * y[j + k];
+	s1 += c1[k] * y[j + k];
+      }
+    }
+    for(; j < n; j++) {
+      s0 += KCOL(u, i, j) * y[j];
+      s1 += KCOL(u, i + 4, j) * y[j];
+    }
+    for(r = 0; r < 4; r++) {
+      x[i + r] = accum ? x[i + r] + (s0[r] + a[i + r]) : s0[r] + a[i + r];
+      x[i + r + 4] = accum ? x[i + r + 4] + (s1[r] + a[i + r + 4]) :
+	s1[r] + a[i + r + 4];
+    }
+  }
+#endif
+  for(; i < m; i++) {
+    sum = 0;
+    for(j = 0; j < n; j++)
+      sum += u[i][j] * y[j];
+    x[i] = accum ? x[i] + (sum + a[i]) : sum + a[i];
+  }
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Rx[i] += sum_j (Ry[j] * u[i][j] + Ru[i][j] * y[j]) + Ra[i]. */
+
+NL_KERNEL
+void nn_kern_matvec_R(double *Rx, double **u, double **Ru, double *y,
+		      double *Ry, double *Ra, unsigned m, unsigned n)
+{
+  unsigned i = 0, j;
+  double sum;
+#ifdef NL_KERNEL_VECTORS
+  kvec s, cu[4], cRu[4];
+  unsigned k, r;
+
+  for(; i + 4 <= m; i += 4) {
+    s = KZERO;
+    for(j = 0; j + 4 <= n; j += 4) {
+      KTRANS(cu, u, i, j);
+      KTRANS(cRu, Ru, i, j);
+      for(k = 0; k < 4; k++)
+	s += Ry[j + k] * cu[k] + cRu[k] * y[j + k];
+    }
+    for(; j < n; j++)
+      s += Ry[j] * KCOL(u, i, j) + KCOL(Ru, i, j) * y[j];
+    for(r = 0; r < 4; r++)
+      Rx[i + r] += s[r] + Ra[i + r];
+  }
+#endif
+  for(; i < m; i++) {
+    sum = 0;
+    for(j = 0; j < n; j++)
+      sum += Ry[j] * u[i][j] + Ru[i][j] * y[j];
+    Rx[i] += sum + Ra[i];
+  }
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* x[i] += sum_j (u[i][j] * y[j] + v[i][j] * y[j] * y[j]) + a[i]. */
+
+NL_KERNEL
+void nn_kern_diagvec(double *x, double **u, double **v, double *y,
+		     double *a, unsigned m, unsigned n)
+{
+  unsigned i = 0, j;
+  double sum;
+#ifdef NL_KERNEL_VECTORS
+  kvec s, cu[4], cv[4];
+  unsigned k, r;
+
+  for(; i + 4 <= m; i += 4) {
+    s = KZERO;
+    for(j = 0; j + 4 <= n; j += 4) {
+      KTRANS(cu, u, i, j);
+      KTRANS(cv, v, i, j);
+      for(k = 0; k < 4; k++)
+	s += cu[k] * y[j + k] + cv[k] * y[j + k] * y[j + k];
+    }
+    for(; j < n; j++)
+      s += KCOL(u, i, j) * y[j] + KCOL(v, i, j) * y[j] * y[j];
+    for(r = 0; r < 4; r++)
+      x[i + r] += s[r] + a[i + r];
+  }
+#endif
+  for(; i < m; i++) {
+    sum = 0;
+    for(j = 0; j < n; j++)
+      sum += u[i][j] * y[j] + v[i][j] * y[j] * y[j];
+    x[i] += sum + a[i];
+  }
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* x[i] += sum_j (sum_k A[i][j][k] * y[j] * y[k] + u[i][j] * y[j]) + a[i],
+   with the terms summed in that order. */
+
+NL_KERNEL
+void nn_kern_quadvec(double *x, double ***A, double **u, double *y,
+		     double *a, unsigned m, unsigned n)
+{
+  unsigned i = 0, j, k;
+  double sum;
+#ifdef NL_KERNEL_VECTORS
+  kvec s, c[4];
+  unsigned kk, r;
+
+  for(; i + 4 <= m; i += 4) {
+    s = KZERO;
+    for(j = 0; j < n; j++) {
+      for(k = 0; k + 4 <= n; k += 4) {
+	kern_trans(c, A[i][j] + k, A[i + 1][j] + k, A[i + 2][j] + k,
+		   A[i + 3][j] + k);
+	for(kk = 0; kk < 4; kk++)
+	  s += c[kk] * y[j] * y[k + kk];
+      }
+      for(; k < n; k++)
+	s += (kvec) { A[i][j][k], A[i + 1][j][k], A[i + 2][j][k],
+			A[i + 3][j][k] } * y[j] * y[k];
+      s += KCOL(u, i, j) * y[j];
+    }
+    for(r = 0; r < 4; r++)
+      x[i + r] += s[r] + a[i + r];
+  }
+#endif
+  for(; i < m; i++) {
+    sum = 0;
+    for(j = 0; j < n; j++) {
+      for(k = 0; k < n; k++)
+	sum += A[i][j][k] * y[j] * y[k];
+      sum += u[i][j] * y[j];
+    }
+    x[i] += sum + a[i];
+  }
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* dy[j] (+)= sum_i dx[i] * u[i][off + j], where the sum is added to the
+   old value of dy[j] if accum is nonzero. */
+
+NL_KERNEL
+void nn_kern_vecmat(double *dy, double *dx, double **u, unsigned off,
+		    unsigned m, unsigned n, int accum)
+{
+  unsigned i, j = 0;
+  double sum;
+#ifdef NL_KERNEL_VECTORS
+  kvec s0, s1, v0, v1;
+
+  for(; j + 8 <= n; j += 8) {
+    s0 = s1 = KZERO;
+    for(i = 0; i < m; i++) {
+      KLOAD(v0, u[i] + off + j);
+      KLOAD(v1, u[i] + off + j + 4);
+      s0 += dx[i] * v0;
+      s1 += dx[i] * v1;
+    }
+    if(accum) {
+      KLOAD(v0, dy + j);
+      KLOAD(v1, dy + j + 4);
+      s0 = v0 + s0;
+      s1 = v1 + s1;
+    }
+    KSTORE(dy + j, s0);
+    KSTORE(dy + j + 4, s1);
+  }
+#endif
+  for(; j < n; j++) {
+    sum = 0;
+    for(i = 0; i < m; i++)
+      sum += dx[i] * u[i][off + j];
+    dy[j] = accum ? dy[j] + sum : sum;
+  }
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Rdy[j] += sum_i (Rdx[i] * u[i][j] + Ru[i][j] * dx[i]). */
+
+NL_KERNEL
+void nn_kern_vecmat_R(double *Rdy, double *dx, double *Rdx, double **u,
+		      double **Ru, unsigned m, unsigned n)
+{
+  unsigned i, j = 0;
+  double sum;
+#ifdef NL_KERNEL_VECTORS
+  kvec s0, s1, v0, v1, w0, w1;
+
+  for(; j + 8 <= n; j += 8) {
+    s0 = s1 = KZERO;
+    for(i = 0; i < m; i++) {
+      KLOAD(v0, u[i] + j);
+      KLOAD(v1, u[i] + j + 4);
+      KLOAD(w0, Ru[i] + j);
+      KLOAD(w1, Ru[i] + j + 4);
+      s0 += Rdx[i] * v0 + w0 * dx[i];
+      s1 += Rdx[i] * v1 + w1 * dx[i];
+    }
+    KLOAD(v0, Rdy + j);
+    KLOAD(v1, Rdy + j + 4);
+    s0 = v0 + s0;
+    s1 = v1 + s1;
+    KSTORE(Rdy + j, s0);
+    KSTORE(Rdy + j + 4, s1);
+  }
+#endif
+  for(; j < n; j++) {
+    sum = 0;
+    for(i = 0; i < m; i++)
+      sum += Rdx[i] * u[i][j] + Ru[i][j] * dx[i];
+    Rdy[j] += sum;
+  }
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* dy[j] += sum_i dx[i] * (u[i][j] + 2 * v[i][j] * y[j]). */
+
+NL_KERNEL
+void nn_kern_diagvecmat(double *dy, double *dx, double **u, double **v,
+			double *y, unsigned m, unsigned n)
+{
+  unsigned i, j = 0;
+  double sum;
+#ifdef NL_KERNEL_VECTORS
+  kvec s0, s1, v0, v1, w0, w1, y0, y1;
+
+  for(; j + 8 <= n; j += 8) {
+    s0 = s1 = KZERO;
+    KLOAD(y0, y + j);
+    KLOAD(y1, y + j + 4);
+    for(i = 0; i < m; i++) {
+      KLOAD(v0, u[i] + j);
+      KLOAD(v1, u[i] + j + 4);
+      KLOAD(w0, v[i] + j);
+      KLOAD(w1, v[i] + j + 4);
+      s0 += dx[i] * (v0 + 2.0 * w0 * y0);
+      s1 += dx[i] * (v1 + 2.0 * w1 * y1);
+    }
+    KLOAD(v0, dy + j);
+    KLOAD(v1, dy + j + 4);
+    s0 = v0 + s0;
+    s1 = v1 + s1;
+    KSTORE(dy + j, s0);
+    KSTORE(dy + j + 4, s1);
+  }
+#endif
+  for(; j < n; j++) {
+    sum = 0;
+    for(i = 0; i < m; i++)
+      sum += dx[i] * (u[i][j] + 2.0 * v[i][j] * y[j]);
+    dy[j] += sum;
+  }
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* dy[j] += sum_i (u[i][j] + sum_k (A[i][j][k] + A[i][k][j]) * y[k] -
+   A[i][j][j] * y[j]) * dx[i]. */
+
+NL_KERNEL
+void nn_kern_quadvecmat(double *dy, double *dx, double ***A, double **u,
+			double *y, unsigned m, unsigned n)
+{
+  unsigned i, j = 0, k;
+  double sum1, sum2;
+#ifdef NL_KERNEL_VECTORS
+  kvec s1, s2, c[4], v, yj;
+  unsigned kk;
+
+  for(; j + 4 <= n; j += 4) {
+    s1 = KZERO;
+    KLOAD(yj, y + j);
+    for(i = 0; i < m; i++) {
+      s2 = KZERO;
+      for(k = 0; k + 4 <= n; k += 4) {
+	KTRANS(c, A[i], j, k);
+	for(kk = 0; kk < 4; kk++) {
+	  KLOAD(v, A[i][k + kk] + j);
+	  s2 += (c[kk] + v) * y[k + kk];
+	}
+      }
+      for(; k < n; k++) {
+	KLOAD(v, A[i][k] + j);
+	s2 += (KCOL(A[i], j, k) + v) * y[k];
+      }
+      KLOAD(v, u[i] + j);
+      s1 += (v + s2 - (kvec) { A[i][j][j], A[i][j + 1][j + 1],
+			       A[i][j + 2][j + 2], A[i][j + 3][j + 3] } *
+	     yj) * dx[i];
+    }
+    KLOAD(v, dy + j);
+    s1 = v + s1;
+    KSTORE(dy + j, s1);
+  }
+#endif
+  for(; j < n; j++) {
+    sum1 = 0;
+    for(i = 0; i < m; i++) {
+      sum2 = 0;
+      for(k = 0; k < n; k++)
+	sum2 += (A[i][j][k] + A[i][k][j]) * y[k];
+      sum1 += (u[i][j] + sum2 - A[i][j][j] * y[j]) * dx[i];
+    }
+    dy[j] += sum1;
+  }
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* du[i][j] = dx[i] * y[j].  This and the other outer products below
+   need no help from us to be vectorized. */
+
+NL_KERNEL
+void nn_kern_outer(double **du, double *dx, double *y, unsigned m,
+		   unsigned n)
+{
+  double *row, d;
+  unsigned i, j;
+
+  for(i = 0; i < m; i++) {
+    row = du[i];
+    d = dx[i];
+    for(j = 0; j < n; j++)
+      row[j] = d * y[j];
+  }
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Rdu[i][j] = Rdx[i] * y[j] + Ry[j] * dx[i]. */
+
+NL_KERNEL
+void nn_kern_outer_R(double **Rdu, double *dx, double *Rdx, double *y,
+		     double *Ry, unsigned m, unsigned n)
+{
+  double *row, d, Rd;
+  unsigned i, j;
+
+  for(i = 0; i < m; i++) {
+    row = Rdu[i];
+    d = dx[i];
+    Rd = Rdx[i];
+    for(j = 0; j < n; j++)
+      row[j] = Rd * y[j] + Ry[j] * d;
+  }
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* du[i][j] = dx[i] * y[j] and dv[i][j] = dx[i] * y[j] * y[j]. */
+
+NL_KERNEL
+void nn_kern_diagouter(double **du, double **dv, double *dx, double *y,
+		       unsigned m, unsigned n)
+{
+  double *urow, *vrow, d;
+  unsigned i, j;
+
+  for(i = 0; i < m; i++) {
+    urow = du[i];
+    vrow = dv[i];
+    d = dx[i];
+    for(j = 0; j < n; j++) {
+      urow[j] = d * y[j];
+      vrow[j] = d * y[j] * y[j];
+    }
+  }
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* G[i][j] += sum_r d[r] * J[r][i] * J[r][j] for r < k and i <= j < n,
+   which is the upper triangle of a symmetric rank-k update.  G only
+   needs valid entries at and above the diagonal.  The columns are
+   taken in blocks so that the rows of J being read stay in the cache,
+   but every entry still adds up its terms in order of r.  Terms with
+   a zero d[r] * J[r][i], which are common when a weight only feeds
+   some of the outputs, are skipped. */
+
+#define KERN_SYRK_BLOCK 256
+
+NL_KERNEL
+void nn_kern_syrk(double **G, double **J, double *d, unsigned k,
+		  unsigned n)
+{
+  double *row, *col, s;
+  unsigned i, j, r, jb, j0, j1;
+
+  for(jb = 0; jb < n; jb += KERN_SYRK_BLOCK) {
+    j1 = (n - jb > KERN_SYRK_BLOCK) ? jb + KERN_SYRK_BLOCK : n;
+    for(i = 0; i < j1; i++) {
+      row = G[i];
+      j0 = (i > jb) ? i : jb;
+      for(r = 0; r < k; r++) {
+	if((s = d[r] * J[r][i]) == 0.0)
+	  continue;
+	col = J[r];
+	for(j = j0; j < j1; j++)
+	  row[j] += s * col[j];
+      }
+    }
+  }
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Single precision versions of nn_kern_matvec() and nn_kern_vecmat()
+   for compiled plans (see nn_set_single()).  The weights and the
+   vector are floats, as are the products and the partial sums of
+   each vector lane, but each dot product is finished in double and
+   the answers are doubles.  These make no promise to match any other
+   order of summation. */
+
+#ifdef NL_KERNEL_VECTORS
+
+typedef float kfvec __attribute__((vector_size(8 * sizeof(float))));
+
+#define KFZERO ((kfvec) { 0, 0, 0, 0, 0, 0, 0, 0 })
+
+#endif /* NL_KERNEL_VECTORS */
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* x[i] = sum_j u[i][j] * y[j] + a[i]. */
+
+NL_KERNEL
+void nn_kern_matvec_f(double *x, float **u, float *y, double *a,
+		      unsigned m, unsigned n)
+{
+  unsigned i, j;
+  double sum;
+#ifdef NL_KERNEL_VECTORS
+  kfvec s0, s1, r0, r1, v0, v1;
+  unsigned k;
+#endif
+
+  for(i = 0; i < m; i++) {
+    sum = 0;
+    j = 0;
+#ifdef NL_KERNEL_VECTORS
+    s0 = s1 = KFZERO;
+    for(; j + 16 <= n; j += 16) {
+      memcpy(&r0, u[i] + j, sizeof(kfvec));
+      memcpy(&r1, u[i] + j + 8, sizeof(kfvec));
+      memcpy(&v0, y + j, sizeof(kfvec));
+      memcpy(&v1, y + j + 8, sizeof(kfvec));
+      s0 += r0 * v0;
+      s1 += r1 * v1;
+    }
+    s0 += s1;
+    for(k = 0; k < 8; k++)
+      sum += s0[k];
+#endif
+    for(; j < n; j++)
+      sum += u[i][j] * y[j];
+    x[i] = sum + a[i];
+  }
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* dy[j] = sum_i dx[i] * u[i][off + j]. */
+
+NL_KERNEL
+void nn_kern_vecmat_f(double *dy, float *dx, float **u, unsigned off,
+		      unsigned m, unsigned n)
+{
+  unsigned i, j = 0;
+  double sum;
+#ifdef NL_KERNEL_VECTORS
+  kfvec s0, s1, v0, v1;
+  unsigned k;
+
+  for(; j + 16 <= n; j += 16) {
+    s0 = s1 = KFZERO;
+    for(i = 0; i < m; i++) {
+      memcpy(&v0, u[i] + off + j, sizeof(kfvec));
+      memcpy(&v1, u[i] + off + j + 8, sizeof(kfvec));
+      s0 += dx[i] * v0;
+      s1 += dx[i] * v1;
+    }
+    for(k = 0; k < 8; k++) {
+      dy[j + k] = s0[k];
+      dy[j + k + 8] = s1[k];
+    }
+  }
+#endif
+  for(; j < n; j++) {
+    sum = 0;
+    for(i = 0; i < m; i++)
+      sum += dx[i] * u[i][off + j];
+    dy[j] = sum;
+  }
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Approximations for the fast modes of the builtin activation
+   functions.  Everything is built on one exp(): x is split into
+   k * ln(2) + r with |r| <= ln(2) / 2, a degree 12 Taylor polynomial
+   gives exp(r), and 2^k is put straight into the exponent bits.
+   Arguments are clamped to [-708, 709] so that the answer is always
+   a normal number, so exp() of a large argument is large but finite
+   and exp() of a very negative argument is tiny but not zero. */
+
+#ifdef NL_KERNEL_VECTORS
+
+#define KSEL(m, a, b) ((kvec) (((kint) (a) & (m)) | ((kint) (b) & ~(m))))
+
+#define KEXP_SHIFT 6755399441055744.0     /* 1.5 * 2^52 */
+#define KEXP_LN2HI 6.93147180369123816490e-01
+#define KEXP_LN2LO 1.90821492927058770002e-10
+
+static INLINE void kern_exp(kvec *y, kvec *x)
+{
+  kvec z, t, k, r, p;
+  kint e;
+
+  z = KSEL(*x < -708.0, KZERO - 708.0, *x);
+  z = KSEL(z > 709.0, KZERO + 709.0, z);
+
+  /* Adding 1.5 * 2^52 rounds z / ln(2) to an integer k, which is
+     left in the low bits of t. */
+  t = z * 1.44269504088896338700 + KEXP_SHIFT;
+  k = t - KEXP_SHIFT;
+  r = (z - k * KEXP_LN2HI) - k * KEXP_LN2LO;
+
+  p = r * (1.0 / 479001600) + 1.0 / 39916800;
+  p = p * r + 1.0 / 3628800;
+  p = p * r + 1.0 / 362880;
+  p = p * r + 1.0 / 40320;
+  p = p * r + 1.0 / 5040;
+  p = p * r + 1.0 / 720;
+  p = p * r + 1.0 / 120;
+  p = p * r + 1.0 / 24;
+  p = p * r + 1.0 / 6;
+  p = p * r + 0.5;
+  p = p * r + 1.0;
+  p = p * r + 1.0;
+
+  e = ((kint) t - (kint) (KZERO + KEXP_SHIFT)) << 52;
+  *y = (kvec) ((kint) p + e);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* tanh(x) = (1 - exp(-2|x|)) / (1 + exp(-2|x|)), with the sign of x. */
+
+static INLINE void kern_tanh(kvec *y, kvec *x)
+{
+  kint sign = (kint) -KZERO;
+  kvec t, e;
+
+  t = (kvec) ((kint) *x & ~sign);
+  t = -2.0 * t;
+  kern_exp(&e, &t);
+  t = (1.0 - e) / (1.0 + e);
+  *y = (kvec) ((kint) t | ((kint) *x & sign));
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* The same clamping as the exact logistic function. */
+
+static INLINE void kern_logistic(kvec *y, kvec *x)
+{
+  kvec t, e;
+
+  t = -*x;
+  kern_exp(&e, &t);
+  t = 1.0 / (e + 1.0);
+  t = KSEL(*x > 1000.0, KZERO + (1.0 - 1e-8), t);
+  *y = KSEL(*x < -1000.0, KZERO + (0.0 + 1e-8), t);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+static INLINE void kern_gauss(kvec *y, kvec *x)
+{
+  kvec t;
+
+  t = -(*x * *x);
+  kern_exp(y, &t);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+static INLINE void kern_expnx(kvec *y, kvec *x)
+{
+  kvec t;
+
+  t = -*x;
+  kern_exp(y, &t);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Map the n values of x through op and into y.  The last few values
+   are copied into a padded vector so that they get the same answers
+   as they would have elsewhere in the array. */
+
+static INLINE void kern_apply(double *x, double *y, unsigned n,
+			      void (*op)(kvec *y, kvec *x))
+{
+  kvec vx, vy;
+  unsigned i;
+
+  for(i = 0; i + 4 <= n; i += 4) {
+    KLOAD(vx, x + i);
+    op(&vy, &vx);
+    KSTORE(y + i, vy);
+  }
+  if(i < n) {
+    vx = KZERO;
+    memcpy(&vx, x + i, (n - i) * sizeof(double));
+    op(&vy, &vx);
+    memcpy(y + i, &vy, (n - i) * sizeof(double));
+  }
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+NL_KERNEL
+void nn_kern_fast_tanh(double *x, double *y, unsigned n)
+{
+  kern_apply(x, y, n, kern_tanh);
+}
+
+NL_KERNEL
+void nn_kern_fast_logistic(double *x, double *y, unsigned n)
+{
+  kern_apply(x, y, n, kern_logistic);
+}
+
+NL_KERNEL
+void nn_kern_fast_gauss(double *x, double *y, unsigned n)
+{
+  kern_apply(x, y, n, kern_gauss);
+}
+
+NL_KERNEL
+void nn_kern_fast_exp(double *x, double *y, unsigned n)
+{
+  kern_apply(x, y, n, kern_exp);
+}
+
+NL_KERNEL
+void nn_kern_fast_expnx(double *x, double *y, unsigned n)
+{
+  kern_apply(x, y, n, kern_expnx);
+}
+
+#endif /* NL_KERNEL_VECTORS */
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
@@ -154,13 +154,14 @@ NN_LINK *nn_link(NN *nn, char *format, ...)
 {
   va_list args;
   char *buffer;
-  unsigned numin, numout, numaux, weightbits;
+  unsigned numin, numout, numaux, weightbits, i;
   NN_LAYERLIST *src, *dst, *l;
   char netf[2] = "l";
   NN_NETFUNC *nf;
   NN_LINK *link;
   int sanity;
 
+  if(nn_check_not_frozen(nn, "nn_link")) return(NULL);
   va_start(args, format);
   buffer = xmalloc(strlen(format) * 3 * sizeof(char));
   vsprintf(buffer, format, args);
@@ -189,6 +190,7 @@ NN_LINK *nn_link(NN *nn, char *format, ...)
   link->RA = link->RdA = NULL;
   link->Ru = link->Rdu = link->Rv = link->Rdv = link->Rw = link->Rdw = NULL;
   link->Ra = link->Rda = link->Rb = link->Rdb = NULL;
+  link->start = link->index = NULL;
   link->source = src;
   link->dest = dst;
   link->nfunc = nf;
@@ -200,52 +202,55 @@ NN_LINK *nn_link(NN *nn, char *format, ...)
   link->numout = numout;
   link->numaux = numaux;
   link->numweights = 0;
+  link->shared = 0;
+  link->packed = 0;
 
   if(weightbits & NN_WMATRIX) {
     link->A = allocate_array(3, sizeof(double), numout, numin, numin);
     link->dA = allocate_array(3, sizeof(double), numout, numin, numin);
-    link->RA = allocate_array(3, sizeof(double), numout, numin, numin);
-    link->RdA = allocate_array(3, sizeof(double), numout, numin, numin);
     nn->numweights += numout * numin * numin;
     link->numweights += numout * numin * numin;
   }
-  if(weightbits & NN_WVECTOR_1) {
+  if((weightbits & NN_WVECTOR_1) && (weightbits & NN_WSPARSE)) {
+    /* A sparse link starts out with every connection. */
+    link->start = xmalloc((numout + 1) * sizeof(unsigned));
+    link->index = xmalloc(numout * numin * sizeof(unsigned));
+    for(i = 0; i <= numout; i++)
+      link->start[i] = i * numin;
+    for(i = 0; i < numout * numin; i++)
+      link->index[i] = i % numin;
+    link->u = nn_sparse_array(numout, link->start, NULL);
+    link->du = nn_sparse_array(numout, link->start, NULL);
+    nn->numweights += numout * numin;
+    link->numweights += numout * numin;
+  }
+  else if(weightbits & NN_WVECTOR_1) {
     link->u = allocate_array(2, sizeof(double), numout, numin);
     link->du = allocate_array(2, sizeof(double), numout, numin);
-    link->Ru = allocate_array(2, sizeof(double), numout, numin);
-    link->Rdu = allocate_array(2, sizeof(double), numout, numin);
     nn->numweights += numout * numin;
     link->numweights += numout * numin;
   }
   if(weightbits & NN_WVECTOR_2) {
     link->v = allocate_array(2, sizeof(double), numout, numin);
     link->dv = allocate_array(2, sizeof(double), numout, numin);
-    link->Rv = allocate_array(2, sizeof(double), numout, numin);
-    link->Rdv = allocate_array(2, sizeof(double), numout, numin);
     nn->numweights += numout * numin;
     link->numweights += numout * numin;
   }
   if(weightbits & NN_WUSER) {
     link->w = allocate_array(2, sizeof(double), numout, numaux);
     link->dw = allocate_array(2, sizeof(double), numout, numaux);
-    link->Rw = allocate_array(2, sizeof(double), numout, numaux);
-    link->Rdw = allocate_array(2, sizeof(double), numout, numaux);
     nn->numweights += numout * numaux;
     link->numweights += numout * numaux;
   }
   if(weightbits & NN_WSCALAR_1) {
     link->a = allocate_array(1, sizeof(double), numout);
     link->da = allocate_array(1, sizeof(double), numout);
-    link->Ra = allocate_array(1, sizeof(double), numout);
-    link->Rda = allocate_array(1, sizeof(double), numout);
     nn->numweights += numout;
     link->numweights += numout;
   }
   if(weightbits & NN_WSCALAR_2) {
     link->b = allocate_array(1, sizeof(double), numout);
     link->db = allocate_array(1, sizeof(double), numout);
-    link->Rb = allocate_array(1, sizeof(double), numout);
-    link->Rdb = allocate_array(1, sizeof(double), numout);
     nn->numweights += numout;
     link->numweights += numout;
   }
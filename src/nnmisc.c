@@ -3,9 +3,11 @@
 
 #include <stdlib.h>
 #include <math.h>
+#include <string.h>
 #include "nodelib/misc.h"
 #include "nodelib/nn.h"
 #include "nodelib/optimize.h"
+#include "nodelib/thread.h"
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
@@ -94,101 +96,334 @@ static void update_all_need_grads_flags(NN *nn)
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
+/* The number of u weights in link, which is less than numin * numout
+   for a sparse link. */
+
+static unsigned link_usize(NN_LINK *link)
+{
+  if(link->index)
+    return(link->start[link->numout]);
+  return(link->numin * link->numout);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Make the rows of a sparse u array with numout rows, where row i
+   starts start[i] elements into the data.  If data is NULL, then the
+   space for the data is allocated in the same block as the row
+   pointers, so that either kind of array can be freed with
+   deallocate_array(). */
+
+double **nn_sparse_array(unsigned numout, unsigned *start, double *data)
+{
+  extern const size_t xalloc_magic;
+  double **rows;
+  size_t sz;
+  unsigned i;
+
+  if(data == NULL) {
+    sz = numout * sizeof(double *);
+    sz = ((sz + xalloc_magic - 1) / xalloc_magic) * xalloc_magic;
+    rows = xmalloc(sz + (start[numout] + 1) * sizeof(double));
+    data = (double *)((char *)rows + sz);
+  }
+  else
+    rows = xmalloc(numout * sizeof(double *));
+  for(i = 0; i < numout; i++)
+    rows[i] = data + start[i];
+  return(rows);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* The alignment, in bytes, of the vectors made by nn_pack(). */
+
+#define PACK_ALIGN 64
+
+/* Copy the dim dimensional array at *array to the front of *next, and
+   replace it with a view into that space.  The old array is freed,
+   unless it was a one dimensional view into the old packed buffer. */
+
+static void pack_array(void *array, double **next, int packed, unsigned dim,
+		       unsigned n0, unsigned n1, unsigned n2)
+{
+  void **hold = array;
+  double *src;
+  unsigned sz;
+
+  if(dim == 3) {
+    src = &((double ***)*hold)[0][0][0];
+    sz = n0 * n1 * n2;
+  }
+  else if(dim == 2) {
+    src = &((double **)*hold)[0][0];
+    sz = n0 * n1;
+  }
+  else {
+    src = *hold;
+    sz = n0;
+  }
+  memcpy(*next, src, sz * sizeof(double));
+  if(dim > 1 || !packed)
+    deallocate_array(*hold);
+  *hold = allocate_array_view(*next, dim, sizeof(double), n0, n1, n2);
+  *next += sz;
+}
+
+/* Same as pack_array(), for the sparse u array of link. */
+
+static void pack_sparse(double ***array, double **next, NN_LINK *link)
+{
+  unsigned sz = link->start[link->numout];
+
+  memcpy(*next, (*array)[0], sz * sizeof(double));
+  deallocate_array(*array);
+  *array = nn_sparse_array(link->numout, link->start, *next);
+  *next += sz;
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Move the weights and derivatives of one link to *w and *g, in the
+   same order used by update_pointer_pointers().  A frozen link has no
+   derivatives, in which case *g is NULL. */
+
+static void pack_link(NN_LINK *link, double **w, double **g)
+{
+  unsigned numin = link->numin, numout = link->numout;
+  unsigned numaux = link->numaux, packed = link->packed;
+
+  if(link->A) {
+    pack_array(&link->A, w, packed, 3, numout, numin, numin);
+    if(*g) pack_array(&link->dA, g, packed, 3, numout, numin, numin);
+  }
+  if(link->u && link->index) {
+    pack_sparse(&link->u, w, link);
+    if(*g) pack_sparse(&link->du, g, link);
+  }
+  else if(link->u) {
+    pack_array(&link->u, w, packed, 2, numout, numin, 0);
+    if(*g) pack_array(&link->du, g, packed, 2, numout, numin, 0);
+  }
+  if(link->v) {
+    pack_array(&link->v, w, packed, 2, numout, numin, 0);
+    if(*g) pack_array(&link->dv, g, packed, 2, numout, numin, 0);
+  }
+  if(link->w) {
+    pack_array(&link->w, w, packed, 2, numout, numaux, 0);
+    if(*g) pack_array(&link->dw, g, packed, 2, numout, numaux, 0);
+  }
+  if(link->a) {
+    pack_array(&link->a, w, packed, 1, numout, 0, 0);
+    if(*g) pack_array(&link->da, g, packed, 1, numout, 0, 0);
+  }
+  if(link->b) {
+    pack_array(&link->b, w, packed, 1, numout, 0, 0);
+    if(*g) pack_array(&link->db, g, packed, 1, numout, 0, 0);
+  }
+  link->packed = 1;
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Rebuild the packed buffers of nn from scratch.  The trained weights
+   come first, followed by the weights of the locked links. */
+
+static void pack_links(NN *nn)
+{
+  unsigned i, total, stride;
+  double *w, *g;
+  void *buf;
+
+  /* The replicas hold on to the tables that are about to be replaced. */
+  if(nn->replicas)
+    nn_free_replicas(nn);
+
+  total = 0;
+  for(i = 0; i < nn->numlinks; i++)
+    total += nn->links[i]->numweights;
+  stride = PACK_ALIGN / sizeof(double);
+  stride = ((total + stride - 1) / stride) * stride;
+
+  buf = xmalloc((nn->frozen ? 1 : 2) * stride * sizeof(double) + PACK_ALIGN);
+  w = (double *)(((size_t)buf + PACK_ALIGN - 1) &
+		 ~((size_t)PACK_ALIGN - 1));
+  g = nn->frozen ? NULL : w + stride;
+  nn->wvec = w;
+  nn->gvec = g;
+
+  for(i = 0; i < nn->numlinks; i++)
+    if(nn->links[i]->need_grads)
+      pack_link(nn->links[i], &w, &g);
+  for(i = 0; i < nn->numlinks; i++)
+    if(!nn->links[i]->need_grads)
+      pack_link(nn->links[i], &w, &g);
+
+  if(nn->wbuf) xfree(nn->wbuf);
+  nn->wbuf = buf;
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
 static void update_pointer_pointers(NN *nn)
 {
-  unsigned i, j, sz, tot;
-  double *srcw, *srcg;
+  unsigned i, j, k, n, tot, sz[6];
+  double *w[6], *g[6];
+
+  /* A compiled plan depends on which links are locked. */
+  nn_plan_free(nn);
+  if(nn->packed)
+    pack_links(nn);
 
+  /* A frozen NN has no derivatives to point to. */
   if(nn->weights) xfree(nn->weights);
   if(nn->grads) xfree(nn->grads);
   nn->weights = xmalloc(sizeof(double *) * nn->numweights);
-  nn->grads = xmalloc(sizeof(double *) * nn->numweights);
+  nn->grads = nn->frozen ? NULL : xmalloc(sizeof(double *) * nn->numweights);
   tot = 0;
   for(i = 0; i < nn->numlinks; i++)
     if(nn->links[i]->need_grads) {
-      if(nn->links[i]->A) {
-	srcw = &nn->links[i]->A[0][0][0];
-	srcg = &nn->links[i]->dA[0][0][0];
-	sz = nn->links[i]->numin * nn->links[i]->numin * nn->links[i]->numout;
-	for(j = 0; j < sz; j++) {
-	  nn->weights[tot + j] = &srcw[j];
-	  nn->grads[tot + j] = &srcg[j];
-	}
-	tot += sz;
-      }
-      if(nn->links[i]->u) {
-	srcw = &nn->links[i]->u[0][0];
-	srcg = &nn->links[i]->du[0][0];
-	sz = nn->links[i]->numin * nn->links[i]->numout;
-	for(j = 0; j < sz; j++) {
-	  nn->weights[tot + j] = &srcw[j];
-	  nn->grads[tot + j] = &srcg[j];
-	}
-	tot += sz;
-      }
-      if(nn->links[i]->v) {
-	srcw = &nn->links[i]->v[0][0];
-	srcg = &nn->links[i]->dv[0][0];
-	sz = nn->links[i]->numin * nn->links[i]->numout;
-	for(j = 0; j < sz; j++) {
-	  nn->weights[tot + j] = &srcw[j];
-	  nn->grads[tot + j] = &srcg[j];
+      n = nn_link_blocks(nn->links[i], w, g, NULL, NULL, sz);
+      for(k = 0; k < n; k++) {
+	for(j = 0; j < sz[k]; j++) {
+	  nn->weights[tot + j] = &w[k][j];
+	  if(nn->grads)
+	    nn->grads[tot + j] = &g[k][j];
 	}
-	tot += sz;
-      }
-      if(nn->links[i]->w) {
-	srcw = &nn->links[i]->w[0][0];
-	srcg = &nn->links[i]->dw[0][0];
-	sz = nn->links[i]->numaux * nn->links[i]->numout;
-	for(j = 0; j < sz; j++) {
-	  nn->weights[tot + j] = &srcw[j];
-	  nn->grads[tot + j] = &srcg[j];
-	}
-	tot += sz;
-      }
-      if(nn->links[i]->a) {
-	srcw = &nn->links[i]->a[0];
-	srcg = &nn->links[i]->da[0];
-	sz = nn->links[i]->numout;
-	for(j = 0; j < sz; j++) {
-	  nn->weights[tot + j] = &srcw[j];
-	  nn->grads[tot + j] = &srcg[j];
-	}
-	tot += sz;
-      }
-      if(nn->links[i]->b) {
-	srcw = &nn->links[i]->b[0];
-	srcg = &nn->links[i]->db[0];
-	sz = nn->links[i]->numout;
-	for(j = 0; j < sz; j++) {
-	  nn->weights[tot + j] = &srcw[j];
-	  nn->grads[tot + j] = &srcg[j];
-	}
-	tot += sz;
+	tot += sz[k];
       }
     }
 }
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
+int nn_pack(NN *nn)
+{
+  unsigned i;
+
+  if(nn_check_not_frozen(nn, "nn_pack")) return(1);
+  for(i = 0; i < nn->numlinks; i++)
+    if(nn->links[i]->shared) {
+      ulog(ULOG_ERROR, "nn_pack: link %d has shared weights.", i);
+      return(1);
+    }
+  nn->packed = 1;
+  update_pointer_pointers(nn);
+  return(0);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+int nn_freeze(NN *nn)
+{
+  unsigned i;
+
+  if(nn->frozen) return(0);
+
+  /* The replicas and the plan point at what is about to go. */
+  if(nn->replicas)
+    nn_free_replicas(nn);
+  nn_plan_free(nn);
+
+  nn_free_derivs(nn);
+  if(nn->grads) xfree(nn->grads);
+  nn->grads = NULL;
+  if(nn->layers[0].Bx) {
+    for(i = 0; i < nn->numlayers; i++) {
+      xfree(nn->layers[i].Bx);
+      xfree(nn->layers[i].By);
+      nn->layers[i].Bx = nn->layers[i].By = NULL;
+    }
+  }
+  if(nn->Btmp) xfree(nn->Btmp);
+  nn->Bx = nn->By = nn->Btmp = NULL;
+  nn->batchsz = nn->batchcap = 0;
+  nn->frozen = 1;
+
+  /* Rebuild the packed buffer without the derivatives, and the
+   * table of weights that points into it.
+   */
+  if(nn->packed)
+    update_pointer_pointers(nn);
+  return(0);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Make the weights of each link i of the frozen nn views into
+   data[i], where they are in the same order as in nn_link_blocks(),
+   and let go of the old ones.  The links are then marked as packed,
+   so that nn_destroy() only frees the views. */
+
+void nn_view_weights(NN *nn, double **data)
+{
+  NN_LINK *link;
+  double *p;
+  unsigned i, numin, numout;
+
+  if(nn->replicas)
+    nn_free_replicas(nn);
+  for(i = 0; i < nn->numlinks; i++) {
+    link = nn->links[i];
+    p = data[i];
+    numin = link->numin;
+    numout = link->numout;
+    if(link->A) {
+      deallocate_array(link->A);
+      link->A = allocate_array_view(p, 3, sizeof(double), numout, numin,
+				    numin);
+      p += numout * numin * numin;
+    }
+    if(link->u && link->index) {
+      deallocate_array(link->u);
+      link->u = nn_sparse_array(numout, link->start, p);
+      p += link->start[numout];
+    }
+    else if(link->u) {
+      deallocate_array(link->u);
+      link->u = allocate_array_view(p, 2, sizeof(double), numout, numin);
+      p += numout * numin;
+    }
+    if(link->v) {
+      deallocate_array(link->v);
+      link->v = allocate_array_view(p, 2, sizeof(double), numout, numin);
+      p += numout * numin;
+    }
+    if(link->w) {
+      deallocate_array(link->w);
+      link->w = allocate_array_view(p, 2, sizeof(double), numout,
+				    link->numaux);
+      p += numout * link->numaux;
+    }
+    if(link->a) {
+      if(!link->packed) deallocate_array(link->a);
+      link->a = p;
+      p += numout;
+    }
+    if(link->b) {
+      if(!link->packed) deallocate_array(link->b);
+      link->b = p;
+      p += numout;
+    }
+    link->packed = 1;
+  }
+
+  /* Nothing is left in the packed buffer, if there was one. */
+  if(nn->wbuf) xfree(nn->wbuf);
+  nn->wbuf = NULL;
+  nn->wvec = NULL;
+  nn->packed = 0;
+  update_pointer_pointers(nn);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
 void nn_lock_link(NN *nn, unsigned linknum)
 {
+  if(nn_check_not_frozen(nn, "nn_lock_link")) return;
   if(nn->links[linknum]->need_grads != 0) {
     nn->links[linknum]->need_grads = 0;
-    if(nn->links[linknum]->A)
-      nn->numweights -= nn->links[linknum]->numin *
-	nn->links[linknum]->numin * nn->links[linknum]->numout;
-    if(nn->links[linknum]->u)
-      nn->numweights -= nn->links[linknum]->numin * nn->links[linknum]->numout;
-    if(nn->links[linknum]->v)
-      nn->numweights -= nn->links[linknum]->numin * nn->links[linknum]->numout;
-    if(nn->links[linknum]->w)
-      nn->numweights -= nn->links[linknum]->numaux *
-	nn->links[linknum]->numout;
-    if(nn->links[linknum]->a)
-      nn->numweights -= nn->links[linknum]->numout;
-    if(nn->links[linknum]->b)
-      nn->numweights -= nn->links[linknum]->numout;
+    nn->numweights -= nn->links[linknum]->numweights;
   }
   update_all_need_grads_flags(nn);
   update_pointer_pointers(nn);
@@ -198,22 +433,10 @@ void nn_lock_link(NN *nn, unsigned linknum)
 
 void nn_unlock_link(NN *nn, unsigned linknum)
 {
+  if(nn_check_not_frozen(nn, "nn_unlock_link")) return;
   if(nn->links[linknum]->need_grads != 1) {
     nn->links[linknum]->need_grads = 1;
-    if(nn->links[linknum]->A)
-      nn->numweights += nn->links[linknum]->numin *
-	nn->links[linknum]->numin * nn->links[linknum]->numout;
-    if(nn->links[linknum]->u)
-      nn->numweights += nn->links[linknum]->numin * nn->links[linknum]->numout;
-    if(nn->links[linknum]->v)
-      nn->numweights += nn->links[linknum]->numin * nn->links[linknum]->numout;
-    if(nn->links[linknum]->w)
-      nn->numweights += nn->links[linknum]->numaux *
-	nn->links[linknum]->numout;
-    if(nn->links[linknum]->a)
-      nn->numweights += nn->links[linknum]->numout;
-    if(nn->links[linknum]->b)
-      nn->numweights += nn->links[linknum]->numout;
+    nn->numweights += nn->links[linknum]->numweights;
   }
   update_all_need_grads_flags(nn);
   update_pointer_pointers(nn);
@@ -221,6 +444,114 @@ void nn_unlock_link(NN *nn, unsigned linknum)
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
+int nn_set_sparse(NN *nn, unsigned linknum, unsigned *start, unsigned *index)
+{
+  NN_LINK *link;
+  unsigned i, j, k, end, nnz, oldnnz;
+  double **u;
+
+  if(nn_check_not_frozen(nn, "nn_set_sparse")) return(1);
+  if(linknum >= nn->numlinks || !nn->links[linknum]->index) {
+    ulog(ULOG_ERROR, "nn_set_sparse: link %d is not a sparse link.",
+	 linknum);
+    return(1);
+  }
+  link = nn->links[linknum];
+  if(link->shared) {
+    ulog(ULOG_ERROR, "nn_set_sparse: link %d has shared weights.", linknum);
+    return(1);
+  }
+  if(start[0] != 0) {
+    ulog(ULOG_ERROR, "nn_set_sparse: start[0] must be zero.");
+    return(1);
+  }
+  for(i = 0; i < link->numout; i++) {
+    if(start[i + 1] < start[i]) {
+      ulog(ULOG_ERROR, "nn_set_sparse: start[%d] < start[%d].", i + 1, i);
+      return(1);
+    }
+    for(j = start[i]; j < start[i + 1]; j++)
+      if(index[j] >= link->numin ||
+	 (j > start[i] && index[j] <= index[j - 1])) {
+	ulog(ULOG_ERROR, "nn_set_sparse: bad inputs for output %d.", i);
+	return(1);
+      }
+  }
+
+  /* The replicas share the weights that are about to be replaced. */
+  if(nn->replicas)
+    nn_free_replicas(nn);
+
+  /* Both index lists are sorted, so the old weights can be picked up
+   * in a single pass over each row.
+   */
+  nnz = start[link->numout];
+  u = nn_sparse_array(link->numout, start, NULL);
+  for(i = 0; i < link->numout; i++) {
+    k = link->start[i];
+    end = link->start[i + 1];
+    for(j = start[i]; j < start[i + 1]; j++) {
+      while(k < end && link->index[k] < index[j])
+	k++;
+      u[0][j] = (k < end && link->index[k] == index[j]) ? link->u[0][k] : 0;
+    }
+  }
+  deallocate_array(link->u);
+  deallocate_array(link->du);
+  link->u = u;
+  link->du = nn_sparse_array(link->numout, start, NULL);
+  if(link->Ru) {
+    deallocate_array(link->Ru);
+    deallocate_array(link->Rdu);
+    link->Ru = link->Rdu = NULL;
+  }
+
+  oldnnz = link->start[link->numout];
+  xfree(link->start);
+  xfree(link->index);
+  link->start = xmalloc((link->numout + 1) * sizeof(unsigned));
+  link->index = xmalloc((nnz + 1) * sizeof(unsigned));
+  memcpy(link->start, start, (link->numout + 1) * sizeof(unsigned));
+  memcpy(link->index, index, nnz * sizeof(unsigned));
+
+  link->numweights = link->numweights - oldnnz + nnz;
+  if(link->need_grads)
+    nn->numweights = nn->numweights - oldnnz + nnz;
+  update_pointer_pointers(nn);
+  return(0);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+int nn_set_sparse_mask(NN *nn, unsigned linknum, int *mask)
+{
+  NN_LINK *link;
+  unsigned i, j, n, *start, *index;
+  int result;
+
+  if(linknum >= nn->numlinks || !nn->links[linknum]->index) {
+    ulog(ULOG_ERROR, "nn_set_sparse_mask: link %d is not a sparse link.",
+	 linknum);
+    return(1);
+  }
+  link = nn->links[linknum];
+  start = xmalloc((link->numout + 1) * sizeof(unsigned));
+  index = xmalloc((link->numout * link->numin + 1) * sizeof(unsigned));
+  for(n = 0, i = 0; i < link->numout; i++) {
+    start[i] = n;
+    for(j = 0; j < link->numin; j++)
+      if(mask[i * link->numin + j])
+	index[n++] = j;
+  }
+  start[link->numout] = n;
+  result = nn_set_sparse(nn, linknum, start, index);
+  xfree(start);
+  xfree(index);
+  return(result);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
 void nn_get_weights(NN *nn, double *w)
 {
   unsigned i, j, sz;
@@ -236,7 +567,7 @@ void nn_get_weights(NN *nn, double *w)
       }
       if(nn->links[i]->u) {
 	src = &nn->links[i]->u[0][0];
-	sz = nn->links[i]->numin * nn->links[i]->numout;
+	sz = link_usize(nn->links[i]);
 	for(j = 0; j < sz; j++)
 	  *w++ = *src++;
       }
@@ -274,6 +605,7 @@ void nn_get_grads(NN *nn, double *g)
   unsigned i, j, sz;
   double *src;
 
+  if(nn_check_not_frozen(nn, "nn_get_grads")) return;
   for(i = 0; i < nn->numlinks; i++)
     if(nn->links[i]->need_grads) {
       if(nn->links[i]->A) {
@@ -284,7 +616,7 @@ void nn_get_grads(NN *nn, double *g)
       }
       if(nn->links[i]->u) {
 	src = &nn->links[i]->du[0][0];
-	sz = nn->links[i]->numin * nn->links[i]->numout;
+	sz = link_usize(nn->links[i]);
 	for(j = 0; j < sz; j++)
 	  *g++ = *src++;
       }
@@ -332,7 +664,7 @@ void nn_set_weights(NN *nn, double *w)
       }
       if(nn->links[i]->u) {
 	dst = &nn->links[i]->u[0][0];
-	sz = nn->links[i]->numin * nn->links[i]->numout;
+	sz = link_usize(nn->links[i]);
 	for(j = 0; j < sz; j++)
 	  *dst++ = *w++;
       }
@@ -361,6 +693,9 @@ void nn_set_weights(NN *nn, double *w)
 	  *dst++ = *w++;
       }
     }
+
+  /* Keep the float copies of a single precision plan current. */
+  nn_plan_sync(nn);
 }
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
@@ -370,6 +705,7 @@ void nn_set_grads(NN *nn, double *g)
   unsigned i, j, sz;
   double *dst;
 
+  if(nn_check_not_frozen(nn, "nn_set_grads")) return;
   for(i = 0; i < nn->numlinks; i++)
     if(nn->links[i]->need_grads) {
       if(nn->links[i]->A) {
@@ -380,7 +716,7 @@ void nn_set_grads(NN *nn, double *g)
       }
       if(nn->links[i]->u) {
 	dst = &nn->links[i]->du[0][0];
-	sz = nn->links[i]->numin * nn->links[i]->numout;
+	sz = link_usize(nn->links[i]);
 	for(j = 0; j < sz; j++)
 	  *dst++ = *g++;
       }
@@ -418,6 +754,8 @@ void nn_set_Rweights(NN *nn, double *Rw)
   unsigned i, j, sz;
   double *dst;
 
+  if(nn_check_not_frozen(nn, "nn_set_Rweights")) return;
+  nn_alloc_R(nn);
   for(i = 0; i < nn->numlinks; i++)
     if(nn->links[i]->need_grads) {
       if(nn->links[i]->RA) {
@@ -428,7 +766,7 @@ void nn_set_Rweights(NN *nn, double *Rw)
       }
       if(nn->links[i]->Ru) {
 	dst = &nn->links[i]->Ru[0][0];
-	sz = nn->links[i]->numin * nn->links[i]->numout;
+	sz = link_usize(nn->links[i]);
 	for(j = 0; j < sz; j++)
 	  *dst++ = *Rw++;
       }
@@ -466,6 +804,8 @@ void nn_set_Rgrads(NN *nn, double *Rg)
   unsigned i, j, sz;
   double *dst;
 
+  if(nn_check_not_frozen(nn, "nn_set_Rgrads")) return;
+  nn_alloc_R(nn);
   for(i = 0; i < nn->numlinks; i++)
     if(nn->links[i]->need_grads) {
       if(nn->links[i]->RA) {
@@ -476,7 +816,7 @@ void nn_set_Rgrads(NN *nn, double *Rg)
       }
       if(nn->links[i]->Ru) {
 	dst = &nn->links[i]->Rdu[0][0];
-	sz = nn->links[i]->numin * nn->links[i]->numout;
+	sz = link_usize(nn->links[i]);
 	for(j = 0; j < sz; j++)
 	  *dst++ = *Rg++;
       }
@@ -514,6 +854,8 @@ void nn_get_Rweights(NN *nn, double *Rw)
   unsigned i, j, sz;
   double *src;
 
+  if(nn_check_not_frozen(nn, "nn_get_Rweights")) return;
+  nn_alloc_R(nn);
   for(i = 0; i < nn->numlinks; i++)
     if(nn->links[i]->need_grads) {
       if(nn->links[i]->RA) {
@@ -524,7 +866,7 @@ void nn_get_Rweights(NN *nn, double *Rw)
       }
       if(nn->links[i]->Ru) {
 	src = &nn->links[i]->Ru[0][0];
-	sz = nn->links[i]->numin * nn->links[i]->numout;
+	sz = link_usize(nn->links[i]);
 	for(j = 0; j < sz; j++)
 	  *Rw++ = *src++;
       }
@@ -562,6 +904,8 @@ void nn_get_Rgrads(NN *nn, double *Rg)
   unsigned i, j, sz;
   double *src;
 
+  if(nn_check_not_frozen(nn, "nn_get_Rgrads")) return;
+  nn_alloc_R(nn);
   for(i = 0; i < nn->numlinks; i++)
     if(nn->links[i]->need_grads) {
       if(nn->links[i]->RA) {
@@ -572,7 +916,7 @@ void nn_get_Rgrads(NN *nn, double *Rg)
       }
       if(nn->links[i]->Ru) {
 	src = &nn->links[i]->Rdu[0][0];
-	sz = nn->links[i]->numin * nn->links[i]->numout;
+	sz = link_usize(nn->links[i]);
 	for(j = 0; j < sz; j++)
 	  *Rg++ = *src++;
       }
@@ -634,6 +978,19 @@ int nn_check_valid_layer(NN *nn, unsigned l)
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
+/* Check that nn still has its derivatives. */
+
+int nn_check_not_frozen(NN *nn, char *who)
+{
+  if(nn->frozen) {
+    ulog(ULOG_ERROR, "%s: the NN is frozen.", who);
+    return(1);
+  }
+  return(0);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
 /* Check that (l, s) is a valid slab in nn. */
 
 int nn_check_valid_slab(NN *nn, unsigned l, unsigned s)
@@ -649,6 +1006,64 @@ int nn_check_valid_slab(NN *nn, unsigned l, unsigned s)
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
+/* Fill in the first element and the size of every block of weights
+   that link uses, in the same (A, u, v, w, a, b) order that is used
+   to build the weight vector.  Any of w, g, Rw, and Rg can be NULL,
+   while an entry is set to NULL if the corresponding array is not
+   allocated.  The number of blocks is returned. */
+
+unsigned nn_link_blocks(NN_LINK *link, double **w, double **g,
+			double **Rw, double **Rg, unsigned *sz)
+{
+  unsigned n = 0;
+
+  if(link->A) {
+    if(w) w[n] = &link->A[0][0][0];
+    if(g) g[n] = link->dA ? &link->dA[0][0][0] : NULL;
+    if(Rw) Rw[n] = link->RA ? &link->RA[0][0][0] : NULL;
+    if(Rg) Rg[n] = link->RdA ? &link->RdA[0][0][0] : NULL;
+    sz[n++] = link->numin * link->numin * link->numout;
+  }
+  if(link->u) {
+    if(w) w[n] = &link->u[0][0];
+    if(g) g[n] = link->du ? &link->du[0][0] : NULL;
+    if(Rw) Rw[n] = link->Ru ? &link->Ru[0][0] : NULL;
+    if(Rg) Rg[n] = link->Rdu ? &link->Rdu[0][0] : NULL;
+    sz[n++] = link_usize(link);
+  }
+  if(link->v) {
+    if(w) w[n] = &link->v[0][0];
+    if(g) g[n] = link->dv ? &link->dv[0][0] : NULL;
+    if(Rw) Rw[n] = link->Rv ? &link->Rv[0][0] : NULL;
+    if(Rg) Rg[n] = link->Rdv ? &link->Rdv[0][0] : NULL;
+    sz[n++] = link->numin * link->numout;
+  }
+  if(link->w) {
+    if(w) w[n] = &link->w[0][0];
+    if(g) g[n] = link->dw ? &link->dw[0][0] : NULL;
+    if(Rw) Rw[n] = link->Rw ? &link->Rw[0][0] : NULL;
+    if(Rg) Rg[n] = link->Rdw ? &link->Rdw[0][0] : NULL;
+    sz[n++] = link->numaux * link->numout;
+  }
+  if(link->a) {
+    if(w) w[n] = link->a;
+    if(g) g[n] = link->da;
+    if(Rw) Rw[n] = link->Ra;
+    if(Rg) Rg[n] = link->Rda;
+    sz[n++] = link->numout;
+  }
+  if(link->b) {
+    if(w) w[n] = link->b;
+    if(g) g[n] = link->db;
+    if(Rw) Rw[n] = link->Rb;
+    if(Rg) Rg[n] = link->Rdb;
+    sz[n++] = link->numout;
+  }
+  return(n);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
 unsigned nn_layerlist_len(NN_LAYERLIST *list)
 {
   unsigned sz = 0;
@@ -732,6 +1147,7 @@ void nn_shutdown(void)
 
   nn_shutdown_actfuncs();
   nn_shutdown_netfuncs();
+  thread_shutdown();
 }
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
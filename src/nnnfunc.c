@@ -9,12 +9,13 @@
 #include "nodelib/nn.h"
 #include "nodelib/xalloc.h"
 #include "nodelib/hash.h"
+#include "nodelib/ulog.h"
 
 static HASH *nfhash = NULL;
 static void nfinit(void);
 
 /* linear, quadratic, xquadratic, copy, alias, diagonal,
-   euclidean, pair-wise product, product */
+   euclidean, pair-wise product, product, sparse linear */
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
@@ -51,6 +52,8 @@ void nn_register_netfunc(char *name,
     nfx->Rforward = Rforward;
     nfx->Rbackward = Rbackward;
     nfx->sanity = sanity;
+    nfx->forward_batch = NULL;
+    nfx->backward_batch = NULL;
   }
   else {
     nfx = xmalloc(sizeof(NN_NETFUNC));
@@ -60,12 +63,36 @@ void nn_register_netfunc(char *name,
     nfx->Rforward = Rforward;
     nfx->Rbackward = Rbackward;
     nfx->sanity = sanity;
+    nfx->forward_batch = NULL;
+    nfx->backward_batch = NULL;
     hash_insert(nfhash, nfx);
   }
 }
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
+int nn_register_netfunc_batch(char *name,
+			      void (*forward_batch)(struct NN *nn,
+						    struct NN_LINK *link,
+						    struct NN_LAYER *dst),
+			      void (*backward_batch)(struct NN *nn,
+						     struct NN_LINK *link,
+						     struct NN_LAYER *src))
+{
+  NN_NETFUNC *nfx;
+
+  if((nfx = nn_find_netfunc(name)) == NULL) {
+    ulog(ULOG_ERROR, "nn_register_netfunc_batch: unknown net function"
+	 " '%s'.", name);
+    return(1);
+  }
+  nfx->forward_batch = forward_batch;
+  nfx->backward_batch = backward_batch;
+  return(0);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
 NN_NETFUNC *nn_find_netfunc(char *name)
 {
   NN_NETFUNC nf;
@@ -99,16 +126,10 @@ void nn_shutdown_netfuncs(void)
 static void nflinearf(NN *nn, NN_LINK *link, NN_LAYER *dst)
 {
   NN_LAYER *src;
-  unsigned i, j;
-  double sum;
 
   src = link->source->layer;
-  for(i = 0; i < link->numout; i++) {
-    sum = 0;
-    for(j = 0; j < link->numin; j++)
-      sum += link->u[i][j] * src->y[j];
-    dst->x[i] += sum + link->a[i];
-  }
+  nn_kern_matvec(dst->x, link->u, src->y, link->a,
+		 link->numout, link->numin, 1);
 }
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
@@ -116,23 +137,17 @@ static void nflinearf(NN *nn, NN_LINK *link, NN_LAYER *dst)
 static void nflinearb(NN *nn, NN_LINK *link, NN_LAYER *src)
 {
   NN_LAYER *dst;
-  unsigned i, j;
-  double sum;
+  unsigned i;
 
   dst = link->dest->layer;
-  if(link->need_grads || nn->need_all_grads)
-    for(i = 0; i < link->numout; i++) {
-      for(j = 0; j < link->numin; j++)
-	link->du[i][j] = dst->dx[i] * src->y[j];
+  if(link->need_grads || nn->need_all_grads) {
+    nn_kern_outer(link->du, dst->dx, src->y, link->numout, link->numin);
+    for(i = 0; i < link->numout; i++)
       link->da[i] = dst->dx[i];
-    }
+  }
   if(src->need_grads || nn->need_all_grads)
-    for(j = 0; j < link->numin; j++) {
-      sum = 0;
-      for(i = 0; i < link->numout; i++)
-	sum += dst->dx[i] * link->u[i][j];
-      src->dy[j] += sum;
-    }
+    nn_kern_vecmat(src->dy, dst->dx, link->u, 0,
+		   link->numout, link->numin, 1);
 }
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
@@ -140,17 +155,10 @@ static void nflinearb(NN *nn, NN_LINK *link, NN_LAYER *src)
 static void nflinearRf(NN *nn, NN_LINK *link, NN_LAYER *dst)
 {
   NN_LAYER *src;
-  unsigned i, j;
-  double sum;
 
   src = link->source->layer;
-  for(i = 0; i < link->numout; i++) {
-    sum = 0;
-    for(j = 0; j < link->numin; j++)
-      sum += src->Ry[j] * link->u[i][j] +
-	link->Ru[i][j] * src->y[j];
-    dst->Rx[i] += sum + link->Ra[i];
-  }
+  nn_kern_matvec_R(dst->Rx, link->u, link->Ru, src->y, src->Ry, link->Ra,
+		   link->numout, link->numin);
 }
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
@@ -158,22 +166,88 @@ static void nflinearRf(NN *nn, NN_LINK *link, NN_LAYER *dst)
 static void nflinearRb(NN *nn, NN_LINK *link, NN_LAYER *src)
 {
   NN_LAYER *dst;
-  unsigned i, j;
-  double sum;
+  unsigned i;
 
   dst = link->dest->layer;
-  for(i = 0; i < link->numout; i++) {
-    for(j = 0; j < link->numin; j++)
-      link->Rdu[i][j] = dst->Rdx[i] * src->y[j] +
-	src->Ry[j] * dst->dx[i];
+  nn_kern_outer_R(link->Rdu, dst->dx, dst->Rdx, src->y, src->Ry,
+		  link->numout, link->numin);
+  for(i = 0; i < link->numout; i++)
     link->Rda[i] = dst->Rdx[i];
+  nn_kern_vecmat_R(src->Rdy, dst->dx, dst->Rdx, link->u, link->Ru,
+		   link->numout, link->numin);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* The batch versions of the net functions keep the same order of
+   operations as the single pattern versions, so that the net inputs
+   computed for a batch are exactly the same as those computed one
+   pattern at a time.  The pattern index is always the innermost loop. */
+
+static void nflinearBf(NN *nn, NN_LINK *link, NN_LAYER *dst)
+{
+  NN_LAYER *src;
+  unsigned i, j, k, n;
+  double *t, *x, *y, u;
+
+  src = link->source->layer;
+  n = nn->batchsz;
+  t = nn->Btmp;
+  for(i = 0; i < link->numout; i++) {
+    for(k = 0; k < n; k++)
+      t[k] = 0;
+    for(j = 0; j < link->numin; j++) {
+      u = link->u[i][j];
+      y = src->By + j * n;
+      for(k = 0; k < n; k++)
+	t[k] += u * y[k];
+    }
+    x = dst->Bx + i * n;
+    for(k = 0; k < n; k++)
+      x[k] += t[k] + link->a[i];
   }
-  for(j = 0; j < link->numin; j++) {
-    sum = 0;
-    for(i = 0; i < link->numout; i++)
-      sum += dst->Rdx[i] * link->u[i][j] + link->Ru[i][j] * dst->dx[i];
-    src->Rdy[j] += sum;
-  }
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+static void nflinearBb(NN *nn, NN_LINK *link, NN_LAYER *src)
+{
+  NN_LAYER *dst;
+  unsigned i, j, k, n;
+  double *t, *dx, *dy, *y, u, sum;
+
+  dst = link->dest->layer;
+  n = nn->batchsz;
+  t = nn->Btmp;
+  if(link->need_grads || nn->need_all_grads)
+    for(i = 0; i < link->numout; i++) {
+      dx = dst->Bdx + i * n;
+      for(j = 0; j < link->numin; j++) {
+	y = src->By + j * n;
+	sum = 0;
+	for(k = 0; k < n; k++)
+	  sum += dx[k] * y[k];
+	link->du[i][j] = sum;
+      }
+      sum = 0;
+      for(k = 0; k < n; k++)
+	sum += dx[k];
+      link->da[i] = sum;
+    }
+  if(src->need_grads || nn->need_all_grads)
+    for(j = 0; j < link->numin; j++) {
+      for(k = 0; k < n; k++)
+	t[k] = 0;
+      for(i = 0; i < link->numout; i++) {
+	u = link->u[i][j];
+	dx = dst->Bdx + i * n;
+	for(k = 0; k < n; k++)
+	  t[k] += dx[k] * u;
+      }
+      dy = src->Bdy + j * n;
+      for(k = 0; k < n; k++)
+	dy[k] += t[k];
+    }
 }
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
@@ -194,50 +268,128 @@ static int nflinears(NN *nn, NN_LAYERLIST *src, NN_LAYERLIST *dst,
 }
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
-/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
-static void nfdiagonalf(NN *nn, NN_LINK *link, NN_LAYER *dst)
+/* The sparse linear net function only visits the connections listed in
+   link->start and link->index.  Since the rows of u are consecutive,
+   u[0][k] is the weight of the connection to input index[k]. */
+
+static void nfsparsef(NN *nn, NN_LINK *link, NN_LAYER *dst)
 {
   NN_LAYER *src;
-  unsigned i, j;
-  double sum;
+  unsigned i, k, *start = link->start, *index = link->index;
+  double sum, *u = link->u[0], *y;
 
   src = link->source->layer;
+  y = src->y;
   for(i = 0; i < link->numout; i++) {
     sum = 0;
-    for(j = 0; j < link->numin; j++)
-      sum += link->u[i][j] * src->y[j] +
-	link->v[i][j] * src->y[j] * src->y[j];
+    for(k = start[i]; k < start[i + 1]; k++)
+      sum += u[k] * y[index[k]];
     dst->x[i] += sum + link->a[i];
   }
 }
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
-static void nfdiagonalb(NN *nn, NN_LINK *link, NN_LAYER *src)
+static void nfsparseb(NN *nn, NN_LINK *link, NN_LAYER *src)
 {
   NN_LAYER *dst;
-  unsigned i, j;
-  double sum;
+  unsigned i, k, *start = link->start, *index = link->index;
+  double *u = link->u[0], *du = link->du[0];
 
   dst = link->dest->layer;
   if(link->need_grads || nn->need_all_grads)
     for(i = 0; i < link->numout; i++) {
-      for(j = 0; j < link->numin; j++) {
-	link->du[i][j] = dst->dx[i] * src->y[j];
-	link->dv[i][j] = dst->dx[i] * src->y[j] * src->y[j];
-      }
+      for(k = start[i]; k < start[i + 1]; k++)
+	du[k] = dst->dx[i] * src->y[index[k]];
       link->da[i] = dst->dx[i];
     }
   if(src->need_grads || nn->need_all_grads)
-    for(j = 0; j < link->numin; j++) {
-      sum = 0;
-      for(i = 0; i < link->numout; i++)
-	sum += dst->dx[i] * 
-	  (link->u[i][j] + 2.0 * link->v[i][j] * src->y[j]);
-      src->dy[j] += sum;
+    for(i = 0; i < link->numout; i++)
+      for(k = start[i]; k < start[i + 1]; k++)
+	src->dy[index[k]] += dst->dx[i] * u[k];
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+static void nfsparseRf(NN *nn, NN_LINK *link, NN_LAYER *dst)
+{
+  NN_LAYER *src;
+  unsigned i, k, j, *start = link->start, *index = link->index;
+  double sum, *u = link->u[0], *Ru = link->Ru[0];
+
+  src = link->source->layer;
+  for(i = 0; i < link->numout; i++) {
+    sum = 0;
+    for(k = start[i]; k < start[i + 1]; k++) {
+      j = index[k];
+      sum += src->Ry[j] * u[k] + src->y[j] * Ru[k];
+    }
+    dst->Rx[i] += sum + link->Ra[i];
+  }
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+static void nfsparseRb(NN *nn, NN_LINK *link, NN_LAYER *src)
+{
+  NN_LAYER *dst;
+  unsigned i, k, j, *start = link->start, *index = link->index;
+  double *u = link->u[0], *Ru = link->Ru[0], *Rdu = link->Rdu[0];
+
+  dst = link->dest->layer;
+  for(i = 0; i < link->numout; i++) {
+    for(k = start[i]; k < start[i + 1]; k++) {
+      j = index[k];
+      Rdu[k] = dst->Rdx[i] * src->y[j] + dst->dx[i] * src->Ry[j];
+      src->Rdy[j] += dst->Rdx[i] * u[k] + dst->dx[i] * Ru[k];
     }
+    link->Rda[i] = dst->Rdx[i];
+  }
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+static int nfsparses(NN *nn, NN_LAYERLIST *src, NN_LAYERLIST *dst,
+		     unsigned *numin, unsigned *numout, unsigned *numaux)
+{
+  if(nflinears(nn, src, dst, numin, numout, numaux) == -1)
+    return(-1);
+  return(NN_WVECTOR | NN_WSCALAR | NN_WSPARSE);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+static void nfdiagonalf(NN *nn, NN_LINK *link, NN_LAYER *dst)
+{
+  NN_LAYER *src;
+
+  src = link->source->layer;
+  nn_kern_diagvec(dst->x, link->u, link->v, src->y, link->a,
+		  link->numout, link->numin);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+static void nfdiagonalb(NN *nn, NN_LINK *link, NN_LAYER *src)
+{
+  NN_LAYER *dst;
+  unsigned i;
+
+  dst = link->dest->layer;
+  if(link->need_grads || nn->need_all_grads) {
+    nn_kern_diagouter(link->du, link->dv, dst->dx, src->y,
+		      link->numout, link->numin);
+    for(i = 0; i < link->numout; i++)
+      link->da[i] = dst->dx[i];
+  }
+  if(src->need_grads || nn->need_all_grads)
+    nn_kern_diagvecmat(src->dy, dst->dx, link->u, link->v, src->y,
+		       link->numout, link->numin);
 }
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
@@ -291,6 +443,80 @@ static void nfdiagonalRb(NN *nn, NN_LINK *link, NN_LAYER *src)
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
+static void nfdiagonalBf(NN *nn, NN_LINK *link, NN_LAYER *dst)
+{
+  NN_LAYER *src;
+  unsigned i, j, k, n;
+  double *t, *x, *y, u, v;
+
+  src = link->source->layer;
+  n = nn->batchsz;
+  t = nn->Btmp;
+  for(i = 0; i < link->numout; i++) {
+    for(k = 0; k < n; k++)
+      t[k] = 0;
+    for(j = 0; j < link->numin; j++) {
+      u = link->u[i][j];
+      v = link->v[i][j];
+      y = src->By + j * n;
+      for(k = 0; k < n; k++)
+	t[k] += u * y[k] + v * y[k] * y[k];
+    }
+    x = dst->Bx + i * n;
+    for(k = 0; k < n; k++)
+      x[k] += t[k] + link->a[i];
+  }
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+static void nfdiagonalBb(NN *nn, NN_LINK *link, NN_LAYER *src)
+{
+  NN_LAYER *dst;
+  unsigned i, j, k, n;
+  double *t, *dx, *dy, *y, u, v, sum1, sum2;
+
+  dst = link->dest->layer;
+  n = nn->batchsz;
+  t = nn->Btmp;
+  if(link->need_grads || nn->need_all_grads)
+    for(i = 0; i < link->numout; i++) {
+      dx = dst->Bdx + i * n;
+      for(j = 0; j < link->numin; j++) {
+	y = src->By + j * n;
+	sum1 = sum2 = 0;
+	for(k = 0; k < n; k++) {
+	  sum1 += dx[k] * y[k];
+	  sum2 += dx[k] * y[k] * y[k];
+	}
+	link->du[i][j] = sum1;
+	link->dv[i][j] = sum2;
+      }
+      sum1 = 0;
+      for(k = 0; k < n; k++)
+	sum1 += dx[k];
+      link->da[i] = sum1;
+    }
+  if(src->need_grads || nn->need_all_grads)
+    for(j = 0; j < link->numin; j++) {
+      y = src->By + j * n;
+      for(k = 0; k < n; k++)
+	t[k] = 0;
+      for(i = 0; i < link->numout; i++) {
+	u = link->u[i][j];
+	v = link->v[i][j];
+	dx = dst->Bdx + i * n;
+	for(k = 0; k < n; k++)
+	  t[k] += dx[k] * (u + 2.0 * v * y[k]);
+      }
+      dy = src->Bdy + j * n;
+      for(k = 0; k < n; k++)
+	dy[k] += t[k];
+    }
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
 static int nfdiagonals(NN *nn, NN_LAYERLIST *src, NN_LAYERLIST *dst,
 		       unsigned *numin, unsigned *numout, unsigned *numaux)
 {
@@ -313,19 +539,10 @@ static int nfdiagonals(NN *nn, NN_LAYERLIST *src, NN_LAYERLIST *dst,
 static void nfquadraticf(NN *nn, NN_LINK *link, NN_LAYER *dst)
 {
   NN_LAYER *src;
-  unsigned i, j, k;
-  double sum;
 
   src = link->source->layer;
-  for(i = 0; i < link->numout; i++) {
-    sum = 0;
-    for(j = 0; j < link->numin; j++) {
-      for(k = 0; k < link->numin; k++)
-	sum += link->A[i][j][k] * src->y[j] * src->y[k];
-      sum += link->u[i][j] * src->y[j];
-    }
-    dst->x[i] += sum + link->a[i];
-  }
+  nn_kern_quadvec(dst->x, link->A, link->u, src->y, link->a,
+		  link->numout, link->numin);
 }
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
@@ -334,7 +551,6 @@ static void nfquadraticb(NN *nn, NN_LINK *link, NN_LAYER *src)
 {
   NN_LAYER *dst;
   unsigned i, j, k;
-  double sum1, sum2;
 
   dst = link->dest->layer;
   if(link->need_grads || nn->need_all_grads)
@@ -347,17 +563,8 @@ static void nfquadraticb(NN *nn, NN_LINK *link, NN_LAYER *src)
       link->da[i] = dst->dx[i];
     }
   if(src->need_grads || nn->need_all_grads)
-    for(j = 0; j < link->numin; j++) {
-      sum1 = 0;
-      for(i = 0; i < link->numout; i++) {
-	sum2 = 0;
-	for(k = 0; k < link->numin; k++)
-	  sum2 += (link->A[i][j][k] + link->A[i][k][j]) * src->y[k];
-	sum1 += (link->u[i][j] + sum2 - link->A[i][j][j] * src->y[j]) *
-	  dst->dx[i];
-      }
-      src->dy[j] += sum1;
-    }
+    nn_kern_quadvecmat(src->dy, dst->dx, link->A, link->u, src->y,
+		       link->numout, link->numin);
 }
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
@@ -603,6 +810,33 @@ static void nfcopyRb(NN *nn, NN_LINK *link, NN_LAYER *src)
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
+static void nfcopyBf(NN *nn, NN_LINK *link, NN_LAYER *dst)
+{
+  NN_LAYER *src;
+  unsigned i, sz;
+
+  src = link->source->layer;
+  sz = link->numout * nn->batchsz;
+  for(i = 0; i < sz; i++)
+    dst->Bx[i] += src->By[i];
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+static void nfcopyBb(NN *nn, NN_LINK *link, NN_LAYER *src)
+{
+  NN_LAYER *dst;
+  unsigned i, sz;
+
+  dst = link->dest->layer;
+  sz = link->numout * nn->batchsz;
+  if(src->need_grads || nn->need_all_grads)
+    for(i = 0; i < sz; i++)
+      src->Bdy[i] += dst->Bdx[i];
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
 static int nfcopys(NN *nn, NN_LAYERLIST *src, NN_LAYERLIST *dst,
 		   unsigned *numin, unsigned *numout, unsigned *numaux)
 {
@@ -660,6 +894,25 @@ static void nfkopyRb(NN *nn, NN_LINK *link, NN_LAYER *src)
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
+static void nfkopyBf(NN *nn, NN_LINK *link, NN_LAYER *dst)
+{
+  NN_LAYER *src;
+  unsigned i, sz;
+
+  src = link->source->layer;
+  sz = link->numout * nn->batchsz;
+  for(i = 0; i < sz; i++)
+    dst->Bx[i] += src->By[i];
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+static void nfkopyBb(NN *nn, NN_LINK *link, NN_LAYER *src)
+{
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
 static int nfkopys(NN *nn, NN_LAYERLIST *src, NN_LAYERLIST *dst,
 		   unsigned *numin, unsigned *numout, unsigned *numaux)
 {
@@ -735,6 +988,54 @@ static void nfscalarRb(NN *nn, NN_LINK *link, NN_LAYER *src)
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
+static void nfscalarBf(NN *nn, NN_LINK *link, NN_LAYER *dst)
+{
+  NN_LAYER *src;
+  unsigned i, k, n;
+  double *x, *y, a;
+
+  src = link->source->layer;
+  n = nn->batchsz;
+  for(i = 0; i < link->numout; i++) {
+    a = link->a[i];
+    x = dst->Bx + i * n;
+    y = src->By + i * n;
+    for(k = 0; k < n; k++)
+      x[k] += y[k] * a;
+  }
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+static void nfscalarBb(NN *nn, NN_LINK *link, NN_LAYER *src)
+{
+  NN_LAYER *dst;
+  unsigned i, k, n;
+  double *dx, *dy, *y, a, sum;
+
+  dst = link->dest->layer;
+  n = nn->batchsz;
+  if(link->need_grads || nn->need_all_grads)
+    for(i = 0; i < link->numout; i++) {
+      dx = dst->Bdx + i * n;
+      y = src->By + i * n;
+      sum = 0;
+      for(k = 0; k < n; k++)
+	sum += dx[k] * y[k];
+      link->da[i] = sum;
+    }
+  if(src->need_grads || nn->need_all_grads)
+    for(i = 0; i < link->numin; i++) {
+      a = link->a[i];
+      dx = dst->Bdx + i * n;
+      dy = src->Bdy + i * n;
+      for(k = 0; k < n; k++)
+	dy[k] += dx[k] * a;
+    }
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
 static int nfscalars(NN *nn, NN_LAYERLIST *src, NN_LAYERLIST *dst,
 		   unsigned *numin, unsigned *numout, unsigned *numaux)
 {
@@ -817,6 +1118,39 @@ static void nfproductRb(NN *nn, NN_LINK *link, NN_LAYER *src)
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
+static void nfproductBf(NN *nn, NN_LINK *link, NN_LAYER *dst)
+{
+  NN_LAYER *src1, *src2;
+  unsigned i, sz;
+
+  src1 = link->source->layer;
+  src2 = link->source->cdr->layer;
+  sz = link->numout * nn->batchsz;
+  for(i = 0; i < sz; i++)
+    dst->Bx[i] += src1->By[i] * src2->By[i];
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+static void nfproductBb(NN *nn, NN_LINK *link, NN_LAYER *src)
+{
+  NN_LAYER *src1, *src2, *dst;
+  unsigned i, sz;
+
+  src1 = link->source->layer;
+  src2 = link->source->cdr->layer;
+  dst = link->dest->layer;
+  sz = link->numin * nn->batchsz;
+
+  if(src1->need_grads || src2->need_grads || nn->need_all_grads)
+  for(i = 0; i < sz; i++) {
+    src1->Bdy[i] += dst->Bdx[i] * src2->By[i];
+    src2->Bdy[i] += dst->Bdx[i] * src1->By[i];
+  }
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
 static int nfproducts(NN *nn, NN_LAYERLIST *src, NN_LAYERLIST *dst,
 		   unsigned *numin, unsigned *numout, unsigned *numaux)
 {
@@ -1090,6 +1424,35 @@ static void nfunitminusRb(NN *nn, NN_LINK *link, NN_LAYER *src)
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
+static void nfunitminusBf(NN *nn, NN_LINK *link, NN_LAYER *dst)
+{
+  NN_LAYER *src;
+  unsigned i, sz;
+
+  src = link->source->layer;
+  dst = link->dest->layer;
+  sz = link->numout * nn->batchsz;
+  for(i = 0; i < sz; i++)
+    dst->Bx[i] += (1 - src->By[i]);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+static void nfunitminusBb(NN *nn, NN_LINK *link, NN_LAYER *src)
+{
+  NN_LAYER *dst;
+  unsigned i, sz;
+
+  dst = link->dest->layer;
+  sz = link->numout * nn->batchsz;
+
+  if(src->need_grads || nn->need_all_grads)
+    for(i = 0; i < sz; i++)
+      src->Bdy[i] -= dst->Bdx[i];
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
 static int nfunitminuss(NN *nn, NN_LAYERLIST *src, NN_LAYERLIST *dst,
 		   unsigned *numin, unsigned *numout, unsigned *numaux)
 {
@@ -1111,6 +1474,18 @@ static int nfunitminuss(NN *nn, NN_LAYERLIST *src, NN_LAYERLIST *dst,
 /* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
+/* Identify the builtin net functions that nn_compile() can fuse with
+   an activation function. */
+
+int nn_netfunc_kind(NN_NETFUNC *nf)
+{
+  if(nf->forward == nflinearf && nf->backward == nflinearb)
+    return(NN_NF_LINEAR);
+  return(NN_NF_OTHER);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
 static int nfcmp(const void *a, const void *b, void *obj)
 {
   const NN_NETFUNC *x = a, *y = b;
@@ -1156,6 +1531,16 @@ static void nfinit(void)
 			nfnormRf, nfnormRb, nfnorms);
     nn_register_netfunc("unitminus", nfunitminusf, nfunitminusb,
 			nfunitminusRf, nfunitminusRb, nfunitminuss);
+    nn_register_netfunc("xsparse", nfsparsef, nfsparseb,
+			nfsparseRf, nfsparseRb, nfsparses);
+
+    nn_register_netfunc_batch("linear", nflinearBf, nflinearBb);
+    nn_register_netfunc_batch("diagonal", nfdiagonalBf, nfdiagonalBb);
+    nn_register_netfunc_batch("copy", nfcopyBf, nfcopyBb);
+    nn_register_netfunc_batch("kopy", nfkopyBf, nfkopyBb);
+    nn_register_netfunc_batch("scalar", nfscalarBf, nfscalarBb);
+    nn_register_netfunc_batch("product", nfproductBf, nfproductBb);
+    nn_register_netfunc_batch("unitminus", nfunitminusBf, nfunitminusBb);
   }
 }
 
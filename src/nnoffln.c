@@ -4,19 +4,502 @@
 #include <stdlib.h>
 #include <math.h>
 
+#define NN_OFFLINE_OWNER
 #include "nodelib/nn.h"
 #include "nodelib/misc.h"
 #include "nodelib/dataset.h"
 #include "nodelib/optimize.h"
+#include "nodelib/thread.h"
 
 double nn_offline_bignum_skip = 0.0;
+unsigned nn_offline_batch = 0;
+unsigned nn_offline_threads = 1;
+unsigned nn_offline_chunk = 64;
+int nn_offline_deterministic = 0;
+int nn_offline_bound_random = 0;
+unsigned nn_offline_multi_threads = 0;
+unsigned nn_jobs_threads = 0;
+int nn_jobs_pin = 0;
+
+/* The partial sums kept by one thread of the threaded offline
+   routines, along with the buffers that the thread works in. */
+
+typedef struct OFFLINE_SLOT {
+  NN *nn;
+  double **in, **tgt, **dedy, *gall, *scratch;
+  double errsum, rmse;
+  unsigned totalouts;
+} OFFLINE_SLOT;
+
+/* Everything shared by the threads.  The lock protects the DATASET,
+   the next chunk to hand out, (in deterministic mode) the chunk sums
+   in total, and the error of the finished chunks in partial, which
+   stops the handing out of chunks once it passes limit. */
+
+typedef struct OFFLINE_WORK {
+  NN *nn;
+  DATASET *set;
+  unsigned *index, maxi, chunk, numchunks, batch, next, done;
+  int grad;
+  double limit, partial;
+  THREAD_LOCK *lock;
+  OFFLINE_SLOT *slots, total;
+} OFFLINE_WORK;
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
-double nn_offline_test(NN *nn, DATASET *set, int (*hook)(NN *nn))
+double nn_error(NN *nn, double *y, double *t, unsigned n, double *dedy,
+		double *d2edy2)
+{
+  OPT_ERRVEC *ev;
+  double errsum = 0.0, deriv, deriv2;
+  unsigned i;
+
+  if((ev = nn->info.error_vector) == NULL)
+    ev = opt_errvec_find(nn->info.error_function);
+  if(ev)
+    return(ev->error(y, t, n, dedy, d2edy2));
+  for(i = 0; i < n; i++)
+    errsum += nn->info.error_function(y[i], t[i],
+				      dedy ? &dedy[i] : &deriv,
+				      d2edy2 ? &d2edy2[i] : &deriv2);
+  return(errsum);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+void nn_error_hv(NN *nn, double *y, double *t, double *d2edy2, double *v,
+		 double *hv)
+{
+  OPT_ERRVEC *ev = nn->info.error_vector;
+  unsigned i;
+
+  if(ev && ev->hv)
+    ev->hv(y, t, nn->numout, v, hv);
+  else
+    for(i = 0; i < nn->numout; i++)
+      hv[i] = d2edy2[i] * v[i];
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Add the error of the outputs y (stepping by stride) against the
+   targets t to the sums.  Targets that are NaN or too big are left
+   out, so the good ones are packed into scratch, which must hold
+   3 * numout doubles, and handed to nn_error() all at once.  The
+   derivatives are only computed if dedy is not NULL, and are zero
+   for the targets that were left out. */
+
+static void offline_error(NN *nn, double *y, unsigned stride, double *t,
+			  double *dedy, double *scratch, double *errsum,
+			  double *rmse, unsigned *totalouts)
+{
+  double *yy, *tt, *dd;
+  unsigned j, n;
+
+  yy = scratch;
+  tt = scratch + nn->numout;
+  dd = scratch + 2 * nn->numout;
+  for(n = 0, j = 0; j < nn->numout; j++) {
+
+    /* Check for funky conditions. */
+    if(t[j] == t[j] && (nn_offline_bignum_skip == 0.0 ||
+			fabs(t[j]) < fabs(nn_offline_bignum_skip))) {
+      yy[n] = y[j * stride];
+      tt[n] = t[j];
+      *rmse += (yy[n] - tt[n]) * (yy[n] - tt[n]);
+      n++;
+    }
+  }
+  *totalouts += n;
+  if(n > 0)
+    *errsum += nn_error(nn, yy, tt, n, dedy ? dd : NULL, NULL);
+  if(dedy)
+    for(n = 0, j = 0; j < nn->numout; j++) {
+      if(t[j] == t[j] && (nn_offline_bignum_skip == 0.0 ||
+			  fabs(t[j]) < fabs(nn_offline_bignum_skip)))
+	dedy[j] = dd[n++];
+      else
+	dedy[j] = 0;
+    }
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* The batched version of the two offline routines below.  The same
+   patterns are visited in the same order, but they are collected in
+   groups of bsz patterns and passed through the network with
+   nn_forward_batch() and nn_backward_batch().  If perm is not NULL,
+   then the i'th pattern visited is perm[i].  The gradient is only
+   computed if grad is nonzero.  The pass stops early once the summed
+   error is more than limit, and the error so far is returned. */
+
+static double offline_batch(NN *nn, DATASET *set, unsigned *perm,
+			    unsigned maxi, unsigned bsz, int grad,
+			    double limit)
+{
+  double errsum, rmse, *x, *t, *scratch, *gall = NULL;
+  double **in, **tgt, **dedy;
+  unsigned i, j, k, n, pats, index, cont_flag, totalouts = 0;
+
+  pats = dataset_size(set);
+  in = allocate_array(2, sizeof(double), bsz, nn->numin);
+  tgt = allocate_array(2, sizeof(double), bsz, nn->numout);
+  dedy = allocate_array(2, sizeof(double), bsz, nn->numout);
+  scratch = allocate_array(1, sizeof(double), 3 * nn->numout);
+  if(grad) {
+    gall = allocate_array(1, sizeof(double), nn->numweights + 1);
+    for(i = 0; i < nn->numweights; i++)
+      gall[i] = 0.0;
+  }
+  errsum = rmse = 0.0;
+
+  i = 0;
+  while(i < maxi) {
+
+    /* Fill up a batch with valid patterns.  The patterns are copied
+     * since the DATASET may reuse its buffers on the next access.
+     */
+    for(n = 0; n < bsz && i < maxi; i++) {
+      if(perm)
+	index = perm[i];
+      else if(nn->info.subsample == 0.0)
+	index = i;
+      else
+	index = random() % pats;	
+      x = dataset_x(set, index);
+      t = dataset_y(set, index);
+
+      /* Check for funky conditions. */
+      cont_flag = 0;
+      for(j = 0; j < nn->numin; j++)
+	if(x[j] != x[j]) {
+	  cont_flag = 1;
+	  break;
+	}
+      if(cont_flag) continue;
+
+      if(nn_offline_bignum_skip != 0.0)
+	for(j = 0; j < nn->numin; j++)
+	  if(fabs(x[j]) >= fabs(nn_offline_bignum_skip)) {
+	    cont_flag = 1;
+	    break;
+	  }
+      if(cont_flag) continue;
+
+      for(j = 0; j < nn->numin; j++)
+	in[n][j] = x[j];
+      for(j = 0; j < nn->numout; j++)
+	tgt[n][j] = t[j];
+      n++;
+    }
+    if(n == 0) break;
+
+    nn_forward_batch(nn, in, n);
+    for(k = 0; k < n; k++)
+      offline_error(nn, &nn->By[k], n, tgt[k], grad ? dedy[k] : NULL,
+		    scratch, &errsum, &rmse, &totalouts);
+    for(j = 0; j < nn->numout; j++)
+      nn->t[j] = tgt[n - 1][j];
+
+    if(grad) {
+      nn_backward_batch(nn, dedy);
+      for(j = 0; j < nn->numweights; j++)
+	gall[j] += *nn->grads[j];
+    }
+    if(errsum > limit) break;
+  }
+
+  if(grad) {
+    for(j = 0; j < nn->numweights; j++)
+      *nn->grads[j] = gall[j] / totalouts;
+    deallocate_array(gall);
+  }
+  deallocate_array(in);
+  deallocate_array(tgt);
+  deallocate_array(dedy);
+  deallocate_array(scratch);
+  nn->info.error = errsum / totalouts;
+  nn->info.rmse = sqrt(rmse / totalouts);
+  return(nn->info.error);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Returns nonzero if the input pattern x has a NaN or (if
+   nn_offline_bignum_skip is set) a component that is too big. */
+
+static int offline_bad_input(NN *nn, double *x)
+{
+  unsigned j;
+
+  for(j = 0; j < nn->numin; j++)
+    if(x[j] != x[j])
+      return(1);
+  if(nn_offline_bignum_skip != 0.0)
+    for(j = 0; j < nn->numin; j++)
+      if(fabs(x[j]) >= fabs(nn_offline_bignum_skip))
+	return(1);
+  return(0);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+static void offline_slot_clear(OFFLINE_SLOT *slot, unsigned numweights)
+{
+  unsigned j;
+
+  slot->errsum = slot->rmse = 0.0;
+  slot->totalouts = 0;
+  if(slot->gall)
+    for(j = 0; j < numweights; j++)
+      slot->gall[j] = 0.0;
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+static void offline_slot_add(OFFLINE_SLOT *dst, OFFLINE_SLOT *src,
+			     unsigned numweights)
 {
-  double errsum, deriv, deriv2, *x, *t, rmse;
-  unsigned i, j, pats, index, maxi, cont_flag, totalouts = 0;
+  unsigned j;
+
+  dst->errsum += src->errsum;
+  dst->rmse += src->rmse;
+  dst->totalouts += src->totalouts;
+  if(dst->gall)
+    for(j = 0; j < numweights; j++)
+      dst->gall[j] += src->gall[j];
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Run the n patterns that are in the slot's buffers through the
+   slot's NN, in batches of work->batch patterns, and add the results
+   to the slot's sums. */
+
+static void offline_range(OFFLINE_WORK *work, OFFLINE_SLOT *slot, unsigned n)
+{
+  NN *nn = slot->nn;
+  unsigned i, j, k, m;
+
+  for(k = 0; k < n; k += m) {
+    m = (n - k < work->batch) ? n - k : work->batch;
+    if(m == 1)
+      nn_forward(nn, slot->in[k]);
+    else
+      nn_forward_batch(nn, &slot->in[k], m);
+    for(i = 0; i < m; i++)
+      offline_error(work->nn, (m == 1) ? nn->y : &nn->By[i], m,
+		    slot->tgt[k + i], work->grad ? slot->dedy[k + i] : NULL,
+		    slot->scratch, &slot->errsum, &slot->rmse,
+		    &slot->totalouts);
+    if(work->grad) {
+      if(m == 1)
+	nn_backward(nn, slot->dedy[k]);
+      else
+	nn_backward_batch(nn, &slot->dedy[k]);
+      for(j = 0; j < nn->numweights; j++)
+	slot->gall[j] += *nn->grads[j];
+    }
+  }
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Copy the valid patterns numbered start through end - 1 (through
+   work->index, if it is set) into the slot's buffers, and return how
+   many there were.  The caller must hold the lock. */
+
+static unsigned offline_fetch(OFFLINE_WORK *work, OFFLINE_SLOT *slot,
+			      unsigned start, unsigned end)
+{
+  NN *nn = work->nn;
+  double *x, *t;
+  unsigned i, j, n, index;
+
+  for(n = 0, i = start; i < end; i++) {
+    index = work->index ? work->index[i] : i;
+    x = dataset_x(work->set, index);
+    t = dataset_y(work->set, index);
+    if(offline_bad_input(nn, x)) continue;
+    for(j = 0; j < nn->numin; j++)
+      slot->in[n][j] = x[j];
+    for(j = 0; j < nn->numout; j++)
+      slot->tgt[n][j] = t[j];
+    n++;
+  }
+  return(n);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* The body of each thread.  Grab the next chunk of patterns and copy
+   the valid ones while holding the lock, then process them without
+   it.  In deterministic mode the chunk's sums are added to the total
+   in chunk order; otherwise the slot keeps a running sum. */
+
+static void offline_worker(void *obj, unsigned id)
+{
+  OFFLINE_WORK *work = obj;
+  OFFLINE_SLOT *slot = &work->slots[id];
+  NN *nn = work->nn;
+  double before;
+  unsigned c, n, end;
+
+  for(;;) {
+    thread_lock(work->lock);
+    if((c = work->next) >= work->numchunks) {
+      thread_unlock(work->lock);
+      break;
+    }
+    work->next++;
+    end = (c + 1) * work->chunk;
+    if(end > work->maxi) end = work->maxi;
+    n = offline_fetch(work, slot, c * work->chunk, end);
+    thread_unlock(work->lock);
+
+    if(nn_offline_deterministic) {
+      offline_slot_clear(slot, nn->numweights);
+      offline_range(work, slot, n);
+      thread_lock(work->lock);
+      while(work->done != c)
+	thread_wait(work->lock);
+      offline_slot_add(&work->total, slot, nn->numweights);
+      if(work->total.errsum > work->limit)
+	work->next = work->numchunks;
+      work->done++;
+      thread_broadcast(work->lock);
+      thread_unlock(work->lock);
+    }
+    else {
+      before = slot->errsum;
+      offline_range(work, slot, n);
+      if(work->limit < HUGE_VAL) {
+	thread_lock(work->lock);
+	work->partial += slot->errsum - before;
+	if(work->partial > work->limit)
+	  work->next = work->numchunks;
+	thread_unlock(work->lock);
+      }
+    }
+  }
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* The threaded version of the two offline routines below, for
+   networks without recurrent links only, since the chunks are done out
+   of order.  Thread zero uses nn itself, while the others use replicas
+   of nn.  The patterns visited are perm[0] through perm[maxi - 1] if
+   perm is not NULL.  Otherwise, the subsampled pattern indices are
+   picked up front so that random() is only called from this thread.
+   No more chunks are handed out once the summed error is more than
+   limit. */
+
+static double offline_threaded(NN *nn, DATASET *set, unsigned *perm,
+			       unsigned maxi, unsigned numthreads, int grad,
+			       double limit)
+{
+  OFFLINE_WORK work;
+  OFFLINE_SLOT *slot;
+  NN **reps = NULL;
+  unsigned i, j, pats;
+
+  pats = dataset_size(set);
+  work.nn = nn;
+  work.set = set;
+  work.maxi = maxi;
+  work.grad = grad;
+  work.limit = limit;
+  work.partial = 0.0;
+  work.batch = (nn_offline_batch > 1) ? nn_offline_batch : 1;
+  work.chunk = (nn_offline_chunk > work.batch) ? nn_offline_chunk : work.batch;
+  work.numchunks = (maxi + work.chunk - 1) / work.chunk;
+  work.next = work.done = 0;
+  if(numthreads > work.numchunks)
+    numthreads = work.numchunks;
+  if(numthreads == 0)
+    numthreads = 1;
+
+  work.index = perm;
+  if(perm == NULL && nn->info.subsample != 0.0) {
+    work.index = xmalloc(sizeof(unsigned) * (maxi + 1));
+    for(i = 0; i < maxi; i++)
+      work.index[i] = random() % pats;
+  }
+
+  if(numthreads > 1 && (reps = nn_get_replicas(nn, numthreads - 1)) == NULL)
+    numthreads = 1;
+
+  work.slots = xmalloc(sizeof(OFFLINE_SLOT) * numthreads);
+  for(i = 0; i < numthreads; i++) {
+    slot = &work.slots[i];
+    slot->nn = (i == 0) ? nn : reps[i - 1];
+    slot->in = allocate_array(2, sizeof(double), work.chunk, nn->numin);
+    slot->tgt = allocate_array(2, sizeof(double), work.chunk, nn->numout);
+    slot->dedy = allocate_array(2, sizeof(double), work.chunk, nn->numout);
+    slot->scratch = allocate_array(1, sizeof(double), 3 * nn->numout);
+    slot->gall = grad ?
+      allocate_array(1, sizeof(double), nn->numweights + 1) : NULL;
+    offline_slot_clear(slot, nn->numweights);
+  }
+  work.total.gall = grad ?
+    allocate_array(1, sizeof(double), nn->numweights + 1) : NULL;
+  offline_slot_clear(&work.total, nn->numweights);
+  work.lock = thread_lock_create();
+
+  thread_run(numthreads, offline_worker, &work);
+
+  /* Combine the per thread sums, always in the same order. */
+  if(!nn_offline_deterministic)
+    for(i = 0; i < numthreads; i++)
+      offline_slot_add(&work.total, &work.slots[i], nn->numweights);
+
+  if(grad)
+    for(j = 0; j < nn->numweights; j++)
+      *nn->grads[j] = work.total.gall[j] / work.total.totalouts;
+  nn->info.error = work.total.errsum / work.total.totalouts;
+  nn->info.rmse = sqrt(work.total.rmse / work.total.totalouts);
+
+  thread_lock_destroy(work.lock);
+  for(i = 0; i < numthreads; i++) {
+    slot = &work.slots[i];
+    deallocate_array(slot->in);
+    deallocate_array(slot->tgt);
+    deallocate_array(slot->dedy);
+    deallocate_array(slot->scratch);
+    if(slot->gall) deallocate_array(slot->gall);
+  }
+  if(work.total.gall) deallocate_array(work.total.gall);
+  xfree(work.slots);
+  if(work.index && work.index != perm) xfree(work.index);
+  return(nn->info.error);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Returns the number of threads that the offline routines should use,
+   or zero if they should not use the threaded code at all. */
+
+static unsigned offline_numthreads(void)
+{
+  unsigned n;
+
+  n = (nn_offline_threads == 0) ? thread_count() : nn_offline_threads;
+  return((n > 1 || nn_offline_deterministic) ? n : 0);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* The body of nn_offline_test() and nn_offline_test_bounded().  If
+   perm is not NULL, then it holds the order of the patterns.  The pass
+   may stop once the error is certain to be more than bound. */
+
+static double offline_test(NN *nn, DATASET *set, int (*hook)(NN *nn),
+			   unsigned *perm, double bound)
+{
+  double errsum, *x, *t, *scratch, rmse, limit;
+  unsigned i, j, pats, index, maxi, cont_flag, numthreads, totalouts = 0;
 
   nn->info.subsample = fabs(nn->info.subsample);
 
@@ -27,6 +510,9 @@ double nn_offline_test(NN *nn, DATASET *set, int (*hook)(NN *nn))
 	 nn->numin, nn->numout, dataset_x_size(set), dataset_y_size(set));
     return(-1.0);
   }
+
+  /* The weights may have changed since the last pass. */
+  nn_plan_sync(nn);
   errsum = rmse = 0.0;
   
   maxi = (int) ((nn->info.subsample == 0) ? pats :
@@ -34,8 +520,23 @@ double nn_offline_test(NN *nn, DATASET *set, int (*hook)(NN *nn))
 		pats * nn->info.subsample + 0.5 :
 		(nn->info.subsample < pats) ? nn->info.subsample : pats);
 
-  for(i = 0; i < maxi; i++) {
-    if(nn->info.subsample == 0.0)
+  /* The error is the sum over at most maxi * numout outputs divided by
+   * their number, so once the sum passes this, it is over the bound.
+   */
+  limit = (bound < HUGE_VAL) ? bound * maxi * nn->numout : HUGE_VAL;
+
+  if(hook == NULL && nn_feedforward(nn) &&
+     (numthreads = offline_numthreads()) > 0)
+    return(offline_threaded(nn, set, perm, maxi, numthreads, 0, limit));
+  if(nn_offline_batch > 1 && hook == NULL)
+    return(offline_batch(nn, set, perm, maxi, nn_offline_batch, 0, limit));
+
+  /* Even a hopeless bound gets an estimate from one valid pattern. */
+  scratch = xmalloc(sizeof(double) * 3 * nn->numout);
+  for(i = 0; i < maxi && (totalouts == 0 || errsum <= limit); i++) {
+    if(perm)
+      index = perm[i];
+    else if(nn->info.subsample == 0.0)
       index = i;
     else
       index = random() % pats;	
@@ -60,21 +561,14 @@ double nn_offline_test(NN *nn, DATASET *set, int (*hook)(NN *nn))
     if(cont_flag) continue;
 
     nn_forward(nn, x);
-    for(j = 0; j < nn->numout; j++) {
-      
-      /* Check for funky conditions. */
-      if(t[j] == t[j] && (nn_offline_bignum_skip == 0.0 ||
-			  fabs(t[j]) < fabs(nn_offline_bignum_skip))) {
-	errsum += nn->info.error_function(nn->y[j], t[j], &deriv, &deriv2);
-	rmse += (nn->y[j] - t[j]) * (nn->y[j] - t[j]);
-	totalouts++;
-      }
-
+    offline_error(nn, nn->y, 1, t, NULL, scratch, &errsum, &rmse,
+		  &totalouts);
+    for(j = 0; j < nn->numout; j++)
       nn->t[j] = t[j];
-    }
     if(hook)
       hook(nn);
   }
+  xfree(scratch);
   nn->info.error = errsum / totalouts;
   nn->info.rmse = sqrt(rmse / totalouts);
   return(nn->info.error);
@@ -82,12 +576,217 @@ double nn_offline_test(NN *nn, DATASET *set, int (*hook)(NN *nn))
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
-double nn_offline_grad(NN *nn, DATASET *set, int (*hook)(NN *nn))
+double nn_offline_test(NN *nn, DATASET *set, int (*hook)(NN *nn))
+{
+  return(offline_test(nn, set, hook, NULL, HUGE_VAL));
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Returns nonzero if a partial sum of the errors of nn bounds the
+   total, which is only so if no error is negative. */
+
+static int offline_boundable(NN *nn)
+{
+  OPT_ERRVEC *ev;
+
+  if((ev = nn->info.error_vector) == NULL)
+    ev = opt_errvec_find(nn->info.error_function);
+  return(ev != NULL && ev->nonneg);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Returns the order in which a bounded pass of nn over set should
+   visit the patterns, or NULL for the usual order.  In a random
+   order, the error so far is a fair sample. */
+
+static unsigned *offline_bound_perm(NN *nn, DATASET *set)
+{
+  unsigned *perm;
+  unsigned i, j, k, pats;
+
+  pats = dataset_size(set);
+  if(!nn_offline_bound_random || nn->info.subsample != 0.0 || pats < 2)
+    return(NULL);
+  perm = xmalloc(sizeof(unsigned) * pats);
+  for(i = 0; i < pats; i++)
+    perm[i] = i;
+  for(i = pats - 1; i > 0; i--) {
+    j = random() % (i + 1);
+    k = perm[i]; perm[i] = perm[j]; perm[j] = k;
+  }
+  return(perm);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+double nn_offline_test_bounded(NN *nn, DATASET *set, double bound)
+{
+  unsigned *perm;
+  double err;
+
+  if(!offline_boundable(nn))
+    return(offline_test(nn, set, NULL, NULL, HUGE_VAL));
+  perm = offline_bound_perm(nn, set);
+  err = offline_test(nn, set, NULL, perm, bound);
+  if(perm) xfree(perm);
+  return(err);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Everything shared by the threads of nn_offline_test_multi().  The
+   fields of base are used as they are by the other threaded routines,
+   except that the chunks are only a unit of copying, and the lock
+   also protects the next weight vector to hand out. */
+
+typedef struct MULTI_WORK {
+  OFFLINE_WORK base;
+  NN **clones;
+  double **w, *err;
+  unsigned n, next;
+} MULTI_WORK;
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* The body of each thread of nn_offline_test_multi().  Grab the next
+   weight vector, load it into this thread's clone, and make a whole
+   pass with it, copying the patterns a chunk at a time. */
+
+static void multi_worker(void *obj, unsigned id)
+{
+  MULTI_WORK *work = obj;
+  OFFLINE_WORK *base = &work->base;
+  OFFLINE_SLOT *slot = &base->slots[id];
+  NN *nn = slot->nn;
+  unsigned c, i, n, end;
+
+  for(;;) {
+    thread_lock(base->lock);
+    c = work->next;
+    if(c < work->n) work->next++;
+    thread_unlock(base->lock);
+    if(c >= work->n) break;
+
+    for(i = 0; i < nn->numweights; i++)
+      *nn->weights[i] = work->w[c][i];
+    nn_plan_sync(nn);
+    offline_slot_clear(slot, 0);
+    for(i = 0; i < base->maxi; i += base->chunk) {
+      end = (i + base->chunk < base->maxi) ? i + base->chunk : base->maxi;
+      thread_lock(base->lock);
+      n = offline_fetch(base, slot, i, end);
+      thread_unlock(base->lock);
+      offline_range(base, slot, n);
+    }
+    work->err[c] = slot->errsum / slot->totalouts;
+  }
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+int nn_offline_test_multi(NN *nn, DATASET *set, double **w, unsigned n,
+			  double *err)
+{
+  MULTI_WORK work;
+  OFFLINE_SLOT *slot;
+  unsigned i, pats, numthreads;
+
+  pats = dataset_size(set);
+  if(dataset_x_size(set) != nn->numin || dataset_y_size(set) != nn->numout) {
+    ulog(ULOG_ERROR, "nn_offline_test_multi: I/O dimensions are "
+	 "incompatible.%tNN dimension = (%d x %d)%tDATASET dimension = "
+	 "(%d x %d).", nn->numin, nn->numout, dataset_x_size(set),
+	 dataset_y_size(set));
+    return(1);
+  }
+  if(n == 0) return(0);
+
+  nn->info.subsample = fabs(nn->info.subsample);
+  work.base.nn = nn;
+  work.base.set = set;
+  work.base.maxi = (int) ((nn->info.subsample == 0) ? pats :
+			  (nn->info.subsample > 0 && nn->info.subsample < 1) ?
+			  pats * nn->info.subsample + 0.5 :
+			  (nn->info.subsample < pats) ?
+			  nn->info.subsample : pats);
+  work.base.grad = 0;
+  work.base.batch = (nn_offline_batch > 1) ? nn_offline_batch : 1;
+  work.base.chunk = (nn_offline_chunk > work.base.batch) ?
+    nn_offline_chunk : work.base.batch;
+  work.base.index = NULL;
+  if(nn->info.subsample != 0.0) {
+    work.base.index = xmalloc(sizeof(unsigned) * (work.base.maxi + 1));
+    for(i = 0; i < work.base.maxi; i++)
+      work.base.index[i] = random() % pats;
+  }
+  work.w = w;
+  work.err = err;
+  work.n = n;
+  work.next = 0;
+
+  numthreads = (nn_offline_multi_threads == 0) ? thread_count() :
+    nn_offline_multi_threads;
+  if(numthreads > n) numthreads = n;
+  if(numthreads == 0) numthreads = 1;
+
+  /* Each thread needs weights of its own, so replicas will not do. */
+  work.clones = xmalloc(sizeof(NN *) * numthreads);
+  for(i = 0; i < numthreads; i++)
+    if((work.clones[i] = nn_clone(nn)) == NULL)
+      break;
+  if(i == 0) {
+    xfree(work.clones);
+    if(work.base.index) xfree(work.base.index);
+    return(1);
+  }
+  numthreads = i;
+
+  work.base.slots = xmalloc(sizeof(OFFLINE_SLOT) * numthreads);
+  for(i = 0; i < numthreads; i++) {
+    slot = &work.base.slots[i];
+    slot->nn = work.clones[i];
+    slot->in = allocate_array(2, sizeof(double), work.base.chunk, nn->numin);
+    slot->tgt = allocate_array(2, sizeof(double), work.base.chunk,
+			       nn->numout);
+    slot->scratch = allocate_array(1, sizeof(double), 3 * nn->numout);
+    slot->dedy = NULL;
+    slot->gall = NULL;
+  }
+  work.base.lock = thread_lock_create();
+
+  thread_run(numthreads, multi_worker, &work);
+
+  thread_lock_destroy(work.base.lock);
+  for(i = 0; i < numthreads; i++) {
+    slot = &work.base.slots[i];
+    deallocate_array(slot->in);
+    deallocate_array(slot->tgt);
+    deallocate_array(slot->scratch);
+    nn_destroy(work.clones[i]);
+  }
+  xfree(work.base.slots);
+  xfree(work.clones);
+  if(work.base.index) xfree(work.base.index);
+  return(0);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* The body of nn_offline_grad() and nn_offline_grad_bounded().  If
+   perm is not NULL, then it holds the order of the patterns.  The pass
+   may stop once the error is certain to be more than bound, leaving a
+   gradient of only the patterns seen. */
+
+static double offline_grad(NN *nn, DATASET *set, int (*hook)(NN *nn),
+			   unsigned *perm, double bound)
 {
   double *gall;
-  double errsum, *x, *t, *dedy, *d2edy2, rmse;
-  unsigned i, j, pats, maxi, index, cont_flag, totalouts = 0;
+  double errsum, *x, *t, *dedy, *scratch, rmse, limit;
+  unsigned i, j, pats, maxi, index, cont_flag, numthreads, totalouts = 0;
 
+  if(nn_check_not_frozen(nn, "nn_offline_grad")) return(-1.0);
   nn->info.subsample = fabs(nn->info.subsample);
 
   pats = dataset_size(set);
@@ -97,20 +796,32 @@ double nn_offline_grad(NN *nn, DATASET *set, int (*hook)(NN *nn))
 	 nn->numin, nn->numout, dataset_x_size(set), dataset_y_size(set));
     return(-1.0);
   }
-  errsum = rmse = 0.0;
-  dedy = xmalloc(sizeof(double) * nn->numout);
-  d2edy2 = xmalloc(sizeof(double) * nn->numout);
-  gall = allocate_array(1, sizeof(double), nn->numweights);
-  for(i = 0; i < nn->numweights; i++)
-    gall[i] = 0.0;
 
+  /* The weights may have changed since the last pass. */
+  nn_plan_sync(nn);
   maxi = (int) ((nn->info.subsample == 0) ? pats :
 		(nn->info.subsample > 0 && nn->info.subsample < 1) ?
 		pats * nn->info.subsample + 0.5 :
 		(nn->info.subsample < pats) ? nn->info.subsample : pats);
+  limit = (bound < HUGE_VAL) ? bound * maxi * nn->numout : HUGE_VAL;
+
+  if(hook == NULL && nn_feedforward(nn) &&
+     (numthreads = offline_numthreads()) > 0)
+    return(offline_threaded(nn, set, perm, maxi, numthreads, 1, limit));
+  if(nn_offline_batch > 1 && hook == NULL)
+    return(offline_batch(nn, set, perm, maxi, nn_offline_batch, 1, limit));
+
+  errsum = rmse = 0.0;
+  dedy = xmalloc(sizeof(double) * nn->numout);
+  scratch = xmalloc(sizeof(double) * 3 * nn->numout);
+  gall = allocate_array(1, sizeof(double), nn->numweights);
+  for(i = 0; i < nn->numweights; i++)
+    gall[i] = 0.0;
 
-  for(i = 0; i < maxi; i++) {
-    if(nn->info.subsample == 0.0)
+  for(i = 0; i < maxi && (totalouts == 0 || errsum <= limit); i++) {
+    if(perm)
+      index = perm[i];
+    else if(nn->info.subsample == 0.0)
       index = i;
     else
       index = random() % pats;	
@@ -136,21 +847,10 @@ double nn_offline_grad(NN *nn, DATASET *set, int (*hook)(NN *nn))
     if(cont_flag) continue;
 
     nn_forward(nn, x);
-    for(j = 0; j < nn->numout; j++) {
-
-      /* Check for funky conditions. */
-      if(t[j] == t[j] && (nn_offline_bignum_skip == 0.0 ||
-			  fabs(t[j]) < fabs(nn_offline_bignum_skip))) {
-	errsum += nn->info.error_function(nn->y[j], t[j],
-					  &dedy[j], &d2edy2[j]);
-	rmse += (nn->y[j] - t[j]) * (nn->y[j] - t[j]);
-	totalouts++;
-      }
-      else
-	dedy[j] = d2edy2[j] = 0;
-
+    offline_error(nn, nn->y, 1, t, dedy, scratch, &errsum, &rmse,
+		  &totalouts);
+    for(j = 0; j < nn->numout; j++)
       nn->t[j] = t[j];
-    }
     nn_backward(nn, dedy);
     for(j = 0; j < nn->numweights; j++)
       gall[j] += *nn->grads[j];
@@ -163,7 +863,7 @@ double nn_offline_grad(NN *nn, DATASET *set, int (*hook)(NN *nn))
 
   deallocate_array(gall);
   xfree(dedy);
-  xfree(d2edy2);
+  xfree(scratch);
   nn->info.error = errsum / totalouts;
   nn->info.rmse = sqrt(rmse / totalouts);
   return(nn->info.error);
@@ -171,6 +871,51 @@ double nn_offline_grad(NN *nn, DATASET *set, int (*hook)(NN *nn))
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
+double nn_offline_grad(NN *nn, DATASET *set, int (*hook)(NN *nn))
+{
+  return(offline_grad(nn, set, hook, NULL, HUGE_VAL));
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+double nn_offline_grad_bounded(NN *nn, DATASET *set, double bound)
+{
+  unsigned *perm;
+  double err;
+
+  if(!offline_boundable(nn))
+    return(offline_grad(nn, set, NULL, NULL, HUGE_VAL));
+  perm = offline_bound_perm(nn, set);
+  err = offline_grad(nn, set, NULL, perm, bound);
+  if(perm) xfree(perm);
+  return(err);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+double nn_minibatch_grad(NN *nn, DATASET *set, unsigned *index, unsigned n)
+{
+  unsigned numthreads;
+
+  if(nn_check_not_frozen(nn, "nn_minibatch_grad")) return(-1.0);
+  if(dataset_x_size(set) != nn->numin || dataset_y_size(set) != nn->numout) {
+    ulog(ULOG_ERROR, "nn_minibatch_grad: I/O dimensions are incompatible.%t"
+	 "NN dimension = (%d x %d)%tDATASET dimension = (%d x %d).",
+	 nn->numin, nn->numout, dataset_x_size(set), dataset_y_size(set));
+    return(-1.0);
+  }
+
+  /* The weights change after every mini-batch. */
+  nn_plan_sync(nn);
+  if(nn_feedforward(nn) && (numthreads = offline_numthreads()) > 0)
+    return(offline_threaded(nn, set, index, n, numthreads, 1, HUGE_VAL));
+  return(offline_batch(nn, set, index, n,
+		       (nn_offline_batch > 1) ? nn_offline_batch : n, 1,
+		       HUGE_VAL));
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
 static double nn_gradf_wrapper(void *obj)
 {
   NN *nn = obj;
@@ -189,9 +934,119 @@ static double nn_funcf_wrapper(void *obj)
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
-/* Check for cross validation condition. */
+static double nn_boundf_wrapper(void *obj, double bound)
+{
+  NN *nn = obj;
+
+  return(nn_offline_test_bounded(nn, nn->info.train_set, bound));
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+static double nn_gradbf_wrapper(void *obj, double bound)
+{
+  NN *nn = obj;
+
+  return(nn_offline_grad_bounded(nn, nn->info.train_set, bound));
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+static int nn_multif_wrapper(void *obj, double **w, unsigned n, double *err)
+{
+  NN *nn = obj;
+
+  return(nn_offline_test_multi(nn, nn->info.train_set, w, n, err));
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+static double nn_batchf_wrapper(void *obj, unsigned *index, unsigned n)
+{
+  NN *nn = obj;
+
+  return(nn_minibatch_grad(nn, nn->info.train_set, index, n));
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* The Gauss-Newton matrix is averaged over the patterns, while the
+   error is averaged over every output, so it is scaled to match. */
+
+static int nn_hessf_wrapper(void *obj, double **H)
+{
+  NN *nn = obj;
+  unsigned i, j;
+
+  if(nn_offline_gauss_newton(nn, nn->info.train_set, H) != 0)
+    return(1);
+  for(i = 0; i < nn->numweights; i++)
+    for(j = 0; j < nn->numweights; j++)
+      H[i][j] /= nn->numout;
+  return(0);
+}
 
-static double last_test_error;
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+static int nn_hvf_wrapper(void *obj, unsigned *index, unsigned n,
+			  double *v, double *hv)
+{
+  NN *nn = obj;
+
+  return(nn_offline_Hv(nn, nn->info.train_set, index, n, v, hv));
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Everything shared by the threads of nn_train_jobs().  The lock
+   protects the next job to hand out and the best error that any run
+   has had at each epoch, which is what a run is culled against. */
+
+typedef struct JOBS_WORK {
+  NN_JOB *jobs;
+  unsigned n, next, numbest;
+  double cull, *best;
+  THREAD_LOCK *lock;
+} JOBS_WORK;
+
+/* What nn->info.job points to while a job is running. */
+
+typedef struct JOBS_SLOT {
+  JOBS_WORK *work;
+  NN_JOB *job;
+} JOBS_SLOT;
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Returns nonzero if the run of nn has fallen too far behind the best
+   run at the same epoch, and marks its job as cancelled. */
+
+static int jobs_cull(JOBS_SLOT *slot, NN *nn)
+{
+  JOBS_WORK *work = slot->work;
+  unsigned epoch = nn->info.opt.epoch;
+  double err;
+  int result = 0;
+
+  err = nn->info.test_set ? nn->info.test_error : nn->info.opt.error;
+  thread_lock(work->lock);
+  if(epoch < work->numbest) {
+    if(err < work->best[epoch])
+      work->best[epoch] = err;
+    else if(epoch >= nn->info.opt.min_epochs &&
+	    err > (1 + work->cull) * work->best[epoch])
+      result = 1;
+  }
+  thread_unlock(work->lock);
+  if(result)
+    slot->job->cancelled = 1;
+  return(result);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Check for cross validation condition, and the culling of
+   nn_train_jobs(). */
 
 static int nn_haltf_wrapper(void *obj)
 {
@@ -202,9 +1057,13 @@ static int nn_haltf_wrapper(void *obj)
 
   if(nn->info.test_set) {
     new_test_error = nn_offline_test(nn, nn->info.test_set, NULL);
-    if(new_test_error > last_test_error)
+    if(new_test_error > nn->info.test_error)
       result = 1;
+    nn->info.test_error = new_test_error;
   }
+  if(nn->info.job && ((JOBS_SLOT *) nn->info.job)->work->cull > 0)
+    if(jobs_cull(nn->info.job, nn))
+      result = 1;
   return(result);
 }
 
@@ -212,6 +1071,8 @@ static int nn_haltf_wrapper(void *obj)
 
 int nn_train(NN *nn)
 {
+  if(nn_check_not_frozen(nn, "nn_train")) return(1);
+
   /* Check for the sanity of the train and test pattern sets. */
 
   if(!nn->info.train_set) {
@@ -243,18 +1104,27 @@ int nn_train(NN *nn)
     return(1);
   }
 
-  last_test_error = 10e20;
+  nn->info.test_error = 10e20;
 
   /* Fill up the opt structure. */
 
   nn->info.opt.size = nn->numweights;
   nn->info.opt.weights = nn->weights;
   nn->info.opt.grads = nn->grads;
+  nn->info.opt.wvec = nn->wvec;
+  nn->info.opt.gvec = nn->gvec;
   nn->info.opt.obj = nn;
 
   nn->info.opt.gradf = nn_gradf_wrapper;
   nn->info.opt.funcf = nn_funcf_wrapper;
+  nn->info.opt.boundf = offline_boundable(nn) ? nn_boundf_wrapper : NULL;
+  nn->info.opt.gradbf = offline_boundable(nn) ? nn_gradbf_wrapper : NULL;
+  nn->info.opt.multif = nn_multif_wrapper;
   nn->info.opt.haltf = nn_haltf_wrapper;
+  nn->info.opt.batchf = nn_batchf_wrapper;
+  nn->info.opt.hessf = nn_hessf_wrapper;
+  nn->info.opt.hvf = nn_hvf_wrapper;
+  nn->info.opt.numpats = dataset_size(nn->info.train_set);
 
   /* Do the training and collect the statistics. */
 
@@ -265,3 +1135,84 @@ int nn_train(NN *nn)
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
+/* The body of each thread of nn_train_jobs().  Grab the next job and
+   train its NN until there are none left.  A pinned worker is let go
+   again at the end, since the pool outlives the jobs. */
+
+static void jobs_worker(void *obj, unsigned id)
+{
+  JOBS_WORK *work = obj;
+  JOBS_SLOT slot;
+  THREAD_PIN *pin = NULL;
+  NN_JOB *job;
+  NN *nn;
+  unsigned i;
+
+  if(nn_jobs_pin && id > 0)
+    pin = thread_pin(id);
+  slot.work = work;
+  for(;;) {
+    thread_lock(work->lock);
+    i = work->next;
+    if(i < work->n) work->next++;
+    thread_unlock(work->lock);
+    if(i >= work->n) break;
+
+    slot.job = job = &work->jobs[i];
+    nn = job->nn;
+    nn->info.job = &slot;
+    job->result = nn_train(nn);
+    nn->info.job = NULL;
+    job->epochs = nn->info.opt.epoch;
+    job->error = nn->info.opt.error;
+    job->test_error = nn->info.test_set ? nn->info.test_error : 0.0;
+  }
+  thread_unpin(pin);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+int nn_train_jobs(NN_JOB *jobs, unsigned n, double cull)
+{
+  JOBS_WORK work;
+  unsigned i, numthreads;
+  int result = 0;
+
+  /* Set up every run in order, so that random() is only called from
+   * this thread and each run starts from the same place every time.
+   */
+  work.numbest = 0;
+  for(i = 0; i < n; i++) {
+    if(jobs[i].wmax > 0) {
+      srandom(jobs[i].seed);
+      nn_init(jobs[i].nn, jobs[i].wmax);
+    }
+    jobs[i].result = jobs[i].cancelled = 0;
+    jobs[i].epochs = 0;
+    jobs[i].error = jobs[i].test_error = 0.0;
+    if(jobs[i].nn->info.opt.max_epochs + 2 > work.numbest)
+      work.numbest = jobs[i].nn->info.opt.max_epochs + 2;
+  }
+
+  work.jobs = jobs;
+  work.n = n;
+  work.next = 0;
+  work.cull = cull;
+  work.best = allocate_array(1, sizeof(double), work.numbest);
+  for(i = 0; i < work.numbest; i++)
+    work.best[i] = HUGE_VAL;
+  work.lock = thread_lock_create();
+
+  numthreads = (nn_jobs_threads == 0) ? thread_count() : nn_jobs_threads;
+  if(numthreads > n) numthreads = n;
+  thread_run(numthreads, jobs_worker, &work);
+
+  thread_lock_destroy(work.lock);
+  deallocate_array(work.best);
+  for(i = 0; i < n; i++)
+    if(jobs[i].result != 0)
+      result = 1;
+  return(result);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
@@ -6,15 +6,22 @@
 
 #include "nodelib/nn.h"
 #include "nodelib/misc.h"
+#include "nodelib/xalloc.h"
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
 void nn_forward(NN *nn, double *input)
 {
-  unsigned i, j, k;
+  unsigned i, j;
   NN_LAYER *slab;
   NN_LINKLIST *l;
 
+  if(nn->compiled) {
+    if(nn->plan == NULL) nn_compile(nn);
+    nn_plan_forward(nn, input);
+    return;
+  }
+
   /* Clean up the net input. */
   for(i = 0; i < nn->numlayers; i++)
     for(j = 0; j < nn->layers[i].sz; j++)
@@ -41,8 +48,7 @@ void nn_forward(NN *nn, double *input)
 	l->link->nfunc->forward(nn, l->link, slab);
 
       /* Map net inputs through the activation functions. */
-      for(k = 0; k < slab->sz; k++)
-	slab->y[k] = slab->afunc->func(slab->x[k]);
+      nn_actfunc_forward(slab, slab->x, slab->y, slab->sz);
     }
   }
 }
@@ -55,6 +61,13 @@ void nn_backward(NN *nn, double *de_dy)
   NN_LAYER *slab;
   NN_LINKLIST *l;
 
+  if(nn_check_not_frozen(nn, "nn_backward")) return;
+  if(nn->compiled) {
+    if(nn->plan == NULL) nn_compile(nn);
+    nn_plan_backward(nn, de_dy);
+    return;
+  }
+
   /* Clean up the derivatives. */
   for(i = 0; i < nn->numweights; i++)
     *nn->grads[i] = 0.0;
@@ -82,9 +95,8 @@ void nn_backward(NN *nn, double *de_dy)
 	  l->link->nfunc->backward(nn, l->link, slab);
 
       if(slab->need_grads || nn->need_all_grads)
-	for(k = 0; k < slab->sz; k++)
-	  slab->dx[k] = slab->dy[k]  * 
-	    slab->afunc->deriv(slab->x[k], slab->y[k]);
+	nn_actfunc_backward(slab, slab->x, slab->y, slab->dy, slab->dx,
+			    slab->sz);
       else
 	for(k = 0; k < slab->sz; k++)
 	  slab->dx[k] = 0;
@@ -93,3 +105,305 @@ void nn_backward(NN *nn, double *de_dy)
 }
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Make room in the batch buffers for n patterns, and point the batch
+   buffers of each slab into the batch buffers of its layer. */
+
+static void batch_resize(NN *nn, unsigned n)
+{
+  unsigned i, j, off;
+  NN_LAYER *layer;
+
+  if(n > nn->batchcap) {
+    for(i = 0; i < nn->numlayers; i++) {
+      layer = &nn->layers[i];
+      if(layer->Bx) {
+	xfree(layer->Bx);
+	xfree(layer->By);
+      }
+      if(layer->Bdx) {
+	xfree(layer->Bdx);
+	xfree(layer->Bdy);
+      }
+      layer->Bx  = xmalloc(sizeof(double) * layer->sz * n);
+      layer->By  = xmalloc(sizeof(double) * layer->sz * n);
+      /* A frozen NN has no derivatives to keep. */
+      if(!nn->frozen) {
+	layer->Bdx = xmalloc(sizeof(double) * layer->sz * n);
+	layer->Bdy = xmalloc(sizeof(double) * layer->sz * n);
+      }
+    }
+    if(nn->Btmp) xfree(nn->Btmp);
+    nn->Btmp = xmalloc(sizeof(double) * n);
+    nn->batchcap = n;
+  }
+
+  nn->batchsz = n;
+  for(i = 0; i < nn->numlayers; i++) {
+    layer = &nn->layers[i];
+    off = 0;
+    for(j = 0; j < layer->numslabs; j++) {
+      layer->slabs[j].Bx  = layer->Bx  + off * n;
+      layer->slabs[j].By  = layer->By  + off * n;
+      if(layer->Bdx) {
+	layer->slabs[j].Bdx = layer->Bdx + off * n;
+	layer->slabs[j].Bdy = layer->Bdy + off * n;
+      }
+      off += layer->slabs[j].sz;
+    }
+  }
+  nn->Bx = nn->layers[0].Bx;
+  nn->By = nn->layers[nn->numlayers - 1].By;
+  nn->Bdx = nn->layers[0].Bdx;
+  nn->Bdy = nn->layers[nn->numlayers - 1].Bdy;
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Returns nonzero if every link leads from a lower layer to a higher
+   layer, in which case the patterns of a batch do not depend on one
+   another. */
+
+int nn_feedforward(NN *nn)
+{
+  unsigned i;
+  NN_LAYERLIST *s, *d;
+
+  for(i = 0; i < nn->numlinks; i++)
+    for(s = nn->links[i]->source; s != NULL; s = s->cdr)
+      for(d = nn->links[i]->dest; d != NULL; d = d->cdr)
+	if(s->layer->idl >= d->layer->idl)
+	  return(0);
+  return(1);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Copy pattern k of the batch buffers of layer into the single
+   pattern buffers, and back again.  A frozen NN has no derivatives to
+   copy. */
+
+static void batch_gather(NN_LAYER *layer, unsigned n, unsigned k)
+{
+  unsigned i;
+
+  for(i = 0; i < layer->sz; i++) {
+    layer->x[i]  = layer->Bx[i * n + k];
+    layer->y[i]  = layer->By[i * n + k];
+  }
+  if(layer->Bdx)
+    for(i = 0; i < layer->sz; i++) {
+      layer->dx[i] = layer->Bdx[i * n + k];
+      layer->dy[i] = layer->Bdy[i * n + k];
+    }
+}
+
+static void batch_scatter(NN_LAYER *layer, unsigned n, unsigned k)
+{
+  unsigned i;
+
+  for(i = 0; i < layer->sz; i++) {
+    layer->Bx[i * n + k]  = layer->x[i];
+    layer->By[i * n + k]  = layer->y[i];
+  }
+  if(layer->Bdx)
+    for(i = 0; i < layer->sz; i++) {
+      layer->Bdx[i * n + k] = layer->dx[i];
+      layer->Bdy[i * n + k] = layer->dy[i];
+    }
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Compute the net input of a link for all patterns in the batch, using
+   the single pattern forward pass if the net function has no batch
+   version. */
+
+static void batch_link_forward(NN *nn, NN_LINK *link, NN_LAYER *dst)
+{
+  NN_LAYERLIST *l;
+  unsigned k, n = nn->batchsz;
+
+  if(link->nfunc->forward_batch) {
+    link->nfunc->forward_batch(nn, link, dst);
+    return;
+  }
+  for(k = 0; k < n; k++) {
+    for(l = link->source; l != NULL; l = l->cdr)
+      batch_gather(l->layer, n, k);
+    batch_gather(dst, n, k);
+    link->nfunc->forward(nn, link, dst);
+    batch_scatter(dst, n, k);
+  }
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Compute the backward pass of a link for all patterns in the batch.
+   Without a batch version of the net function, the single pattern
+   backward pass is called for each pattern and the weight derivatives
+   are summed over the batch by hand. */
+
+static void batch_link_backward(NN *nn, NN_LINK *link, NN_LAYER *src)
+{
+  NN_LAYERLIST *l;
+  double *g[6], *sum = NULL;
+  unsigned i, j, k, tot, nb, sz[6], n = nn->batchsz;
+
+  if(link->nfunc->backward_batch) {
+    link->nfunc->backward_batch(nn, link, src);
+    return;
+  }
+  nb = nn_link_blocks(link, NULL, g, NULL, NULL, sz);
+  if(link->numweights > 0 && (link->need_grads || nn->need_all_grads)) {
+    sum = xmalloc(sizeof(double) * link->numweights);
+    for(i = 0; i < link->numweights; i++)
+      sum[i] = 0;
+  }
+  for(k = 0; k < n; k++) {
+    for(l = link->source; l != NULL; l = l->cdr)
+      batch_gather(l->layer, n, k);
+    for(l = link->dest; l != NULL; l = l->cdr)
+      batch_gather(l->layer, n, k);
+    batch_gather(src, n, k);
+    link->nfunc->backward(nn, link, src);
+    for(l = link->source; l != NULL; l = l->cdr)
+      batch_scatter(l->layer, n, k);
+    batch_scatter(src, n, k);
+    if(sum)
+      for(i = 0, tot = 0; i < nb; i++)
+	for(j = 0; j < sz[i]; j++)
+	  sum[tot++] += g[i][j];
+  }
+  if(sum) {
+    for(i = 0, tot = 0; i < nb; i++)
+      for(j = 0; j < sz[i]; j++)
+	g[i][j] = sum[tot++];
+    xfree(sum);
+  }
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+void nn_forward_batch(NN *nn, double **input, unsigned n)
+{
+  unsigned i, j, k, sz;
+  NN_LAYER *slab;
+  NN_LINKLIST *l;
+
+  if(n == 0) return;
+  batch_resize(nn, n);
+
+  /* Networks with recurrent links must see the patterns in order. */
+  if(!nn_feedforward(nn)) {
+    for(k = 0; k < n; k++) {
+      nn_forward(nn, input[k]);
+      for(i = 0; i < nn->numlayers; i++)
+	batch_scatter(&nn->layers[i], n, k);
+    }
+    return;
+  }
+
+  /* Clean up the net input. */
+  for(i = 0; i < nn->numlayers; i++) {
+    sz = nn->layers[i].sz * n;
+    for(j = 0; j < sz; j++)
+      nn->layers[i].Bx[j] = 0.0;
+  }
+
+  /* Fill up the input vectors. */
+  for(i = 0; i < nn->numin; i++)
+    for(k = 0; k < n; k++)
+      nn->Bx[i * n + k] = input[k][i];
+
+  /* For each layer... */
+  for(i = 0; i < nn->numlayers; i++) {
+
+    /* Compute the net input contributed by links coming into this layer. */
+    for(l = nn->layers[i].in; l != NULL; l = l->cdr)
+      batch_link_forward(nn, l->link, &nn->layers[i]);
+
+    /* For each sublayer... */
+    for(j = 0; j < nn->layers[i].numslabs; j++) {
+      slab = &nn->layers[i].slabs[j];
+      for(l = slab->in; l != NULL; l = l->cdr)
+	batch_link_forward(nn, l->link, slab);
+
+      /* Map net inputs through the activation functions. */
+      nn_actfunc_forward(slab, slab->Bx, slab->By, slab->sz * n);
+    }
+  }
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+void nn_backward_batch(NN *nn, double **de_dy)
+{
+  unsigned i, j, k, sz, n = nn->batchsz;
+  NN_LAYER *slab;
+  NN_LINKLIST *l;
+  double *gall;
+
+  if(nn_check_not_frozen(nn, "nn_backward_batch")) return;
+  if(n == 0) return;
+
+  /* Networks with recurrent links are done one pattern at a time. */
+  if(!nn_feedforward(nn)) {
+    gall = xmalloc(sizeof(double) * (nn->numweights + 1));
+    for(i = 0; i < nn->numweights; i++)
+      gall[i] = 0.0;
+    for(k = 0; k < n; k++) {
+      for(i = 0; i < nn->numlayers; i++)
+	batch_gather(&nn->layers[i], n, k);
+      nn_backward(nn, de_dy[k]);
+      for(i = 0; i < nn->numlayers; i++)
+	batch_scatter(&nn->layers[i], n, k);
+      for(i = 0; i < nn->numweights; i++)
+	gall[i] += *nn->grads[i];
+    }
+    for(i = 0; i < nn->numweights; i++)
+      *nn->grads[i] = gall[i];
+    xfree(gall);
+    return;
+  }
+
+  /* Clean up the derivatives. */
+  for(i = 0; i < nn->numweights; i++)
+    *nn->grads[i] = 0.0;
+
+  for(i = 0; i < nn->numlayers; i++) {
+    sz = nn->layers[i].sz * n;
+    for(j = 0; j < sz; j++)
+      nn->layers[i].Bdy[j] = 0.0;
+  }
+
+  /* Pass the partial of the error w.r.t. the output. */
+  for(i = 0; i < nn->numout; i++)
+    for(k = 0; k < n; k++)
+      nn->Bdy[i * n + k] = de_dy[k][i];
+ 
+  for(i = nn->numlayers; i > 0; i--) {
+
+    for(l = nn->layers[i - 1].out; l != NULL; l = l->cdr)
+      if(nn->layers[i - 1].need_grads || l->link->need_grads ||
+	 nn->need_all_grads)
+	batch_link_backward(nn, l->link, &nn->layers[i - 1]);
+
+    for(j = 0; j < nn->layers[i - 1].numslabs; j++) {
+      
+      slab = &nn->layers[i - 1].slabs[j];
+      for(l = slab->out; l != NULL; l = l->cdr)
+	if(slab->need_grads || l->link->need_grads || nn->need_all_grads)
+	  batch_link_backward(nn, l->link, slab);
+
+      sz = slab->sz * n;
+      if(slab->need_grads || nn->need_all_grads)
+	nn_actfunc_backward(slab, slab->Bx, slab->By, slab->Bdy, slab->Bdx, sz);
+      else
+	for(k = 0; k < sz; k++)
+	  slab->Bdx[k] = 0;
+    }
+  }
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
@@ -0,0 +1,548 @@
+
+/* Copyright (c) 2000 by G. W. Flake. */
+
+#include <stdlib.h>
+
+#include "nodelib/nn.h"
+#include "nodelib/misc.h"
+#include "nodelib/xalloc.h"
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* The types of steps in a compiled plan.  A LINK step calls the net
+   function of a link, an ACT (DERIV) step maps the net inputs (output
+   derivatives) of a slab through its activation function, and a FUSED
+   step does both for a linear link that is the only one feeding (or
+   fed by) the slab. */
+
+#define PLAN_LINK  0
+#define PLAN_ACT   1
+#define PLAN_DERIV 2
+#define PLAN_FUSED 3
+
+/* For a LINK step, \em{unit} is the layer or slab that is passed to
+   the net function.  For a FUSED step, \em{unit} is the layer or slab
+   that the link is attached to, \em{slab} is the part of it handled
+   by this step, and \em{off} is the offset of the slab within the
+   link's rows (forward) or columns (backward).  The link's weight
+   derivatives are only computed by the FUSED step that has
+   \em{first} set.
+
+   In single precision, \em{uf} is the float copy of a FUSED step's
+   weights, \em{fin} is the float copy of the source outputs (forward)
+   or destination derivatives (backward) that it reads, and \em{fout}
+   is the float copy of the outputs (forward) or derivatives
+   (backward) of \em{slab} that an ACT, DERIV, or FUSED step must
+   update.  Otherwise, all three are NULL. */
+
+typedef struct NN_STEP {
+  int type;
+  NN_LINK *link;
+  NN_LAYER *unit, *slab;
+  unsigned off, first;
+  float **uf, *fin, *fout;
+} NN_STEP;
+
+/* A range of doubles that must be cleared. */
+
+typedef struct NN_SPAN {
+  double *ptr;
+  unsigned sz;
+} NN_SPAN;
+
+/* For single precision, \em{uf[i]} is a float copy of the \em{u}
+   matrix of link \em{i} if that link is fused (or else NULL), and
+   \em{yf} and \em{dxf} hold float copies of the outputs and output
+   derivatives of every layer, starting at \em{base[idl]}. */
+
+struct NN_PLAN {
+  NN_STEP *fwd, *bwd;
+  unsigned numfwd, numbwd, capfwd, capbwd;
+  NN_SPAN *xclear, *dyclear, *gclear;
+  unsigned numxclear, numdyclear, numgclear;
+  float ***uf, *yf, *dxf;
+  unsigned *base, numuf;
+};
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+static NN_STEP *plan_add(NN_STEP **steps, unsigned *num, unsigned *cap,
+			 int type, NN_LINK *link, NN_LAYER *unit,
+			 NN_LAYER *slab)
+{
+  NN_STEP *st;
+
+  if(*num == *cap) {
+    *cap = (*cap == 0) ? 16 : *cap * 2;
+    *steps = xrealloc(*steps, sizeof(NN_STEP) * *cap);
+  }
+  st = &(*steps)[(*num)++];
+  st->type = type;
+  st->link = link;
+  st->unit = unit;
+  st->slab = slab;
+  st->off = 0;
+  st->first = 1;
+  st->uf = NULL;
+  st->fin = st->fout = NULL;
+  return(st);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Add a span to a clear list, merging it with the last one if the two
+   are adjacent.  The list has room for at least one span per slab. */
+
+static void plan_span(NN_SPAN *spans, unsigned *num, double *ptr, unsigned sz)
+{
+  if(sz == 0) return;
+  if(*num > 0 && spans[*num - 1].ptr + spans[*num - 1].sz == ptr)
+    spans[*num - 1].sz += sz;
+  else {
+    spans[*num].ptr = ptr;
+    spans[*num].sz = sz;
+    (*num)++;
+  }
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Returns nonzero if the link can be fused with the slabs of the layer
+   at index idl.  The link must be a builtin linear link that leads
+   from a lower layer to a higher one, so that the source values
+   cannot change while the destination is being computed. */
+
+static int plan_fusable(NN_LINK *link, unsigned src, unsigned dst)
+{
+  return(nn_netfunc_kind(link->nfunc) == NN_NF_LINEAR && src < dst);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Returns the float copy of the outputs (or derivatives, if dx is
+   set) of a layer or slab. */
+
+static float *plan_shadow(NN *nn, NN_PLAN *plan, NN_LAYER *unit, int dx)
+{
+  NN_LAYER *layer = &nn->layers[unit->idl];
+
+  if(dx)
+    return(plan->dxf + plan->base[unit->idl] + (unit->dx - layer->dx));
+  return(plan->yf + plan->base[unit->idl] + (unit->y - layer->y));
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Make the float buffers for a single precision plan, and point the
+   steps at them. */
+
+static void plan_single(NN *nn, NN_PLAN *plan)
+{
+  NN_STEP *st;
+  unsigned i, k, total;
+
+  plan->base = xmalloc(sizeof(unsigned) * nn->numlayers);
+  for(total = 0, i = 0; i < nn->numlayers; i++) {
+    plan->base[i] = total;
+    total += nn->layers[i].sz;
+  }
+  plan->yf = xcalloc(total + 1, sizeof(float));
+  plan->dxf = nn->frozen ? NULL : xcalloc(total + 1, sizeof(float));
+  plan->uf = xcalloc(nn->numlinks + 1, sizeof(float **));
+  plan->numuf = nn->numlinks;
+
+  for(k = 0; k < plan->numfwd + plan->numbwd; k++) {
+    st = (k < plan->numfwd) ? &plan->fwd[k] : &plan->bwd[k - plan->numfwd];
+    if(st->type == PLAN_FUSED) {
+      for(i = 0; nn->links[i] != st->link; i++)
+	;
+      if(plan->uf[i] == NULL)
+	plan->uf[i] = allocate_array(2, sizeof(float), st->link->numout,
+				     st->link->numin);
+      st->uf = plan->uf[i];
+    }
+    if(k < plan->numfwd) {
+      if(st->type == PLAN_FUSED)
+	st->fin = plan_shadow(nn, plan, st->link->source->layer, 0);
+      if(st->type != PLAN_LINK)
+	st->fout = plan_shadow(nn, plan, st->slab, 0);
+    }
+    else {
+      if(st->type == PLAN_FUSED)
+	st->fin = plan_shadow(nn, plan, st->link->dest->layer, 1);
+      if(st->type != PLAN_LINK)
+	st->fout = plan_shadow(nn, plan, st->slab, 1);
+    }
+  }
+  nn_plan_sync(nn);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Copy the weights of the fused links into their float copies. */
+
+void nn_plan_sync(NN *nn)
+{
+  NN_PLAN *plan = nn->plan;
+  NN_LINK *link;
+  unsigned i, j, k;
+
+  if(plan == NULL || plan->uf == NULL) return;
+  for(i = 0; i < plan->numuf; i++)
+    if(plan->uf[i] != NULL) {
+      link = nn->links[i];
+      for(j = 0; j < link->numout; j++)
+	for(k = 0; k < link->numin; k++)
+	  plan->uf[i][j][k] = link->u[j][k];
+    }
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+int nn_compile(NN *nn)
+{
+  NN_PLAN *plan;
+  NN_LAYER *layer, *slab;
+  NN_LINKLIST *l;
+  NN_STEP *st;
+  double *g[6];
+  unsigned i, j, k, n, nl, nsl, numslabs, last, sz[6], *assigned;
+
+  nn_plan_free(nn);
+  plan = xcalloc(1, sizeof(NN_PLAN));
+
+  numslabs = 0;
+  for(i = 0; i < nn->numlayers; i++)
+    numslabs += nn->layers[i].numslabs;
+  plan->xclear = xmalloc(sizeof(NN_SPAN) * (numslabs + 1));
+  plan->dyclear = xmalloc(sizeof(NN_SPAN) * (numslabs + 1));
+  plan->gclear = xmalloc(sizeof(NN_SPAN) * (6 * nn->numlinks + 1));
+  assigned = xmalloc(sizeof(unsigned) * (numslabs + 1));
+  last = nn->numlayers - 1;
+
+  /* The forward pass, in the same order as nn_forward().  The input
+   * layer is always copied over, so it is never cleared or fused.
+   */
+  for(i = 0; i < nn->numlayers; i++) {
+    layer = &nn->layers[i];
+    nl = nn_linklist_len(layer->in);
+    for(nsl = 0, j = 0; j < layer->numslabs; j++) {
+      nsl += nn_linklist_len(layer->slabs[j].in);
+      assigned[j] = 0;
+    }
+    if(i > 0 && nl == 1 && nsl == 0 && plan_fusable(layer->in->link,
+		  layer->in->link->source->layer->idl, i)) {
+      for(j = 0; j < layer->numslabs; j++) {
+	slab = &layer->slabs[j];
+	st = plan_add(&plan->fwd, &plan->numfwd, &plan->capfwd,
+		      PLAN_FUSED, layer->in->link, layer, slab);
+	st->off = slab->x - layer->x;
+	assigned[j] = 1;
+      }
+    }
+    else {
+      for(l = layer->in; l != NULL; l = l->cdr)
+	plan_add(&plan->fwd, &plan->numfwd, &plan->capfwd,
+		 PLAN_LINK, l->link, layer, NULL);
+      for(j = 0; j < layer->numslabs; j++) {
+	slab = &layer->slabs[j];
+	if(i > 0 && nl == 0 && nn_linklist_len(slab->in) == 1 &&
+	   plan_fusable(slab->in->link, slab->in->link->source->layer->idl,
+			i)) {
+	  plan_add(&plan->fwd, &plan->numfwd, &plan->capfwd,
+		   PLAN_FUSED, slab->in->link, slab, slab);
+	  assigned[j] = 1;
+	  continue;
+	}
+	for(l = slab->in; l != NULL; l = l->cdr)
+	  plan_add(&plan->fwd, &plan->numfwd, &plan->capfwd,
+		   PLAN_LINK, l->link, slab, NULL);
+	plan_add(&plan->fwd, &plan->numfwd, &plan->capfwd,
+		 PLAN_ACT, NULL, slab, slab);
+      }
+    }
+    if(i > 0)
+      for(j = 0; j < layer->numslabs; j++)
+	if(!assigned[j])
+	  plan_span(plan->xclear, &plan->numxclear,
+		    layer->slabs[j].x, layer->slabs[j].sz);
+  }
+
+  /* The backward pass, in the same order as nn_backward().  The output
+   * layer is always copied over, so it is never cleared or fused.  A
+   * frozen NN gets no backward pass at all.
+   */
+  for(i = nn->frozen ? 0 : nn->numlayers; i > 0; i--) {
+    layer = &nn->layers[i - 1];
+    nl = nn_linklist_len(layer->out);
+    for(nsl = 0, j = 0; j < layer->numslabs; j++) {
+      nsl += nn_linklist_len(layer->slabs[j].out);
+      assigned[j] = 0;
+    }
+    if(i - 1 != last && nl == 1 && nsl == 0 && plan_fusable(layer->out->link,
+		  i - 1, layer->out->link->dest->layer->idl)) {
+      for(j = 0; j < layer->numslabs; j++) {
+	slab = &layer->slabs[j];
+	st = plan_add(&plan->bwd, &plan->numbwd, &plan->capbwd,
+		      PLAN_FUSED, layer->out->link, layer, slab);
+	st->off = slab->y - layer->y;
+	st->first = (j == 0);
+	assigned[j] = 1;
+      }
+    }
+    else {
+      for(l = layer->out; l != NULL; l = l->cdr)
+	plan_add(&plan->bwd, &plan->numbwd, &plan->capbwd,
+		 PLAN_LINK, l->link, layer, NULL);
+      for(j = 0; j < layer->numslabs; j++) {
+	slab = &layer->slabs[j];
+	if(i - 1 != last && nl == 0 && nn_linklist_len(slab->out) == 1 &&
+	   plan_fusable(slab->out->link, i - 1,
+			slab->out->link->dest->layer->idl)) {
+	  plan_add(&plan->bwd, &plan->numbwd, &plan->capbwd,
+		   PLAN_FUSED, slab->out->link, slab, slab);
+	  assigned[j] = 1;
+	  continue;
+	}
+	for(l = slab->out; l != NULL; l = l->cdr)
+	  plan_add(&plan->bwd, &plan->numbwd, &plan->capbwd,
+		   PLAN_LINK, l->link, slab, NULL);
+	plan_add(&plan->bwd, &plan->numbwd, &plan->capbwd,
+		 PLAN_DERIV, NULL, slab, slab);
+      }
+    }
+    if(i - 1 != last)
+      for(j = 0; j < layer->numslabs; j++)
+	if(!assigned[j])
+	  plan_span(plan->dyclear, &plan->numdyclear,
+		    layer->slabs[j].dy, layer->slabs[j].sz);
+  }
+
+  /* The builtin linear links assign their derivatives, but all others
+   * may only add to them.
+   */
+  for(i = 0; i < nn->numlinks && !nn->frozen; i++)
+    if(nn->links[i]->need_grads &&
+       nn_netfunc_kind(nn->links[i]->nfunc) != NN_NF_LINEAR) {
+      n = nn_link_blocks(nn->links[i], NULL, g, NULL, NULL, sz);
+      for(k = 0; k < n; k++)
+	plan_span(plan->gclear, &plan->numgclear, g[k], sz[k]);
+    }
+
+  xfree(assigned);
+  nn->plan = plan;
+  nn->compiled = 1;
+  if(nn->single)
+    plan_single(nn, plan);
+  return(0);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+void nn_uncompile(NN *nn)
+{
+  nn_plan_free(nn);
+  nn->compiled = 0;
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+int nn_set_single(NN *nn, int single)
+{
+  nn->single = (single != 0);
+  if(nn->single || nn->compiled)
+    return(nn_compile(nn));
+  return(0);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Throw away the plan, but not the fact that nn was compiled, so that
+   the next pass will build a new one. */
+
+void nn_plan_free(NN *nn)
+{
+  NN_PLAN *plan = nn->plan;
+  unsigned i;
+
+  if(plan == NULL) return;
+  if(plan->uf) {
+    for(i = 0; i < plan->numuf; i++)
+      if(plan->uf[i]) deallocate_array(plan->uf[i]);
+    xfree(plan->uf);
+    xfree(plan->yf);
+    if(plan->dxf) xfree(plan->dxf);
+    xfree(plan->base);
+  }
+  if(plan->fwd) xfree(plan->fwd);
+  if(plan->bwd) xfree(plan->bwd);
+  xfree(plan->xclear);
+  xfree(plan->dyclear);
+  xfree(plan->gclear);
+  xfree(plan);
+  nn->plan = NULL;
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Keep the float copy of some outputs or derivatives up to date. */
+
+static void plan_store(float *f, double *d, unsigned n)
+{
+  unsigned i;
+
+  for(i = 0; i < n; i++)
+    f[i] = d[i];
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* A linear link followed by the activation function of one slab of
+   its destination.  The arithmetic is the same as nflinearf(), unless
+   the plan is in single precision. */
+
+static void plan_fused_forward(NN_STEP *st)
+{
+  NN_LINK *link = st->link;
+  NN_LAYER *slab = st->slab;
+
+  if(st->uf)
+    nn_kern_matvec_f(slab->x, st->uf + st->off, st->fin, link->a + st->off,
+		     slab->sz, link->numin);
+  else
+    nn_kern_matvec(slab->x, link->u + st->off, link->source->layer->y,
+		   link->a + st->off, slab->sz, link->numin, 0);
+  nn_actfunc_forward(slab, slab->x, slab->y, slab->sz);
+  if(st->fout)
+    plan_store(st->fout, slab->y, slab->sz);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* A linear link that is the only one to use some slab as a source,
+   followed by the derivative of that slab's activation function.  The
+   arithmetic and the conditions are the same as in nflinearb() and
+   nn_backward(). */
+
+static void plan_fused_backward(NN *nn, NN_STEP *st)
+{
+  NN_LINK *link = st->link;
+  NN_LAYER *unit = st->unit, *slab = st->slab;
+  double *dx, *y;
+  unsigned i, j, numout;
+  int called;
+
+  called = unit->need_grads || link->need_grads || nn->need_all_grads;
+  dx = link->dest->layer->dx;
+  y = link->source->layer->y;
+  numout = link->numout;
+
+  if(called && st->first && (link->need_grads || nn->need_all_grads)) {
+    nn_kern_outer(link->du, dx, y, numout, link->numin);
+    for(i = 0; i < numout; i++)
+      link->da[i] = dx[i];
+  }
+
+  if(called && (unit->need_grads || nn->need_all_grads)) {
+    if(st->uf)
+      nn_kern_vecmat_f(slab->dy, st->fin, st->uf, st->off, numout, slab->sz);
+    else
+      nn_kern_vecmat(slab->dy, dx, link->u, st->off, numout, slab->sz, 0);
+  }
+  else
+    for(j = 0; j < slab->sz; j++)
+      slab->dy[j] = 0;
+
+  if(slab->need_grads || nn->need_all_grads)
+    nn_actfunc_backward(slab, slab->x, slab->y, slab->dy, slab->dx, slab->sz);
+  else
+    for(j = 0; j < slab->sz; j++)
+      slab->dx[j] = 0;
+  if(st->fout)
+    plan_store(st->fout, slab->dx, slab->sz);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+void nn_plan_forward(NN *nn, double *input)
+{
+  NN_PLAN *plan = nn->plan;
+  NN_STEP *st, *end;
+  NN_LAYER *slab;
+  NN_SPAN *sp;
+  unsigned i, k;
+
+  for(i = 0; i < plan->numxclear; i++) {
+    sp = &plan->xclear[i];
+    for(k = 0; k < sp->sz; k++)
+      sp->ptr[k] = 0.0;
+  }
+  for(i = 0; i < nn->numin; i++)
+    nn->x[i] = input[i];
+
+  end = plan->fwd + plan->numfwd;
+  for(st = plan->fwd; st < end; st++)
+    switch(st->type) {
+    case PLAN_LINK:
+      st->link->nfunc->forward(nn, st->link, st->unit);
+      break;
+    case PLAN_ACT:
+      slab = st->slab;
+      nn_actfunc_forward(slab, slab->x, slab->y, slab->sz);
+      if(st->fout)
+	plan_store(st->fout, slab->y, slab->sz);
+      break;
+    case PLAN_FUSED:
+      plan_fused_forward(st);
+      break;
+    }
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+void nn_plan_backward(NN *nn, double *de_dy)
+{
+  NN_PLAN *plan = nn->plan;
+  NN_STEP *st, *end;
+  NN_LAYER *slab;
+  NN_SPAN *sp;
+  unsigned i, k;
+
+  for(i = 0; i < plan->numgclear; i++) {
+    sp = &plan->gclear[i];
+    for(k = 0; k < sp->sz; k++)
+      sp->ptr[k] = 0.0;
+  }
+  for(i = 0; i < plan->numdyclear; i++) {
+    sp = &plan->dyclear[i];
+    for(k = 0; k < sp->sz; k++)
+      sp->ptr[k] = 0.0;
+  }
+  for(i = 0; i < nn->numout; i++)
+    nn->dy[i] = de_dy[i];
+
+  end = plan->bwd + plan->numbwd;
+  for(st = plan->bwd; st < end; st++)
+    switch(st->type) {
+    case PLAN_LINK:
+      if(st->unit->need_grads || st->link->need_grads || nn->need_all_grads)
+	st->link->nfunc->backward(nn, st->link, st->unit);
+      break;
+    case PLAN_DERIV:
+      slab = st->slab;
+      if(slab->need_grads || nn->need_all_grads)
+	nn_actfunc_backward(slab, slab->x, slab->y, slab->dy, slab->dx,
+			    slab->sz);
+      else
+	for(k = 0; k < slab->sz; k++)
+	  slab->dx[k] = 0;
+      if(st->fout)
+	plan_store(st->fout, slab->dx, slab->sz);
+      break;
+    case PLAN_FUSED:
+      plan_fused_backward(nn, st);
+      break;
+    }
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
@@ -292,8 +292,8 @@ static int nn_solve_internal(NN *nn, DATASET *set, unsigned linknum,
   NN_LINK *link;
   NN_ACTFUNC *af;
   NN_NETFUNC *nf;
-  unsigned in, out, n, i, j, k, l, nl, nbasis;
-  double *x, *y, **AtA, **Atb, sum;
+  unsigned in, out, n, i, j, k, l, m, nl, nbasis, *live;
+  double *x, *y, **AtA, **Atb, **S, sum;
 
   /* First, check that the dataset and nn are compatible. */
   n = dataset_size(set);
@@ -326,7 +326,7 @@ static int nn_solve_internal(NN *nn, DATASET *set, unsigned linknum,
     return(1);
   }    
   nf = nn_find_netfunc("l");
-  if(link->nfunc->forward != nf->forward) {
+  if(link->nfunc->forward != nf->forward && !link->index) {
     ulog(ULOG_ERROR, "nn_solve: link to solve must be linear.");
     return(2);
   }
@@ -342,8 +342,12 @@ static int nn_solve_internal(NN *nn, DATASET *set, unsigned linknum,
    */
 
   for(i = 0; i < out; i++) {
-    for(j = 0; j < nbasis; j++)
-      link->u[i][j] = 0;
+    if(link->index)
+      for(j = link->start[i]; j < link->start[i + 1]; j++)
+	link->u[0][j] = 0;
+    else
+      for(j = 0; j < nbasis; j++)
+	link->u[i][j] = 0;
     link->a[i] = 0;
   }
 
@@ -392,6 +396,36 @@ static int nn_solve_internal(NN *nn, DATASET *set, unsigned linknum,
     }
   }
 
+  /* A sparse link only gets to use some of the basis functions for
+   * each output, so each one has a smaller system of its own, made of
+   * the live rows and columns of AtA (plus the bias).
+   */
+  if(link->index) {
+    S = allocate_array(2, sizeof(double), nbasis + 1, nbasis + 1);
+    live = allocate_array(1, sizeof(unsigned), nbasis + 1);
+    for(l = 0; l < out; l++) {
+      for(m = 0, k = link->start[l]; k < link->start[l + 1]; k++)
+	live[m++] = link->index[k];
+      live[m++] = nbasis;
+      for(i = 0; i < m; i++)
+	for(j = 0; j < m; j++)
+	  S[i][j] = AtA[live[i]][live[j]];
+      spinv(S, S, m);
+      for(i = 0; i < m; i++) {
+	sum = 0.0;
+	for(j = 0; j < m; j++)
+	  sum += S[i][j] * Atb[l][live[j]];
+	if(i < m - 1) link->u[l][i] = sum;
+	else link->a[l] = sum;
+      }
+    }
+    deallocate_array(S);
+    deallocate_array(live);
+    deallocate_array(AtA);
+    deallocate_array(Atb);
+    return(0);
+  }
+
   /* Invert AtA to get (A^t * A)^{-1}. */
   spinv(AtA, AtA, nbasis + 1);
 
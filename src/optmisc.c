@@ -4,55 +4,390 @@
 /* Handy routines to simplify the interface to the optimizers. */
 
 #include <stdlib.h>
+#include <string.h>
 #include "nodelib/optimize.h"
 #include "nodelib/ulog.h"
 #include "nodelib/misc.h"
+#include "nodelib/xalloc.h"
+
+/* The remembered evaluations of an OPTIMIZER: the weights, error,
+   gradient, and gradient magnitude at the last call to gradf, the
+   weights and error at the last call to funcf, and room to gather
+   the current weights. */
+
+typedef struct OPT_CACHE {
+  double *gw, *g, gerr, gmag;
+  double *fw, ferr;
+  double *w;
+  int hasg, hasf;
+} OPT_CACHE;
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
-double opt_eval_func(OPTIMIZER *opt, double *weights)
+/* Returns the sum of the squared weights, for the weight decay term. */
+
+static double weight_sumsq(OPTIMIZER *opt)
 {
   unsigned i;
+  double sum = 0, *w;
 
-  if(opt->stochastic) srandom(opt->seed);
-  if(weights)
+  if(opt->wvec) {
+    w = opt->wvec;
     for(i = 0; i < opt->size; i++)
-      *opt->weights[i] = weights[i];
-  opt->error = opt->funcf(opt->obj);
-  if(opt->wdecay) {
-    double sum = 0;
+      sum += w[i] * w[i];
+  }
+  else
     for(i = 0; i < opt->size; i++)
       sum += *opt->weights[i] * *opt->weights[i];
-    opt->error += opt->wdecay * sum;
+  return(sum);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+static OPT_CACHE *cache_create(unsigned n)
+{
+  OPT_CACHE *c;
+
+  c = xmalloc(sizeof(OPT_CACHE));
+  c->gw = allocate_array(1, sizeof(double), n);
+  c->g = allocate_array(1, sizeof(double), n);
+  c->fw = allocate_array(1, sizeof(double), n);
+  c->w = allocate_array(1, sizeof(double), n);
+  c->hasg = c->hasf = 0;
+  return(c);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+static void cache_destroy(OPT_CACHE *c)
+{
+  deallocate_array(c->gw);
+  deallocate_array(c->g);
+  deallocate_array(c->fw);
+  deallocate_array(c->w);
+  xfree(c);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+double opt_eval_func(OPTIMIZER *opt, double *weights)
+{
+  OPT_CACHE *c = opt->evalcache;
+  size_t sz = opt->size * sizeof(double);
+  double *w = NULL;
+
+  if(opt->stochastic) srandom(opt->seed);
+  if(weights)
+    opt_set_weights(opt, weights);
+  if(c) {
+    w = opt_weights_vector(opt, c->w);
+    if(c->hasg && memcmp(w, c->gw, sz) == 0)
+      return(opt->error = c->gerr);
+    if(c->hasf && memcmp(w, c->fw, sz) == 0)
+      return(opt->error = c->ferr);
   }
+  opt->error = opt->funcf(opt->obj);
+  if(opt->wdecay)
+    opt->error += opt->wdecay * weight_sumsq(opt);
   opt->fcalls++;
+  if(c) {
+    memcpy(c->fw, w, sz);
+    c->ferr = opt->error;
+    c->hasf = 1;
+  }
   return(opt->error);
 }
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
+double opt_eval_bounded(OPTIMIZER *opt, double *weights, double bound)
+{
+  OPT_CACHE *c = opt->evalcache;
+  size_t sz = opt->size * sizeof(double);
+  double err, decay = 0.0, *w = NULL;
+
+  if(opt->boundf == NULL)
+    return(opt_eval_func(opt, weights));
+  if(opt->stochastic) srandom(opt->seed);
+  if(weights)
+    opt_set_weights(opt, weights);
+  if(c) {
+    w = opt_weights_vector(opt, c->w);
+    if(c->hasg && memcmp(w, c->gw, sz) == 0)
+      return(opt->error = c->gerr);
+    if(c->hasf && memcmp(w, c->fw, sz) == 0)
+      return(opt->error = c->ferr);
+  }
+
+  /* The weight decay is known up front, so it comes off the bound. */
+  if(opt->wdecay)
+    decay = opt->wdecay * weight_sumsq(opt);
+  err = opt->boundf(opt->obj, bound - decay);
+  opt->error = err + decay;
+  opt->fcalls++;
+  if(c && err <= bound - decay) {
+    memcpy(c->fw, w, sz);
+    c->ferr = opt->error;
+    c->hasf = 1;
+  }
+  return(opt->error);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+void opt_eval_multi(OPTIMIZER *opt, double **weights, unsigned n,
+		    double *err)
+{
+  double *w0, sum;
+  unsigned i, j;
+
+  if(opt->stochastic) srandom(opt->seed);
+  if(opt->multif == NULL || opt->multif(opt->obj, weights, n, err) != 0) {
+    w0 = allocate_array(1, sizeof(double), opt->size);
+    opt_get_weights(opt, w0);
+    for(i = 0; i < n; i++) {
+      if(opt->stochastic) srandom(opt->seed);
+      opt_set_weights(opt, weights[i]);
+      err[i] = opt->funcf(opt->obj);
+    }
+    opt_set_weights(opt, w0);
+    deallocate_array(w0);
+  }
+  if(opt->wdecay)
+    for(i = 0; i < n; i++) {
+      for(sum = 0, j = 0; j < opt->size; j++)
+	sum += weights[i][j] * weights[i][j];
+      err[i] += opt->wdecay * sum;
+    }
+  opt->fcalls += n;
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Add the weight decay to a freshly computed error and gradient, and
+   update the gradient statistics. */
+
+static void grad_finish(OPTIMIZER *opt)
+{
+  unsigned i;
+  double *w, *g;
+
+  if(opt->wdecay) {
+    opt->error += opt->wdecay * weight_sumsq(opt);
+    if(opt->wvec) {
+      w = opt->wvec;
+      g = opt->gvec;
+      for(i = 0; i < opt->size; i++)
+	g[i] += 2 * opt->wdecay * w[i];
+    }
+    else
+      for(i = 0; i < opt->size; i++)
+	*opt->grads[i] += 2 * opt->wdecay * *opt->weights[i];
+  }
+  opt->gradmag = 0;
+  if(opt->gvec) {
+    g = opt->gvec;
+    for(i = 0; i < opt->size; i++)
+      opt->gradmag += g[i] * g[i];
+  }
+  else
+    for(i = 0; i < opt->size; i++)
+      opt->gradmag += *opt->grads[i] * *opt->grads[i];
+  opt->gcalls++;
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
 double opt_eval_grad(OPTIMIZER *opt, double *weights)
 {
+  OPT_CACHE *c = opt->evalcache;
+  size_t sz = opt->size * sizeof(double);
   unsigned i;
+  double *w = NULL;
 
   if(opt->stochastic) srandom(opt->seed);
   if(weights)
-    for(i = 0; i < opt->size; i++)
-      *opt->weights[i] = weights[i];
+    opt_set_weights(opt, weights);
+  if(c) {
+    w = opt_weights_vector(opt, c->w);
+    if(c->hasg && memcmp(w, c->gw, sz) == 0) {
+      if(opt->gvec)
+	memcpy(opt->gvec, c->g, sz);
+      else
+	for(i = 0; i < opt->size; i++)
+	  *opt->grads[i] = c->g[i];
+      opt->gradmag = c->gmag;
+      return(opt->error = c->gerr);
+    }
+  }
   opt->error = opt->gradf(opt->obj);
-  if(opt->wdecay) {
-    double sum = 0;
+  grad_finish(opt);
+  if(c) {
+    memcpy(c->gw, w, sz);
+    opt_get_grads(opt, c->g);
+    c->gerr = opt->error;
+    c->gmag = opt->gradmag;
+    c->hasg = 1;
+  }
+  return(opt->error);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+double opt_eval_grad_bounded(OPTIMIZER *opt, double *weights, double bound)
+{
+  OPT_CACHE *c = opt->evalcache;
+  size_t sz = opt->size * sizeof(double);
+  double err, decay = 0.0, *w = NULL;
+
+  if(weights)
+    opt_set_weights(opt, weights);
+  if(opt->gradbf == NULL) {
+    if(!(c && opt->boundf == NULL) &&
+       opt_eval_bounded(opt, NULL, bound) > bound)
+      return(opt->error);
+    return(opt_eval_grad(opt, NULL));
+  }
+  if(c) {
+    w = opt_weights_vector(opt, c->w);
+    if(c->hasg && memcmp(w, c->gw, sz) == 0)
+      return(opt_eval_grad(opt, NULL));
+    if(c->hasf && memcmp(w, c->fw, sz) == 0 && c->ferr > bound)
+      return(opt->error = c->ferr);
+  }
+  if(opt->stochastic) srandom(opt->seed);
+
+  /* As in opt_eval_bounded(), the weight decay comes off the bound. */
+  if(opt->wdecay)
+    decay = opt->wdecay * weight_sumsq(opt);
+  err = opt->gradbf(opt->obj, bound - decay);
+  if(err > bound - decay) {
+    opt->error = err + decay;
+    opt->gcalls++;
+    return(opt->error);
+  }
+  opt->error = err;
+  grad_finish(opt);
+  if(c) {
+    memcpy(c->gw, w, sz);
+    opt_get_grads(opt, c->g);
+    c->gerr = opt->error;
+    c->gmag = opt->gradmag;
+    c->hasg = 1;
+  }
+  return(opt->error);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+double opt_eval_batch(OPTIMIZER *opt, unsigned *index, unsigned n)
+{
+  opt->error = opt->batchf(opt->obj, index, n);
+  grad_finish(opt);
+  return(opt->error);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+void opt_get_weights(OPTIMIZER *opt, double *w)
+{
+  unsigned i;
+
+  if(opt->wvec)
+    memcpy(w, opt->wvec, opt->size * sizeof(double));
+  else
     for(i = 0; i < opt->size; i++)
-      sum += *opt->weights[i] * *opt->weights[i];
-    opt->error += opt->wdecay * sum;
+      w[i] = *opt->weights[i];
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+void opt_set_weights(OPTIMIZER *opt, double *w)
+{
+  unsigned i;
+
+  if(opt->wvec)
+    memcpy(opt->wvec, w, opt->size * sizeof(double));
+  else
     for(i = 0; i < opt->size; i++)
-      *opt->grads[i] += 2 * opt->wdecay * *opt->weights[i];
+      *opt->weights[i] = w[i];
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+void opt_get_grads(OPTIMIZER *opt, double *g)
+{
+  unsigned i;
+
+  if(opt->gvec)
+    memcpy(g, opt->gvec, opt->size * sizeof(double));
+  else
+    for(i = 0; i < opt->size; i++)
+      g[i] = *opt->grads[i];
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+double *opt_weights_vector(OPTIMIZER *opt, double *buf)
+{
+  if(opt->wvec)
+    return(opt->wvec);
+  opt_get_weights(opt, buf);
+  return(buf);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+double *opt_grads_vector(OPTIMIZER *opt, double *buf)
+{
+  if(opt->gvec)
+    return(opt->gvec);
+  opt_get_grads(opt, buf);
+  return(buf);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+void opt_extend_weights(OPTIMIZER *opt, double *x, double *d, double a)
+{
+  unsigned i;
+  double *w;
+
+  if(opt->wvec) {
+    w = opt->wvec;
+    if(x)
+      for(i = 0; i < opt->size; i++)
+	w[i] = x[i] + a * d[i];
+    else
+      for(i = 0; i < opt->size; i++)
+	w[i] += a * d[i];
   }
-  opt->gradmag = 0;
-  for(i = 0; i < opt->size; i++)
-    opt->gradmag += *opt->grads[i] * *opt->grads[i];
-  opt->gcalls++;
-  return(opt->error);
+  else {
+    if(x)
+      for(i = 0; i < opt->size; i++)
+	*opt->weights[i] = x[i] + a * d[i];
+    else
+      for(i = 0; i < opt->size; i++)
+	*opt->weights[i] += a * d[i];
+  }
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+double opt_grad_dot(OPTIMIZER *opt, double *d)
+{
+  unsigned i;
+  double sum = 0, *g;
+
+  if(opt->gvec) {
+    g = opt->gvec;
+    for(i = 0; i < opt->size; i++)
+      sum += g[i] * d[i];
+  }
+  else
+    for(i = 0; i < opt->size; i++)
+      sum += *opt->grads[i] * d[i];
+  return(sum);
 }
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
@@ -68,6 +403,8 @@ int optimize(OPTIMIZER *opt)
 
   /* Initialize internal state. */
   opt->engine(opt, 0);
+  if(opt->cache && !opt->stochastic)
+    opt->evalcache = cache_create(opt->size);
 
   opt->fcalls = opt->gcalls = 0;
   opt->error = opt->decayed_error = 0;
@@ -131,6 +468,10 @@ int optimize(OPTIMIZER *opt)
 
   /* Clean up. */
   opt->engine(opt, -1);
+  if(opt->evalcache) {
+    cache_destroy(opt->evalcache);
+    opt->evalcache = NULL;
+  }
 
   return(0);
 }
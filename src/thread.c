@@ -0,0 +1,357 @@
+
+/* Copyright (c) 2000 by G. W. Flake. */
+
+/* Binding a thread to a processor is a GNU extension. */
+#if defined(PTHREADS) && defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <stdlib.h>
+
+#ifdef PTHREADS
+#include <pthread.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sched.h>
+#endif
+#endif
+
+#include "nodelib/thread.h"
+#include "nodelib/xalloc.h"
+#include "nodelib/ulog.h"
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+struct THREAD_LOCK {
+#ifdef PTHREADS
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+#else
+  int dummy;
+#endif
+};
+
+struct THREAD {
+#ifdef PTHREADS
+  pthread_t tid;
+  void (*func)(void *obj);
+  void *obj;
+#else
+  int dummy;
+#endif
+};
+
+struct THREAD_PIN {
+#if defined(PTHREADS) && defined(__linux__)
+  cpu_set_t old;
+#else
+  int dummy;
+#endif
+};
+
+#ifdef PTHREADS
+
+/* One of these exists for every pooled worker.  The \em{seen} field
+   holds the last job generation that the worker has looked at. */
+
+typedef struct POOL_WORKER {
+  pthread_t tid;
+  unsigned id, seen;
+} POOL_WORKER;
+
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_start = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t pool_done = PTHREAD_COND_INITIALIZER;
+
+static POOL_WORKER **pool_workers = NULL;
+static unsigned pool_size = 0, pool_gen = 0, pool_pending = 0;
+static int pool_busy = 0, pool_quit = 0;
+
+static void (*job_func)(void *obj, unsigned id) = NULL;
+static void *job_obj = NULL;
+static unsigned job_n = 0;
+
+#endif
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+THREAD_LOCK *thread_lock_create(void)
+{
+  THREAD_LOCK *lock;
+
+  lock = xmalloc(sizeof(THREAD_LOCK));
+#ifdef PTHREADS
+  pthread_mutex_init(&lock->mutex, NULL);
+  pthread_cond_init(&lock->cond, NULL);
+#endif
+  return(lock);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+void thread_lock_destroy(THREAD_LOCK *lock)
+{
+#ifdef PTHREADS
+  pthread_mutex_destroy(&lock->mutex);
+  pthread_cond_destroy(&lock->cond);
+#endif
+  xfree(lock);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+void thread_lock(THREAD_LOCK *lock)
+{
+#ifdef PTHREADS
+  pthread_mutex_lock(&lock->mutex);
+#endif
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+void thread_unlock(THREAD_LOCK *lock)
+{
+#ifdef PTHREADS
+  pthread_mutex_unlock(&lock->mutex);
+#endif
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+void thread_wait(THREAD_LOCK *lock)
+{
+#ifdef PTHREADS
+  pthread_cond_wait(&lock->cond, &lock->mutex);
+#endif
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+void thread_broadcast(THREAD_LOCK *lock)
+{
+#ifdef PTHREADS
+  pthread_cond_broadcast(&lock->cond);
+#endif
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+#ifdef PTHREADS
+
+/* The main loop of a pooled worker.  Sleep until a new job generation
+   is posted, run it if our id is in range, and tell the caller when
+   the last worker is done. */
+
+static void *pool_main(void *arg)
+{
+  POOL_WORKER *pw = arg;
+  void (*func)(void *obj, unsigned id);
+  void *obj;
+
+  pthread_mutex_lock(&pool_mutex);
+  for(;;) {
+    while(!pool_quit && pw->seen == pool_gen)
+      pthread_cond_wait(&pool_start, &pool_mutex);
+    if(pool_quit) break;
+    pw->seen = pool_gen;
+    if(pw->id < job_n) {
+      func = job_func;
+      obj = job_obj;
+      pthread_mutex_unlock(&pool_mutex);
+      func(obj, pw->id);
+      pthread_mutex_lock(&pool_mutex);
+      if(--pool_pending == 0)
+	pthread_cond_signal(&pool_done);
+    }
+  }
+  pthread_mutex_unlock(&pool_mutex);
+  return(NULL);
+}
+
+#endif
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+int thread_run(unsigned n, void (*func)(void *obj, unsigned id), void *obj)
+{
+  unsigned i;
+#ifdef PTHREADS
+  POOL_WORKER *pw;
+
+  pthread_mutex_lock(&pool_mutex);
+  if(n < 2 || pool_busy) {
+    pthread_mutex_unlock(&pool_mutex);
+    for(i = 0; i < n; i++)
+      func(obj, i);
+    return(0);
+  }
+  pool_busy = 1;
+
+  /* Grow the pool so that there are n - 1 workers plus the caller. */
+  if(pool_size < n - 1) {
+    pool_workers = xrealloc(pool_workers, sizeof(POOL_WORKER *) * (n - 1));
+    for(i = pool_size; i < n - 1; i++) {
+      pw = xmalloc(sizeof(POOL_WORKER));
+      pw->id = i + 1;
+      pw->seen = pool_gen;
+      if(pthread_create(&pw->tid, NULL, pool_main, pw) != 0) {
+	ulog(ULOG_ERROR, "thread_run: unable to create thread %d.", i + 1);
+	xfree(pw);
+	break;
+      }
+      pool_workers[i] = pw;
+    }
+    pool_size = i;
+  }
+
+  /* If we failed to make enough workers, then the caller gets to
+   * run the missing ids itself.
+   */
+  job_func = func;
+  job_obj = obj;
+  job_n = (n < pool_size + 1) ? n : pool_size + 1;
+  pool_pending = job_n - 1;
+  pool_gen++;
+  pthread_cond_broadcast(&pool_start);
+  pthread_mutex_unlock(&pool_mutex);
+
+  func(obj, 0);
+  for(i = job_n; i < n; i++)
+    func(obj, i);
+
+  pthread_mutex_lock(&pool_mutex);
+  while(pool_pending > 0)
+    pthread_cond_wait(&pool_done, &pool_mutex);
+  pool_busy = 0;
+  pthread_mutex_unlock(&pool_mutex);
+#else
+  for(i = 0; i < n; i++)
+    func(obj, i);
+#endif
+  return(0);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+unsigned thread_count(void)
+{
+#ifdef PTHREADS
+  long n;
+
+  n = sysconf(_SC_NPROCESSORS_ONLN);
+  return((n > 0) ? n : 1);
+#else
+  return(1);
+#endif
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+void thread_shutdown(void)
+{
+#ifdef PTHREADS
+  unsigned i;
+
+  pthread_mutex_lock(&pool_mutex);
+  if(pool_busy) {
+    pthread_mutex_unlock(&pool_mutex);
+    ulog(ULOG_ERROR, "thread_shutdown: pool is still running.");
+    return;
+  }
+  pool_quit = 1;
+  pthread_cond_broadcast(&pool_start);
+  pthread_mutex_unlock(&pool_mutex);
+
+  for(i = 0; i < pool_size; i++) {
+    pthread_join(pool_workers[i]->tid, NULL);
+    xfree(pool_workers[i]);
+  }
+  if(pool_workers) xfree(pool_workers);
+  pool_workers = NULL;
+  pool_size = 0;
+  pool_quit = 0;
+#endif
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+#ifdef PTHREADS
+
+/* The body of a thread made by thread_start(). */
+
+static void *start_main(void *arg)
+{
+  THREAD *thread = arg;
+
+  thread->func(thread->obj);
+  return(NULL);
+}
+
+#endif
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+THREAD *thread_start(void (*func)(void *obj), void *obj)
+{
+#ifdef PTHREADS
+  THREAD *thread;
+
+  thread = xmalloc(sizeof(THREAD));
+  thread->func = func;
+  thread->obj = obj;
+  if(pthread_create(&thread->tid, NULL, start_main, thread) != 0) {
+    ulog(ULOG_WARN, "thread_start: unable to create thread.");
+    xfree(thread);
+    return(NULL);
+  }
+  return(thread);
+#else
+  return(NULL);
+#endif
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+void thread_join(THREAD *thread)
+{
+#ifdef PTHREADS
+  pthread_join(thread->tid, NULL);
+  xfree(thread);
+#endif
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+THREAD_PIN *thread_pin(unsigned cpu)
+{
+#if defined(PTHREADS) && defined(__linux__)
+  THREAD_PIN *pin;
+  cpu_set_t set;
+
+  pin = xmalloc(sizeof(THREAD_PIN));
+  CPU_ZERO(&set);
+  CPU_SET(cpu % thread_count(), &set);
+  if(pthread_getaffinity_np(pthread_self(), sizeof(pin->old),
+			    &pin->old) != 0 ||
+     pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+    xfree(pin);
+    return(NULL);
+  }
+  return(pin);
+#else
+  return(NULL);
+#endif
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+void thread_unpin(THREAD_PIN *pin)
+{
+#if defined(PTHREADS) && defined(__linux__)
+  if(pin == NULL) return;
+  pthread_setaffinity_np(pthread_self(), sizeof(pin->old), &pin->old);
+  xfree(pin);
+#endif
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
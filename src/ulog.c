@@ -34,7 +34,7 @@ static char *ulog_file_name = NULL;
 static int ulog_msg_code = -1;
 
 #ifdef PTHREADS
-static pthread_mutex_t ulog_mutex;
+static pthread_mutex_t ulog_mutex = PTHREAD_MUTEX_INITIALIZER;
 #endif
 
 
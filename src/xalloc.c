@@ -6,6 +6,10 @@
 /*#include <malloc.h>*/
 #include <memory.h>
 
+#ifdef PTHREADS
+#include <pthread.h>
+#endif
+
 #undef XALLOC_DEBUG
 
 #define OWNER
@@ -24,6 +28,16 @@
 /* To keep track of all the memory in use. */
 static size_t xalloc_total_used = 0;
 
+/* The running total is shared by all threads. */
+#ifdef PTHREADS
+static pthread_mutex_t xalloc_mutex = PTHREAD_MUTEX_INITIALIZER;
+#define XALLOC_LOCK() pthread_mutex_lock(&xalloc_mutex)
+#define XALLOC_UNLOCK() pthread_mutex_unlock(&xalloc_mutex)
+#else
+#define XALLOC_LOCK()
+#define XALLOC_UNLOCK()
+#endif
+
 /* This is so that we only call the monster macro once. */
 
 const size_t xalloc_magic = XALLOC_MAGIC;
@@ -43,7 +57,9 @@ void *xmalloc(size_t size)
 
   /* Assign the size of the segment, and keep a running total. */
   *ptr = size;
+  XALLOC_LOCK();
   xalloc_total_used += size;
+  XALLOC_UNLOCK();
 
   /* Reset the pointer to the user memory. */
   ptr = (size_t *)((char *)ptr + xalloc_magic);  
@@ -69,14 +85,14 @@ void *xrealloc(void *old_ptr, size_t size)
   /* Get back the pointer that was returned by either malloc() or realloc() */
   old_ptr = ((char *)old_ptr - xalloc_magic);
 
-  /* Remove the old segment from the running total. */
-  xalloc_total_used -= *((size_t *)old_ptr);
-
   /* Make room to keep the size. */
   size += xalloc_magic;
 
-  /* Update the running total. */
+  /* Remove the old segment from the running total, and add the new. */
+  XALLOC_LOCK();
+  xalloc_total_used -= *((size_t *)old_ptr);
   xalloc_total_used += size;
+  XALLOC_UNLOCK();
 
   /* Get the memory. */
   if(!(new_ptr = realloc(old_ptr, size)))
@@ -99,7 +115,9 @@ void xfree(void *ptr)
     ptr = ((char *)ptr - xalloc_magic);
 
     /* Remove from the running total, and free it. */
+    XALLOC_LOCK();
     xalloc_total_used -= *((size_t *)ptr);
+    XALLOC_UNLOCK();
     free(ptr);
   }
   else
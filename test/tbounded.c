@@ -0,0 +1,270 @@
+
+/* Copyright (c) 2000 by G. W. Flake. */
+
+/* A test for bounded evaluations that stop early... */
+
+#include <nodelib.h>
+#include <stdio.h>
+#include <math.h>
+
+#define NPATS 400
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* A DATASET that passes everything on to a real one, counting how
+   many patterns are read along the way. */
+
+static unsigned reads;
+
+static unsigned counted_size(void *instance)
+{
+  return(dataset_size(instance));
+}
+
+static unsigned counted_x_size(void *instance)
+{
+  return(dataset_x_size(instance));
+}
+
+static unsigned counted_y_size(void *instance)
+{
+  return(dataset_y_size(instance));
+}
+
+static double *counted_x(void *instance, unsigned index)
+{
+  reads++;
+  return(dataset_x(instance, index));
+}
+
+static double *counted_y(void *instance, unsigned index)
+{
+  return(dataset_y(instance, index));
+}
+
+static DATASET_METHOD counted_method = {
+  counted_size,
+  counted_x_size,
+  counted_y_size,
+  counted_x,
+  counted_y
+};
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Returns nonzero if nn_offline_test_bounded() agrees with
+   nn_offline_test() for a loose bound, stops early for a tight one,
+   and still gives a real estimate for a bound that no error can meet,
+   and if nn_offline_grad_bounded() does the same with the gradient,
+   in whatever mode the globals are in. */
+
+static int bounded(NN *nn, DATASET *set)
+{
+  double err, loose, tight, hopeless, g[64];
+  unsigned i, all;
+
+  reads = 0;
+  err = nn_offline_test(nn, set, NULL);
+  all = reads;
+  reads = 0;
+  loose = nn_offline_test_bounded(nn, set, 2 * err);
+  if(loose != err && fabs(loose - err) > 1e-12 * err) return(0);
+  if(reads != all) return(0);
+  reads = 0;
+  tight = nn_offline_test_bounded(nn, set, err / 4);
+  if(tight <= err / 4 || reads >= all) return(0);
+  hopeless = nn_offline_test_bounded(nn, set, -1);
+  if(hopeless <= 0 || hopeless >= HUGE_VAL) return(0);
+
+  err = nn_offline_grad(nn, set, NULL);
+  for(i = 0; i < nn->numweights; i++)
+    g[i] = *nn->grads[i];
+  reads = 0;
+  loose = nn_offline_grad_bounded(nn, set, 2 * err);
+  if(loose != err && fabs(loose - err) > 1e-12 * err) return(0);
+  if(reads != all) return(0);
+  for(i = 0; i < nn->numweights; i++)
+    if(fabs(*nn->grads[i] - g[i]) > 1e-12 * (fabs(g[i]) + 1e-12))
+      return(0);
+  reads = 0;
+  tight = nn_offline_grad_bounded(nn, set, err / 4);
+  return(tight > err / 4 && reads < all);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Train a fresh net on set with the given engine and line search, and
+   return the final error.  If exact is nonzero, then the error vector
+   claims it may go negative, so that nothing is ever bounded.  The
+   evaluation cache is on if cache is nonzero.  The number of patterns
+   read goes in count. */
+
+static double train(DATASET *set, void (*engine)(OPTIMIZER *opt, int state),
+		    double (*stepf)(OPTIMIZER *opt, double *dir,
+				    double stepsz),
+		    int exact, int cache, unsigned *count)
+{
+  OPT_ERRVEC ev = opt_errvec_quadratic;
+  NN *nn;
+  double err;
+
+  srandom(1);
+  nn = nn_create("2 6 1");
+  nn_link(nn, "0 -l-> 1");
+  nn_link(nn, "1 -l-> 2");
+  nn_set_actfunc(nn, 2, 0, "linear");
+  nn_init(nn, 0.5);
+  ev.nonneg = !exact;
+  nn->info.error_vector = &ev;
+  nn->info.train_set = set;
+  nn->info.opt.engine = engine;
+  nn->info.opt.stepf = stepf;
+  nn->info.opt.max_epochs = 20;
+  nn->info.opt.delta_error_tol = -1e10;
+  nn->info.opt.cache = cache;
+  reads = 0;
+  nn_train(nn);
+  *count = reads;
+  nn->info.error_vector = NULL;
+  err = nn_offline_test(nn, set, NULL);
+  nn_destroy(nn);
+  return(err);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+static double user_quadratic(double output, double target,
+			     double *derivative, double *second_derivative)
+{
+  return(opt_err_quadratic(output, target, derivative, second_derivative));
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+static void nothing(void *obj, unsigned id)
+{
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+int main(int argc, char **argv)
+{
+  NN *nn;
+  DATASET *matrix, *data;
+  double *x, err, ea, eb;
+  unsigned i, all, ca, cb, aokay = 1;
+  size_t base;
+
+  srandom(0);
+
+  /* Make sure that the pool of threads is as big as it will get
+   * before we count the memory.
+   */
+  nn = nn_create("1 1");
+  nn_link(nn, "0 -l-> 1");
+  nn_destroy(nn);
+  thread_run(3, nothing, NULL);
+  base = xmemused();
+
+  x = allocate_array(1, sizeof(double), NPATS * 3);
+  for(i = 0; i < NPATS; i++) {
+    x[3 * i] = random_range(-1, 1);
+    x[3 * i + 1] = random_range(-1, 1);
+    x[3 * i + 2] = sin(2 * x[3 * i]) * x[3 * i + 1];
+  }
+  matrix = dataset_create(&dsm_matrix_method, dsm_c_matrix(x, 2, 1, NPATS));
+  data = dataset_create(&counted_method, matrix);
+
+  /* Plain, batched, threaded, and shuffled passes all stop early. */
+  nn = nn_create("2 5 1");
+  nn_link(nn, "0 -l-> 1");
+  nn_link(nn, "1 -l-> 2");
+  nn_init(nn, 0.5);
+  if(!bounded(nn, data)) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed plain\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed plain\n", argv[0]);
+  nn_offline_batch = 16;
+  if(!bounded(nn, data)) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed batch\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed batch\n", argv[0]);
+  nn_offline_batch = 1;
+  nn_offline_threads = 3;
+  nn_offline_chunk = 16;
+  if(!bounded(nn, data)) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed threads\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed threads\n", argv[0]);
+  nn_offline_deterministic = 1;
+  if(!bounded(nn, data)) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed deterministic\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed deterministic\n", argv[0]);
+  nn_offline_deterministic = 0;
+  nn_offline_threads = 1;
+  nn_offline_chunk = 64;
+  nn_offline_bound_random = 1;
+  if(!bounded(nn, data)) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed random\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed random\n", argv[0]);
+  nn_offline_bound_random = 0;
+
+  /* An error function that we know nothing about is never cut short. */
+  nn->info.error_function = user_quadratic;
+  reads = 0;
+  err = nn_offline_test(nn, data, NULL);
+  all = reads;
+  reads = 0;
+  if(nn_offline_test_bounded(nn, data, err / 4) != err || reads != all) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed user\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed user\n", argv[0]);
+  nn_destroy(nn);
+
+  /* The line searches get about as far while reading fewer patterns,
+   * with or without the cache.
+   */
+  ea = train(data, opt_conjgrad_pr, opt_lnsrch_golden, 1, 0, &ca);
+  eb = train(data, opt_conjgrad_pr, opt_lnsrch_golden, 0, 0, &cb);
+  if(eb > 1.1 * ea || cb >= ca) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed golden\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed golden\n", argv[0]);
+  ea = train(data, opt_conjgrad_pr, opt_lnsrch_cubic, 1, 0, &ca);
+  eb = train(data, opt_conjgrad_pr, opt_lnsrch_cubic, 0, 0, &cb);
+  if(eb > 1.1 * ea || cb >= ca) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed cubic\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed cubic\n", argv[0]);
+  ea = train(data, opt_conjgrad_pr, opt_lnsrch_cubic, 1, 1, &ca);
+  eb = train(data, opt_conjgrad_pr, opt_lnsrch_cubic, 0, 1, &cb);
+  if(eb > 1.1 * ea || cb >= ca) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed cubic cached\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed cubic cached\n", argv[0]);
+
+  dataset_destroy(data);
+  dsm_destroy_matrix(dataset_destroy(matrix));
+  deallocate_array(x);
+
+  if(xmemused() != base) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed leak\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed leak\n", argv[0]);
+
+  exit(!aokay);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
@@ -0,0 +1,236 @@
+
+/* Copyright (c) 2000 by G. W. Flake. */
+
+/* A test for the prefetching DATASET... */
+
+#include <nodelib.h>
+#include <stdio.h>
+#include <math.h>
+
+#define NPATS 1000
+#define XSZ 3
+#define YSZ 2
+#define TESTFILE "/tmp/tdsprefetch.dat"
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Returns nonzero if pattern i of a is pattern j of b. */
+
+static int same(DATASET *a, unsigned i, DATASET *b, unsigned j)
+{
+  double *p, *q;
+  unsigned k;
+
+  p = dataset_x(a, i);
+  q = dataset_x(b, j);
+  for(k = 0; k < dataset_x_size(a); k++)
+    if(p[k] != q[k]) return(0);
+  p = dataset_y(a, i);
+  q = dataset_y(b, j);
+  for(k = 0; k < dataset_y_size(a); k++)
+    if(p[k] != q[k]) return(0);
+  return(1);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Put a random permutation of the first n integers in perm. */
+
+static void shuffle(unsigned *perm, unsigned n)
+{
+  unsigned i, j, t;
+
+  for(i = 0; i < n; i++)
+    perm[i] = i;
+  for(i = n - 1; i > 0; i--) {
+    j = random() % (i + 1);
+    t = perm[i]; perm[i] = perm[j]; perm[j] = t;
+  }
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Returns the biggest difference between the gradients of nn on a
+   and on b, with the given number of threads. */
+
+static double gradients(NN *nn, DATASET *a, DATASET *b, unsigned threads)
+{
+  double *ga, *gb, e, err = 0;
+  unsigned i;
+
+  ga = allocate_array(1, sizeof(double), nn->numweights);
+  gb = allocate_array(1, sizeof(double), nn->numweights);
+  nn_offline_threads = threads;
+  nn_offline_grad(nn, a, NULL);
+  nn_get_grads(nn, ga);
+  nn_offline_grad(nn, b, NULL);
+  nn_get_grads(nn, gb);
+  nn_offline_threads = 1;
+  for(i = 0; i < nn->numweights; i++) {
+    e = fabs(ga[i] - gb[i]);
+    err = (e > err) ? e : err;
+  }
+  deallocate_array(ga);
+  deallocate_array(gb);
+  return(err);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Open fname as a file of patterns made of floats. */
+
+static DSM_FILE *floats(char *fname)
+{
+  DSM_FILE *dsmf;
+
+  dsmf = dsm_file(fname);
+  dsmf->x_width = XSZ;
+  dsmf->y_width = YSZ;
+  dsmf->x_read_width = XSZ * sizeof(float);
+  dsmf->y_read_width = YSZ * sizeof(float);
+  dsmf->offset = 0;
+  dsmf->step = (XSZ + YSZ) * sizeof(float);
+  dsmf->type = SL_FLOAT;
+  dsm_file_initiate(dsmf);
+  return(dsmf);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+static void nothing(void *obj, unsigned id)
+{
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+int main(int argc, char **argv)
+{
+  DATASET *data, *pre, *file, *file2;
+  DSM_PREFETCH *pf;
+  DSM_FILE *dsmf, *dsmf2;
+  NN *nn;
+  FILE *fp;
+  double *x;
+  float f;
+  unsigned perm[NPATS], i, k, aokay = 1, ok;
+  size_t base;
+
+  srandom(0);
+
+  /* Make sure that the pool of threads is as big as it will get
+   * before we count the memory.
+   */
+  nn = nn_create("1 1");
+  nn_link(nn, "0 -l-> 1");
+  nn_destroy(nn);
+  thread_run(3, nothing, NULL);
+  base = xmemused();
+
+  x = allocate_array(1, sizeof(double), NPATS * (XSZ + YSZ));
+  for(i = 0; i < NPATS * (XSZ + YSZ); i++)
+    x[i] = random_range(-1, 1);
+  data = dataset_create(&dsm_matrix_method,
+			dsm_c_matrix(x, XSZ, YSZ, NPATS));
+
+  /* Two epochs in order, with a block size that does not divide the
+   * number of patterns.
+   */
+  pf = dsm_prefetch(data, NULL, 0, 7, 3);
+  pre = dataset_create(&dsm_prefetch_method, pf);
+  ok = (dataset_size(pre) == NPATS && dataset_x_size(pre) == XSZ &&
+	dataset_y_size(pre) == YSZ);
+  for(k = 0; k < 2; k++)
+    for(i = 0; i < NPATS; i++)
+      ok = ok && same(pre, i, data, i);
+  if(!ok || dataset_x(pre, NPATS) != NULL) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed order\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed order\n", argv[0]);
+
+  /* Jumping around still gets the right patterns. */
+  for(ok = 1, k = 0; k < 300; k++) {
+    i = random() % NPATS;
+    ok = ok && same(pre, i, data, i);
+  }
+  if(!ok) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed random\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed random\n", argv[0]);
+
+  /* A new permutation every epoch. */
+  for(ok = 1, k = 0; k < 3; k++) {
+    shuffle(perm, NPATS);
+    dsm_prefetch_order(pf, perm);
+    for(i = 0; i < NPATS; i++)
+      ok = ok && same(pre, i, data, perm[i]);
+  }
+  if(!ok) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed permutation\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed permutation\n", argv[0]);
+
+  /* Training through the prefetcher gives the same gradient, with
+   * and without threads.
+   */
+  dsm_prefetch_order(pf, NULL);
+  nn = nn_create("3 5 2");
+  nn_link(nn, "0 -l-> 1");
+  nn_link(nn, "1 -l-> 2");
+  nn_init(nn, 0.5);
+  if(gradients(nn, pre, data, 1) > 1e-12 ||
+     gradients(nn, pre, data, 3) > 1e-12) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed gradient\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed gradient\n", argv[0]);
+  nn_destroy(nn);
+  dsm_destroy_prefetch(dataset_destroy(pre));
+
+  /* A file of floats, read ahead with the default sizes.  The
+   * prefetcher gets its own DSM_FILE, since they are not thread safe.
+   */
+  if((fp = fopen(TESTFILE, "wb")) == NULL) {
+    fprintf(stderr, "%s: cannot open test file.\n", argv[0]);
+    exit(1);
+  }
+  for(i = 0; i < NPATS * (XSZ + YSZ); i++) {
+    f = x[i];
+    fwrite(&f, sizeof(float), 1, fp);
+  }
+  fclose(fp);
+  dsmf = floats(TESTFILE);
+  dsmf2 = floats(TESTFILE);
+  file = dataset_create(&dsm_file_method, dsmf);
+  pre = dataset_create(&dsm_prefetch_method,
+		       dsm_prefetch(dataset_create(&dsm_file_method, dsmf2),
+				    NULL, 0, 0, 0));
+  for(ok = 1, i = 0; i < NPATS; i++)
+    ok = ok && same(pre, i, file, i);
+  if(!ok) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed file\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed file\n", argv[0]);
+  pf = dataset_destroy(pre);
+  file2 = pf->dset;
+  dsm_destroy_prefetch(pf);
+  dsm_destroy_file(dataset_destroy(file2));
+  dsm_destroy_file(dataset_destroy(file));
+  remove(TESTFILE);
+
+  dsm_destroy_matrix(dataset_destroy(data));
+  deallocate_array(x);
+
+  if(xmemused() != base) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed leak\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed leak\n", argv[0]);
+
+  exit(!aokay);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
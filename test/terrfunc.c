@@ -0,0 +1,193 @@
+
+/* Copyright (c) 2000 by G. W. Flake. */
+
+/* A test for the vector forms of the error functions... */
+
+#include <nodelib.h>
+#include <stdio.h>
+#include <math.h>
+
+#define N 11
+#define EPS 1e-5
+#define NPATS 30
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Not a builtin, so the offline routines have to call it one output
+   at a time. */
+
+static double my_quadratic(double output, double target, double *derivative,
+			   double *second_derivative)
+{
+  *derivative = output - target;
+  *second_derivative = 1.0;
+  return(0.5 * (output - target) * (output - target));
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Returns the biggest difference between the vector and scalar forms
+   of ev for outputs and targets in [lo, hi], with all and with none
+   of the derivatives asked for. */
+
+static double vector(OPT_ERRVEC *ev, double lo, double hi)
+{
+  double y[N], t[N], d[N], d2[N], sd, sd2, e, es = 0, err = 0;
+  unsigned i;
+
+  for(i = 0; i < N; i++) {
+    y[i] = random_range(lo, hi);
+    t[i] = random_range(lo, hi);
+  }
+  y[0] = t[0];
+  e = ev->error(y, t, N, d, d2);
+  for(i = 0; i < N; i++) {
+    es += ev->scalar(y[i], t[i], &sd, &sd2);
+    err = (fabs(d[i] - sd) > err) ? fabs(d[i] - sd) : err;
+    err = (fabs(d2[i] - sd2) > err) ? fabs(d2[i] - sd2) : err;
+  }
+  err = (fabs(e - es) > err) ? fabs(e - es) : err;
+  e = ev->error(y, t, N, NULL, NULL);
+  err = (fabs(e - es) > err) ? fabs(e - es) : err;
+  return(err);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Returns the biggest difference between the derivatives of the
+   softmax cross entropy and central differences of its error and
+   its first derivatives. */
+
+static double softmax(void)
+{
+  OPT_ERRVEC *ev = &opt_errvec_softmax_cross_entropy;
+  double y[N], t[N], v[N], d[N], d2[N], dp[N], dm[N], hv[N];
+  double ep, em, e, err = 0;
+  unsigned i, j;
+
+  for(i = 0; i < N; i++) {
+    y[i] = random_range(-3, 3);
+    t[i] = random_range(0, 1);
+    v[i] = random_range(-1, 1);
+  }
+  ev->error(y, t, N, d, d2);
+  ev->hv(y, t, N, v, hv);
+  for(i = 0; i < N; i++) {
+    y[i] += EPS;
+    ep = ev->error(y, t, N, dp, NULL);
+    y[i] -= 2 * EPS;
+    em = ev->error(y, t, N, dm, NULL);
+    y[i] += EPS;
+    e = fabs(d[i] - (ep - em) / (2 * EPS));
+    err = (e > err) ? e : err;
+    e = fabs(d2[i] - (dp[i] - dm[i]) / (2 * EPS));
+    err = (e > err) ? e : err;
+  }
+  for(i = 0; i < N; i++)
+    y[i] += EPS * v[i];
+  ev->error(y, t, N, dp, NULL);
+  for(i = 0; i < N; i++)
+    y[i] -= 2 * EPS * v[i];
+  ev->error(y, t, N, dm, NULL);
+  for(j = 0; j < N; j++) {
+    e = fabs(hv[j] - (dp[j] - dm[j]) / (2 * EPS));
+    err = (e > err) ? e : err;
+  }
+
+  /* Huge outputs must not overflow. */
+  y[0] = 1000;
+  e = ev->error(y, t, N, d, NULL);
+  if(e != e || d[0] != d[0])
+    err = 1;
+  return(err);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Returns the biggest difference between the offline gradients of nn
+   with the vector quadratic error and with a scalar one, for the
+   given batch size and number of threads. */
+
+static double offline(NN *nn, DATASET *set, unsigned batch, unsigned threads)
+{
+  double *ga, *gb, ea, eb, e, err;
+  unsigned i;
+
+  ga = allocate_array(1, sizeof(double), nn->numweights);
+  gb = allocate_array(1, sizeof(double), nn->numweights);
+  nn_offline_batch = batch;
+  nn_offline_threads = threads;
+  nn->info.error_function = opt_err_quadratic;
+  ea = nn_offline_grad(nn, set, NULL);
+  nn_get_grads(nn, ga);
+  nn->info.error_function = my_quadratic;
+  eb = nn_offline_grad(nn, set, NULL);
+  nn_get_grads(nn, gb);
+  nn->info.error_function = opt_err_quadratic;
+  nn_offline_batch = 0;
+  nn_offline_threads = 1;
+  err = fabs(ea - eb);
+  for(i = 0; i < nn->numweights; i++) {
+    e = fabs(ga[i] - gb[i]);
+    err = (e > err) ? e : err;
+  }
+  deallocate_array(ga);
+  deallocate_array(gb);
+  return(err);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+int main(int argc, char **argv)
+{
+  NN *nn;
+  DATASET *data;
+  double *x;
+  unsigned i, aokay = 1;
+
+  srandom(0);
+
+  if(opt_errvec_find(opt_err_quadratic) != &opt_errvec_quadratic ||
+     opt_errvec_find(my_quadratic) != NULL ||
+     vector(&opt_errvec_quadratic, -3, 3) > 1e-12 ||
+     vector(&opt_errvec_logistic, -3, 3) > 1e-12 ||
+     vector(&opt_errvec_huber, -3, 3) > 1e-12 ||
+     vector(&opt_errvec_cross_entropy, 0.01, 0.99) > 1e-12 ||
+     vector(&opt_errvec_symmetric_cross_entropy, -0.99, 0.99) > 1e-12) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed vector\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed vector\n", argv[0]);
+
+  if(softmax() > 1e-6) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed softmax\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed softmax\n", argv[0]);
+
+  /* The offline routines give the same answer either way, including
+   * with targets that have to be skipped.
+   */
+  nn = nn_create("3 5 4");
+  nn_link(nn, "0 -l-> 1");
+  nn_link(nn, "1 -l-> 2");
+  nn_init(nn, 0.5);
+  x = allocate_array(1, sizeof(double), NPATS * (3 + 4));
+  for(i = 0; i < NPATS * (3 + 4); i++)
+    x[i] = random_range(-1, 1);
+  x[3 + 1] = x[5 * 7 + 3 + 2] = 0.0 / 0.0;
+  data = dataset_create(&dsm_matrix_method, dsm_c_matrix(x, 3, 4, NPATS));
+  if(offline(nn, data, 0, 1) > 1e-12 || offline(nn, data, 7, 1) > 1e-12 ||
+     offline(nn, data, 4, 3) > 1e-12) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed offline\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed offline\n", argv[0]);
+  dsm_destroy_matrix(dataset_destroy(data));
+  deallocate_array(x);
+  nn_destroy(nn);
+
+  exit(!aokay);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
@@ -0,0 +1,170 @@
+
+/* Copyright (c) 2000 by G. W. Flake. */
+
+/* A test for nn_offline_Hv() and the Hessian-free engine... */
+
+#include <nodelib.h>
+#include <stdio.h>
+#include <math.h>
+
+#define NPATS 200
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Returns the biggest difference between nn_offline_Hv() over all of
+   set, with the given number of threads, and the same product made
+   the slow way: from nn_Hv() one pattern at a time for the Hessian,
+   or from nn_offline_gauss_newton() for the Gauss-Newton matrix. */
+
+static double product(NN *nn, DATASET *set, unsigned threads)
+{
+  double *v, *ha, *hb, *hv, **G, e, err = 0;
+  unsigned i, j, n = nn->numweights;
+
+  v = allocate_array(1, sizeof(double), n);
+  ha = allocate_array(1, sizeof(double), n);
+  hb = allocate_array(1, sizeof(double), n);
+  hv = allocate_array(1, sizeof(double), n);
+  G = allocate_array(2, sizeof(double), n, n);
+  for(i = 0; i < n; i++) {
+    v[i] = random_range(-1, 1);
+    hb[i] = 0;
+  }
+  nn_offline_threads = threads;
+
+  nn_hv_gauss_newton = 0;
+  nn_offline_Hv(nn, set, NULL, 0, v, ha);
+  for(j = 0; j < NPATS; j++) {
+    nn_Hv(nn, dataset_x(set, j), dataset_y(set, j), v);
+    nn_get_Rgrads(nn, hv);
+    for(i = 0; i < n; i++)
+      hb[i] += hv[i] / (NPATS * nn->numout);
+  }
+  for(i = 0; i < n; i++) {
+    e = fabs(ha[i] - hb[i]);
+    err = (e > err) ? e : err;
+  }
+
+  nn_hv_gauss_newton = 1;
+  nn_offline_Hv(nn, set, NULL, 0, v, ha);
+  nn_offline_gauss_newton(nn, set, G);
+  for(i = 0; i < n; i++) {
+    for(hb[i] = 0, j = 0; j < n; j++)
+      hb[i] += G[i][j] * v[j] / nn->numout;
+    e = fabs(ha[i] - hb[i]);
+    err = (e > err) ? e : err;
+  }
+
+  nn_offline_threads = 1;
+  deallocate_array(v);
+  deallocate_array(ha);
+  deallocate_array(hb);
+  deallocate_array(hv);
+  deallocate_array(G);
+  return(err);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Train a fresh net on set for a number of epochs with a curvature
+   batch of the given size (zero for all patterns), and return the
+   ratio of the final error to the starting error. */
+
+static double train(DATASET *set, unsigned epochs, unsigned batch)
+{
+  NN *nn;
+  double before, after;
+
+  srandom(1);
+  nn = nn_create("2 8 2");
+  nn_link(nn, "0 -l-> 1");
+  nn_link(nn, "1 -l-> 2");
+  nn_set_actfunc(nn, 2, 0, "linear");
+  nn_init(nn, 0.5);
+  nn->info.train_set = set;
+  nn->info.opt.engine = opt_hessian_free;
+  nn->info.opt.max_epochs = epochs;
+  nn->info.opt.min_epochs = epochs;
+  nn->info.opt.delta_error_tol = -1e10;
+  nn->info.opt.batch = batch;
+  before = nn_offline_test(nn, set, NULL);
+  nn_train(nn);
+  after = nn_offline_test(nn, set, NULL);
+  nn_destroy(nn);
+  return(after / before);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+static void nothing(void *obj, unsigned id)
+{
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+int main(int argc, char **argv)
+{
+  NN *nn;
+  DATASET *data;
+  double *x;
+  unsigned i, aokay = 1;
+  size_t base;
+
+  srandom(0);
+
+  /* Make sure that the pool of threads is as big as it will get
+   * before we count the memory.
+   */
+  nn = nn_create("1 1");
+  nn_link(nn, "0 -l-> 1");
+  nn_destroy(nn);
+  thread_run(3, nothing, NULL);
+  base = xmemused();
+
+  x = allocate_array(1, sizeof(double), NPATS * 4);
+  for(i = 0; i < NPATS; i++) {
+    x[4 * i] = random_range(-1, 1);
+    x[4 * i + 1] = random_range(-1, 1);
+    x[4 * i + 2] = sin(2 * x[4 * i]) * x[4 * i + 1];
+    x[4 * i + 3] = cos(x[4 * i] + x[4 * i + 1]);
+  }
+  data = dataset_create(&dsm_matrix_method, dsm_c_matrix(x, 2, 2, NPATS));
+
+  /* Both products agree with the matrices they stand in for. */
+  nn = nn_create("2 5 2");
+  nn_link(nn, "0 -l-> 1");
+  nn_link(nn, "1 -l-> 2");
+  nn_init(nn, 0.5);
+  if(product(nn, data, 1) > 1e-10 || product(nn, data, 3) > 1e-10) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed product\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed product\n", argv[0]);
+  nn_destroy(nn);
+
+  /* Training gets most of the way down, with the curvature from
+   * every pattern or from a small subset.
+   */
+  if(train(data, 20, 0) > 0.05) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed train\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed train\n", argv[0]);
+  if(train(data, 20, 50) > 0.05) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed subsample\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed subsample\n", argv[0]);
+  dsm_destroy_matrix(dataset_destroy(data));
+  deallocate_array(x);
+
+  if(xmemused() != base) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed leak\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed leak\n", argv[0]);
+
+  exit(!aokay);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
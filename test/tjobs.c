@@ -0,0 +1,163 @@
+
+/* Copyright (c) 2000 by G. W. Flake. */
+
+/* A test for training many NNs at once with nn_train_jobs()... */
+
+#include <nodelib.h>
+#include <stdio.h>
+#include <math.h>
+
+#define NPATS 200
+#define NJOBS 6
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Make a net for job i, whose hidden layer size and weight decay
+   depend on i, ready for nn_train() on set. */
+
+static NN *make(unsigned i, unsigned hidden, DATASET *set)
+{
+  NN *nn;
+
+  nn = nn_create("2 %d 1", hidden);
+  nn_link(nn, "0 -l-> 1");
+  nn_link(nn, "1 -l-> 2");
+  nn_set_actfunc(nn, 2, 0, "linear");
+  nn->info.train_set = set;
+  nn->info.opt.max_epochs = 20;
+  nn->info.opt.delta_error_tol = -1e10;
+  nn->info.opt.wdecay = (i % 2) ? 1e-4 : 0;
+  return(nn);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+static void nothing(void *obj, unsigned id)
+{
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+int main(int argc, char **argv)
+{
+  NN_JOB jobs[NJOBS];
+  NN *nn;
+  DATASET *data, *test;
+  double *x, *y, wa[64], wb[64];
+  unsigned i, j, aokay = 1, same = 1;
+  size_t base;
+
+  srandom(0);
+
+  /* Make sure that the pool of threads is as big as it will get
+   * before we count the memory.
+   */
+  nn = nn_create("1 1");
+  nn_link(nn, "0 -l-> 1");
+  nn_destroy(nn);
+  thread_run(3, nothing, NULL);
+  base = xmemused();
+
+  x = allocate_array(1, sizeof(double), NPATS * 3);
+  y = allocate_array(1, sizeof(double), NPATS * 3);
+  for(i = 0; i < NPATS; i++) {
+    x[3 * i] = random_range(-1, 1);
+    x[3 * i + 1] = random_range(-1, 1);
+    x[3 * i + 2] = sin(2 * x[3 * i]) * x[3 * i + 1];
+    y[3 * i] = random_range(-1, 1);
+    y[3 * i + 1] = random_range(-1, 1);
+    y[3 * i + 2] = sin(2 * y[3 * i]) * y[3 * i + 1];
+  }
+  data = dataset_create(&dsm_matrix_method, dsm_c_matrix(x, 2, 1, NPATS));
+  test = dataset_create(&dsm_matrix_method, dsm_c_matrix(y, 2, 1, NPATS));
+
+  /* Runs of different sizes and decays that share one DATASET end up
+   * exactly where they would have if they were trained one by one.
+   */
+  for(i = 0; i < NJOBS; i++) {
+    jobs[i].nn = make(i, 3 + i, data);
+    jobs[i].seed = i + 1;
+    jobs[i].wmax = 0.5;
+  }
+  nn_jobs_threads = 3;
+  nn_jobs_pin = 1;
+  if(nn_train_jobs(jobs, NJOBS, 0) != 0)
+    same = 0;
+  nn_jobs_threads = 0;
+  nn_jobs_pin = 0;
+  for(i = 0; i < NJOBS; i++) {
+    nn = make(i, 3 + i, data);
+    srandom(i + 1);
+    nn_init(nn, 0.5);
+    nn_train(nn);
+    nn_get_weights(nn, wa);
+    nn_get_weights(jobs[i].nn, wb);
+    for(j = 0; j < nn->numweights; j++)
+      if(wa[j] != wb[j]) same = 0;
+    if(jobs[i].error != nn->info.opt.error || jobs[i].cancelled ||
+       jobs[i].result != 0)
+      same = 0;
+    nn_destroy(nn);
+    nn_destroy(jobs[i].nn);
+  }
+  if(!same) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed same\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed same\n", argv[0]);
+
+  /* A run with a single hidden node falls far behind one with eight
+   * and is stopped, but not before its minimum number of epochs.
+   */
+  for(i = 0; i < 2; i++) {
+    jobs[i].nn = make(0, i ? 1 : 8, data);
+    jobs[i].nn->info.opt.min_epochs = 5;
+    jobs[i].seed = 1;
+    jobs[i].wmax = 0.5;
+  }
+  nn_jobs_threads = 1;
+  nn_train_jobs(jobs, 2, 2);
+  nn_jobs_threads = 0;
+  if(jobs[0].cancelled || !jobs[1].cancelled || jobs[1].epochs < 5 ||
+     jobs[1].epochs >= jobs[0].epochs) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed cull\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed cull\n", argv[0]);
+  for(i = 0; i < 2; i++)
+    nn_destroy(jobs[i].nn);
+
+  /* Each run keeps its own cross validation error. */
+  for(i = 0; i < 3; i++) {
+    jobs[i].nn = make(i, 4, data);
+    jobs[i].nn->info.test_set = test;
+    jobs[i].seed = i + 1;
+    jobs[i].wmax = 0.5;
+  }
+  same = (nn_train_jobs(jobs, 3, 0) == 0);
+  for(i = 0; i < 3; i++) {
+    if(jobs[i].test_error != nn_offline_test(jobs[i].nn, test, NULL))
+      same = 0;
+    nn_destroy(jobs[i].nn);
+  }
+  if(!same) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed test\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed test\n", argv[0]);
+
+  dsm_destroy_matrix(dataset_destroy(data));
+  dsm_destroy_matrix(dataset_destroy(test));
+  deallocate_array(x);
+  deallocate_array(y);
+
+  if(xmemused() != base) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed leak\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed leak\n", argv[0]);
+
+  exit(!aokay);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
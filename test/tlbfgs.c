@@ -0,0 +1,156 @@
+
+/* Copyright (c) 2000 by G. W. Flake. */
+
+/* A test for the limited memory BFGS engine... */
+
+#include <nodelib.h>
+#include <stdio.h>
+#include <math.h>
+
+#define N 2000
+#define NPATS 100
+
+static double *W, *G;
+static size_t peak;
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* The extended Rosenbrock function, whose minimum of zero is at all
+   ones, and its gradient. */
+
+static double rosenbrock(void *obj)
+{
+  double a, b, sum = 0;
+  unsigned i;
+
+  for(i = 0; i < N; i += 2) {
+    a = W[i + 1] - W[i] * W[i];
+    b = 1 - W[i];
+    sum += 100 * a * a + b * b;
+  }
+  return(sum);
+}
+
+static double rosenbrock_grad(void *obj)
+{
+  double a, b;
+  unsigned i;
+
+  for(i = 0; i < N; i += 2) {
+    a = W[i + 1] - W[i] * W[i];
+    b = 1 - W[i];
+    G[i] = -400 * a * W[i] - 2 * b;
+    G[i + 1] = 200 * a;
+  }
+  return(rosenbrock(obj));
+}
+
+static int hook(void *obj)
+{
+  if(xmemused() > peak)
+    peak = xmemused();
+  return(0);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+int main(int argc, char **argv)
+{
+  OPTIMIZER opt = OPTIMIZER_DEFAULT;
+  NN *nn;
+  DATASET *data;
+  double **wp, **gp, *x, e, before;
+  unsigned i, aokay = 1;
+  size_t base;
+
+  srandom(0);
+
+  /* Make sure that the activation and net functions are registered
+   * before we count the memory.
+   */
+  nn = nn_create("1 1");
+  nn_link(nn, "0 -l-> 1");
+  nn_destroy(nn);
+  base = xmemused();
+
+  /* Thousands of variables, with memory that only grows linearly. */
+  W = allocate_array(1, sizeof(double), N);
+  G = allocate_array(1, sizeof(double), N);
+  wp = xmalloc(sizeof(double *) * N);
+  gp = xmalloc(sizeof(double *) * N);
+  for(i = 0; i < N; i++) {
+    W[i] = (i % 2) ? 1 : -1.2;
+    wp[i] = &W[i];
+    gp[i] = &G[i];
+  }
+  opt.size = N;
+  opt.funcf = rosenbrock;
+  opt.gradf = rosenbrock_grad;
+  opt.weights = wp;
+  opt.grads = gp;
+  opt.wvec = W;
+  opt.gvec = G;
+  opt.engine = opt_lbfgs;
+  opt.max_epochs = 200;
+  opt.error_tol = 1e-12;
+  opt.delta_error_tol = -1e10;
+  opt.hook = hook;
+  opt.hook_freq = 1;
+  peak = xmemused();
+  optimize(&opt);
+  for(e = 0, i = 0; i < N; i++)
+    e = (fabs(W[i] - 1) > e) ? fabs(W[i] - 1) : e;
+  if(e > 1e-5 || opt.epoch > 200) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed rosenbrock\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed rosenbrock\n", argv[0]);
+  if(peak - base > 4 * (2 * opt.history + 10) * N * sizeof(double)) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed memory\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed memory\n", argv[0]);
+  deallocate_array(W);
+  deallocate_array(G);
+  xfree(wp);
+  xfree(gp);
+
+  /* It trains a net through nn_train(), with a short history. */
+  x = allocate_array(1, sizeof(double), NPATS * 3);
+  for(i = 0; i < NPATS; i++) {
+    x[3 * i] = random_range(-1, 1);
+    x[3 * i + 1] = random_range(-1, 1);
+    x[3 * i + 2] = sin(2 * x[3 * i]) * x[3 * i + 1];
+  }
+  data = dataset_create(&dsm_matrix_method, dsm_c_matrix(x, 2, 1, NPATS));
+  nn = nn_create("2 8 1");
+  nn_link(nn, "0 -l-> 1");
+  nn_link(nn, "1 -l-> 2");
+  nn_set_actfunc(nn, 2, 0, "linear");
+  nn_init(nn, 0.5);
+  nn->info.train_set = data;
+  nn->info.opt.engine = opt_lbfgs;
+  nn->info.opt.history = 3;
+  nn->info.opt.max_epochs = 100;
+  nn->info.opt.delta_error_tol = -1e10;
+  before = nn_offline_test(nn, data, NULL);
+  nn_train(nn);
+  if(nn_offline_test(nn, data, NULL) > 0.01 * before) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed train\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed train\n", argv[0]);
+  nn_destroy(nn);
+  dsm_destroy_matrix(dataset_destroy(data));
+  deallocate_array(x);
+
+  if(xmemused() != base) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed leak\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed leak\n", argv[0]);
+
+  exit(!aokay);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
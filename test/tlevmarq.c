@@ -0,0 +1,133 @@
+
+/* Copyright (c) 2000 by G. W. Flake. */
+
+/* A test for Levenberg-Marquardt with the Gauss-Newton matrix... */
+
+#include <nodelib.h>
+#include <stdio.h>
+#include <math.h>
+
+#define NPATS 200
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Train a net with a hidden layer if hidden is nonzero (or a linear
+   model if not) on set for a number of epochs with the given number
+   of threads.  The final weights go in w, and the ratio of the final
+   error to the starting error is returned. */
+
+static double train(DATASET *set, int hidden, unsigned epochs,
+		    unsigned threads, double *w)
+{
+  NN *nn;
+  double before, after;
+
+  srandom(1);
+  nn = nn_create(hidden ? "2 6 1" : "2 1");
+  nn_link(nn, "0 -l-> 1");
+  if(hidden)
+    nn_link(nn, "1 -l-> 2");
+  nn_set_actfunc(nn, hidden ? 2 : 1, 0, "linear");
+  nn_init(nn, 0.5);
+  nn->info.train_set = set;
+  nn->info.opt.engine = opt_levenberg_marquardt;
+  nn->info.opt.max_epochs = epochs;
+  nn->info.opt.min_epochs = epochs;
+  nn->info.opt.delta_error_tol = -1e10;
+  nn_offline_threads = threads;
+  before = nn_offline_test(nn, set, NULL);
+  nn_train(nn);
+  after = nn_offline_test(nn, set, NULL);
+  nn_offline_threads = 1;
+  if(w)
+    nn_get_weights(nn, w);
+  nn_destroy(nn);
+  return(after / before);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+static void nothing(void *obj, unsigned id)
+{
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+int main(int argc, char **argv)
+{
+  NN *nn;
+  DATASET *data;
+  double *x, wa[32], wb[32], e, g[4];
+  unsigned i, aokay = 1;
+  size_t base;
+
+  srandom(0);
+
+  /* Make sure that the pool of threads is as big as it will get
+   * before we count the memory.
+   */
+  nn = nn_create("1 1");
+  nn_link(nn, "0 -l-> 1");
+  nn_destroy(nn);
+  thread_run(3, nothing, NULL);
+  base = xmemused();
+
+  x = allocate_array(1, sizeof(double), NPATS * 3);
+  for(i = 0; i < NPATS; i++) {
+    x[3 * i] = random_range(-1, 1);
+    x[3 * i + 1] = random_range(-1, 1);
+    x[3 * i + 2] = sin(2 * x[3 * i]) * x[3 * i + 1];
+  }
+  data = dataset_create(&dsm_matrix_method, dsm_c_matrix(x, 2, 1, NPATS));
+
+  /* For a linear model the Gauss-Newton matrix is the Hessian, so a
+   * few steps should land on the least squares solution.
+   */
+  train(data, 0, 5, 1, wa);
+  nn = nn_create("2 1");
+  nn_link(nn, "0 -l-> 1");
+  nn_set_actfunc(nn, 1, 0, "linear");
+  nn_set_weights(nn, wa);
+  nn_offline_grad(nn, data, NULL);
+  nn_get_grads(nn, g);
+  nn_destroy(nn);
+  for(e = 0, i = 0; i < 3; i++)
+    e = (fabs(g[i]) > e) ? fabs(g[i]) : e;
+  if(e > 1e-8) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed linear\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed linear\n", argv[0]);
+
+  /* A nonlinear net should get most of the way down quickly. */
+  if(train(data, 1, 20, 1, wa) > 0.05) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed nonlinear\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed nonlinear\n", argv[0]);
+
+  /* Building the Gauss-Newton matrix with threads changes nothing but
+   * the last bits.
+   */
+  train(data, 1, 20, 3, wb);
+  for(e = 0, i = 0; i < 6 * 3 + 7; i++)
+    e = (fabs(wa[i] - wb[i]) > e) ? fabs(wa[i] - wb[i]) : e;
+  if(e > 1e-6) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed threads\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed threads\n", argv[0]);
+
+  dsm_destroy_matrix(dataset_destroy(data));
+  deallocate_array(x);
+
+  if(xmemused() != base) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed leak\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed leak\n", argv[0]);
+
+  exit(!aokay);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
@@ -0,0 +1,107 @@
+
+/* Copyright (c) 2000 by G. W. Flake. */
+
+/* A test for the vector and fast versions of the activation
+   functions... */
+
+#include <nodelib.h>
+#include <stdio.h>
+#include <math.h>
+
+#define N 37
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Returns nonzero if the vector versions of the named activation
+   function differ at all from the scalar ones, or if the fast version
+   is off by more than tol (relative to the output if rel is set). */
+
+static int compare(char *name, double scale, double tol, int rel)
+{
+  NN_ACTFUNC *af;
+  double x[N], y[N], dy[N], dx[N], f[N], err;
+  unsigned k, bad = 0;
+
+  af = nn_find_actfunc(name);
+  for(k = 0; k < N; k++) {
+    x[k] = random_range(-scale, scale);
+    dy[k] = random_range(-1, 1);
+  }
+  if(af->func_vec == NULL || af->deriv_vec == NULL)
+    return(1);
+  af->func_vec(x, y, N);
+  af->deriv_vec(x, y, dy, dx, N);
+  for(k = 0; k < N; k++)
+    if(y[k] != af->func(x[k]) || dx[k] != dy[k] * af->deriv(x[k], y[k]))
+      bad = 1;
+  if(af->fast_vec) {
+    af->fast_vec(x, f, N);
+    for(k = 0; k < N; k++) {
+      err = fabs(f[k] - y[k]);
+      if(rel) err /= fabs(y[k]);
+      if(err > tol) bad = 1;
+    }
+  }
+  return(bad);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+int main(int argc, char **argv)
+{
+  NN *nn;
+  double x[4], y[2], err;
+  unsigned i, k, aokay = 1;
+
+  srandom(0);
+
+  if(compare("tanh", 20, 1e-15, 0) || compare("logistic", 40, 5e-16, 0) ||
+     compare("gauss", 5, 5e-16, 0) || compare("exp", 700, 1e-15, 1) ||
+     compare("exp(-x)", 700, 1e-15, 1) || compare("linear", 10, 0, 0) ||
+     compare("sin", 10, 0, 0) || compare("cos", 10, 0, 0)) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed builtins\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed builtins\n", argv[0]);
+
+  /* A net with fast hidden units must be close to the exact one, and
+   * must not change when it is compiled.
+   */
+  nn = nn_create("4 10 2");
+  nn_link(nn, "0 -l-> 1");
+  nn_link(nn, "1 -l-> 2");
+  nn_set_actfunc(nn, 2, 0, "logistic");
+  nn_init(nn, 1);
+  err = 0;
+  for(k = 0; k < 20; k++) {
+    for(i = 0; i < 4; i++)
+      x[i] = random_range(-1, 1);
+    nn_set_actfunc_fast(nn, 1, 0, 0);
+    nn_set_actfunc_fast(nn, 2, 0, 0);
+    nn_forward(nn, x);
+    y[0] = nn->y[0];
+    y[1] = nn->y[1];
+    nn_set_actfunc_fast(nn, 1, 0, 1);
+    nn_set_actfunc_fast(nn, 2, 0, 1);
+    nn_forward(nn, x);
+    for(i = 0; i < 2; i++)
+      err = (fabs(y[i] - nn->y[i]) > err) ? fabs(y[i] - nn->y[i]) : err;
+    y[0] = nn->y[0];
+    y[1] = nn->y[1];
+    nn_compile(nn);
+    nn_forward(nn, x);
+    if(y[0] != nn->y[0] || y[1] != nn->y[1])
+      err = 1;
+    nn_uncompile(nn);
+  }
+  if(err > 1e-14) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed fast\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed fast\n", argv[0]);
+  nn_destroy(nn);
+
+  exit(!aokay);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
@@ -0,0 +1,87 @@
+
+/* Copyright (c) 1996 by G. W. Flake. */
+
+/* A test for nn_forward_batch() and nn_backward_batch()... */
+
+#include <nodelib.h>
+#include <stdio.h>
+#include <math.h>
+
+#define NPATS 13
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+int main(int argc, char **argv)
+{
+  NN *nn;
+  double **x, **dedy, *g, *gb, err, maxerr;
+  unsigned i, j, k, aokay = 1;
+
+  srandom(0);
+
+  /* Mix net functions with and without batch versions. */
+  nn = nn_create("3 6 (3 2) (2)");
+  nn_link(nn, "0 -l-> 1");
+  nn_link(nn, "1 -d-> (2 0)");
+  nn_link(nn, "1 -q-> (2 1)");
+  nn_link(nn, "(2 0) -l-> 3");
+  nn_link(nn, "(2 1) -e-> 3");
+  nn_set_actfunc(nn, 2, 1, "logistic");
+  nn_set_actfunc(nn, 3, 0, "linear");
+  nn_init(nn, 0.5);
+
+  x = allocate_array(2, sizeof(double), NPATS, nn->numin);
+  dedy = allocate_array(2, sizeof(double), NPATS, nn->numout);
+  g = allocate_array(1, sizeof(double), nn->numweights);
+  gb = allocate_array(1, sizeof(double), nn->numweights);
+  for(i = 0; i < NPATS; i++) {
+    for(j = 0; j < nn->numin; j++)
+      x[i][j] = random_range(-1, 1);
+    for(j = 0; j < nn->numout; j++)
+      dedy[i][j] = random_range(-1, 1);
+  }
+
+  /* Accumulate the single pattern results. */
+  for(i = 0; i < nn->numweights; i++)
+    g[i] = 0;
+  nn_forward_batch(nn, x, NPATS);
+  maxerr = 0;
+  for(k = 0; k < NPATS; k++) {
+    nn_forward(nn, x[k]);
+    for(j = 0; j < nn->numout; j++) {
+      err = fabs(nn->y[j] - nn->By[j * NPATS + k]);
+      maxerr = (err > maxerr) ? err : maxerr;
+    }
+    nn_backward(nn, dedy[k]);
+    for(i = 0; i < nn->numweights; i++)
+      g[i] += *nn->grads[i];
+  }
+  if(maxerr != 0) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed forward (%g)\n", argv[0], maxerr);
+  }
+  else fprintf(stderr, "%s: passed forward\n", argv[0]);
+
+  nn_forward_batch(nn, x, NPATS);
+  nn_backward_batch(nn, dedy);
+  nn_get_grads(nn, gb);
+  maxerr = 0;
+  for(i = 0; i < nn->numweights; i++) {
+    err = fabs(g[i] - gb[i]) / (fabs(g[i]) + 1);
+    maxerr = (err > maxerr) ? err : maxerr;
+  }
+  if(maxerr > 1e-12) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed backward (%g)\n", argv[0], maxerr);
+  }
+  else fprintf(stderr, "%s: passed backward\n", argv[0]);
+
+  deallocate_array(x);
+  deallocate_array(dedy);
+  deallocate_array(g);
+  deallocate_array(gb);
+  nn_destroy(nn);
+  exit(!aokay);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
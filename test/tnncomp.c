@@ -0,0 +1,125 @@
+
+/* Copyright (c) 2000 by G. W. Flake. */
+
+/* A test for nn_compile()... */
+
+#include <nodelib.h>
+#include <stdio.h>
+#include <math.h>
+
+#define NPATS 7
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Run NPATS patterns through nn both ways, and return nonzero if the
+   outputs, weight derivatives, or input derivatives differ at all. */
+
+static int compare(NN *nn)
+{
+  double *x, *dedy, *y, *g, *dx;
+  unsigned i, k, bad = 0;
+
+  x = allocate_array(1, sizeof(double), nn->numin);
+  dedy = allocate_array(1, sizeof(double), nn->numout);
+  y = allocate_array(1, sizeof(double), nn->numout);
+  dx = allocate_array(1, sizeof(double), nn->numin);
+  g = allocate_array(1, sizeof(double), nn->numweights);
+  for(k = 0; k < NPATS; k++) {
+    for(i = 0; i < nn->numin; i++)
+      x[i] = random_range(-1, 1);
+    for(i = 0; i < nn->numout; i++)
+      dedy[i] = random_range(-1, 1);
+
+    nn_uncompile(nn);
+    nn_forward(nn, x);
+    nn_backward(nn, dedy);
+    for(i = 0; i < nn->numout; i++)
+      y[i] = nn->y[i];
+    for(i = 0; i < nn->numin; i++)
+      dx[i] = nn->dx[i];
+    nn_get_grads(nn, g);
+
+    nn_compile(nn);
+    nn_forward(nn, x);
+    nn_backward(nn, dedy);
+    for(i = 0; i < nn->numout; i++)
+      if(y[i] != nn->y[i]) bad = 1;
+    for(i = 0; i < nn->numin; i++)
+      if(dx[i] != nn->dx[i]) bad = 1;
+    for(i = 0; i < nn->numweights; i++)
+      if(g[i] != *nn->grads[i]) bad = 1;
+  }
+  deallocate_array(x);
+  deallocate_array(dedy);
+  deallocate_array(y);
+  deallocate_array(dx);
+  deallocate_array(g);
+  return(bad);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+int main(int argc, char **argv)
+{
+  NN *nn;
+  unsigned aokay = 1;
+
+  srandom(0);
+
+  /* A plain MLP, where every link can be fused. */
+  nn = nn_create("4 10 10 3");
+  nn_link(nn, "0 -l-> 1");
+  nn_link(nn, "1 -l-> 2");
+  nn_link(nn, "2 -l-> 3");
+  nn_set_actfunc(nn, 2, 0, "logistic");
+  nn_set_actfunc(nn, 3, 0, "linear");
+  nn_init(nn, 0.5);
+  if(compare(nn)) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed mlp\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed mlp\n", argv[0]);
+
+  /* A locked link and all gradients. */
+  nn_lock_link(nn, 1);
+  nn->need_all_grads = 1;
+  if(compare(nn)) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed locked\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed locked\n", argv[0]);
+  nn_destroy(nn);
+
+  /* Slabs, other net functions, short cut links, and an unknown
+   * activation function.
+   */
+  nn = nn_create("3 6 (3 2) (2 1)");
+  nn_link(nn, "0 -l-> 1");
+  nn_link(nn, "1 -d-> (2 0)");
+  nn_link(nn, "1 -q-> (2 1)");
+  nn_link(nn, "2 -l-> 3");
+  nn_link(nn, "0 -l-> (3 1)");
+  nn_set_actfunc(nn, 1, 0, "sin");
+  nn_set_actfunc(nn, 2, 1, "logistic");
+  nn_set_actfunc(nn, 3, 0, "linear");
+  nn_init(nn, 0.5);
+  if(compare(nn)) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed slabs\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed slabs\n", argv[0]);
+
+  /* Changing an activation function after compiling. */
+  nn_compile(nn);
+  nn_set_actfunc(nn, 1, 0, "tanh");
+  if(compare(nn)) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed actfunc\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed actfunc\n", argv[0]);
+  nn_destroy(nn);
+
+  exit(!aokay);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
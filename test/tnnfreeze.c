@@ -0,0 +1,223 @@
+
+/* Copyright (c) 2000 by G. W. Flake. */
+
+/* A test for nn_freeze()... */
+
+#include <nodelib.h>
+#include <stdio.h>
+#include <math.h>
+
+#define NPATS 50
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Forget the state of the recurrent links. */
+
+static void reset(NN *nn)
+{
+  unsigned i, j;
+
+  for(i = 0; i < nn->numlayers; i++)
+    for(j = 0; j < nn->layers[i].sz; j++)
+      nn->layers[i].x[j] = nn->layers[i].y[j] = 0;
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Run the patterns in x through nn one at a time, compiled or not, and
+   in a single batch, and save the outputs in y, yc, and yb. */
+
+static void outputs(NN *nn, double **x, double **y, double **yc,
+		    double **yb)
+{
+  unsigned i, k;
+
+  nn_uncompile(nn);
+  reset(nn);
+  for(k = 0; k < NPATS; k++) {
+    nn_forward(nn, x[k]);
+    for(i = 0; i < nn->numout; i++)
+      y[k][i] = nn->y[i];
+  }
+  nn_compile(nn);
+  reset(nn);
+  for(k = 0; k < NPATS; k++) {
+    nn_forward(nn, x[k]);
+    for(i = 0; i < nn->numout; i++)
+      yc[k][i] = nn->y[i];
+  }
+  nn_uncompile(nn);
+  reset(nn);
+  nn_forward_batch(nn, x, NPATS);
+  for(k = 0; k < NPATS; k++)
+    for(i = 0; i < nn->numout; i++)
+      yb[k][i] = nn->By[i * NPATS + k];
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Returns nonzero if freezing nn changes any of its outputs, or leaves
+   any of the derivatives behind.  The memory in use just before and
+   just after freezing (and running the patterns again) goes in
+   before and after. */
+
+static int compare(NN *nn, size_t *before, size_t *after)
+{
+  double **x, **y, **yc, **yb, **fy, **fyc, **fyb;
+  unsigned i, j, k, n = nn->numout, bad = 0;
+
+  x = allocate_array(2, sizeof(double), NPATS, nn->numin);
+  y = allocate_array(2, sizeof(double), NPATS, n);
+  yc = allocate_array(2, sizeof(double), NPATS, n);
+  yb = allocate_array(2, sizeof(double), NPATS, n);
+  fy = allocate_array(2, sizeof(double), NPATS, n);
+  fyc = allocate_array(2, sizeof(double), NPATS, n);
+  fyb = allocate_array(2, sizeof(double), NPATS, n);
+  for(k = 0; k < NPATS; k++)
+    for(i = 0; i < nn->numin; i++)
+      x[k][i] = random_range(-1, 1);
+
+  outputs(nn, x, y, yc, yb);
+  *before = xmemused();
+  nn_freeze(nn);
+  outputs(nn, x, fy, fyc, fyb);
+  nn_uncompile(nn);
+  *after = xmemused();
+  for(k = 0; k < NPATS; k++)
+    for(i = 0; i < n; i++)
+      if(fy[k][i] != y[k][i] || fyc[k][i] != yc[k][i] ||
+	 fyb[k][i] != yb[k][i])
+	bad = 1;
+
+  if(nn->grads || nn->dx || nn->dy || nn->Ry || nn->Bdx || nn->gvec)
+    bad = 1;
+  for(i = 0; i < nn->numlinks; i++)
+    if(nn->links[i]->du || nn->links[i]->Ru || nn->links[i]->Rdu ||
+       nn->links[i]->da || nn->links[i]->Ra || nn->links[i]->Rda)
+      bad = 1;
+  for(i = 0; i < nn->numlayers; i++)
+    for(j = 0; j < nn->layers[i].numslabs; j++)
+      if(nn->layers[i].slabs[j].dx || nn->layers[i].slabs[j].Rdy)
+	bad = 1;
+
+  deallocate_array(x); deallocate_array(y); deallocate_array(yc);
+  deallocate_array(yb); deallocate_array(fy); deallocate_array(fyc);
+  deallocate_array(fyb);
+  return(bad);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+int main(int argc, char **argv)
+{
+  NN *nn;
+  DATASET *data;
+  double *x, e, ef;
+  size_t base, before, after;
+  unsigned i, aokay = 1;
+
+  srandom(0);
+
+  /* Make sure that the activation and net functions are registered
+   * before we count the memory.
+   */
+  nn = nn_create("1 1");
+  nn_link(nn, "0 -l-> 1");
+  nn_destroy(nn);
+  base = xmemused();
+
+  /* A plain MLP, which should lose at least its weight derivatives. */
+  nn = nn_create("7 64 21 3");
+  nn_link(nn, "0 -l-> 1");
+  nn_link(nn, "1 -l-> 2");
+  nn_link(nn, "2 -l-> 3");
+  nn_set_actfunc(nn, 3, 0, "linear");
+  nn_init(nn, 0.5);
+  if(compare(nn, &before, &after) ||
+     before - after < nn->numweights * sizeof(double)) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed mlp\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed mlp\n", argv[0]);
+
+  /* The threaded offline routines must still work. */
+  x = allocate_array(1, sizeof(double), NPATS * (nn->numin + nn->numout));
+  for(i = 0; i < NPATS * (nn->numin + nn->numout); i++)
+    x[i] = random_range(-1, 1);
+  data = dataset_create(&dsm_matrix_method,
+			dsm_c_matrix(x, nn->numin, nn->numout, NPATS));
+  nn_offline_threads = 1;
+  e = nn_offline_test(nn, data, NULL);
+  nn_offline_threads = 2;
+  nn_set_single(nn, 1);
+  ef = nn_offline_test(nn, data, NULL);
+  nn_offline_threads = 1;
+  if(fabs(e - ef) > 1e-5 * e) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed offline\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed offline\n", argv[0]);
+  dsm_destroy_matrix(dataset_destroy(data));
+  deallocate_array(x);
+  nn_destroy(nn);
+
+  /* A packed net with slabs and a recurrent link. */
+  nn = nn_create("3 20 (17 2) (2 1)");
+  nn_link(nn, "0 -l-> 1");
+  nn_link(nn, "1 -l-> 2");
+  nn_link(nn, "1 -q-> (2 1)");
+  nn_link(nn, "2 -l-> 3");
+  nn_link(nn, "0 -l-> (3 1)");
+  nn_link(nn, "(3 1) -s-> (3 1)");
+  nn_set_actfunc(nn, 2, 1, "logistic");
+  nn_set_actfunc(nn, 3, 0, "linear");
+  nn_init(nn, 0.5);
+  nn_pack(nn);
+  if(compare(nn, &before, &after)) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed packed\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed packed\n", argv[0]);
+  nn_destroy(nn);
+
+  /* A feedforward net whose quadratic link has no batch version, so
+   * the batch passes go through it one pattern at a time.
+   */
+  nn = nn_create("3 8 2");
+  nn_link(nn, "0 -l-> 1");
+  nn_link(nn, "1 -q-> 2");
+  nn_set_actfunc(nn, 2, 0, "linear");
+  nn_init(nn, 0.5);
+  if(compare(nn, &before, &after)) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed quadratic\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed quadratic\n", argv[0]);
+  x = allocate_array(1, sizeof(double), NPATS * 5);
+  for(i = 0; i < NPATS * 5; i++)
+    x[i] = random_range(-1, 1);
+  data = dataset_create(&dsm_matrix_method, dsm_c_matrix(x, 3, 2, NPATS));
+  nn_offline_batch = 1;
+  e = nn_offline_test(nn, data, NULL);
+  nn_offline_batch = 16;
+  ef = nn_offline_test(nn, data, NULL);
+  nn_offline_batch = 1;
+  if(fabs(e - ef) > 1e-12 * e) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed quadratic batch\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed quadratic batch\n", argv[0]);
+  dsm_destroy_matrix(dataset_destroy(data));
+  deallocate_array(x);
+  nn_destroy(nn);
+
+  if(xmemused() != base) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed leak\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed leak\n", argv[0]);
+
+  exit(!aokay);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
@@ -0,0 +1,391 @@
+
+/* Copyright (c) 2000 by G. W. Flake. */
+
+/* A test for nn_Hv(), the lazy R variables, the offline Hessian, and
+   the Gauss-Newton matrix... */
+
+#include <nodelib.h>
+#include <stdio.h>
+#include <math.h>
+
+#define EPS 1e-5
+#define NPATS 20
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Put the gradient of the error of nn at (x, t) in g. */
+
+static void grad(NN *nn, double *x, double *t, double *g)
+{
+  double dedy[8];
+
+  nn_forward(nn, x);
+  nn_error(nn, nn->y, t, nn->numout, dedy, NULL);
+  nn_backward(nn, dedy);
+  nn_get_grads(nn, g);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Returns the biggest difference between nn_Hv() and a central
+   difference of the gradient, for a random pattern and vector. */
+
+static double compare(NN *nn)
+{
+  double x[8], t[8], *v, *w, *gp, *gm, *hv, err = 0, e;
+  unsigned i;
+
+  v = allocate_array(1, sizeof(double), nn->numweights);
+  w = allocate_array(1, sizeof(double), nn->numweights);
+  gp = allocate_array(1, sizeof(double), nn->numweights);
+  gm = allocate_array(1, sizeof(double), nn->numweights);
+  hv = allocate_array(1, sizeof(double), nn->numweights);
+  for(i = 0; i < nn->numin; i++)
+    x[i] = random_range(-1, 1);
+  for(i = 0; i < nn->numout; i++)
+    t[i] = random_range(-1, 1);
+  for(i = 0; i < nn->numweights; i++)
+    v[i] = random_range(-1, 1);
+
+  nn_get_weights(nn, w);
+  for(i = 0; i < nn->numweights; i++)
+    *nn->weights[i] = w[i] + EPS * v[i];
+  grad(nn, x, t, gp);
+  for(i = 0; i < nn->numweights; i++)
+    *nn->weights[i] = w[i] - EPS * v[i];
+  grad(nn, x, t, gm);
+  nn_set_weights(nn, w);
+
+  nn_Hv(nn, x, t, v);
+  nn_get_Rgrads(nn, hv);
+  for(i = 0; i < nn->numweights; i++) {
+    e = fabs(hv[i] - (gp[i] - gm[i]) / (2 * EPS));
+    err = (e > err) ? e : err;
+  }
+  deallocate_array(v); deallocate_array(w); deallocate_array(gp);
+  deallocate_array(gm); deallocate_array(hv);
+  return(err);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Returns the biggest difference between nn_offline_hessian(), with
+   the given number of threads, and the average of nn_hessian() over
+   the patterns in set, or 1 if the result is not symmetric. */
+
+static double offline(NN *nn, DATASET *set, unsigned threads)
+{
+  double **H, **HH, **Hsum, err = 0, e;
+  unsigned i, j, k, n = nn->numweights;
+
+  H = allocate_array(2, sizeof(double), n, n);
+  HH = allocate_array(2, sizeof(double), n, n);
+  Hsum = allocate_array(2, sizeof(double), n, n);
+  for(i = 0; i < n; i++)
+    for(j = 0; j < n; j++)
+      Hsum[i][j] = 0;
+  for(k = 0; k < dataset_size(set); k++) {
+    nn_hessian(nn, dataset_x(set, k), dataset_y(set, k), HH);
+    for(i = 0; i < n; i++)
+      for(j = 0; j < n; j++)
+	Hsum[i][j] += HH[i][j] / dataset_size(set);
+  }
+
+  nn_offline_threads = threads;
+  if(nn_offline_hessian(nn, set, H) != 0)
+    err = 1;
+  nn_offline_threads = 1;
+  for(i = 0; i < n; i++)
+    for(j = 0; j < n; j++) {
+      e = fabs(H[i][j] - Hsum[i][j]);
+      err = (e > err) ? e : err;
+      if(H[i][j] != H[j][i])
+	err = 1;
+    }
+  deallocate_array(H); deallocate_array(HH); deallocate_array(Hsum);
+  return(err);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Returns the biggest difference between nn_offline_gauss_newton(),
+   with the given number of threads, and the same matrix built from
+   central differences of the outputs, or 1 if the result is not
+   symmetric. */
+
+static double gauss_newton(NN *nn, DATASET *set, unsigned threads)
+{
+  double **G, **Gfd, **J, *w, *x, *t, d[8], de, err = 0, e;
+  unsigned i, j, k, o, n = nn->numweights, pats = dataset_size(set);
+
+  G = allocate_array(2, sizeof(double), n, n);
+  Gfd = allocate_array(2, sizeof(double), n, n);
+  J = allocate_array(2, sizeof(double), nn->numout, n);
+  w = allocate_array(1, sizeof(double), n);
+  nn_get_weights(nn, w);
+  for(i = 0; i < n; i++)
+    for(j = 0; j < n; j++)
+      Gfd[i][j] = 0;
+  for(k = 0; k < pats; k++) {
+    x = dataset_x(set, k);
+    t = dataset_y(set, k);
+    nn_forward(nn, x);
+    for(o = 0; o < nn->numout; o++)
+      nn->info.error_function(nn->y[o], t[o], &de, &d[o]);
+    for(i = 0; i < n; i++) {
+      *nn->weights[i] = w[i] + EPS;
+      nn_forward(nn, x);
+      for(o = 0; o < nn->numout; o++)
+	J[o][i] = nn->y[o];
+      *nn->weights[i] = w[i] - EPS;
+      nn_forward(nn, x);
+      for(o = 0; o < nn->numout; o++)
+	J[o][i] = (J[o][i] - nn->y[o]) / (2 * EPS);
+      *nn->weights[i] = w[i];
+    }
+    for(o = 0; o < nn->numout; o++)
+      for(i = 0; i < n; i++)
+	for(j = 0; j < n; j++)
+	  Gfd[i][j] += d[o] * J[o][i] * J[o][j] / pats;
+  }
+
+  nn_offline_threads = threads;
+  if(nn_offline_gauss_newton(nn, set, G) != 0)
+    err = 1;
+  nn_offline_threads = 1;
+  for(i = 0; i < n; i++)
+    for(j = 0; j < n; j++) {
+      e = fabs(G[i][j] - Gfd[i][j]);
+      err = (e > err) ? e : err;
+      if(G[i][j] != G[j][i])
+	err = 1;
+    }
+  deallocate_array(G); deallocate_array(Gfd); deallocate_array(J);
+  deallocate_array(w);
+  return(err);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Forget what a recurrent net saw on the last pass. */
+
+static void reset(NN *nn)
+{
+  unsigned i, j;
+  NN_LAYER *l;
+
+  for(i = 0; i < nn->numlayers; i++)
+    for(l = &nn->layers[i], j = 0; j < l->sz; j++) {
+      l->x[j] = l->y[j] = l->dx[j] = l->dy[j] = 0.0;
+      if(l->Rx)
+	l->Rx[j] = l->Ry[j] = l->Rdx[j] = l->Rdy[j] = 0.0;
+    }
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Returns the biggest difference between the offline Hessian, the
+   Gauss-Newton matrix, and the product of the Gauss-Newton matrix with
+   a vector of a recurrent nn with one thread and with the given
+   number. */
+
+static double recurrent(NN *nn, DATASET *set, unsigned threads)
+{
+  double **Ha, **Hb, **Ga, **Gb, *v, *hva, *hvb, e, err = 0;
+  unsigned i, j, n = nn->numweights;
+
+  Ha = allocate_array(2, sizeof(double), n, n);
+  Hb = allocate_array(2, sizeof(double), n, n);
+  Ga = allocate_array(2, sizeof(double), n, n);
+  Gb = allocate_array(2, sizeof(double), n, n);
+  v = allocate_array(1, sizeof(double), n);
+  hva = allocate_array(1, sizeof(double), n);
+  hvb = allocate_array(1, sizeof(double), n);
+  for(i = 0; i < n; i++)
+    v[i] = random_range(-1, 1);
+  for(j = 0; j < 2; j++) {
+    nn_offline_threads = (j == 0) ? 1 : threads;
+    reset(nn);
+    nn_offline_hessian(nn, set, (j == 0) ? Ha : Hb);
+    reset(nn);
+    nn_offline_gauss_newton(nn, set, (j == 0) ? Ga : Gb);
+    reset(nn);
+    nn_offline_Hv(nn, set, NULL, 0, v, (j == 0) ? hva : hvb);
+  }
+  nn_offline_threads = 1;
+  for(i = 0; i < n; i++) {
+    for(j = 0; j < n; j++) {
+      e = fabs(Ha[i][j] - Hb[i][j]) + fabs(Ga[i][j] - Gb[i][j]);
+      err = (e > err) ? e : err;
+    }
+    e = fabs(hva[i] - hvb[i]);
+    err = (e > err) ? e : err;
+  }
+  deallocate_array(Ha); deallocate_array(Hb); deallocate_array(Ga);
+  deallocate_array(Gb); deallocate_array(v); deallocate_array(hva);
+  deallocate_array(hvb);
+  return(err);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+int main(int argc, char **argv)
+{
+  NN *nn;
+  DATASET *data;
+  double *x, **H, **G, e;
+  size_t base, used;
+  unsigned i, j, aokay = 1;
+
+  srandom(0);
+
+  /* A net with a big quadratic link, which should be about half the
+   * size until it needs the R variables.
+   */
+  nn = nn_create("4 12 (6 3) 2");
+  nn_link(nn, "0 -l-> 1");
+  nn_link(nn, "1 -q-> (2 0)");
+  nn_link(nn, "1 -l-> (2 1)");
+  nn_link(nn, "2 -l-> 3");
+  nn_set_actfunc(nn, 3, 0, "linear");
+  nn_init(nn, 0.5);
+  base = xmemused();
+  if(nn->Ry || nn->layers[1].slabs[0].Rx || nn->links[1]->RA) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed lazy\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed lazy\n", argv[0]);
+
+  if(compare(nn) > 1e-6) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed Hv\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed Hv\n", argv[0]);
+  used = xmemused();
+
+  /* Letting go of the R variables must not change the answer. */
+  nn_free_R(nn);
+  if(used - xmemused() < (used - base) / 2 || nn->links[1]->RA ||
+     nn->Rdx || compare(nn) > 1e-6) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed free\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed free\n", argv[0]);
+
+  /* A link added later gets its R variables as well. */
+  nn_link(nn, "0 -l-> 3");
+  for(i = 0; i < nn->numweights; i++)
+    *nn->weights[i] = random_range(-0.5, 0.5);
+  if(compare(nn) > 1e-6) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed relink\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed relink\n", argv[0]);
+
+  /* The R weights of a locked link are zero, even when their memory
+   * held something else before.
+   */
+  nn_lock_link(nn, 0);
+  nn_free_R(nn);
+  x = allocate_array(1, sizeof(double), 4096);
+  for(i = 0; i < 4096; i++)
+    x[i] = 1e6;
+  deallocate_array(x);
+  if(compare(nn) > 1e-6) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed locked\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed locked\n", argv[0]);
+  nn_destroy(nn);
+
+  /* An error function that couples the outputs. */
+  nn = nn_create("4 6 3");
+  nn_link(nn, "0 -l-> 1");
+  nn_link(nn, "1 -l-> 2");
+  nn_set_actfunc(nn, 2, 0, "linear");
+  nn_init(nn, 0.5);
+  nn->info.error_vector = &opt_errvec_softmax_cross_entropy;
+  if(compare(nn) > 1e-6) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed softmax\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed softmax\n", argv[0]);
+  nn_destroy(nn);
+
+  /* The offline Hessian, with and without threads and the check. */
+  nn = nn_create("3 5 2");
+  nn_link(nn, "0 -l-> 1");
+  nn_link(nn, "0 -q-> 2");
+  nn_link(nn, "1 -l-> 2");
+  nn_set_actfunc(nn, 2, 0, "linear");
+  nn_init(nn, 0.5);
+  x = allocate_array(1, sizeof(double), NPATS * (3 + 2));
+  for(i = 0; i < NPATS * (3 + 2); i++)
+    x[i] = random_range(-1, 1);
+  data = dataset_create(&dsm_matrix_method, dsm_c_matrix(x, 3, 2, NPATS));
+  if(offline(nn, data, 1) > 1e-12 || offline(nn, data, 3) > 1e-12) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed offline\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed offline\n", argv[0]);
+  nn_hessian_check = 0;
+  if(offline(nn, data, 4) > 1e-12) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed unchecked\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed unchecked\n", argv[0]);
+  nn_hessian_check = 1;
+
+  /* The Gauss-Newton matrix, which is the Hessian for a linear model. */
+  if(gauss_newton(nn, data, 1) > 1e-6 || gauss_newton(nn, data, 3) > 1e-6) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed gauss newton\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed gauss newton\n", argv[0]);
+  nn_destroy(nn);
+  nn = nn_create("3 2");
+  nn_link(nn, "0 -l-> 1");
+  nn_set_actfunc(nn, 1, 0, "linear");
+  nn_init(nn, 0.5);
+  H = allocate_array(2, sizeof(double), nn->numweights, nn->numweights);
+  G = allocate_array(2, sizeof(double), nn->numweights, nn->numweights);
+  nn_offline_hessian(nn, data, H);
+  nn_offline_gauss_newton(nn, data, G);
+  e = 0;
+  for(i = 0; i < nn->numweights; i++)
+    for(j = 0; j < nn->numweights; j++)
+      if(fabs(H[i][j] - G[i][j]) > e)
+	e = fabs(H[i][j] - G[i][j]);
+  if(e > 1e-12) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed linear\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed linear\n", argv[0]);
+  deallocate_array(H);
+  deallocate_array(G);
+  nn_destroy(nn);
+
+  /* A recurrent net must see the patterns in order, so the threads
+   * change nothing at all.
+   */
+  nn = nn_create("3 5 2");
+  nn_link(nn, "0 -l-> 1");
+  nn_link(nn, "1 -l-> 2");
+  nn_link(nn, "2 -l-> 1");
+  nn_set_actfunc(nn, 2, 0, "linear");
+  nn_init(nn, 0.5);
+  nn_hessian_check = 0;
+  if(recurrent(nn, data, 3) != 0) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed recurrent\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed recurrent\n", argv[0]);
+  nn_hessian_check = 1;
+  dsm_destroy_matrix(dataset_destroy(data));
+  deallocate_array(x);
+  nn_destroy(nn);
+
+  exit(!aokay);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
@@ -0,0 +1,204 @@
+
+/* Copyright (c) 2000 by G. W. Flake. */
+
+/* A test for the binary image format and nn_map()... */
+
+#include <nodelib.h>
+#include <stdio.h>
+#include <math.h>
+
+#define NPATS 40
+#define TESTFILE "/tmp/tnnimage.net"
+#define TESTFILE2 "/tmp/tnnimage2.net"
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Returns the biggest difference between the outputs of a and b over
+   some random patterns. */
+
+static double outdiff(NN *a, NN *b)
+{
+  double x[8], e, err = 0;
+  unsigned i, k;
+
+  for(k = 0; k < NPATS; k++) {
+    for(i = 0; i < a->numin; i++)
+      x[i] = random_range(-1, 1);
+    nn_forward(a, x);
+    nn_forward(b, x);
+    for(i = 0; i < a->numout; i++) {
+      e = fabs(a->y[i] - b->y[i]);
+      err = (e > err) ? e : err;
+    }
+  }
+  return(err);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Returns nonzero if a and b have the same weights and the same links
+   locked. */
+
+static int same(NN *a, NN *b)
+{
+  unsigned i;
+
+  if(a->numlinks != b->numlinks || a->numweights != b->numweights)
+    return(0);
+  for(i = 0; i < a->numlinks; i++)
+    if(a->links[i]->need_grads != b->links[i]->need_grads)
+      return(0);
+  for(i = 0; i < a->numweights; i++)
+    if(*a->weights[i] != *b->weights[i])
+      return(0);
+  return(1);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Returns nonzero if every weight of nn lives in its mapped file. */
+
+static int mapped(NN *nn)
+{
+  unsigned char *p, *lo = nn->map, *hi = lo + nn->mapsz;
+  unsigned i;
+
+  if(!nn->map || !nn->frozen)
+    return(0);
+  for(i = 0; i < nn->numweights; i++) {
+    p = (unsigned char *)nn->weights[i];
+    if(p < lo || p + sizeof(double) > hi)
+      return(0);
+  }
+  return(1);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* A net with a sparse link, a locked link, and a few net and
+   activation functions. */
+
+static NN *make_net(void)
+{
+  NN *nn;
+  int mask[6 * 9];
+  unsigned i;
+
+  nn = nn_create("6 (5 4) 3");
+  nn_link(nn, "0 -x-> 1");
+  nn_link(nn, "0 -l-> (1 1)");
+  nn_link(nn, "1 -l-> 2");
+  nn_link(nn, "0 -d-> 2");
+  nn_set_actfunc(nn, 1, 1, "tanh");
+  nn_set_actfunc(nn, 2, 0, "linear");
+  for(i = 0; i < 6 * 5; i++)
+    mask[i] = (random_range(0, 1) < 0.5);
+  nn_set_sparse_mask(nn, 0, mask);
+  nn_init(nn, 0.5);
+  nn_lock_link(nn, 3);
+  return(nn);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+int main(int argc, char **argv)
+{
+  NN *nn, *rd;
+  FILE *fp;
+  unsigned aokay = 1;
+  size_t base;
+
+  srandom(0);
+
+  /* Make sure that the activation and net functions are registered
+   * before we count the memory.
+   */
+  nn = nn_create("1 1");
+  nn_link(nn, "0 -l-> 1");
+  nn_destroy(nn);
+  base = xmemused();
+
+  /* Writing an image and reading it back gives the same net. */
+  nn = make_net();
+  nn_write_binary(nn, TESTFILE);
+  rd = nn_read(TESTFILE);
+  if(rd == NULL || !same(nn, rd) || outdiff(nn, rd) != 0) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed read\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed read\n", argv[0]);
+  if(rd) nn_destroy(rd);
+
+  /* A mapped net computes the same thing straight out of the file. */
+  rd = nn_map(TESTFILE);
+  if(rd == NULL || !same(nn, rd) || !mapped(rd) ||
+     outdiff(nn, rd) != 0) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed map\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed map\n", argv[0]);
+
+  /* And it can be written again, even though it is frozen. */
+  if(rd) {
+    nn_write_binary(rd, TESTFILE2);
+    nn_destroy(rd);
+  }
+  rd = nn_map(TESTFILE2);
+  remove(TESTFILE2);
+  if(rd == NULL || !same(nn, rd) || outdiff(nn, rd) != 0) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed rewrite\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed rewrite\n", argv[0]);
+  if(rd) nn_destroy(rd);
+
+  /* A packed net writes the same image. */
+  nn_pack(nn);
+  nn_write_binary(nn, TESTFILE);
+  rd = nn_map(TESTFILE);
+  if(rd == NULL || !same(nn, rd) || outdiff(nn, rd) != 0) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed packed\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed packed\n", argv[0]);
+  if(rd) nn_destroy(rd);
+
+  /* Text files still load, and nn_map() just reads them. */
+  nn_write(nn, TESTFILE);
+  rd = nn_map(TESTFILE);
+  if(rd == NULL || rd->map || !rd->frozen || outdiff(nn, rd) > 1e-10) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed text\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed text\n", argv[0]);
+  if(rd) nn_destroy(rd);
+
+  /* A damaged image is turned away. */
+  nn_write_binary(nn, TESTFILE);
+  if((fp = fopen(TESTFILE, "r+b")) != NULL) {
+    fseek(fp, -8, SEEK_END);
+    fputc(0x55, fp);
+    fclose(fp);
+  }
+  ulog_threshold = ULOG_ERROR;       /* The warning is expected. */
+  rd = nn_read(TESTFILE);
+  ulog_threshold = ULOG_PRINT;
+  if(rd) {
+    aokay = 0;
+    nn_destroy(rd);
+    fprintf(stderr, "%s: failed checksum\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed checksum\n", argv[0]);
+  remove(TESTFILE);
+  nn_destroy(nn);
+
+  if(xmemused() != base) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed leak\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed leak\n", argv[0]);
+
+  exit(!aokay);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
@@ -0,0 +1,237 @@
+
+/* Copyright (c) 2000 by G. W. Flake. */
+
+/* A test for nn_jacobian() and nn_offline_jacobian()... */
+
+#include <nodelib.h>
+#include <stdio.h>
+#include <math.h>
+
+#define EPS 1e-5
+#define NPATS 30
+
+/* The Jacobians that the hook should see, and the worst difference. */
+
+static double *expected, hookerr;
+static unsigned hookcalls;
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+static void hook(unsigned pattern, double *J, void *obj)
+{
+  NN *nn = obj;
+  unsigned i, sz = nn->numin * nn->numout;
+  double e;
+
+  for(i = 0; i < sz; i++) {
+    e = fabs(J[i] - expected[pattern * sz + i]);
+    hookerr = (e > hookerr) ? e : hookerr;
+  }
+  hookcalls++;
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+static void nothing(void *obj, unsigned id)
+{
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Returns the biggest difference between nn_jacobian() and a central
+   difference of the outputs, for a random input. */
+
+static double compare(NN *nn)
+{
+  double x[8], J[64], yp[8], err = 0, e, xi;
+  unsigned i, j;
+
+  for(i = 0; i < nn->numin; i++)
+    x[i] = random_range(-1, 1);
+  nn_jacobian(nn, x, J);
+  for(j = 0; j < nn->numin; j++) {
+    xi = x[j];
+    x[j] = xi + EPS;
+    nn_forward(nn, x);
+    for(i = 0; i < nn->numout; i++)
+      yp[i] = nn->y[i];
+    x[j] = xi - EPS;
+    nn_forward(nn, x);
+    x[j] = xi;
+    for(i = 0; i < nn->numout; i++) {
+      e = fabs(J[i * nn->numin + j] - (yp[i] - nn->y[i]) / (2 * EPS));
+      err = (e > err) ? e : err;
+    }
+  }
+  return(err);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Returns the biggest difference between nn_offline_jacobian(), with
+   the given number of threads and batch size, and nn_jacobian() on
+   each pattern of set.  The hook is checked as well. */
+
+static double offline(NN *nn, DATASET *set, unsigned threads,
+		      unsigned batch)
+{
+  double *J, err = 0, e;
+  unsigned i, k, sz = nn->numin * nn->numout;
+
+  expected = allocate_array(1, sizeof(double), NPATS * sz);
+  J = allocate_array(1, sizeof(double), NPATS * sz);
+  for(k = 0; k < NPATS; k++)
+    nn_jacobian(nn, dataset_x(set, k), expected + k * sz);
+
+  nn_offline_threads = threads;
+  nn_offline_batch = batch;
+  hookerr = 0;
+  hookcalls = 0;
+  if(nn_offline_jacobian(nn, set, J, NULL, NULL) != 0 ||
+     nn_offline_jacobian(nn, set, NULL, hook, nn) != 0)
+    err = 1;
+  nn_offline_threads = 1;
+  nn_offline_batch = 0;
+  for(i = 0; i < NPATS * sz; i++) {
+    e = fabs(J[i] - expected[i]);
+    err = (e > err) ? e : err;
+  }
+  if(hookcalls != NPATS || hookerr > err)
+    err = (hookcalls != NPATS) ? 1 : hookerr;
+  deallocate_array(expected);
+  deallocate_array(J);
+  return(err);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Forget what a recurrent net saw on the last pass. */
+
+static void reset(NN *nn)
+{
+  unsigned i, j;
+  NN_LAYER *l;
+
+  for(i = 0; i < nn->numlayers; i++)
+    for(l = &nn->layers[i], j = 0; j < l->sz; j++) {
+      l->x[j] = l->y[j] = l->dx[j] = l->dy[j] = 0.0;
+      if(l->Rx)
+	l->Rx[j] = l->Ry[j] = l->Rdx[j] = l->Rdy[j] = 0.0;
+    }
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Returns the biggest difference between nn_offline_jacobian() of a
+   recurrent nn with one thread and with the given number. */
+
+static double recurrent(NN *nn, DATASET *set, unsigned threads)
+{
+  double *Ja, *Jb, e, err = 0;
+  unsigned i, sz = NPATS * nn->numin * nn->numout;
+
+  Ja = allocate_array(1, sizeof(double), sz);
+  Jb = allocate_array(1, sizeof(double), sz);
+  reset(nn);
+  nn_offline_jacobian(nn, set, Ja, NULL, NULL);
+  nn_offline_threads = threads;
+  reset(nn);
+  nn_offline_jacobian(nn, set, Jb, NULL, NULL);
+  nn_offline_threads = 1;
+  for(i = 0; i < sz; i++) {
+    e = fabs(Ja[i] - Jb[i]);
+    err = (e > err) ? e : err;
+  }
+  deallocate_array(Ja);
+  deallocate_array(Jb);
+  return(err);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+int main(int argc, char **argv)
+{
+  NN *nn;
+  DATASET *data;
+  double *x;
+  size_t base;
+  unsigned i, k, aokay = 1;
+  char *shapes[2] = { "5 9 2", "2 9 5" };
+
+  srandom(0);
+
+  /* Make sure that the activation and net functions are registered,
+   * and that the pool of threads is as big as it will get, before we
+   * count the memory.
+   */
+  nn = nn_create("1 1");
+  nn_link(nn, "0 -l-> 1");
+  nn_destroy(nn);
+  thread_run(3, nothing, NULL);
+  base = xmemused();
+
+  /* More inputs than outputs (reverse mode) and the other way around
+   * (forward mode).
+   */
+  for(k = 0; k < 2; k++) {
+    nn = nn_create(shapes[k]);
+    nn_link(nn, "0 -l-> 1");
+    nn_link(nn, "1 -l-> 2");
+    nn_link(nn, "0 -d-> 2");
+    nn_init(nn, 0.5);
+    if(compare(nn) > 1e-6) {
+      aokay = 0;
+      fprintf(stderr, "%s: failed single %s\n", argv[0], shapes[k]);
+    }
+    else fprintf(stderr, "%s: passed single %s\n", argv[0], shapes[k]);
+
+    x = allocate_array(1, sizeof(double), NPATS * nn->numin);
+    for(i = 0; i < NPATS * nn->numin; i++)
+      x[i] = random_range(-1, 1);
+    data = dataset_create(&dsm_matrix_method,
+			  dsm_c_matrix(x, nn->numin, 0, NPATS));
+    if(offline(nn, data, 1, 0) > 1e-12 || offline(nn, data, 3, 0) > 1e-12 ||
+       offline(nn, data, 1, 8) > 1e-12 || offline(nn, data, 2, 8) > 1e-12) {
+      aokay = 0;
+      fprintf(stderr, "%s: failed offline %s\n", argv[0], shapes[k]);
+    }
+    else fprintf(stderr, "%s: passed offline %s\n", argv[0], shapes[k]);
+    dsm_destroy_matrix(dataset_destroy(data));
+    deallocate_array(x);
+    nn_destroy(nn);
+  }
+
+  /* A recurrent net must see the patterns in order, so the threads
+   * change nothing at all, in either mode.
+   */
+  for(k = 0; k < 2; k++) {
+    nn = nn_create(shapes[k]);
+    nn_link(nn, "0 -l-> 1");
+    nn_link(nn, "1 -l-> 2");
+    nn_link(nn, "2 -l-> 1");
+    nn_init(nn, 0.5);
+    x = allocate_array(1, sizeof(double), NPATS * nn->numin);
+    for(i = 0; i < NPATS * nn->numin; i++)
+      x[i] = random_range(-1, 1);
+    data = dataset_create(&dsm_matrix_method,
+			  dsm_c_matrix(x, nn->numin, 0, NPATS));
+    if(recurrent(nn, data, 3) != 0) {
+      aokay = 0;
+      fprintf(stderr, "%s: failed recurrent %s\n", argv[0], shapes[k]);
+    }
+    else fprintf(stderr, "%s: passed recurrent %s\n", argv[0], shapes[k]);
+    dsm_destroy_matrix(dataset_destroy(data));
+    deallocate_array(x);
+    nn_destroy(nn);
+  }
+
+  if(xmemused() != base) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed leak\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed leak\n", argv[0]);
+
+  exit(!aokay);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
@@ -0,0 +1,201 @@
+
+/* Copyright (c) 2000 by G. W. Flake. */
+
+/* A test for the net function kernels, which must give exactly the
+   same answers as plain loops for every size... */
+
+#include <nodelib.h>
+#include <stdio.h>
+#include <math.h>
+
+#define MAXSZ 33
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+static void fill(double *x, unsigned n)
+{
+  unsigned i;
+
+  for(i = 0; i < n; i++)
+    x[i] = random_range(-1, 1);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+static int differ(double *x, double *y, unsigned n)
+{
+  unsigned i;
+
+  for(i = 0; i < n; i++)
+    if(x[i] != y[i]) return(1);
+  return(0);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Try every kernel on an m by n problem, and return nonzero if any of
+   them disagree with the obvious loops. */
+
+static int compare(unsigned m, unsigned n)
+{
+  double **u, **v, **Ru, **du, **dv, ***A;
+  double *y, *Ry, *a, *Ra, *dx, *Rdx, *x, *xr, *dy, *dyr;
+  double sum, sum1, sum2;
+  unsigned i, j, k, bad = 0;
+
+  u = allocate_array(2, sizeof(double), m, n + 3);
+  v = allocate_array(2, sizeof(double), m, n);
+  Ru = allocate_array(2, sizeof(double), m, n);
+  du = allocate_array(2, sizeof(double), m, n);
+  dv = allocate_array(2, sizeof(double), m, n);
+  A = allocate_array(3, sizeof(double), m, n, n);
+  y = allocate_array(1, sizeof(double), n);
+  Ry = allocate_array(1, sizeof(double), n);
+  dy = allocate_array(1, sizeof(double), n);
+  dyr = allocate_array(1, sizeof(double), n);
+  a = allocate_array(1, sizeof(double), m);
+  Ra = allocate_array(1, sizeof(double), m);
+  dx = allocate_array(1, sizeof(double), m);
+  Rdx = allocate_array(1, sizeof(double), m);
+  x = allocate_array(1, sizeof(double), m);
+  xr = allocate_array(1, sizeof(double), m);
+  fill(u[0], m * (n + 3)); fill(v[0], m * n); fill(Ru[0], m * n);
+  fill(A[0][0], m * n * n); fill(y, n); fill(Ry, n); fill(a, m);
+  fill(Ra, m); fill(dx, m); fill(Rdx, m); fill(x, m); fill(dy, n);
+
+  /* Forward kernels. */
+  for(i = 0; i < m; i++) {
+    sum = 0;
+    for(j = 0; j < n; j++)
+      sum += u[i][j] * y[j];
+    xr[i] = x[i] + (sum + a[i]);
+  }
+  nn_kern_matvec(x, u, y, a, m, n, 1);
+  bad |= differ(x, xr, m);
+  for(i = 0; i < m; i++) {
+    sum = 0;
+    for(j = 0; j < n; j++)
+      sum += u[i][j] * y[j];
+    xr[i] = sum + a[i];
+  }
+  nn_kern_matvec(x, u, y, a, m, n, 0);
+  bad |= differ(x, xr, m);
+  for(i = 0; i < m; i++) {
+    sum = 0;
+    for(j = 0; j < n; j++)
+      sum += Ry[j] * u[i][j] + Ru[i][j] * y[j];
+    xr[i] += sum + Ra[i];
+  }
+  nn_kern_matvec_R(x, u, Ru, y, Ry, Ra, m, n);
+  bad |= differ(x, xr, m);
+  for(i = 0; i < m; i++) {
+    sum = 0;
+    for(j = 0; j < n; j++)
+      sum += u[i][j] * y[j] + v[i][j] * y[j] * y[j];
+    xr[i] += sum + a[i];
+  }
+  nn_kern_diagvec(x, u, v, y, a, m, n);
+  bad |= differ(x, xr, m);
+  for(i = 0; i < m; i++) {
+    sum = 0;
+    for(j = 0; j < n; j++) {
+      for(k = 0; k < n; k++)
+	sum += A[i][j][k] * y[j] * y[k];
+      sum += u[i][j] * y[j];
+    }
+    xr[i] += sum + a[i];
+  }
+  nn_kern_quadvec(x, A, u, y, a, m, n);
+  bad |= differ(x, xr, m);
+
+  /* Backward kernels, including one with a column offset. */
+  for(j = 0; j < n; j++) {
+    sum = 0;
+    for(i = 0; i < m; i++)
+      sum += dx[i] * u[i][j + 3];
+    dyr[j] = dy[j] + sum;
+  }
+  nn_kern_vecmat(dy, dx, u, 3, m, n, 1);
+  bad |= differ(dy, dyr, n);
+  for(j = 0; j < n; j++) {
+    sum = 0;
+    for(i = 0; i < m; i++)
+      sum += dx[i] * u[i][j];
+    dyr[j] = sum;
+  }
+  nn_kern_vecmat(dy, dx, u, 0, m, n, 0);
+  bad |= differ(dy, dyr, n);
+  for(j = 0; j < n; j++) {
+    sum = 0;
+    for(i = 0; i < m; i++)
+      sum += Rdx[i] * u[i][j] + Ru[i][j] * dx[i];
+    dyr[j] += sum;
+  }
+  nn_kern_vecmat_R(dy, dx, Rdx, u, Ru, m, n);
+  bad |= differ(dy, dyr, n);
+  for(j = 0; j < n; j++) {
+    sum = 0;
+    for(i = 0; i < m; i++)
+      sum += dx[i] * (u[i][j] + 2.0 * v[i][j] * y[j]);
+    dyr[j] += sum;
+  }
+  nn_kern_diagvecmat(dy, dx, u, v, y, m, n);
+  bad |= differ(dy, dyr, n);
+  for(j = 0; j < n; j++) {
+    sum1 = 0;
+    for(i = 0; i < m; i++) {
+      sum2 = 0;
+      for(k = 0; k < n; k++)
+	sum2 += (A[i][j][k] + A[i][k][j]) * y[k];
+      sum1 += (u[i][j] + sum2 - A[i][j][j] * y[j]) * dx[i];
+    }
+    dyr[j] += sum1;
+  }
+  nn_kern_quadvecmat(dy, dx, A, u, y, m, n);
+  bad |= differ(dy, dyr, n);
+
+  /* Outer products. */
+  nn_kern_outer(du, dx, y, m, n);
+  for(i = 0; i < m; i++)
+    for(j = 0; j < n; j++)
+      if(du[i][j] != dx[i] * y[j]) bad = 1;
+  nn_kern_outer_R(du, dx, Rdx, y, Ry, m, n);
+  for(i = 0; i < m; i++)
+    for(j = 0; j < n; j++)
+      if(du[i][j] != Rdx[i] * y[j] + Ry[j] * dx[i]) bad = 1;
+  nn_kern_diagouter(du, dv, dx, y, m, n);
+  for(i = 0; i < m; i++)
+    for(j = 0; j < n; j++)
+      if(du[i][j] != dx[i] * y[j] || dv[i][j] != dx[i] * y[j] * y[j])
+	bad = 1;
+
+  deallocate_array(u); deallocate_array(v); deallocate_array(Ru);
+  deallocate_array(du); deallocate_array(dv); deallocate_array(A);
+  deallocate_array(y); deallocate_array(Ry); deallocate_array(dy);
+  deallocate_array(dyr); deallocate_array(a); deallocate_array(Ra);
+  deallocate_array(dx); deallocate_array(Rdx); deallocate_array(x);
+  deallocate_array(xr);
+  return(bad);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+int main(int argc, char **argv)
+{
+  unsigned sizes[] = { 1, 3, 4, 5, 7, 8, 9, 12, 16, 17, MAXSZ };
+  unsigned nsizes = sizeof(sizes) / sizeof(sizes[0]);
+  unsigned i, j, aokay = 1;
+
+  srandom(0);
+  for(i = 0; i < nsizes; i++)
+    for(j = 0; j < nsizes; j++)
+      if(compare(sizes[i], sizes[j])) {
+	aokay = 0;
+	fprintf(stderr, "%s: failed %u by %u\n", argv[0], sizes[i], sizes[j]);
+      }
+  if(aokay)
+    fprintf(stderr, "%s: passed\n", argv[0]);
+  exit(!aokay);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
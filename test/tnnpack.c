@@ -0,0 +1,131 @@
+
+/* Copyright (c) 2000 by G. W. Flake. */
+
+/* A test for nn_pack()... */
+
+#include <nodelib.h>
+#include <stdio.h>
+#include <math.h>
+
+#define NPATS 50
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+static NN *make_nn(void)
+{
+  NN *nn;
+
+  srandom(0);
+  nn = nn_create("3 5 (2 2)");
+  nn_link(nn, "0 -l-> 1");
+  nn_link(nn, "1 -l-> 2");
+  nn_link(nn, "0 -q-> (2 1)");
+  nn_set_actfunc(nn, 2, 0, "linear");
+  nn_init(nn, 0.5);
+  return(nn);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Returns nonzero if the packed vectors do not line up with the
+   weight and gradient pointers. */
+
+static int bad_layout(NN *nn)
+{
+  unsigned i;
+
+  if(((size_t)nn->wvec % 64) != 0 || ((size_t)nn->gvec % 64) != 0)
+    return(1);
+  for(i = 0; i < nn->numweights; i++)
+    if(nn->weights[i] != &nn->wvec[i] || nn->grads[i] != &nn->gvec[i])
+      return(1);
+  return(0);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Returns nonzero if the two nets have different weights. */
+
+static int bad_weights(NN *nn1, NN *nn2)
+{
+  unsigned i;
+
+  if(nn1->numweights != nn2->numweights)
+    return(1);
+  for(i = 0; i < nn1->numweights; i++)
+    if(*nn1->weights[i] != *nn2->weights[i])
+      return(1);
+  return(0);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+int main(int argc, char **argv)
+{
+  void (*engines[])(OPTIMIZER *opt, int state) = {
+    opt_conjgrad_pr, opt_quasinewton_bfgs, opt_levenberg_marquardt,
+    opt_gradient_descent
+  };
+  NN *nn1, *nn2;
+  DATASET *data;
+  double *x;
+  unsigned i, k, aokay = 1;
+
+  nn1 = make_nn();
+  nn2 = make_nn();
+  nn_lock_link(nn1, 1);
+  nn_lock_link(nn2, 1);
+  nn_pack(nn2);
+  if(bad_layout(nn2) || bad_weights(nn1, nn2)) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed layout\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed layout\n", argv[0]);
+
+  srandom(0);
+  x = allocate_array(1, sizeof(double), NPATS * (nn1->numin + nn1->numout));
+  for(i = 0; i < NPATS * (nn1->numin + nn1->numout); i++)
+    x[i] = random_range(-1, 1);
+  data = dataset_create(&dsm_matrix_method,
+			dsm_c_matrix(x, nn1->numin, nn1->numout, NPATS));
+
+  /* Every engine must take exactly the same steps either way. */
+  for(k = 0; k < sizeof(engines) / sizeof(engines[0]); k++) {
+    nn1->info.train_set = nn2->info.train_set = data;
+    nn1->info.opt.engine = nn2->info.opt.engine = engines[k];
+    nn1->info.opt.max_epochs = nn2->info.opt.max_epochs = 10;
+    nn1->info.opt.delta_error_tol = nn2->info.opt.delta_error_tol = -1;
+    nn1->info.opt.wdecay = nn2->info.opt.wdecay = 0.001;
+    nn_train(nn1);
+    nn_train(nn2);
+    if(bad_weights(nn1, nn2) || nn1->info.opt.error != nn2->info.opt.error) {
+      aokay = 0;
+      fprintf(stderr, "%s: failed engine %d\n", argv[0], k);
+    }
+    else fprintf(stderr, "%s: passed engine %d\n", argv[0], k);
+  }
+
+  /* Changing the links must keep the weights and the layout. */
+  nn_unlock_link(nn1, 1);
+  nn_unlock_link(nn2, 1);
+  nn_link(nn1, "0 -l-> (2 0)");
+  nn_link(nn2, "0 -l-> (2 0)");
+  for(i = 0; i < nn1->numweights; i++)
+    *nn1->weights[i] = *nn2->weights[i];
+  nn_lock_link(nn1, 0);
+  nn_lock_link(nn2, 0);
+  if(bad_layout(nn2) || bad_weights(nn1, nn2) ||
+     nn_offline_test(nn1, data, NULL) != nn_offline_test(nn2, data, NULL)) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed relink\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed relink\n", argv[0]);
+
+  dsm_destroy_matrix(dataset_destroy(data));
+  deallocate_array(x);
+  nn_destroy(nn1);
+  nn_destroy(nn2);
+  exit(!aokay);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
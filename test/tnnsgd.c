@@ -0,0 +1,173 @@
+
+/* Copyright (c) 2000 by G. W. Flake. */
+
+/* A test for mini-batch gradients and the stochastic engines... */
+
+#include <nodelib.h>
+#include <stdio.h>
+#include <math.h>
+
+#define NPATS 500
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Returns the biggest difference between the gradient of nn over all
+   of set and the mini-batch gradient over every pattern, shuffled,
+   with the given number of threads. */
+
+static double minibatch(NN *nn, DATASET *set, unsigned threads)
+{
+  double *ga, *gb, ea, eb, e, err;
+  unsigned index[NPATS], i, j, k;
+
+  ga = allocate_array(1, sizeof(double), nn->numweights);
+  gb = allocate_array(1, sizeof(double), nn->numweights);
+  for(i = 0; i < NPATS; i++)
+    index[i] = i;
+  for(i = NPATS - 1; i > 0; i--) {
+    j = random() % (i + 1);
+    k = index[i]; index[i] = index[j]; index[j] = k;
+  }
+  ea = nn_offline_grad(nn, set, NULL);
+  nn_get_grads(nn, ga);
+  nn_offline_threads = threads;
+  eb = nn_minibatch_grad(nn, set, index, NPATS);
+  nn_offline_threads = 1;
+  nn_get_grads(nn, gb);
+  err = fabs(ea - eb);
+  for(i = 0; i < nn->numweights; i++) {
+    e = fabs(ga[i] - gb[i]);
+    err = (e > err) ? e : err;
+  }
+  deallocate_array(ga);
+  deallocate_array(gb);
+  return(err);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Train a fresh net on set for a few epochs with the given engine,
+   and return the ratio of the final error to the starting error.  A
+   batch of zero means full gradients. */
+
+static double train(DATASET *set, void (*engine)(OPTIMIZER *opt, int state),
+		    double rate, int nesterov, unsigned batch)
+{
+  NN *nn;
+  double before, after;
+  unsigned steps;
+
+  nn = nn_create("2 8 1");
+  nn_link(nn, "0 -l-> 1");
+  nn_link(nn, "1 -l-> 2");
+  nn_set_actfunc(nn, 2, 0, "linear");
+  nn_init(nn, 0.5);
+  nn->info.train_set = set;
+  nn->info.opt.engine = engine;
+  nn->info.opt.max_epochs = 20;
+  nn->info.opt.min_epochs = 20;
+  nn->info.opt.delta_error_tol = -1e10;
+  nn->info.opt.rate = rate;
+  nn->info.opt.momentum = 0.9;
+  nn->info.opt.batch = batch;
+  nn->info.opt.nesterov = nesterov;
+  before = nn_offline_test(nn, set, NULL);
+  nn_train(nn);
+  after = nn_offline_test(nn, set, NULL);
+  steps = batch ? (NPATS + batch - 1) / batch : 1;
+  if(nn->info.opt.gcalls != 20 * steps)
+    after = before;
+  nn_destroy(nn);
+  return(after / before);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+static void nothing(void *obj, unsigned id)
+{
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+int main(int argc, char **argv)
+{
+  NN *nn;
+  DATASET *data;
+  double *x;
+  unsigned i, aokay = 1;
+  size_t base;
+
+  srandom(0);
+
+  /* Make sure that the pool of threads is as big as it will get
+   * before we count the memory.
+   */
+  nn = nn_create("1 1");
+  nn_link(nn, "0 -l-> 1");
+  nn_destroy(nn);
+  thread_run(3, nothing, NULL);
+  base = xmemused();
+
+  x = allocate_array(1, sizeof(double), NPATS * 3);
+  for(i = 0; i < NPATS; i++) {
+    x[3 * i] = random_range(-1, 1);
+    x[3 * i + 1] = random_range(-1, 1);
+    x[3 * i + 2] = sin(2 * x[3 * i]) * x[3 * i + 1];
+  }
+  data = dataset_create(&dsm_matrix_method, dsm_c_matrix(x, 2, 1, NPATS));
+
+  /* A mini-batch of everything is the full gradient, in any order. */
+  nn = nn_create("2 5 1");
+  nn_link(nn, "0 -l-> 1");
+  nn_link(nn, "1 -l-> 2");
+  nn_init(nn, 0.5);
+  if(minibatch(nn, data, 1) > 1e-12 || minibatch(nn, data, 3) > 1e-12) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed minibatch\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed minibatch\n", argv[0]);
+  nn_destroy(nn);
+
+  /* A few epochs of small steps should make a big dent. */
+  if(train(data, opt_stochastic_descent, 0.1, 0, 16) > 0.2) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed momentum\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed momentum\n", argv[0]);
+  if(train(data, opt_stochastic_descent, 0.1, 1, 16) > 0.2) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed nesterov\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed nesterov\n", argv[0]);
+
+  /* The adaptive engines, with mini-batches and with full gradients. */
+  if(train(data, opt_adam, 0.01, 0, 16) > 0.2 ||
+     train(data, opt_adam, 0.05, 0, 0) > 0.5) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed adam\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed adam\n", argv[0]);
+  if(train(data, opt_rmsprop, 0.003, 0, 16) > 0.2) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed rmsprop\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed rmsprop\n", argv[0]);
+  if(train(data, opt_adagrad, 0.05, 0, 16) > 0.2) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed adagrad\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed adagrad\n", argv[0]);
+
+  dsm_destroy_matrix(dataset_destroy(data));
+  deallocate_array(x);
+
+  if(xmemused() != base) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed leak\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed leak\n", argv[0]);
+
+  exit(!aokay);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
@@ -0,0 +1,189 @@
+
+/* Copyright (c) 2000 by G. W. Flake. */
+
+/* A test for nn_set_single()... */
+
+#include <nodelib.h>
+#include <stdio.h>
+#include <math.h>
+
+#define NPATS 200
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+static double rel_diff(double *a, double *b, unsigned n)
+{
+  double err, maxerr = 0;
+  unsigned i;
+
+  for(i = 0; i < n; i++) {
+    err = fabs(a[i] - b[i]) / (fabs(a[i]) + 1);
+    maxerr = (err > maxerr) ? err : maxerr;
+  }
+  return(maxerr);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Run some patterns through nn in double and single precision, and
+   return the biggest relative difference in the outputs, weight
+   derivatives, and input derivatives. */
+
+static double compare(NN *nn)
+{
+  double *x, *dedy, *y, *g, *dx, *gs, err = 0, e;
+  unsigned i, k;
+
+  x = allocate_array(1, sizeof(double), nn->numin);
+  dedy = allocate_array(1, sizeof(double), nn->numout);
+  y = allocate_array(1, sizeof(double), nn->numout);
+  dx = allocate_array(1, sizeof(double), nn->numin);
+  g = allocate_array(1, sizeof(double), nn->numweights);
+  gs = allocate_array(1, sizeof(double), nn->numweights);
+  for(k = 0; k < 5; k++) {
+    for(i = 0; i < nn->numin; i++)
+      x[i] = random_range(-1, 1);
+    for(i = 0; i < nn->numout; i++)
+      dedy[i] = random_range(-1, 1);
+
+    nn_set_single(nn, 0);
+    nn_forward(nn, x);
+    nn_backward(nn, dedy);
+    for(i = 0; i < nn->numout; i++)
+      y[i] = nn->y[i];
+    for(i = 0; i < nn->numin; i++)
+      dx[i] = nn->dx[i];
+    nn_get_grads(nn, g);
+
+    nn_set_single(nn, 1);
+    nn_forward(nn, x);
+    nn_backward(nn, dedy);
+    nn_get_grads(nn, gs);
+    if((e = rel_diff(y, nn->y, nn->numout)) > err) err = e;
+    if((e = rel_diff(dx, nn->dx, nn->numin)) > err) err = e;
+    if((e = rel_diff(g, gs, nn->numweights)) > err) err = e;
+  }
+  deallocate_array(x);
+  deallocate_array(dedy);
+  deallocate_array(y);
+  deallocate_array(dx);
+  deallocate_array(g);
+  deallocate_array(gs);
+  return(err);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+int main(int argc, char **argv)
+{
+  NN *nn;
+  DATASET *data;
+  double *x, *g, *gs, *w, *y, e, es;
+  unsigned i, k, aokay = 1;
+
+  srandom(0);
+
+  /* A plain MLP, with layers that are not a multiple of the vector
+   * width.
+   */
+  nn = nn_create("7 37 21 3");
+  nn_link(nn, "0 -l-> 1");
+  nn_link(nn, "1 -l-> 2");
+  nn_link(nn, "2 -l-> 3");
+  nn_set_actfunc(nn, 3, 0, "linear");
+  nn_init(nn, 0.5);
+  if(compare(nn) > 1e-5) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed mlp\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed mlp\n", argv[0]);
+
+  /* New weights from nn_init() and nn_set_weights() are seen by the
+   * next forward pass.
+   */
+  x = allocate_array(1, sizeof(double), nn->numin);
+  y = allocate_array(1, sizeof(double), nn->numout);
+  w = allocate_array(1, sizeof(double), nn->numweights);
+  for(i = 0; i < nn->numin; i++)
+    x[i] = random_range(-1, 1);
+  e = 0;
+  for(k = 0; k < 2; k++) {
+    nn_set_single(nn, 1);
+    if(k == 0)
+      nn_init(nn, 0.5);
+    else {
+      nn_get_weights(nn, w);
+      for(i = 0; i < nn->numweights; i++)
+	w[i] = -w[i];
+      nn_set_weights(nn, w);
+    }
+    nn_forward(nn, x);
+    for(i = 0; i < nn->numout; i++)
+      y[i] = nn->y[i];
+    nn_set_single(nn, 0);
+    nn_forward(nn, x);
+    if((es = rel_diff(y, nn->y, nn->numout)) > e) e = es;
+  }
+  if(e > 1e-5) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed set\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed set\n", argv[0]);
+  deallocate_array(x);
+  deallocate_array(y);
+  deallocate_array(w);
+
+  /* The offline routines must pick up new weights, with or without
+   * threads.
+   */
+  x = allocate_array(1, sizeof(double), NPATS * (nn->numin + nn->numout));
+  for(i = 0; i < NPATS * (nn->numin + nn->numout); i++)
+    x[i] = random_range(-1, 1);
+  data = dataset_create(&dsm_matrix_method,
+			dsm_c_matrix(x, nn->numin, nn->numout, NPATS));
+  g = allocate_array(1, sizeof(double), nn->numweights);
+  gs = allocate_array(1, sizeof(double), nn->numweights);
+  for(k = 0; k < 2; k++) {
+    nn_offline_threads = k + 1;
+    nn_set_single(nn, 1);
+    for(i = 0; i < nn->numweights; i++)
+      *nn->weights[i] = random_range(-0.5, 0.5);
+    es = nn_offline_grad(nn, data, NULL);
+    nn_get_grads(nn, gs);
+    nn_set_single(nn, 0);
+    e = nn_offline_grad(nn, data, NULL);
+    nn_get_grads(nn, g);
+    if(fabs(e - es) > 1e-5 * e || rel_diff(g, gs, nn->numweights) > 1e-5) {
+      aokay = 0;
+      fprintf(stderr, "%s: failed offline %d\n", argv[0], k + 1);
+    }
+    else fprintf(stderr, "%s: passed offline %d\n", argv[0], k + 1);
+  }
+  nn_offline_threads = 1;
+  deallocate_array(g);
+  deallocate_array(gs);
+  dsm_destroy_matrix(dataset_destroy(data));
+  deallocate_array(x);
+  nn_destroy(nn);
+
+  /* Slabs, and links that cannot be fused. */
+  nn = nn_create("3 20 (17 2) (2 1)");
+  nn_link(nn, "0 -l-> 1");
+  nn_link(nn, "1 -l-> 2");
+  nn_link(nn, "1 -q-> (2 1)");
+  nn_link(nn, "2 -l-> 3");
+  nn_link(nn, "0 -l-> (3 1)");
+  nn_set_actfunc(nn, 2, 1, "logistic");
+  nn_set_actfunc(nn, 3, 0, "linear");
+  nn_init(nn, 0.5);
+  if(compare(nn) > 1e-5) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed slabs\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed slabs\n", argv[0]);
+  nn_destroy(nn);
+
+  exit(!aokay);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
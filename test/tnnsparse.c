@@ -0,0 +1,269 @@
+
+/* Copyright (c) 2000 by G. W. Flake. */
+
+/* A test for the sparse linear net function... */
+
+#include <nodelib.h>
+#include <stdio.h>
+#include <math.h>
+
+#define EPS 1e-5
+#define NPATS 40
+#define TESTFILE "/tmp/tnnsparse.net"
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Put the gradient of the error of nn at (x, t) in g, and return the
+   error. */
+
+static double grad(NN *nn, double *x, double *t, double *g)
+{
+  double dedy[8], d2, e = 0;
+  unsigned i;
+
+  nn_forward(nn, x);
+  for(i = 0; i < nn->numout; i++)
+    e += nn->info.error_function(nn->y[i], t[i], &dedy[i], &d2);
+  nn_backward(nn, dedy);
+  if(g) nn_get_grads(nn, g);
+  return(e);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Returns the biggest difference between the gradient and nn_Hv() of
+   nn and central differences of the error and of the gradient, for a
+   random pattern and vector. */
+
+static double compare(NN *nn)
+{
+  double x[8], t[8], *v, *w, *g, *gp, *gm, *hv, err = 0, e, ep, em;
+  unsigned i, j;
+
+  v = allocate_array(1, sizeof(double), nn->numweights);
+  w = allocate_array(1, sizeof(double), nn->numweights);
+  g = allocate_array(1, sizeof(double), nn->numweights);
+  gp = allocate_array(1, sizeof(double), nn->numweights);
+  gm = allocate_array(1, sizeof(double), nn->numweights);
+  hv = allocate_array(1, sizeof(double), nn->numweights);
+  for(i = 0; i < nn->numin; i++)
+    x[i] = random_range(-1, 1);
+  for(i = 0; i < nn->numout; i++)
+    t[i] = random_range(-1, 1);
+  for(i = 0; i < nn->numweights; i++)
+    v[i] = random_range(-1, 1);
+
+  nn_get_weights(nn, w);
+  grad(nn, x, t, g);
+  for(j = 0; j < nn->numweights; j++) {
+    *nn->weights[j] = w[j] + EPS;
+    ep = grad(nn, x, t, NULL);
+    *nn->weights[j] = w[j] - EPS;
+    em = grad(nn, x, t, NULL);
+    *nn->weights[j] = w[j];
+    e = fabs(g[j] - (ep - em) / (2 * EPS));
+    err = (e > err) ? e : err;
+  }
+
+  for(i = 0; i < nn->numweights; i++)
+    *nn->weights[i] = w[i] + EPS * v[i];
+  grad(nn, x, t, gp);
+  for(i = 0; i < nn->numweights; i++)
+    *nn->weights[i] = w[i] - EPS * v[i];
+  grad(nn, x, t, gm);
+  nn_set_weights(nn, w);
+
+  nn_Hv(nn, x, t, v);
+  nn_get_Rgrads(nn, hv);
+  for(i = 0; i < nn->numweights; i++) {
+    e = fabs(hv[i] - (gp[i] - gm[i]) / (2 * EPS));
+    err = (e > err) ? e : err;
+  }
+  deallocate_array(v); deallocate_array(w); deallocate_array(g);
+  deallocate_array(gp); deallocate_array(gm); deallocate_array(hv);
+  return(err);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Returns the biggest difference between the outputs of a and b over
+   some random patterns. */
+
+static double outdiff(NN *a, NN *b)
+{
+  double x[8], e, err = 0;
+  unsigned i, k;
+
+  for(k = 0; k < NPATS; k++) {
+    for(i = 0; i < a->numin; i++)
+      x[i] = random_range(-1, 1);
+    nn_forward(a, x);
+    nn_forward(b, x);
+    for(i = 0; i < a->numout; i++) {
+      e = fabs(a->y[i] - b->y[i]);
+      err = (e > err) ? e : err;
+    }
+  }
+  return(err);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Make a net with a sparse hidden layer and a sparse output layer,
+   where each link keeps about a third of its connections. */
+
+static NN *make_sparse(void)
+{
+  NN *nn;
+  int mask[8 * 12];
+  unsigned i;
+
+  nn = nn_create("8 12 3");
+  nn_link(nn, "0 -x-> 1");
+  nn_link(nn, "1 -x-> 2");
+  nn_set_actfunc(nn, 2, 0, "linear");
+  for(i = 0; i < 8 * 12; i++)
+    mask[i] = (random_range(0, 1) < 0.33);
+  nn_set_sparse_mask(nn, 0, mask);
+  for(i = 0; i < 3 * 12; i++)
+    mask[i] = (random_range(0, 1) < 0.33);
+  nn_set_sparse_mask(nn, 1, mask);
+  nn_init(nn, 0.5);
+  return(nn);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+int main(int argc, char **argv)
+{
+  NN *nn, *dense, *rd;
+  DATASET *data;
+  double *w, *x, **u, e;
+  int mask[6 * 4];
+  unsigned i, j, k, n, aokay = 1;
+  size_t base;
+
+  srandom(0);
+
+  /* Make sure that the activation and net functions are registered
+   * before we count the memory.
+   */
+  nn = nn_create("1 1");
+  nn_link(nn, "0 -l-> 1");
+  nn_destroy(nn);
+  base = xmemused();
+
+  /* A fully connected sparse link is just a linear link. */
+  nn = nn_create("7 37 3");
+  nn_link(nn, "0 -x-> 1");
+  nn_link(nn, "1 -x-> 2");
+  dense = nn_create("7 37 3");
+  nn_link(dense, "0 -l-> 1");
+  nn_link(dense, "1 -l-> 2");
+  nn_init(nn, 0.5);
+  w = allocate_array(1, sizeof(double), nn->numweights);
+  nn_get_weights(nn, w);
+  nn_set_weights(dense, w);
+  deallocate_array(w);
+  if(nn->numweights != dense->numweights || outdiff(nn, dense) > 1e-12) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed full\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed full\n", argv[0]);
+  nn_destroy(dense);
+  nn_destroy(nn);
+
+  /* The gradient and Hv of a sparse net, packed or not. */
+  nn = make_sparse();
+  n = nn->links[0]->start[12] + nn->links[1]->start[3] + 12 + 3;
+  if(nn->numweights != n || compare(nn) > 1e-6) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed Hv\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed Hv\n", argv[0]);
+  nn_pack(nn);
+  if(compare(nn) > 1e-6) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed packed\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed packed\n", argv[0]);
+
+  /* Writing and reading keeps the connections and the weights. */
+  nn_write(nn, TESTFILE);
+  rd = nn_read(TESTFILE);
+  remove(TESTFILE);
+  if(rd == NULL || rd->numweights != nn->numweights ||
+     outdiff(nn, rd) > 1e-10) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed io\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed io\n", argv[0]);
+  if(rd) nn_destroy(rd);
+  nn_destroy(nn);
+
+  /* Dropping connections keeps the weights of the others. */
+  nn = nn_create("4 6");
+  nn_link(nn, "0 -x-> 1");
+  nn_init(nn, 0.5);
+  nn_pack(nn);
+  u = allocate_array(2, sizeof(double), 6, 4);
+  for(i = 0; i < 6; i++)
+    for(j = 0; j < 4; j++) {
+      u[i][j] = nn->links[0]->u[i][j];
+      mask[i * 4 + j] = (i + j) % 3 != 0;
+    }
+  nn_set_sparse_mask(nn, 0, mask);
+  for(i = 0; i < 6; i++)
+    for(k = nn->links[0]->start[i]; k < nn->links[0]->start[i + 1]; k++)
+      if(nn->links[0]->u[0][k] != u[i][nn->links[0]->index[k]] ||
+	 !mask[i * 4 + nn->links[0]->index[k]])
+	aokay = 0;
+  if(!aokay || nn->links[0]->start[6] != 16 || nn->numweights != 16 + 6) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed keep\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed keep\n", argv[0]);
+  deallocate_array(u);
+
+  /* nn_solve() finds a sparse linear map exactly. */
+  nn_set_actfunc(nn, 1, 0, "linear");
+  x = allocate_array(1, sizeof(double), NPATS * (4 + 6));
+  for(k = 0; k < NPATS; k++) {
+    for(i = 0; i < 4; i++)
+      x[k * 10 + i] = random_range(-1, 1);
+    nn_forward(nn, &x[k * 10]);
+    for(i = 0; i < 6; i++)
+      x[k * 10 + 4 + i] = nn->y[i];
+  }
+  data = dataset_create(&dsm_matrix_method,
+			dsm_c_matrix(x, 4, 6, NPATS));
+  w = allocate_array(1, sizeof(double), nn->numweights);
+  nn_get_weights(nn, w);
+  for(i = 0; i < nn->numweights; i++)
+    *nn->weights[i] = random_range(-0.5, 0.5);
+  e = 0;
+  if(nn_solve(nn, data, 0) != 0)
+    e = 1;
+  for(i = 0; i < nn->numweights; i++)
+    if(fabs(*nn->weights[i] - w[i]) > e)
+      e = fabs(*nn->weights[i] - w[i]);
+  if(e > 1e-8) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed solve\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed solve\n", argv[0]);
+  deallocate_array(w);
+  dsm_destroy_matrix(dataset_destroy(data));
+  deallocate_array(x);
+  nn_destroy(nn);
+
+  if(xmemused() != base) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed leak\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed leak\n", argv[0]);
+
+  exit(!aokay);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
@@ -0,0 +1,214 @@
+
+/* Copyright (c) 2000 by G. W. Flake. */
+
+/* A test for the threaded versions of nn_offline_grad()... */
+
+#include <nodelib.h>
+#include <stdio.h>
+#include <math.h>
+#include <unistd.h>
+
+#define NPATS 1000
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+static double grad_diff(double *g1, double *g2, unsigned n)
+{
+  double err, maxerr = 0;
+  unsigned i;
+
+  for(i = 0; i < n; i++) {
+    err = fabs(g1[i] - g2[i]) / (fabs(g1[i]) + 1);
+    maxerr = (err > maxerr) ? err : maxerr;
+  }
+  return(maxerr);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* A DATASET that passes everything on to a real one, but sleeps a
+   little on each pattern so that the threads take turns. */
+
+static unsigned slow_size(void *instance)
+{
+  return(dataset_size(instance));
+}
+
+static unsigned slow_x_size(void *instance)
+{
+  return(dataset_x_size(instance));
+}
+
+static unsigned slow_y_size(void *instance)
+{
+  return(dataset_y_size(instance));
+}
+
+static double *slow_x(void *instance, unsigned index)
+{
+  usleep(10);
+  return(dataset_x(instance, index));
+}
+
+static double *slow_y(void *instance, unsigned index)
+{
+  return(dataset_y(instance, index));
+}
+
+static DATASET_METHOD slow_method = {
+  slow_size,
+  slow_x_size,
+  slow_y_size,
+  slow_x,
+  slow_y
+};
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Forget what a recurrent net saw on the last pass. */
+
+static void reset(NN *nn)
+{
+  unsigned i, j;
+
+  for(i = 0; i < nn->numlayers; i++)
+    for(j = 0; j < nn->layers[i].sz; j++)
+      nn->layers[i].x[j] = nn->layers[i].y[j] =
+	nn->layers[i].dx[j] = nn->layers[i].dy[j] = 0.0;
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+int main(int argc, char **argv)
+{
+  NN *nn;
+  DATASET *data, *matrix;
+  double *x, *g, *gd, *gt, e, ed, et, eg;
+  unsigned i, nw, aokay = 1;
+
+  srandom(0);
+
+  nn = nn_create("4 8 (2 3)");
+  nn_link(nn, "0 -l-> 1");
+  nn_link(nn, "1 -l-> 2");
+  nn_link(nn, "0 -l-> (2 1)");
+  nn_set_actfunc(nn, 2, 0, "linear");
+  nn_set_actfunc(nn, 2, 1, "logistic");
+  nn_init(nn, 0.5);
+  nw = nn->numweights;
+  nn_lock_link(nn, 2);
+
+  x = allocate_array(1, sizeof(double), NPATS * (nn->numin + nn->numout));
+  for(i = 0; i < NPATS * (nn->numin + nn->numout); i++)
+    x[i] = random_range(-1, 1);
+  data = dataset_create(&dsm_matrix_method,
+			dsm_c_matrix(x, nn->numin, nn->numout, NPATS));
+
+  g = allocate_array(1, sizeof(double), nw);
+  gd = allocate_array(1, sizeof(double), nw);
+  gt = allocate_array(1, sizeof(double), nw);
+
+  /* The serial answer. */
+  e = nn_offline_grad(nn, data, NULL);
+  nn_get_grads(nn, g);
+
+  /* Deterministic sums must not depend on the number of threads. */
+  nn_offline_deterministic = 1;
+  nn_offline_chunk = 37;
+  nn_offline_threads = 1;
+  ed = nn_offline_grad(nn, data, NULL);
+  nn_get_grads(nn, gd);
+  nn_offline_threads = 4;
+  et = nn_offline_grad(nn, data, NULL);
+  nn_get_grads(nn, gt);
+  if(ed != et || grad_diff(gd, gt, nn->numweights) != 0) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed deterministic\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed deterministic\n", argv[0]);
+
+  /* Unordered sums, with batches, should agree to rounding error. */
+  nn_offline_deterministic = 0;
+  nn_offline_batch = 5;
+  et = nn_offline_grad(nn, data, NULL);
+  nn_get_grads(nn, gt);
+  if(fabs(e - et) > 1e-12 || grad_diff(g, gt, nn->numweights) > 1e-12 ||
+     fabs(e - ed) > 1e-12 || grad_diff(g, gd, nn->numweights) > 1e-12) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed threaded\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed threaded\n", argv[0]);
+
+  /* The replicas must follow changes to the locked links. */
+  nn_offline_threads = 1;
+  nn_offline_batch = 0;
+  nn_unlock_link(nn, 2);
+  e = nn_offline_test(nn, data, NULL);
+  nn_offline_grad(nn, data, NULL);
+  nn_get_grads(nn, g);
+  nn_offline_threads = 3;
+  et = nn_offline_test(nn, data, NULL);
+  nn_offline_grad(nn, data, NULL);
+  nn_get_grads(nn, gt);
+  if(fabs(e - et) > 1e-12 || grad_diff(g, gt, nn->numweights) > 1e-12) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed replicas\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed replicas\n", argv[0]);
+
+  deallocate_array(g);
+  deallocate_array(gd);
+  deallocate_array(gt);
+  dsm_destroy_matrix(dataset_destroy(data));
+  deallocate_array(x);
+  nn_destroy(nn);
+
+  /* A recurrent net must see the patterns in order, so the threads
+   * change nothing at all.
+   */
+  nn = nn_create("2 6 1");
+  nn_link(nn, "0 -l-> 1");
+  nn_link(nn, "1 -l-> 2");
+  nn_link(nn, "2 -l-> 1");
+  nn_set_actfunc(nn, 2, 0, "linear");
+  nn_init(nn, 0.5);
+  nw = nn->numweights;
+  x = allocate_array(1, sizeof(double), NPATS * 3);
+  for(i = 0; i < NPATS; i++) {
+    x[3 * i] = random_range(-1, 1);
+    x[3 * i + 1] = random_range(-1, 1);
+    x[3 * i + 2] = sin(2 * x[3 * i]) * x[3 * i + 1];
+  }
+  matrix = dataset_create(&dsm_matrix_method, dsm_c_matrix(x, 2, 1, NPATS));
+  data = dataset_create(&slow_method, matrix);
+  g = allocate_array(1, sizeof(double), nw);
+  gt = allocate_array(1, sizeof(double), nw);
+  nn_offline_chunk = 16;
+  nn_offline_threads = 1;
+  reset(nn);
+  e = nn_offline_test(nn, data, NULL);
+  reset(nn);
+  ed = nn_offline_grad(nn, data, NULL);
+  nn_get_grads(nn, g);
+  nn_offline_threads = 4;
+  reset(nn);
+  et = nn_offline_test(nn, data, NULL);
+  reset(nn);
+  eg = nn_offline_grad(nn, data, NULL);
+  nn_get_grads(nn, gt);
+  if(e != et || ed != eg || grad_diff(g, gt, nw) != 0) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed recurrent\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed recurrent\n", argv[0]);
+  nn_offline_threads = 1;
+  deallocate_array(g);
+  deallocate_array(gt);
+  dataset_destroy(data);
+  dsm_destroy_matrix(dataset_destroy(matrix));
+  deallocate_array(x);
+  nn_destroy(nn);
+  exit(!aokay);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
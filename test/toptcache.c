@@ -0,0 +1,203 @@
+
+/* Copyright (c) 2000 by G. W. Flake. */
+
+/* A test for the evaluation cache of the optimizers... */
+
+#include <nodelib.h>
+#include <stdio.h>
+#include <math.h>
+
+#define N 20
+#define NPATS 200
+
+static double W[N], G[N];
+static unsigned passes;
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* The extended Rosenbrock function and its gradient, counting how
+   many times either one is called. */
+
+static double rosenbrock(void *obj)
+{
+  double a, b, sum = 0;
+  unsigned i;
+
+  passes++;
+  for(i = 0; i < N; i += 2) {
+    a = W[i + 1] - W[i] * W[i];
+    b = 1 - W[i];
+    sum += 100 * a * a + b * b;
+  }
+  return(sum);
+}
+
+static double rosenbrock_grad(void *obj)
+{
+  double a, b;
+  unsigned i;
+
+  for(i = 0; i < N; i += 2) {
+    a = W[i + 1] - W[i] * W[i];
+    b = 1 - W[i];
+    G[i] = -400 * a * W[i] - 2 * b;
+    G[i + 1] = 200 * a;
+  }
+  return(rosenbrock(obj));
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Minimize from the usual starting point with the given engine and
+   line search, with or without the cache, and put the final weights
+   in w.  The number of calls to funcf and gradf is returned. */
+
+static unsigned minimize(void (*engine)(OPTIMIZER *opt, int state),
+			 double (*stepf)(OPTIMIZER *opt, double *dir,
+					 double stepsz),
+			 int cache, double *w)
+{
+  OPTIMIZER opt = OPTIMIZER_DEFAULT;
+  double *wp[N], *gp[N];
+  unsigned i;
+
+  for(i = 0; i < N; i++) {
+    W[i] = (i % 2) ? 1 : -1.2;
+    wp[i] = &W[i];
+    gp[i] = &G[i];
+  }
+  opt.size = N;
+  opt.funcf = rosenbrock;
+  opt.gradf = rosenbrock_grad;
+  opt.weights = wp;
+  opt.grads = gp;
+  opt.engine = engine;
+  opt.stepf = stepf;
+  opt.max_epochs = 30;
+  opt.delta_error_tol = -1e10;
+  opt.cache = cache;
+  passes = 0;
+  optimize(&opt);
+  for(i = 0; i < N; i++)
+    w[i] = W[i];
+  return(passes);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Returns nonzero if the cache leaves the path of the engine alone and
+   saves at least the given fraction of the evaluations. */
+
+static int same_path(void (*engine)(OPTIMIZER *opt, int state),
+		     double (*stepf)(OPTIMIZER *opt, double *dir,
+				     double stepsz), double saved)
+{
+  double wa[N], wb[N];
+  unsigned i, pa, pb;
+
+  pa = minimize(engine, stepf, 0, wa);
+  pb = minimize(engine, stepf, 1, wb);
+  for(i = 0; i < N; i++)
+    if(wa[i] != wb[i]) return(0);
+  return(pb <= (1 - saved) * pa);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Train a net with conjugate gradients, with or without the cache,
+   and return the final error.  The number of calls to funcf and gradf
+   goes in calls.  The error vector does not promise to be positive,
+   so that trial points are never cut short and the paths can match. */
+
+static double train(DATASET *set, int cache, unsigned *calls)
+{
+  OPT_ERRVEC ev = opt_errvec_quadratic;
+  NN *nn;
+  double err;
+
+  srandom(1);
+  nn = nn_create("2 6 1");
+  nn_link(nn, "0 -l-> 1");
+  nn_link(nn, "1 -l-> 2");
+  nn_set_actfunc(nn, 2, 0, "linear");
+  nn_init(nn, 0.5);
+  ev.nonneg = 0;
+  nn->info.error_vector = &ev;
+  nn->info.train_set = set;
+  nn->info.opt.max_epochs = 30;
+  nn->info.opt.delta_error_tol = -1e10;
+  nn->info.opt.cache = cache;
+  nn_train(nn);
+  *calls = nn->info.opt.fcalls + nn->info.opt.gcalls;
+  nn->info.error_vector = NULL;
+  err = nn_offline_test(nn, set, NULL);
+  nn_destroy(nn);
+  return(err);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+int main(int argc, char **argv)
+{
+  NN *nn;
+  DATASET *data;
+  double *x, ea, eb;
+  unsigned i, ca, cb, aokay = 1;
+  size_t base;
+
+  srandom(0);
+
+  /* Make sure that the activation and net functions are registered
+   * before we count the memory.
+   */
+  nn = nn_create("1 1");
+  nn_link(nn, "0 -l-> 1");
+  nn_destroy(nn);
+  base = xmemused();
+
+  /* The cubic search needs most of its gradients, so with the cache
+   * it should take about half as many evaluations.  The others only
+   * save the evaluation at the point they return.
+   */
+  if(!same_path(opt_conjgrad_pr, opt_lnsrch_cubic, 0.4) ||
+     !same_path(opt_quasinewton_bfgs, NULL, 0.4) ||
+     !same_path(opt_lbfgs, NULL, 0.4)) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed cubic\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed cubic\n", argv[0]);
+  if(!same_path(opt_conjgrad_pr, opt_lnsrch_golden, 0.05) ||
+     !same_path(opt_conjgrad_pr, opt_lnsrch_hybrid, 0.05)) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed golden\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed golden\n", argv[0]);
+
+  /* Training a net gets to the same place with fewer passes. */
+  x = allocate_array(1, sizeof(double), NPATS * 3);
+  for(i = 0; i < NPATS; i++) {
+    x[3 * i] = random_range(-1, 1);
+    x[3 * i + 1] = random_range(-1, 1);
+    x[3 * i + 2] = sin(2 * x[3 * i]) * x[3 * i + 1];
+  }
+  data = dataset_create(&dsm_matrix_method, dsm_c_matrix(x, 2, 1, NPATS));
+  ea = train(data, 0, &ca);
+  eb = train(data, 1, &cb);
+  if(fabs(ea - eb) > 1e-10 * ea || cb > 0.6 * ca) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed train\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed train\n", argv[0]);
+  dsm_destroy_matrix(dataset_destroy(data));
+  deallocate_array(x);
+
+  if(xmemused() != base) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed leak\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed leak\n", argv[0]);
+
+  exit(!aokay);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
@@ -0,0 +1,216 @@
+
+/* Copyright (c) 2000 by G. W. Flake. */
+
+/* A test for the parallel line search and nn_offline_test_multi()... */
+
+#include <nodelib.h>
+#include <stdio.h>
+#include <math.h>
+
+#define N 10
+#define NPATS 300
+
+static double W[N], G[N];
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* A badly scaled quadratic bowl with its minimum of zero at all ones,
+   and its gradient. */
+
+static double bowl(void *obj)
+{
+  double sum = 0;
+  unsigned i;
+
+  for(i = 0; i < N; i++)
+    sum += (i + 1) * (i + 1) * (W[i] - 1) * (W[i] - 1);
+  return(sum);
+}
+
+static double bowl_grad(void *obj)
+{
+  unsigned i;
+
+  for(i = 0; i < N; i++)
+    G[i] = 2 * (i + 1) * (i + 1) * (W[i] - 1);
+  return(bowl(obj));
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Returns the biggest difference between nn_offline_test_multi() at a
+   few random weight vectors, with the given number of threads, and
+   nn_offline_test() at each one.  The weights of nn must come back
+   as they were, or a huge difference is returned. */
+
+static double multi(NN *nn, DATASET *set, unsigned threads)
+{
+  double **w, *w0, *w1, err[5], e, diff = 0;
+  unsigned i, j, n = nn->numweights;
+
+  w = allocate_array(2, sizeof(double), 5, n);
+  w0 = allocate_array(1, sizeof(double), n);
+  w1 = allocate_array(1, sizeof(double), n);
+  nn_get_weights(nn, w0);
+  for(i = 0; i < 5; i++)
+    for(j = 0; j < n; j++)
+      w[i][j] = w0[j] + random_range(-0.1, 0.1);
+  nn_offline_multi_threads = threads;
+  nn_offline_test_multi(nn, set, w, 5, err);
+  nn_offline_multi_threads = 0;
+  nn_get_weights(nn, w1);
+  for(j = 0; j < n; j++)
+    if(w0[j] != w1[j]) diff = HUGE_VAL;
+  for(i = 0; i < 5; i++) {
+    nn_set_weights(nn, w[i]);
+    e = fabs(nn_offline_test(nn, set, NULL) - err[i]);
+    diff = (e > diff) ? e : diff;
+  }
+  nn_set_weights(nn, w0);
+  deallocate_array(w);
+  deallocate_array(w0);
+  deallocate_array(w1);
+  return(diff);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Train a fresh net on set with the parallel line search, the given
+   engine, and the given number of threads for the trials.  The final
+   weights go in w, and the ratio of the final error to the starting
+   error is returned. */
+
+static double train(DATASET *set, void (*engine)(OPTIMIZER *opt, int state),
+		    unsigned threads, double *w)
+{
+  NN *nn;
+  double before, after;
+
+  srandom(1);
+  nn = nn_create("2 6 1");
+  nn_link(nn, "0 -l-> 1");
+  nn_link(nn, "1 -l-> 2");
+  nn_set_actfunc(nn, 2, 0, "linear");
+  nn_init(nn, 0.5);
+  nn->info.train_set = set;
+  nn->info.opt.engine = engine;
+  nn->info.opt.stepf = opt_lnsrch_parallel;
+  nn->info.opt.max_epochs = 50;
+  nn->info.opt.delta_error_tol = -1e10;
+  nn_offline_multi_threads = threads;
+  before = nn_offline_test(nn, set, NULL);
+  nn_train(nn);
+  after = nn_offline_test(nn, set, NULL);
+  nn_offline_multi_threads = 0;
+  nn_get_weights(nn, w);
+  nn_destroy(nn);
+  return(after / before);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+static void nothing(void *obj, unsigned id)
+{
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+int main(int argc, char **argv)
+{
+  OPTIMIZER opt = OPTIMIZER_DEFAULT;
+  NN *nn;
+  DATASET *data;
+  double *wp[N], *gp[N], *x, e, wa[32], wb[32];
+  unsigned i, aokay = 1;
+  size_t base;
+
+  srandom(0);
+
+  /* Make sure that the pool of threads is as big as it will get
+   * before we count the memory.
+   */
+  nn = nn_create("1 1");
+  nn_link(nn, "0 -l-> 1");
+  nn_destroy(nn);
+  thread_run(3, nothing, NULL);
+  base = xmemused();
+
+  /* With a parabola in every batch, conjugate gradients on a quadratic
+   * should finish in about as many steps as there are variables, even
+   * without a multif to evaluate the trials at once.
+   */
+  for(i = 0; i < N; i++) {
+    W[i] = 0;
+    wp[i] = &W[i];
+    gp[i] = &G[i];
+  }
+  opt.size = N;
+  opt.funcf = bowl;
+  opt.gradf = bowl_grad;
+  opt.weights = wp;
+  opt.grads = gp;
+  opt.stepf = opt_lnsrch_parallel;
+  opt.max_epochs = 2 * N;
+  opt.error_tol = 1e-12;
+  opt.delta_error_tol = -1e10;
+  optimize(&opt);
+  for(e = 0, i = 0; i < N; i++)
+    e = (fabs(W[i] - 1) > e) ? fabs(W[i] - 1) : e;
+  if(e > 1e-5) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed bowl\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed bowl\n", argv[0]);
+
+  x = allocate_array(1, sizeof(double), NPATS * 3);
+  for(i = 0; i < NPATS; i++) {
+    x[3 * i] = random_range(-1, 1);
+    x[3 * i + 1] = random_range(-1, 1);
+    x[3 * i + 2] = sin(2 * x[3 * i]) * x[3 * i + 1];
+  }
+  data = dataset_create(&dsm_matrix_method, dsm_c_matrix(x, 2, 1, NPATS));
+
+  /* Each weight vector gets what a plain pass would give it. */
+  nn = nn_create("2 5 1");
+  nn_link(nn, "0 -l-> 1");
+  nn_link(nn, "1 -l-> 2");
+  nn_init(nn, 0.5);
+  nn_lock_link(nn, 0);
+  if(multi(nn, data, 1) != 0 || multi(nn, data, 3) != 0) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed multi\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed multi\n", argv[0]);
+  nn_destroy(nn);
+
+  /* Training gets most of the way down, and the number of threads
+   * changes nothing at all.
+   */
+  if(train(data, opt_conjgrad_pr, 1, wa) > 0.05 ||
+     train(data, opt_quasinewton_bfgs, 3, wb) > 0.05) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed train\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed train\n", argv[0]);
+  train(data, opt_conjgrad_pr, 3, wb);
+  for(e = 0, i = 0; i < 6 * 3 + 7; i++)
+    e = (fabs(wa[i] - wb[i]) > e) ? fabs(wa[i] - wb[i]) : e;
+  if(e != 0) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed threads\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed threads\n", argv[0]);
+
+  dsm_destroy_matrix(dataset_destroy(data));
+  deallocate_array(x);
+
+  if(xmemused() != base) {
+    aokay = 0;
+    fprintf(stderr, "%s: failed leak\n", argv[0]);
+  }
+  else fprintf(stderr, "%s: passed leak\n", argv[0]);
+
+  exit(!aokay);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */